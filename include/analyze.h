@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2021 Stonyx
+ * http://www.stonyx.com
+ *
+ * Copyright (C) 2020 Guillaume Valadon
+ * guillaume@valadon.net
+ */
+
+// Define constants, the window and the gap are in milliseconds, the threshold is in degrees, the
+//   chunk sizes are in bytes, temperatures are binned by half a degree from -10 degrees and fan
+//   speeds by 10 RPM up to 20480 RPM, which is as fine as the percentiles get
+#define ANALYZE_DEFAULT_WINDOW 3600000
+#define ANALYZE_DEFAULT_THRESHOLD 50
+#define ANALYZE_DEFAULT_MAX_GAP 600000
+#define ANALYZE_MAX_THREADS 256
+#define ANALYZE_MAX_COLUMNS 128
+#define ANALYZE_MAX_HEADER_LENGTH 65536
+#define ANALYZE_MIN_CHUNK_SIZE (1 << 20)
+#define ANALYZE_MAX_CHUNK_SIZE (64 << 20)
+#define ANALYZE_TEMPERATURE_BINS 256
+#define ANALYZE_TEMPERATURE_BIN_SIZE 50
+#define ANALYZE_MIN_TEMPERATURE -1000
+#define ANALYZE_FAN_SPEED_BINS 2048
+#define ANALYZE_FAN_SPEED_BIN_SIZE 10
+
+// Define what a column of a log holds
+#define ANALYZE_COLUMN_IGNORED 0
+#define ANALYZE_COLUMN_SECONDS 1
+#define ANALYZE_COLUMN_NANOSECONDS 2
+#define ANALYZE_COLUMN_TEMPERATURE 3
+#define ANALYZE_COLUMN_FAN_SPEED 4
+
+// Define the structure holding how the logs are analyzed
+struct analyze_config
+{
+  int64_t window;
+  double threshold;
+  int64_t max_gap;
+  u_int16_t threads;
+};
+
+// Define the structure holding the statistics of a window, every row adds its hottest temperature
+//   and the mean speed of its fans, temperatures are in hundredths of a degree, the time above the
+//   threshold is in milliseconds, and the correlation sums only cover the rows with both
+struct analyze_window
+{
+  int64_t index;
+  u_int64_t samples;
+  int32_t temperature_min;
+  int32_t temperature_max;
+  int64_t temperature_sum;
+  int64_t time_above;
+  u_int64_t fan_samples;
+  u_int32_t fan_speed_min;
+  u_int32_t fan_speed_max;
+  u_int64_t fan_speed_sum;
+  u_int64_t pairs;
+  double sum_x;
+  double sum_y;
+  double sum_xx;
+  double sum_yy;
+  double sum_xy;
+  u_int64_t temperature_histogram[ANALYZE_TEMPERATURE_BINS];
+  u_int64_t fan_speed_histogram[ANALYZE_FAN_SPEED_BINS];
+};
+
+// Define the structure holding how an analysis went
+struct analyze_stats
+{
+  u_int32_t files;
+  u_int16_t threads;
+  u_int64_t bytes;
+  u_int64_t rows;
+  u_int64_t skipped_rows;
+  u_int64_t windows;
+  u_int64_t nanoseconds;
+};
+
+// Declare functions
+int8_t analyze_run(char** paths, u_int32_t path_count, const struct analyze_config* config,
+  FILE* stream, struct analyze_stats* stats);
+void analyze_print_stats(const struct analyze_stats* stats, FILE* stream);
@@ -0,0 +1,31 @@
+/*
+ * Copyright (C) 2021 Stonyx
+ * http://www.stonyx.com
+ *
+ * Copyright (C) 2020 Guillaume Valadon
+ * guillaume@valadon.net
+ */
+
+// Define constants
+#define BENCH_SHM_READS 1000000
+#define BENCH_SHM_DEFAULT_READERS 8
+#define BENCH_SHM_MAX_READERS 1024
+#define BENCH_SHM_PUBLISH_INTERVAL 1000000
+#define BENCH_TRANSPORT_BYTES 100000
+#define BENCH_TRANSPORT_TRANSACTIONS 1000
+#define BENCH_PROTOCOL_ITERATIONS 10000
+#define BENCH_TRACE_ITERATIONS 100000
+#define BENCH_TRACE_ROUNDS 10
+#define BENCH_FAULT_READS 100
+#define BENCH_FAULT_RETRY_INTERVAL 10000000
+#define BENCH_FAULT_MAX_ATTEMPTS 1000
+#define BENCH_LOCK_ACQUISITIONS 100
+#define BENCH_LOCK_WAITER_DELAY 20000000
+
+// Declare functions
+int8_t bench_shm(u_int32_t max_readers);
+int8_t bench_transport(void);
+int8_t bench_protocol(u_int32_t iterations, u_int64_t delay, const char* output_path);
+int8_t bench_trace(u_int32_t iterations);
+int8_t bench_fault(u_int32_t reads);
+int8_t bench_lock(u_int32_t acquisitions);
@@ -6,9 +6,35 @@
  * guillaume@valadon.net
  */
 
+// Define the largest number of arguments on a line of a batch
+#define COMMANDS_MAX_ARGUMENTS 256
+
 // Declare functions
+int8_t access_chip(void);
+int8_t load_profile(void);
+u_int8_t is_command_list(int argc, char** argv);
+int8_t run_commands(int argc, char** argv, u_int8_t replies);
+void analyze_command(int argc, char** argv);
+void batch_command(void);
+void bench_command(int argc, char** argv);
+void bench_fault_command(void);
+void bench_lock_command(void);
+void bench_shm_command(const char* max_readers);
+void bench_trace_command(const char* iterations);
+void bench_transport_command(void);
+void calibrate_command(void);
 void check_command(void);
-void fan_command(u_int8_t fan_id, u_int8_t* speed);
-void log_command(void);
+void daemon_command(const char* socket_path);
+void discover_command(int argc, char** argv);
+void exporter_command(int argc, char** argv);
+int8_t fan_command(u_int8_t fan_number, u_int8_t* speed);
+void fan_control_command(int argc, char** argv);
+int8_t fans_command(int argc, char** argv);
+void history_command(int argc, char** argv);
+void log_command(int argc, char** argv);
+int8_t log_row_command(void);
+void profile_command(void);
+void shm_read_command(void);
+void stats_command(int argc, char** argv);
 void test_command(char* libuLinux_hal_path);
-void temperature_command(u_int8_t sensor_id);
\ No newline at end of file
+int8_t temperature_command(u_int8_t sensor_number);
\ No newline at end of file
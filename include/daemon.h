@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2021 Stonyx
+ * http://www.stonyx.com
+ *
+ * Copyright (C) 2020 Guillaume Valadon
+ * guillaume@valadon.net
+ */
+
+// Define constants
+#define DAEMON_SOCKET_PATH "/run/panq.sock"
+#define DAEMON_PROTOCOL_MAGIC 0x5150
+#define DAEMON_PROTOCOL_VERSION 1
+#define DAEMON_SAMPLE_INTERVAL 1000
+#define DAEMON_CLIENT_TIMEOUT 100
+#define DAEMON_MAX_CLIENTS 16
+#define DAEMON_FIRST_CLIENT 2
+#define DAEMON_MAX_ITEMS 64
+
+// Define the request operations
+#define DAEMON_OP_READ 0x01
+#define DAEMON_OP_STATS 0x02
+#define DAEMON_OP_ROLLUP 0x03
+
+// Define the item types
+#define DAEMON_ITEM_TEMPERATURE 0x01
+#define DAEMON_ITEM_FAN_SPEED 0x02
+#define DAEMON_ITEM_FAN_PWM 0x03
+#define DAEMON_ITEM_FAN_STATUS 0x04
+#define DAEMON_ITEM_POWER_SUPPLY_STATUS 0x05
+
+// Define the structures used by the binary protocol spoken over the Unix socket
+// All fields are in host byte order since the socket is local only
+// A request is a header followed by a payload of header.length bytes, a response is a header
+//   followed by a payload of header.length bytes, for the read operation both payloads are arrays
+//   of items where the request only fills in the type and ID fields, for the stats operation
+//   the request has no payload and the response payload is text, and for the rollup operation
+//   the request payload is a u_int32_t window in seconds and the response payload is text
+struct daemon_header
+{
+  u_int16_t magic;
+  u_int8_t version;
+  u_int8_t op;
+  int8_t status;
+  u_int8_t reserved;
+  u_int16_t age;
+  u_int32_t length;
+} __attribute__((packed));
+
+struct daemon_item
+{
+  u_int8_t type;
+  u_int8_t id;
+  int8_t status;
+  u_int8_t reserved;
+  int32_t value;
+} __attribute__((packed));
+
+// Declare functions
+int8_t daemon_run(const char* socket_path, const char* history_path, const char* hwmon_path);
+int8_t daemon_client_read(const char* socket_path, struct daemon_item* items, u_int16_t count);
+int8_t daemon_client_get_temperature(const char* socket_path, u_int8_t sensor_id,
+  double* temperature);
+int8_t daemon_client_get_fan_speed(const char* socket_path, u_int8_t fan_id, u_int16_t* speed);
+int8_t daemon_client_print_stats(const char* socket_path, FILE* stream);
+int8_t daemon_client_print_rollup(const char* socket_path, u_int32_t window, FILE* stream);
@@ -0,0 +1,31 @@
+/*
+ * Copyright (C) 2021 Stonyx
+ * http://www.stonyx.com
+ *
+ * Copyright (C) 2020 Guillaume Valadon
+ * guillaume@valadon.net
+ */
+
+// Define constants, the interval is in milliseconds, temperatures are in degrees, and the fan
+//   spread is a percentage of the lowest speed seen
+#define DISCOVER_DEFAULT_PASSES 5
+#define DISCOVER_MIN_PASSES 2
+#define DISCOVER_MAX_PASSES 100
+#define DISCOVER_DEFAULT_INTERVAL 200
+#define DISCOVER_MIN_TEMPERATURE 5
+#define DISCOVER_MAX_TEMPERATURE 110
+#define DISCOVER_MAX_TEMPERATURE_SPREAD 5
+#define DISCOVER_MIN_FAN_SPEED 100
+#define DISCOVER_MAX_FAN_SPEED 20000
+#define DISCOVER_MAX_FAN_SPREAD 50
+
+// Define the verdicts on a sensor or fan
+#define DISCOVER_PRESENT 0
+#define DISCOVER_UNREADABLE 1
+#define DISCOVER_OUT_OF_RANGE 2
+#define DISCOVER_UNSTABLE 3
+#define DISCOVER_FAULTY 4
+
+// Declare functions
+int8_t discover_run(u_int8_t passes, u_int32_t interval, struct it8528_presence* presence,
+  FILE* stream);
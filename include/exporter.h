@@ -0,0 +1,19 @@
+/*
+ * Copyright (C) 2021 Stonyx
+ * http://www.stonyx.com
+ *
+ * Copyright (C) 2020 Guillaume Valadon
+ * guillaume@valadon.net
+ */
+
+// Define constants
+#define EXPORTER_DEFAULT_LISTEN "127.0.0.1:9528"
+#define EXPORTER_SAMPLE_INTERVAL 1000
+#define EXPORTER_CLIENT_TIMEOUT 100
+#define EXPORTER_MAX_CLIENTS 16
+#define EXPORTER_REQUEST_SIZE 2048
+#define EXPORTER_CHECK_STATUS_COMMAND 0x0242
+
+// Declare functions
+int8_t exporter_run(const char* listen_address, u_int32_t interval);
+int8_t exporter_check(void);
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2021 Stonyx
+ * http://www.stonyx.com
+ *
+ * Copyright (C) 2020 Guillaume Valadon
+ * guillaume@valadon.net
+ */
+
+// Define constants
+#define FAN_CONTROL_MAX_GROUPS 4
+#define FAN_CONTROL_MAX_FANS 8
+#define FAN_CONTROL_MAX_SENSORS 8
+#define FAN_CONTROL_MAX_POINTS 8
+#define FAN_CONTROL_DEFAULT_INTERVAL 1000
+#define FAN_CONTROL_DEFAULT_HORIZON 30
+#define FAN_CONTROL_DEFAULT_DEADBAND 3
+#define FAN_CONTROL_MAX_HORIZON 600
+#define FAN_CONTROL_MAX_FAILED_STEPS 10
+
+// Define the control modes
+#define FAN_CONTROL_MODE_PID 0
+#define FAN_CONTROL_MODE_CURVE 1
+#define FAN_CONTROL_MODE_PREDICTIVE 2
+
+// Define the structure holding a fan group, the fans of a group are driven from the hottest of its
+//   sensors, in predictive mode every sensor has a thermal model learned while the loop runs and
+//   the speed is picked from the temperatures predicted horizon seconds ahead
+struct fan_control_group
+{
+  // Configuration
+  u_int8_t fan_ids[FAN_CONTROL_MAX_FANS];
+  u_int8_t fan_count;
+  u_int8_t sensor_ids[FAN_CONTROL_MAX_SENSORS];
+  u_int8_t sensor_count;
+  u_int8_t mode;
+  double target;
+  double kp;
+  double ki;
+  double kd;
+  double curve_temperatures[FAN_CONTROL_MAX_POINTS];
+  double curve_speeds[FAN_CONTROL_MAX_POINTS];
+  u_int8_t curve_count;
+  double hysteresis;
+  double min;
+  double max;
+  double slew;
+  double horizon;
+  double forgetting;
+  double deadband;
+
+  // State
+  u_int8_t started;
+  double temperature;
+  double integral;
+  double previous_error;
+  double output;
+  int16_t applied;
+  struct thermal_model models[FAN_CONTROL_MAX_SENSORS];
+  double sensor_temperatures[FAN_CONTROL_MAX_SENSORS];
+  double previous_load;
+
+  // Metrics
+  u_int64_t steps;
+  u_int64_t changes;
+  double time_above_target;
+  double elapsed;
+  double max_temperature;
+  double speed_sum;
+  u_int64_t predicted_steps;
+};
+
+// Define the structure holding a fan control configuration, the load is the fraction of the time
+//   the CPUs were busy since the previous iteration, or the simulated load
+struct fan_control
+{
+  u_int32_t interval;
+  struct fan_control_group groups[FAN_CONTROL_MAX_GROUPS];
+  u_int8_t group_count;
+  double load;
+  u_int64_t cpu_busy;
+  u_int64_t cpu_total;
+};
+
+// Declare functions
+int8_t fan_control_load(const char* path, struct fan_control* control);
+int8_t fan_control_step(struct fan_control* control, double dt);
+int8_t fan_control_run(struct fan_control* control);
+int8_t fan_control_simulate(struct fan_control* control, u_int32_t seconds);
+void fan_control_print_report(struct fan_control* control, FILE* stream);
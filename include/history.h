@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2021 Stonyx
+ * http://www.stonyx.com
+ *
+ * Copyright (C) 2020 Guillaume Valadon
+ * guillaume@valadon.net
+ */
+
+// Define constants
+#define HISTORY_MAGIC 0x54534850
+#define HISTORY_VERSION 1
+#define HISTORY_HEADER_SIZE 4096
+#define HISTORY_CHUNK_SIZE 4096
+#define HISTORY_CHUNK_HEADER_SIZE 64
+#define HISTORY_CHUNK_ACTIVE 0x56544341
+#define HISTORY_CHUNK_SEALED 0x4C414553
+#define HISTORY_MAX_VALUES (IT8528_SENSOR_COUNT + 3 * IT8528_FAN_COUNT + \
+  IT8528_POWER_SUPPLY_COUNT)
+
+// Define the structure at the start of a history file, the values of a sample are every
+//   temperature in hundredths of a degree followed by the speed, PWM, and status of every fan and
+//   by the status of every power supply
+struct history_header
+{
+  u_int32_t magic;
+  u_int16_t version;
+  u_int16_t reserved;
+  u_int32_t chunk_size;
+  u_int8_t sensor_count;
+  u_int8_t fan_count;
+  u_int8_t power_supply_count;
+  u_int8_t reserved2;
+  int64_t created;
+  u_int8_t sensor_ids[IT8528_SENSOR_COUNT];
+  u_int8_t fan_ids[IT8528_FAN_COUNT];
+} __attribute__((packed));
+
+// Define the structure of a chunk of a history file, the writer publishes the count, the number
+//   of used bits, and the time of the last sample after every sample so that readers can decode
+//   the active chunk too, and a full chunk is sealed by storing its checksum and its sealed magic
+//   last, times are wall clock milliseconds
+struct history_chunk
+{
+  u_int32_t magic;
+  u_int32_t checksum;
+  u_int32_t count;
+  u_int32_t bits;
+  int64_t first_time;
+  int64_t last_time;
+  u_int8_t reserved[HISTORY_CHUNK_HEADER_SIZE - 32];
+  u_int8_t data[HISTORY_CHUNK_SIZE - HISTORY_CHUNK_HEADER_SIZE];
+};
+
+// Define the structure holding an open history file being appended to, the previous time, time
+//   delta, values, and validities are the state of the encoder within the active chunk
+struct history
+{
+  int fd;
+  u_int32_t chunk_index;
+  struct history_chunk* chunk;
+  u_int8_t sensor_count;
+  u_int8_t sensor_indexes[IT8528_SENSOR_COUNT];
+  u_int8_t fan_count;
+  u_int8_t fan_indexes[IT8528_FAN_COUNT];
+  u_int8_t power_supply_count;
+  u_int16_t value_count;
+  u_int32_t max_sample_bits;
+  int64_t previous_time;
+  int64_t previous_delta;
+  int32_t values[HISTORY_MAX_VALUES];
+  u_int8_t valid[HISTORY_MAX_VALUES];
+};
+
+// Define the structure holding a range query, times are wall clock milliseconds and a step of 0
+//   prints every sample instead of averages over steps
+struct history_query
+{
+  int64_t from;
+  int64_t to;
+  int64_t step;
+};
+
+// Declare functions
+int8_t history_open(const char* path, struct history* history);
+int8_t history_append(struct history* history, const struct it8528_snapshot* snapshot);
+void history_close(struct history* history);
+int8_t history_query(const char* path, const struct history_query* query, FILE* stream);
+int8_t history_print_info(const char* path, FILE* stream);
+int8_t history_parse_time(const char* text, int64_t* time);
+int8_t history_parse_duration(const char* text, int64_t* duration);
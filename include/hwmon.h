@@ -0,0 +1,27 @@
+/*
+ * Copyright (C) 2021 Stonyx
+ * http://www.stonyx.com
+ *
+ * Copyright (C) 2020 Guillaume Valadon
+ * guillaume@valadon.net
+ */
+
+// Define constants
+#define HWMON_PATH "/run/panq"
+#define HWMON_NAME "panq"
+#define HWMON_MAX_NAME_LENGTH 64
+
+// Define the structure holding a hwmon style tree being refreshed, path is a symbolic link to
+//   the directory of the latest generation, the generation directories are hidden next to it and
+//   the one before the latest is kept so that readers that opened it can finish
+struct hwmon
+{
+  int parent_fd;
+  char name[HWMON_MAX_NAME_LENGTH];
+  u_int64_t generation;
+};
+
+// Declare functions
+int8_t hwmon_open(const char* path, struct hwmon* hwmon);
+int8_t hwmon_update(struct hwmon* hwmon, const struct it8528_snapshot* snapshot);
+void hwmon_close(struct hwmon* hwmon);
@@ -6,10 +6,80 @@
  * guillaume@valadon.net
  */
 
+// Define constants
+#define IT8528_SENSOR_COUNT 31
+#define IT8528_FAN_COUNT 20
+#define IT8528_POWER_SUPPLY_COUNT 2
+#define IT8528_MAX_PLAN_COMMANDS 128
+#define IT8528_FAN_PLAN_COMMANDS 4
+#define IT8528_FAN_GROUPS 4
+#define IT8528_DEFAULT_FAN_REFRESH 30000
+
+// Define the structure holding a snapshot of every sensor, fan, and power supply, the arrays are
+//   indexed the same way as the it8528_sensor_ids and it8528_fan_ids arrays and power supply IDs
+//   start at 1
+struct it8528_snapshot
+{
+  struct timespec time;
+  u_int8_t temperature_valid[IT8528_SENSOR_COUNT];
+  double temperatures[IT8528_SENSOR_COUNT];
+  u_int8_t fan_valid[IT8528_FAN_COUNT];
+  u_int16_t fan_speeds[IT8528_FAN_COUNT];
+  u_int8_t fan_pwms[IT8528_FAN_COUNT];
+  u_int8_t fan_statuses[IT8528_FAN_COUNT];
+  u_int8_t power_supply_valid[IT8528_POWER_SUPPLY_COUNT];
+  u_int8_t power_supply_statuses[IT8528_POWER_SUPPLY_COUNT];
+};
+
+// Define the structure holding a sorted list of unique commands to read and the cache register
+//   class of each of them, followed by the index in that list of the command of every sensor, of
+//   the speed high byte, speed low byte, PWM, and status commands of every fan, and of the power
+//   supply command, or -1 for the sensors and fans left out of the plan
+struct it8528_read_plan
+{
+  u_int16_t count;
+  u_int16_t commands[IT8528_MAX_PLAN_COMMANDS];
+  u_int8_t classes[IT8528_MAX_PLAN_COMMANDS];
+  int16_t temperature_indexes[IT8528_SENSOR_COUNT];
+  int16_t fan_indexes[IT8528_FAN_COUNT][IT8528_FAN_PLAN_COMMANDS];
+  int16_t power_supply_index;
+};
+
+// Define the structure holding the statistics of the fan mode and PWM register writes, writes
+//   counts the writes that reached the chip including refreshes
+struct it8528_fan_write_stats
+{
+  u_int64_t writes;
+  u_int64_t suppressed;
+  u_int64_t refreshes;
+};
+
+// Define the structure holding the speed in percentage to set a fan to
+struct it8528_fan_setting
+{
+  u_int8_t fan_id;
+  u_int8_t speed;
+};
+
+// Declare variables
+extern const u_int8_t it8528_sensor_ids[IT8528_SENSOR_COUNT];
+extern const u_int8_t it8528_fan_ids[IT8528_FAN_COUNT];
+
 // Declare functions
 int8_t it8528_get_fan_status(u_int8_t fan_id, u_int8_t* status);
 int8_t it8528_get_fan_pwm(u_int8_t fan_id, u_int8_t* pwm);
 int8_t it8528_get_fan_speed(u_int8_t fan_id, u_int16_t* speed);
 int8_t it8528_set_fan_speed(u_int8_t fan_id, u_int8_t speed);
+int8_t it8528_set_fan_speeds(const struct it8528_fan_setting* settings, u_int8_t count);
 int8_t it8528_get_temperature(u_int8_t sensor_id, double* temperature);
-int8_t i8528_get_power_supply_status(u_int8_t power_supply_id, u_int8_t* status);
\ No newline at end of file
+void it8528_set_fan_refresh(u_int32_t refresh);
+void it8528_get_fan_write_stats(struct it8528_fan_write_stats* stats);
+void it8528_print_fan_write_stats(FILE* stream);
+int8_t i8528_get_power_supply_status(u_int8_t power_supply_id, u_int8_t* status);
+int8_t it8528_get_fan_pwm_command(u_int8_t fan_id, u_int16_t* command);
+int8_t it8528_get_temperature_command(u_int8_t sensor_id, u_int16_t* command);
+void it8528_plan_snapshot(struct it8528_read_plan* plan, const u_int8_t* sensor_present,
+  const u_int8_t* fan_present);
+int8_t it8528_get_snapshot(struct it8528_snapshot* snapshot);
+int8_t it8528_read_snapshot(const struct it8528_read_plan* plan, int32_t max_age,
+  struct it8528_snapshot* snapshot);
\ No newline at end of file
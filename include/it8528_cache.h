@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2021 Stonyx
+ * http://www.stonyx.com
+ *
+ * Copyright (C) 2020 Guillaume Valadon
+ * guillaume@valadon.net
+ */
+
+// Define the register classes
+#define IT8528_CACHE_CLASS_TEMPERATURE 0
+#define IT8528_CACHE_CLASS_FAN_SPEED 1
+#define IT8528_CACHE_CLASS_FAN_PWM 2
+#define IT8528_CACHE_CLASS_FAN_STATUS 3
+#define IT8528_CACHE_CLASS_POWER_SUPPLY 4
+#define IT8528_CACHE_CLASSES 5
+
+// Define constants
+#define IT8528_CACHE_DEFAULT_MAX_AGE -1
+#define IT8528_CACHE_MAX_MAX_AGE 3600000
+#define IT8528_CACHE_SIZE 256
+
+// Define the structure holding the statistics of a register class
+struct it8528_cache_stats
+{
+  u_int64_t hits;
+  u_int64_t misses;
+};
+
+// Declare functions
+int8_t it8528_cache_get_byte(u_int8_t register_class, u_int8_t command0, u_int8_t command1,
+  int32_t max_age, u_int8_t* value);
+int8_t it8528_cache_lookup(u_int8_t register_class, u_int16_t command, int32_t max_age,
+  u_int8_t* value);
+void it8528_cache_store(u_int16_t command, u_int8_t value);
+void it8528_cache_invalidate(u_int16_t command);
+void it8528_cache_set_max_age(u_int8_t register_class, u_int32_t max_age);
+u_int32_t it8528_cache_get_max_age(u_int8_t register_class);
+int8_t it8528_cache_parse_max_ages(const char* text);
+void it8528_cache_limit_age(int32_t max_age);
+void it8528_cache_get_stats(u_int8_t register_class, struct it8528_cache_stats* stats);
+const char* it8528_cache_get_class_name(u_int8_t register_class);
+void it8528_cache_print_stats(FILE* stream);
@@ -0,0 +1,17 @@
+/*
+ * Copyright (C) 2021 Stonyx
+ * http://www.stonyx.com
+ *
+ * Copyright (C) 2020 Guillaume Valadon
+ * guillaume@valadon.net
+ */
+
+// Define constants
+#define IT8528_EMULATOR_REGISTERS 0x10000
+
+// Declare functions
+void it8528_emulator_reset(void);
+u_int8_t it8528_emulator_get_register(u_int16_t command);
+void it8528_emulator_set_register(u_int16_t command, u_int8_t value);
+void it8528_emulator_set_delays(u_int64_t input_delay, u_int64_t output_delay);
+void it8528_emulator_set_wedged(u_int8_t wedged);
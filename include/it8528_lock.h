@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2021 Stonyx
+ * http://www.stonyx.com
+ *
+ * Copyright (C) 2020 Guillaume Valadon
+ * guillaume@valadon.net
+ */
+
+// Define constants
+#define IT8528_LOCK_SHM_NAME "/panq.lock"
+#define IT8528_LOCK_FILE_PATH "/run/panq.lock"
+#define IT8528_LOCK_MAGIC 0x324B434F
+
+// Define the priority classes of the transactions, a class waiting for the lock goes before every
+//   lower class, control is the fan writes, alarm is the reads a decision depends on such as the
+//   temperatures read by the fan control loop, and telemetry is every other read
+#define IT8528_LOCK_CLASS_CONTROL 0
+#define IT8528_LOCK_CLASS_ALARM 1
+#define IT8528_LOCK_CLASS_TELEMETRY 2
+#define IT8528_LOCK_CLASSES 3
+
+// Define the longest a request of every class waits for the lock in milliseconds, a request made
+//   for a transaction gives up at the transaction deadline if it comes first, and how long in
+//   milliseconds a request can be held back by the requests of the higher classes before it stops
+//   giving way to them, which bounds the starvation of the lower classes by a busy higher class
+#define IT8528_LOCK_CONTROL_DEADLINE 1000
+#define IT8528_LOCK_ALARM_DEADLINE 1000
+#define IT8528_LOCK_TELEMETRY_DEADLINE 500
+#define IT8528_LOCK_TURN_TIMEOUT 50
+
+// Define the structure holding the statistics of the lock, times are in nanoseconds
+struct it8528_lock_stats
+{
+  u_int64_t acquisitions;
+  u_int64_t contentions;
+  u_int64_t timeouts;
+  u_int64_t recoveries;
+  u_int64_t wait_nanoseconds;
+  u_int64_t max_wait_nanoseconds;
+  u_int64_t hold_nanoseconds;
+  u_int64_t max_hold_nanoseconds;
+  u_int64_t preemptions;
+  u_int64_t class_acquisitions[IT8528_LOCK_CLASSES];
+  u_int64_t class_timeouts[IT8528_LOCK_CLASSES];
+  u_int64_t class_wait_nanoseconds[IT8528_LOCK_CLASSES];
+  u_int64_t class_max_wait_nanoseconds[IT8528_LOCK_CLASSES];
+};
+
+// Declare functions
+int8_t it8528_lock_open(const char* name);
+int8_t it8528_lock_set_group(const char* name);
+void it8528_lock_close(void);
+int8_t it8528_lock_acquire(u_int8_t class);
+int8_t it8528_lock_acquire_before(u_int8_t class, u_int64_t deadline);
+int8_t it8528_lock_yield(u_int64_t deadline);
+void it8528_lock_release(void);
+u_int8_t it8528_lock_set_read_class(u_int8_t class);
+u_int8_t it8528_lock_get_read_class(void);
+const char* it8528_lock_get_class_name(u_int8_t class);
+const char* it8528_lock_get_name(void);
+void it8528_lock_get_stats(struct it8528_lock_stats* stats);
+void it8528_lock_print_stats(FILE* stream);
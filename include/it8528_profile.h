@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2021 Stonyx
+ * http://www.stonyx.com
+ *
+ * Copyright (C) 2020 Guillaume Valadon
+ * guillaume@valadon.net
+ */
+
+// Define constants
+#define IT8528_PROFILE_PATH "/etc/model.conf"
+#define IT8528_PROFILE_CACHE_PATH "/run/panq.profile"
+#define IT8528_PROFILE_MAGIC 0x464F5250
+#define IT8528_PROFILE_VERSION 1
+#define IT8528_PROFILE_MAX_NAMES 16
+#define IT8528_PROFILE_MODEL_LENGTH 32
+#define IT8528_PRESENCE_PATH "/run/panq.presence"
+#define IT8528_PRESENCE_MAGIC 0x53455250
+#define IT8528_PRESENCE_VERSION 1
+
+// Define the structure holding a model profile compiled from a model.conf file, the fan and
+//   sensor names map the N of the fanN and tempN commands to chip IDs, the presence arrays are
+//   indexed the same way as the it8528_sensor_ids and it8528_fan_ids arrays, and the whole
+//   structure is written as is to the cache file so it must not hold any pointer
+struct it8528_profile
+{
+  u_int32_t magic;
+  u_int32_t version;
+  u_int32_t size;
+  u_int32_t reserved;
+  u_int64_t source_device;
+  u_int64_t source_inode;
+  int64_t source_size;
+  int64_t source_mtime;
+  char model[IT8528_PROFILE_MODEL_LENGTH];
+  u_int8_t redundant_power;
+  u_int8_t fan_name_count;
+  u_int8_t fan_names[IT8528_PROFILE_MAX_NAMES];
+  u_int8_t sensor_name_count;
+  u_int8_t sensor_names[IT8528_PROFILE_MAX_NAMES];
+  u_int8_t sensor_present[IT8528_SENSOR_COUNT];
+  u_int8_t fan_present[IT8528_FAN_COUNT];
+  struct it8528_read_plan plan;
+};
+
+// Define the structure of the presence map written by the discover command, it tells which sensors
+//   and fans are wired up on this unit, the arrays are indexed the same way as the
+//   it8528_sensor_ids and it8528_fan_ids arrays, and it is kept in /run since it only holds until
+//   the next boot
+struct it8528_presence
+{
+  u_int32_t magic;
+  u_int32_t version;
+  u_int32_t size;
+  u_int32_t reserved;
+  int64_t created;
+  u_int8_t sensor_present[IT8528_SENSOR_COUNT];
+  u_int8_t fan_present[IT8528_FAN_COUNT];
+};
+
+// Declare functions
+int8_t it8528_profile_load(const char* path, u_int8_t required);
+const struct it8528_profile* it8528_profile_get(void);
+int8_t it8528_profile_get_fan_id(u_int8_t number, u_int8_t* fan_id);
+int8_t it8528_profile_get_sensor_id(u_int8_t number, u_int8_t* sensor_id);
+void it8528_profile_print(FILE* stream);
+int8_t it8528_profile_write_presence(const struct it8528_presence* presence);
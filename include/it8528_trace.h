@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2021 Stonyx
+ * http://www.stonyx.com
+ *
+ * Copyright (C) 2020 Guillaume Valadon
+ * guillaume@valadon.net
+ */
+
+// Define the static tracepoints, when sys/sdt.h is available every probe is a USDT probe of the
+//   panq provider that costs a single nop until a tracer attaches to it, otherwise the probes
+//   compile to nothing, define PANQ_NO_SDT to leave them out anyway
+// The probes are transaction__start(op, command), transaction__end(op, command, ret, start_ns)
+//   where start_ns is the monotonic start time or 0 when the counters are off, handshake(kind,
+//   polls, ns, ret), retry(kind, polls, backoff_ns), and lock(class, wait_ns, ret)
+#if !defined(PANQ_NO_SDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define IT8528_TRACE_SDT 1
+#endif
+#endif
+#ifdef IT8528_TRACE_SDT
+#define IT8528_PROBE2(name, a, b) DTRACE_PROBE2(panq, name, a, b)
+#define IT8528_PROBE3(name, a, b, c) DTRACE_PROBE3(panq, name, a, b, c)
+#define IT8528_PROBE4(name, a, b, c, d) DTRACE_PROBE4(panq, name, a, b, c, d)
+#else
+#define IT8528_TRACE_SDT 0
+#define IT8528_PROBE2(name, a, b) do { } while (0)
+#define IT8528_PROBE3(name, a, b, c) do { } while (0)
+#define IT8528_PROBE4(name, a, b, c, d) do { } while (0)
+#endif
+
+// Define the traced operations, the handshakes are in the same order as their kinds
+#define IT8528_TRACE_OP_READ 0
+#define IT8528_TRACE_OP_WRITE 1
+#define IT8528_TRACE_OP_LOCK 2
+#define IT8528_TRACE_OP_HANDSHAKE 3
+#define IT8528_TRACE_OPS (IT8528_TRACE_OP_HANDSHAKE + IT8528_HANDSHAKE_KINDS)
+
+// Define the number of latency buckets, bucket 0 counts the zero latencies and bucket i the
+//   latencies from 2^(i - 1) to 2^i - 1 nanoseconds, the last one also counts everything longer,
+//   and the number of registers every thread keeps counters for
+#define IT8528_TRACE_BUCKETS 40
+#define IT8528_TRACE_REGISTERS 256
+
+// Define the structure holding the counters and latency histogram of an operation
+struct it8528_trace_counters
+{
+  u_int64_t count;
+  u_int64_t errors;
+  u_int64_t retries;
+  u_int64_t nanoseconds;
+  u_int64_t max_nanoseconds;
+  u_int64_t buckets[IT8528_TRACE_BUCKETS];
+};
+
+// Define the structure holding the counters and latency histogram of a register
+struct it8528_trace_register
+{
+  u_int16_t command;
+  u_int8_t used;
+  u_int64_t reads;
+  u_int64_t writes;
+  u_int64_t errors;
+  u_int64_t nanoseconds;
+  u_int64_t max_nanoseconds;
+  u_int64_t buckets[IT8528_TRACE_BUCKETS];
+};
+
+// Declare functions
+void it8528_trace_set_enabled(u_int8_t enabled);
+u_int64_t it8528_trace_begin(void);
+void it8528_trace_end(u_int8_t op, u_int16_t command, u_int64_t start, int8_t ret);
+void it8528_trace_record(u_int8_t op, u_int64_t nanoseconds, int8_t ret);
+void it8528_trace_retry(u_int8_t op);
+void it8528_trace_get_counters(u_int8_t op, struct it8528_trace_counters* counters);
+u_int16_t it8528_trace_get_registers(struct it8528_trace_register* registers);
+const char* it8528_trace_get_op_name(u_int8_t op);
+u_int64_t it8528_trace_get_bucket_limit(u_int8_t bucket);
+void it8528_trace_print(FILE* stream);
@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2021 Stonyx
+ * http://www.stonyx.com
+ *
+ * Copyright (C) 2020 Guillaume Valadon
+ * guillaume@valadon.net
+ */
+
+// Define the structure holding the functions of a port I/O backend
+struct it8528_transport
+{
+  const char* name;
+  int8_t (*open)(void);
+  void (*close)(void);
+  u_int8_t (*read_port)(u_int16_t port);
+  void (*write_port)(u_int8_t value, u_int16_t port);
+};
+
+// Declare variables
+extern const struct it8528_transport it8528_ioperm_transport;
+extern const struct it8528_transport it8528_devport_transport;
+extern const struct it8528_transport it8528_emulated_transport;
+extern const struct it8528_transport* const it8528_transports[];
+extern const struct it8528_transport* it8528_transport;
+
+// Declare functions
+int8_t it8528_open_transport(const char* name);
+void it8528_close_transport(void);
+
+// Function called to read a byte from a port through the open transport
+static inline u_int8_t it8528_inb(u_int16_t port)
+{
+  return it8528_transport->read_port(port);
+}
+
+// Function called to write a byte to a port through the open transport
+static inline void it8528_outb(u_int8_t value, u_int16_t port)
+{
+  it8528_transport->write_port(value, port);
+}
@@ -13,12 +13,99 @@
 #define IT8528_COMM_PORT_2 0x6C
 #define IT8528_WAIT_FOR_READY_INPUT 0x02
 #define IT8528_WAIT_FOR_READY_OUTPUT 0x01
+#define IT8528_DEFAULT_TRANSACTION_TIMEOUT 25
+#define IT8528_MAX_TRANSACTION_TIMEOUT 1000
+
+// Define the error codes returned by the transactions, every failure is negative so that the
+//   callers checking for a non zero value keep working
+#define IT8528_ERROR -1
+#define IT8528_ERROR_LOCK -2
+#define IT8528_ERROR_INPUT_TIMEOUT -3
+#define IT8528_ERROR_OUTPUT_TIMEOUT -4
+#define IT8528_ERROR_BUFFER_TIMEOUT -5
+#define IT8528_ERROR_DEADLINE -6
+#define IT8528_ERROR_BREAKER_OPEN -7
+#define IT8528_ERROR_RESYNC -8
+
+// Define the states of the circuit breaker
+#define IT8528_BREAKER_CLOSED 0
+#define IT8528_BREAKER_OPEN 1
+#define IT8528_BREAKER_HALF_OPEN 2
+
+// Define the wait modes
+#define IT8528_WAIT_MODE_LATENCY 0
+#define IT8528_WAIT_MODE_BALANCED 1
+#define IT8528_WAIT_MODE_CPU 2
+
+// Define the handshake kinds
+#define IT8528_HANDSHAKE_INPUT 0
+#define IT8528_HANDSHAKE_OUTPUT 1
+#define IT8528_HANDSHAKE_BUFFER 2
+#define IT8528_HANDSHAKE_KINDS 3
+
+// Define the structure holding the polls and wall time of a single handshake
+struct it8528_handshake
+{
+  u_int8_t kind;
+  u_int32_t polls;
+  u_int64_t nanoseconds;
+};
+
+// Define the structure holding the accumulated statistics of a handshake kind
+struct it8528_handshake_stats
+{
+  u_int64_t count;
+  u_int64_t polls;
+  u_int64_t nanoseconds;
+  u_int64_t max_nanoseconds;
+  u_int64_t timeouts;
+};
+
+// Define the structure holding the result of a wait calibration
+struct it8528_wait_calibration
+{
+  u_int32_t handshakes;
+  u_int32_t median_polls;
+  u_int32_t max_polls;
+  u_int64_t median_nanoseconds;
+  u_int64_t max_nanoseconds;
+  u_int32_t spin_polls;
+};
+
+// Define the structure holding the statistics of the failed transactions and of the circuit
+//   breaker, fast failures are the transactions refused while the breaker was open
+struct it8528_fault_stats
+{
+  u_int8_t breaker_state;
+  u_int64_t failures;
+  u_int64_t deadline_misses;
+  u_int64_t fast_failures;
+  u_int64_t breaker_trips;
+  u_int64_t recoveries;
+  u_int64_t recovery_failures;
+  u_int64_t drained_bytes;
+};
 
 // Declare functions
 int8_t it8528_check_if_present(void);
 int8_t it8528_get_byte(u_int8_t command0, u_int8_t command1, u_int8_t* value);
+int8_t it8528_read_block(u_int16_t start, u_int16_t length, u_int8_t* buffer);
 int8_t it8528_set_byte(u_int8_t command0, u_int8_t command1, u_int8_t value);
+int8_t it8528_acquire_lock(u_int8_t class);
 int8_t it8528_get_double(u_int8_t command0, u_int8_t command1, double* value);
 int8_t it8528_send_commands(u_int8_t command0, u_int8_t command1);
 int8_t it8528_wait_for_ready(u_int8_t direction);
-int8_t it8528_clear_buffer(void);
\ No newline at end of file
+int8_t it8528_clear_buffer(void);
+void it8528_set_wait_mode(u_int8_t mode);
+int8_t it8528_parse_wait_mode(const char* name, u_int8_t* mode);
+const char* it8528_get_wait_mode_name(u_int8_t mode);
+int8_t it8528_calibrate_wait(struct it8528_wait_calibration* calibration);
+void it8528_get_handshake_stats(u_int8_t kind, struct it8528_handshake_stats* stats);
+const char* it8528_get_handshake_name(u_int8_t kind);
+void it8528_get_last_handshake(struct it8528_handshake* handshake);
+void it8528_print_wait_stats(FILE* stream);
+void it8528_set_transaction_timeout(u_int32_t timeout);
+const char* it8528_strerror(int8_t error);
+void it8528_get_fault_stats(struct it8528_fault_stats* stats);
+const char* it8528_get_breaker_state_name(u_int8_t state);
+void it8528_print_fault_stats(FILE* stream);
\ No newline at end of file
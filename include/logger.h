@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2021 Stonyx
+ * http://www.stonyx.com
+ *
+ * Copyright (C) 2020 Guillaume Valadon
+ * guillaume@valadon.net
+ */
+
+// Define the output formats
+#define LOGGER_FORMAT_CSV 0
+#define LOGGER_FORMAT_JSONL 1
+#define LOGGER_FORMAT_BINARY 2
+
+// Define constants
+#define LOGGER_DEFAULT_INTERVAL 1000000000
+#define LOGGER_MAX_INTERVAL 86400000000000ULL
+#define LOGGER_DEFAULT_FLUSH_SIZE 65536
+#define LOGGER_MAX_FLUSH_SIZE (64 << 20)
+#define LOGGER_DEFAULT_FLUSH_INTERVAL 1000
+#define LOGGER_MAX_RECORD 8192
+#define LOGGER_BINARY_MAGIC 0x474C5150
+#define LOGGER_BINARY_VERSION 1
+
+// Define the structure holding the settings of a logging run, the interval is in nanoseconds,
+//   the flush interval in milliseconds, and a count of 0 logs until a SIGINT or a SIGTERM signal
+struct logger_config
+{
+  u_int8_t format;
+  u_int64_t interval;
+  u_int64_t count;
+  u_int32_t flush_size;
+  u_int32_t flush_interval;
+  const char* output_path;
+};
+
+// Define the structure holding the statistics of a logging run, the jitter of a sample is how
+//   late it woke up after its deadline in nanoseconds
+struct logger_stats
+{
+  u_int64_t samples;
+  u_int64_t missed_deadlines;
+  u_int64_t sample_errors;
+  u_int64_t jitter_nanoseconds;
+  double jitter_squares;
+  u_int64_t max_jitter_nanoseconds;
+  u_int64_t flushes;
+  u_int64_t bytes;
+};
+
+// Define the structure at the start of a binary log, it is followed by the sensor IDs and the fan
+//   IDs of the columns and then by the records, see logger.c for the record layout
+struct logger_binary_header
+{
+  u_int32_t magic;
+  u_int16_t version;
+  u_int8_t sensor_count;
+  u_int8_t fan_count;
+  u_int8_t power_supply_count;
+  u_int8_t reserved[7];
+  u_int64_t interval;
+  int64_t start_monotonic;
+  int64_t start_wall;
+} __attribute__((packed));
+
+// Declare functions
+int8_t logger_run(const struct logger_config* config, struct logger_stats* stats);
+int8_t logger_decode(const char* input_path, const struct logger_config* config,
+  struct logger_stats* stats);
+int8_t logger_parse_interval(const char* text, u_int64_t* interval);
+int8_t logger_parse_format(const char* name, u_int8_t* format);
+void logger_print_stats(const struct logger_stats* stats, FILE* stream);
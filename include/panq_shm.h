@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2021 Stonyx
+ * http://www.stonyx.com
+ *
+ * Copyright (C) 2020 Guillaume Valadon
+ * guillaume@valadon.net
+ */
+
+// This header and src/panq_shm.c make up the small reader library used by local consumers of the
+//   latest readings published by the daemon, they don't depend on the rest of PanQ and reading
+//   needs neither a capability nor a system call per read
+
+#include <sys/types.h>
+
+// Define constants
+#define PANQ_SHM_NAME "/panq"
+#define PANQ_SHM_MAGIC 0x514E4150
+#define PANQ_SHM_VERSION 1
+#define PANQ_SHM_SENSOR_COUNT 31
+#define PANQ_SHM_FAN_COUNT 20
+#define PANQ_SHM_POWER_SUPPLY_COUNT 2
+#define PANQ_SHM_READ_RETRIES 1000
+
+// Define the structures making up the fixed layout of the shared memory region
+struct panq_shm_sensor
+{
+  u_int8_t id;
+  u_int8_t valid;
+  u_int16_t reserved;
+  int32_t temperature;
+};
+
+struct panq_shm_fan
+{
+  u_int8_t id;
+  u_int8_t valid;
+  u_int8_t pwm;
+  u_int8_t status;
+  u_int16_t speed;
+  u_int16_t reserved;
+};
+
+struct panq_shm_data
+{
+  int64_t time;
+  u_int64_t samples;
+  struct panq_shm_sensor sensors[PANQ_SHM_SENSOR_COUNT];
+  struct panq_shm_fan fans[PANQ_SHM_FAN_COUNT];
+  u_int8_t power_supply_valid[PANQ_SHM_POWER_SUPPLY_COUNT];
+  u_int8_t power_supply_statuses[PANQ_SHM_POWER_SUPPLY_COUNT];
+  u_int8_t reserved[4];
+};
+
+// The sequence is odd while the writer updates the data and is kept on its own cache line so that
+//   readers polling it don't share a line with the header
+struct panq_shm_region
+{
+  u_int32_t magic;
+  u_int32_t version;
+  u_int32_t size;
+  u_int32_t reserved;
+  u_int32_t sequence __attribute__((aligned(64)));
+  struct panq_shm_data data __attribute__((aligned(64)));
+};
+
+// Define the structure holding an open region
+struct panq_shm
+{
+  struct panq_shm_region* region;
+};
+
+// Declare functions
+int8_t panq_shm_open(const char* name, struct panq_shm* shm);
+int8_t panq_shm_read(const struct panq_shm* shm, struct panq_shm_data* data);
+void panq_shm_close(struct panq_shm* shm);
+int8_t panq_shm_create(const char* name, struct panq_shm* shm);
+void panq_shm_publish(struct panq_shm* shm, const struct panq_shm_data* data);
+void panq_shm_destroy(const char* name, struct panq_shm* shm);
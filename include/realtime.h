@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2021 Stonyx
+ * http://www.stonyx.com
+ *
+ * Copyright (C) 2020 Guillaume Valadon
+ * guillaume@valadon.net
+ */
+
+// Define constants, the stack size is in bytes and the bound is in microseconds
+#define REALTIME_STACK_SIZE (256 * 1024)
+#define REALTIME_DEFAULT_PRIORITY 10
+#define REALTIME_DEFAULT_BOUND 1000
+#define REALTIME_MAX_BOUND 1000000
+#define REALTIME_BUCKET_COUNT 32
+
+// Define the structure holding the real-time mode that was asked for, cpu is -1 when the process
+//   isn't pinned and priority is 0 when the scheduling class isn't changed
+struct realtime_config
+{
+  u_int8_t enabled;
+  u_int8_t priority;
+  int16_t cpu;
+  u_int32_t bound;
+};
+
+// Define the structure holding the wakeup latencies seen since the start, bucket i counts the
+//   latencies below 2^i nanoseconds that didn't fit in the previous bucket
+struct realtime_stats
+{
+  u_int64_t wakeups;
+  u_int64_t late_wakeups;
+  u_int64_t latency_nanoseconds;
+  double latency_squares;
+  u_int64_t max_latency_nanoseconds;
+  u_int64_t buckets[REALTIME_BUCKET_COUNT];
+};
+
+// Declare functions
+int8_t realtime_parse(const char* string, struct realtime_config* config);
+void realtime_enter(const struct realtime_config* config);
+u_int8_t realtime_is_enabled(void);
+void realtime_record_wakeup(int64_t deadline, int64_t now);
+void realtime_get_stats(struct realtime_stats* stats);
+void realtime_print_stats(FILE* stream);
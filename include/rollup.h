@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2021 Stonyx
+ * http://www.stonyx.com
+ *
+ * Copyright (C) 2020 Guillaume Valadon
+ * guillaume@valadon.net
+ */
+
+// Define the rings, every ring is a fixed number of buckets of a fixed resolution in
+//   milliseconds, 10 minutes of seconds, 24 hours of minutes, and 31 days of hours
+#define ROLLUP_RING_SECONDS 0
+#define ROLLUP_RING_MINUTES 1
+#define ROLLUP_RING_HOURS 2
+#define ROLLUP_RINGS 3
+#define ROLLUP_SECOND_BUCKETS 600
+#define ROLLUP_MINUTE_BUCKETS 1440
+#define ROLLUP_HOUR_BUCKETS 744
+
+// Define the series, every temperature sensor followed by the speed of every fan, indexed the
+//   same way as the it8528_sensor_ids and it8528_fan_ids arrays
+#define ROLLUP_SERIES (IT8528_SENSOR_COUNT + IT8528_FAN_COUNT)
+
+// Define the structure holding a bucket, temperatures are in hundredths of a degree
+struct rollup_bucket
+{
+  int64_t sum;
+  int32_t min;
+  int32_t max;
+  u_int32_t count;
+};
+
+// Declare functions
+void rollup_reset(void);
+void rollup_add(const struct it8528_snapshot* snapshot, int64_t time);
+u_int32_t rollup_query(int64_t window, int64_t now, struct rollup_bucket* results);
+void rollup_print(int64_t window, int64_t now, FILE* stream);
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2021 Stonyx
+ * http://www.stonyx.com
+ *
+ * Copyright (C) 2020 Guillaume Valadon
+ * guillaume@valadon.net
+ */
+
+// Define constants, the readings are gathered over spans of at least THERMAL_MODEL_SPAN seconds
+//   before they are fitted so that temperatures read in whole degrees still show how fast they
+//   change, the model needs THERMAL_MODEL_WARMUP spans before it is trusted, and the covariance
+//   stops being inflated by the forgetting factor once its trace reaches THERMAL_MODEL_MAX_TRACE
+//   so that a steady temperature doesn't make it blow up
+#define THERMAL_MODEL_PARAMETERS 5
+#define THERMAL_MODEL_SPAN 10.0
+#define THERMAL_MODEL_DEFAULT_FORGETTING 0.99
+#define THERMAL_MODEL_INITIAL_COVARIANCE 1000.0
+#define THERMAL_MODEL_MAX_TRACE 100000.0
+#define THERMAL_MODEL_WARMUP 20
+#define THERMAL_MODEL_PREDICTION_STEPS 30
+
+// Define the structure holding the model of a sensor, the rate of change of its temperature in
+//   degrees per second is fitted as a linear combination of 1, the load, the temperature, the
+//   speed, and the speed times the temperature, which is what the heat balance of a mass heated
+//   by the load and cooled by an airflow growing with the speed expands to, the load and the speed
+//   are fractions between 0 and 1
+struct thermal_model
+{
+  double parameters[THERMAL_MODEL_PARAMETERS];
+  double trusted_parameters[THERMAL_MODEL_PARAMETERS];
+  u_int8_t trusted;
+  double covariance[THERMAL_MODEL_PARAMETERS][THERMAL_MODEL_PARAMETERS];
+  double forgetting;
+  u_int8_t started;
+  double temperature;
+  double span_temperature;
+  double span_features[THERMAL_MODEL_PARAMETERS];
+  double span_length;
+  u_int64_t spans;
+  double error_sum;
+  u_int64_t error_count;
+};
+
+// Declare functions
+void thermal_model_init(struct thermal_model* model, double forgetting);
+void thermal_model_observe(struct thermal_model* model, double temperature, double speed,
+  double load, double dt);
+void thermal_model_restart(struct thermal_model* model);
+double thermal_model_get_rate(const struct thermal_model* model, double temperature, double speed,
+  double load);
+double thermal_model_predict(const struct thermal_model* model, double temperature, double speed,
+  double load, double horizon);
+u_int8_t thermal_model_is_usable(const struct thermal_model* model, double temperature);
+double thermal_model_get_error(const struct thermal_model* model);
@@ -0,0 +1,1146 @@
+/*
+ * Copyright (C) 2021 Stonyx
+ * http://www.stonyx.com
+ *
+ * Copyright (C) 2020 Guillaume Valadon
+ * guillaume@valadon.net
+ */
+
+#define _GNU_SOURCE
+
+#include <endian.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+#include "it8528.h"
+#include "analyze.h"
+
+// Define the number of columns of a row printed by the log command without options
+#define ANALYZE_ROW_COLUMNS (1 + IT8528_FAN_COUNT + IT8528_SENSOR_COUNT + IT8528_FAN_COUNT * 2 + \
+  IT8528_POWER_SUPPLY_COUNT)
+
+// Define the largest number of digits of a number, enough for the nanoseconds since the epoch
+#define ANALYZE_MAX_DIGITS 19
+
+// Define the structure holding a mapped log, the rows start after the header if there is one and
+//   the columns after the last one that is used are never parsed
+struct analyze_file
+{
+  const char* path;
+  const char* data;
+  size_t size;
+  size_t start;
+  u_int8_t columns[ANALYZE_MAX_COLUMNS];
+  u_int8_t last_column;
+};
+
+// Define the structure holding a part of a log parsed by a thread, it covers the rows that start
+//   between start and end
+struct analyze_job
+{
+  u_int32_t file;
+  size_t start;
+  size_t end;
+};
+
+// Define the structure holding the windows seen, they are found through a hash table whose slots
+//   hold their position plus one, and the last window found is tried first since rows are mostly
+//   in order
+struct analyze_table
+{
+  struct analyze_window* windows;
+  u_int32_t count;
+  u_int32_t capacity;
+  u_int32_t* slots;
+  u_int32_t slot_count;
+  u_int32_t last;
+};
+
+// Define the structure shared by the threads, the results and the totals are guarded by the mutex
+struct analyze_context
+{
+  const struct analyze_config* config;
+  const struct analyze_file* files;
+  const struct analyze_job* jobs;
+  u_int32_t job_count;
+  u_int32_t next_job;
+  pthread_mutex_t mutex;
+  struct analyze_table results;
+  u_int64_t rows;
+  u_int64_t skipped_rows;
+  int8_t failed;
+};
+
+// Define the structure holding a parsed row, the time is in milliseconds since the epoch, the
+//   temperature is the hottest one in hundredths of a degree, and the fan speed is the mean one
+struct analyze_row
+{
+  int64_t time;
+  int32_t temperature;
+  u_int32_t fan_speed;
+  u_int8_t has_fan_speed;
+};
+
+// Define the structure holding where the separators are in the 64 characters starting at base,
+//   bit i of the mask stands for the character at base + i and the separators already used are
+//   cleared, so that every character is only looked at once
+struct analyze_scanner
+{
+  const char* base;
+  const char* data_end;
+  u_int64_t separators;
+};
+
+// Declare the powers of ten used to scale the numbers to their decimals
+static const u_int64_t analyze_powers[] = { 1, 10, 100 };
+
+// Declare functions
+static int8_t analyze_parse_files(const struct analyze_file* files, u_int32_t file_count,
+  const struct analyze_config* config, FILE* stream, struct analyze_stats* stats);
+static int8_t analyze_open_file(const char* path, struct analyze_file* file);
+static int8_t analyze_find_columns(struct analyze_file* file);
+static void* analyze_thread(void* argument);
+static int8_t analyze_run_job(struct analyze_context* context, const struct analyze_job* job,
+  struct analyze_table* table, u_int64_t* rows, u_int64_t* skipped_rows);
+static const char* analyze_parse_row(const struct analyze_file* file,
+  struct analyze_scanner* scanner, const char* p, struct analyze_row* row, u_int8_t* valid);
+static const char* analyze_skip_row(struct analyze_scanner* scanner, const char* p);
+static const char* analyze_find_separator(struct analyze_scanner* scanner, const char* p);
+static void analyze_scan(struct analyze_scanner* scanner, const char* p);
+static int8_t analyze_parse_number(const char* p, const char* end, u_int8_t decimals,
+  int64_t* value, u_int8_t* present);
+static u_int64_t analyze_load(const char* p, const char* data_end);
+static struct analyze_window* analyze_get_window(struct analyze_table* table, int64_t index);
+static void analyze_add_row(struct analyze_window* window, const struct analyze_row* row);
+static void analyze_merge_window(struct analyze_window* window,
+  const struct analyze_window* other);
+static void analyze_clear_table(struct analyze_table* table);
+static void analyze_free_table(struct analyze_table* table);
+static int analyze_compare_windows(const void* a, const void* b);
+static void analyze_print_window(const struct analyze_window* window, const char* label,
+  FILE* stream);
+static double analyze_get_percentile(const u_int64_t* histogram, u_int32_t bin_count,
+  u_int64_t count, u_int32_t percent);
+
+// Function called to analyze logs written by the log command, every log is mapped in memory and
+//   split into chunks of whole rows parsed by a pool of threads, each thread adds its rows to
+//   windows of its own and merges them into the results after every chunk, and the results are
+//   printed as a CSV row per window followed by a row for all of them
+int8_t analyze_run(char** paths, u_int32_t path_count, const struct analyze_config* config,
+  FILE* stream, struct analyze_stats* stats)
+{
+  // Declare needed variables
+  struct analyze_file* files;
+  struct timespec start;
+  struct timespec end;
+  int8_t ret = 0;
+
+  // Map the logs
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  memset(stats, 0, sizeof(*stats));
+  files = calloc(path_count, sizeof(*files));
+  if (files == NULL)
+  {
+    fprintf(stderr, "analyze_run: calloc() failed!\n");
+    return -1;
+  }
+  for (u_int32_t i = 0; ret == 0 && i < path_count; i++)
+  {
+    if (analyze_open_file(paths[i], &files[i]) != 0)
+    {
+      fprintf(stderr, "analyze_run: analyze_open_file() failed for %s!\n", paths[i]);
+      ret = -1;
+    }
+    stats->bytes += files[i].size;
+  }
+  stats->files = path_count;
+
+  // Parse them and print the windows
+  if (ret == 0 && analyze_parse_files(files, path_count, config, stream, stats) != 0)
+  {
+    fprintf(stderr, "analyze_run: analyze_parse_files() failed!\n");
+    ret = -1;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  stats->nanoseconds = (end.tv_sec - start.tv_sec) * 1000000000ULL + end.tv_nsec - start.tv_nsec;
+
+  // Unmap the logs
+  for (u_int32_t i = 0; i < path_count; i++)
+  {
+    if (files[i].data != NULL)
+    {
+      munmap((void*)files[i].data, files[i].size);
+    }
+  }
+  free(files);
+
+  return ret;
+}
+
+// Function called to print how an analysis went
+void analyze_print_stats(const struct analyze_stats* stats, FILE* stream)
+{
+  // Declare needed variables
+  double seconds = stats->nanoseconds / 1e9;
+
+  fprintf(stream, "files %u\n", stats->files);
+  fprintf(stream, "threads %u\n", stats->threads);
+  fprintf(stream, "bytes %llu\n", (unsigned long long)stats->bytes);
+  fprintf(stream, "rows %llu\n", (unsigned long long)stats->rows);
+  fprintf(stream, "skipped_rows %llu\n", (unsigned long long)stats->skipped_rows);
+  fprintf(stream, "windows %llu\n", (unsigned long long)stats->windows);
+  fprintf(stream, "seconds %.3f\n", seconds);
+  fprintf(stream, "bytes_per_second %.0f\n", seconds > 0 ? stats->bytes / seconds : 0);
+  fprintf(stream, "rows_per_second %.0f\n", seconds > 0 ? stats->rows / seconds : 0);
+}
+
+// Function called to split the mapped logs into chunks small enough to keep every thread busy
+//   until the end and large enough to not merge windows too often, parse them with a pool of
+//   threads, and print the windows sorted by time
+static int8_t analyze_parse_files(const struct analyze_file* files, u_int32_t file_count,
+  const struct analyze_config* config, FILE* stream, struct analyze_stats* stats)
+{
+  // Declare needed variables
+  struct analyze_context context;
+  struct analyze_window total;
+  struct analyze_job* jobs;
+  pthread_t* threads;
+  size_t chunk_size = stats->bytes / ((size_t)config->threads * 4);
+  u_int32_t job_count = 0;
+  u_int16_t thread_count = 0;
+
+  // Work out the chunk size and count the chunks
+  if (chunk_size < ANALYZE_MIN_CHUNK_SIZE)
+  {
+    chunk_size = ANALYZE_MIN_CHUNK_SIZE;
+  }
+  else if (chunk_size > ANALYZE_MAX_CHUNK_SIZE)
+  {
+    chunk_size = ANALYZE_MAX_CHUNK_SIZE;
+  }
+  for (u_int32_t i = 0; i < file_count; i++)
+  {
+    job_count += (files[i].size - files[i].start + chunk_size - 1) / chunk_size;
+  }
+
+  // Split the logs
+  jobs = calloc(job_count > 0 ? job_count : 1, sizeof(*jobs));
+  threads = calloc(config->threads, sizeof(*threads));
+  if (jobs == NULL || threads == NULL)
+  {
+    fprintf(stderr, "analyze_parse_files: calloc() failed!\n");
+    free(jobs);
+    free(threads);
+    return -1;
+  }
+  job_count = 0;
+  for (u_int32_t i = 0; i < file_count; i++)
+  {
+    for (size_t offset = files[i].start; offset < files[i].size; offset += chunk_size)
+    {
+      jobs[job_count].file = i;
+      jobs[job_count].start = offset;
+      jobs[job_count].end = files[i].size - offset > chunk_size ? offset + chunk_size :
+        files[i].size;
+      job_count++;
+    }
+  }
+
+  // Start the threads, there is no point in more threads than chunks, and wait for them
+  memset(&context, 0, sizeof(context));
+  context.config = config;
+  context.files = files;
+  context.jobs = jobs;
+  context.job_count = job_count;
+  pthread_mutex_init(&context.mutex, NULL);
+  while (thread_count < config->threads && (thread_count == 0 || thread_count < job_count))
+  {
+    if (pthread_create(&threads[thread_count], NULL, analyze_thread, &context) != 0)
+    {
+      fprintf(stderr, "analyze_parse_files: pthread_create() failed!\n");
+      context.failed = 1;
+      break;
+    }
+    thread_count++;
+  }
+  for (u_int16_t i = 0; i < thread_count; i++)
+  {
+    pthread_join(threads[i], NULL);
+  }
+  pthread_mutex_destroy(&context.mutex);
+  free(threads);
+  free(jobs);
+  stats->threads = thread_count;
+  stats->rows = context.rows;
+  stats->skipped_rows = context.skipped_rows;
+  stats->windows = context.results.count;
+  if (context.failed)
+  {
+    analyze_free_table(&context.results);
+    return -1;
+  }
+
+  // Sort the windows by time and print them along with all of them merged
+  qsort(context.results.windows, context.results.count, sizeof(struct analyze_window),
+    analyze_compare_windows);
+  memset(&total, 0, sizeof(total));
+  total.temperature_min = INT32_MAX;
+  total.temperature_max = INT32_MIN;
+  total.fan_speed_min = UINT32_MAX;
+  fprintf(stream, "window_start,samples,temperature_min,temperature_max,temperature_mean,"
+    "temperature_p50,temperature_p95,temperature_p99,seconds_above,fan_samples,fan_speed_min,"
+    "fan_speed_max,fan_speed_mean,fan_speed_p50,fan_speed_p95,fan_speed_p99,correlation\n");
+  for (u_int32_t i = 0; i < context.results.count; i++)
+  {
+    char label[24];
+    snprintf(label, sizeof(label), "%lld",
+      (long long)(context.results.windows[i].index * config->window / 1000));
+    analyze_print_window(&context.results.windows[i], label, stream);
+    analyze_merge_window(&total, &context.results.windows[i]);
+  }
+  if (context.results.count > 0)
+  {
+    analyze_print_window(&total, "total", stream);
+  }
+  analyze_free_table(&context.results);
+
+  return 0;
+}
+
+// Function called to map a log in memory and find out what its columns hold
+static int8_t analyze_open_file(const char* path, struct analyze_file* file)
+{
+  // Declare needed variables
+  struct stat status;
+  int fd;
+
+  // Open the log
+  file->path = path;
+  fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    fprintf(stderr, "analyze_open_file: open() failed!\n");
+    return -1;
+  }
+  if (fstat(fd, &status) != 0)
+  {
+    fprintf(stderr, "analyze_open_file: fstat() failed!\n");
+    close(fd);
+    return -1;
+  }
+
+  // An empty log has no rows to map
+  file->size = status.st_size;
+  if (file->size == 0)
+  {
+    close(fd);
+    return 0;
+  }
+
+  // Map it, the mapping outlives the descriptor and is read from start to end by every thread
+  file->data = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (file->data == MAP_FAILED)
+  {
+    file->data = NULL;
+    fprintf(stderr, "analyze_open_file: mmap() failed!\n");
+    return -1;
+  }
+  madvise((void*)file->data, file->size, MADV_SEQUENTIAL);
+
+  return analyze_find_columns(file);
+}
+
+// Function called to find out what the columns of a log hold from its first row, a log streamed
+//   by the log command starts with the column names, a log row has the time, the speed of every
+//   fan, and every temperature first, and the original log rows hold the time, the speed of the
+//   first fan, and the first temperature
+static int8_t analyze_find_columns(struct analyze_file* file)
+{
+  // Declare needed variables
+  size_t length = file->size < ANALYZE_MAX_HEADER_LENGTH ? file->size : ANALYZE_MAX_HEADER_LENGTH;
+  const char* line_end = memchr(file->data, '\n', length);
+  const char* p = file->data;
+  u_int32_t count = 1;
+
+  // Find the end of the first row
+  if (line_end == NULL)
+  {
+    if (file->size > ANALYZE_MAX_HEADER_LENGTH)
+    {
+      fprintf(stderr, "analyze_find_columns: first row too long!\n");
+      return -1;
+    }
+    line_end = file->data + file->size;
+  }
+  memset(file->columns, ANALYZE_COLUMN_IGNORED, sizeof(file->columns));
+
+  // Check if the log starts with the column names
+  if (strncmp(p, "monotonic_ns,", strlen("monotonic_ns,")) == 0)
+  {
+    file->start = line_end - file->data + (line_end < file->data + file->size);
+    for (u_int32_t column = 0; p < line_end; column++)
+    {
+      // Find the end of the name
+      const char* name_end = memchr(p, ',', line_end - p);
+      if (name_end == NULL)
+      {
+        name_end = line_end;
+      }
+      if (column >= ANALYZE_MAX_COLUMNS)
+      {
+        fprintf(stderr, "analyze_find_columns: too many columns!\n");
+        return -1;
+      }
+
+      // Check what the column holds
+      size_t name_length = name_end - p;
+      if (name_length > 0 && p[name_length - 1] == '\r')
+      {
+        name_length--;
+      }
+      if (name_length == strlen("wall_ns") && strncmp(p, "wall_ns", name_length) == 0)
+      {
+        file->columns[column] = ANALYZE_COLUMN_NANOSECONDS;
+      }
+      else if (strncmp(p, "temperature_", strlen("temperature_")) == 0)
+      {
+        file->columns[column] = ANALYZE_COLUMN_TEMPERATURE;
+      }
+      else if (strncmp(p, "fan_", strlen("fan_")) == 0 && name_length > strlen("_rpm") &&
+        strncmp(p + name_length - strlen("_rpm"), "_rpm", strlen("_rpm")) == 0)
+      {
+        file->columns[column] = ANALYZE_COLUMN_FAN_SPEED;
+      }
+      if (file->columns[column] != ANALYZE_COLUMN_IGNORED)
+      {
+        file->last_column = column;
+      }
+      p = name_end + 1;
+    }
+    return 0;
+  }
+
+  // Count the columns of the first row
+  for (; p < line_end; p++)
+  {
+    count += *p == ',';
+  }
+
+  // Check which kind of row it is
+  file->start = 0;
+  file->columns[0] = ANALYZE_COLUMN_SECONDS;
+  if (count == 3)
+  {
+    file->columns[1] = ANALYZE_COLUMN_FAN_SPEED;
+    file->columns[2] = ANALYZE_COLUMN_TEMPERATURE;
+    file->last_column = 2;
+  }
+  else if (count == ANALYZE_ROW_COLUMNS)
+  {
+    memset(file->columns + 1, ANALYZE_COLUMN_FAN_SPEED, IT8528_FAN_COUNT);
+    memset(file->columns + 1 + IT8528_FAN_COUNT, ANALYZE_COLUMN_TEMPERATURE,
+      IT8528_SENSOR_COUNT);
+    file->last_column = IT8528_FAN_COUNT + IT8528_SENSOR_COUNT;
+  }
+  else
+  {
+    fprintf(stderr, "analyze_find_columns: unknown log format!\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+// Function called by every thread to parse chunks until there are none left
+static void* analyze_thread(void* argument)
+{
+  // Declare needed variables
+  struct analyze_context* context = argument;
+  struct analyze_table table;
+  u_int64_t rows;
+  u_int64_t skipped_rows;
+  u_int32_t job;
+  int8_t ret = 0;
+
+  // Loop through the chunks
+  memset(&table, 0, sizeof(table));
+  while (ret == 0 &&
+    (job = __atomic_fetch_add(&context->next_job, 1, __ATOMIC_RELAXED)) < context->job_count)
+  {
+    // Parse the chunk into windows of our own
+    rows = 0;
+    skipped_rows = 0;
+    ret = analyze_run_job(context, &context->jobs[job], &table, &rows, &skipped_rows);
+
+    // Merge them into the results
+    pthread_mutex_lock(&context->mutex);
+    for (u_int32_t i = 0; ret == 0 && i < table.count; i++)
+    {
+      struct analyze_window* window = analyze_get_window(&context->results,
+        table.windows[i].index);
+      if (window == NULL)
+      {
+        ret = -1;
+        break;
+      }
+      analyze_merge_window(window, &table.windows[i]);
+    }
+    context->rows += rows;
+    context->skipped_rows += skipped_rows;
+    if (ret != 0)
+    {
+      context->failed = 1;
+    }
+    pthread_mutex_unlock(&context->mutex);
+    analyze_clear_table(&table);
+
+    // Stop early if another thread failed
+    if (__atomic_load_n(&context->failed, __ATOMIC_RELAXED))
+    {
+      break;
+    }
+  }
+  analyze_free_table(&table);
+
+  return NULL;
+}
+
+// Function called to parse the rows of a chunk, a hot row adds the time until the next row to its
+//   window unless the gap is too long to trust, so the first row after the chunk is looked at too
+static int8_t analyze_run_job(struct analyze_context* context, const struct analyze_job* job,
+  struct analyze_table* table, u_int64_t* rows, u_int64_t* skipped_rows)
+{
+  // Declare needed variables
+  const struct analyze_config* config = context->config;
+  const struct analyze_file* file = &context->files[job->file];
+  const char* data_end = file->data + file->size;
+  const char* end = file->data + job->end;
+  const char* p = file->data + job->start;
+  int32_t threshold = lround(config->threshold * 100);
+  struct analyze_window* window;
+  struct analyze_row row;
+  int64_t previous_time = 0;
+  int64_t previous_index = 0;
+  int64_t window_start = 0;
+  int64_t window_end = 0;
+  u_int8_t previous_hot = 0;
+  u_int8_t valid;
+  struct analyze_scanner scanner = {
+    .data_end = data_end
+  };
+
+  // Skip the end of the row that started in the previous chunk
+  if (job->start > file->start && p[-1] != '\n')
+  {
+    p = memchr(p, '\n', data_end - p);
+    if (p == NULL)
+    {
+      return 0;
+    }
+    p++;
+  }
+
+  // Loop through the rows that start in the chunk and the first one after it
+  while (p < data_end)
+  {
+    u_int8_t last = p >= end;
+    p = analyze_parse_row(file, &scanner, p, &row, &valid);
+    if (!valid)
+    {
+      if (last)
+      {
+        break;
+      }
+      (*skipped_rows)++;
+      continue;
+    }
+
+    // Add the time since a hot previous row to its window
+    if (previous_hot && row.time > previous_time && row.time - previous_time <= config->max_gap)
+    {
+      window = analyze_get_window(table, previous_index);
+      if (window == NULL)
+      {
+        return -1;
+      }
+      window->time_above += row.time - previous_time;
+    }
+    if (last)
+    {
+      break;
+    }
+
+    // Add the row to its window, the index only has to be worked out when the row falls outside
+    //   the window of the previous row
+    if (row.time < window_start || row.time >= window_end)
+    {
+      previous_index = row.time >= 0 ? row.time / config->window :
+        -((-row.time + config->window - 1) / config->window);
+      window_start = previous_index * config->window;
+      window_end = window_start + config->window;
+    }
+    window = analyze_get_window(table, previous_index);
+    if (window == NULL)
+    {
+      return -1;
+    }
+    analyze_add_row(window, &row);
+    previous_time = row.time;
+    previous_hot = row.temperature > threshold;
+    (*rows)++;
+  }
+
+  return 0;
+}
+
+// Function called to parse the row starting at p, a row is valid if it has a time and at least
+//   one temperature, the columns after the last one that is used are skipped in one search for
+//   the end of the row, and the start of the next row is returned
+static const char* analyze_parse_row(const struct analyze_file* file,
+  struct analyze_scanner* scanner, const char* p, struct analyze_row* row, u_int8_t* valid)
+{
+  // Declare needed variables
+  const char* data_end = scanner->data_end;
+  u_int64_t fan_speed_sum = 0;
+  u_int32_t fan_count = 0;
+  u_int8_t has_time = 0;
+  u_int8_t present;
+  int64_t value;
+
+  row->temperature = INT32_MIN;
+  *valid = 0;
+
+  // Loop through the columns up to the last one that is used
+  for (u_int32_t column = 0; ; column++)
+  {
+    // Find the end of the column, leaving out the carriage return of the last one
+    const char* end = analyze_find_separator(scanner, p);
+    if (end == NULL)
+    {
+      return analyze_skip_row(scanner, p);
+    }
+    const char* value_end = end;
+    if ((end >= data_end || *end == '\n') && value_end > p && value_end[-1] == '\r')
+    {
+      value_end--;
+    }
+
+    // Parse the column if it is used
+    switch (file->columns[column])
+    {
+      case ANALYZE_COLUMN_SECONDS:
+        if (analyze_parse_number(p, value_end, 0, &value, &present) != 0)
+        {
+          return analyze_skip_row(scanner, end);
+        }
+        row->time = value * 1000;
+        has_time = present;
+        break;
+      case ANALYZE_COLUMN_NANOSECONDS:
+        if (analyze_parse_number(p, value_end, 0, &value, &present) != 0)
+        {
+          return analyze_skip_row(scanner, end);
+        }
+        row->time = value / 1000000;
+        has_time = present;
+        break;
+      case ANALYZE_COLUMN_TEMPERATURE:
+        if (analyze_parse_number(p, value_end, 2, &value, &present) != 0)
+        {
+          return analyze_skip_row(scanner, end);
+        }
+        if (present && value > row->temperature && value < INT32_MAX)
+        {
+          row->temperature = value;
+        }
+        break;
+      case ANALYZE_COLUMN_FAN_SPEED:
+        if (analyze_parse_number(p, value_end, 0, &value, &present) != 0)
+        {
+          return analyze_skip_row(scanner, end);
+        }
+        if (present && value >= 0 && value <= UINT16_MAX)
+        {
+          fan_speed_sum += value;
+          fan_count++;
+        }
+        break;
+    }
+
+    // Check if the row ended or the rest of it isn't used
+    if (end >= data_end)
+    {
+      p = data_end;
+      break;
+    }
+    if (*end == '\n')
+    {
+      p = end + 1;
+      break;
+    }
+    if (column == file->last_column)
+    {
+      p = analyze_skip_row(scanner, end);
+      break;
+    }
+    p = end + 1;
+  }
+
+  // Work out the mean fan speed, the sum always fits in 32 bits and a single fan needs no division
+  row->has_fan_speed = fan_count > 0;
+  row->fan_speed = fan_count > 1 ? ((u_int32_t)fan_speed_sum + fan_count / 2) / fan_count :
+    fan_speed_sum;
+  *valid = has_time && row->temperature != INT32_MIN;
+
+  return p;
+}
+
+// Function called to skip to the start of the next row, the separators found so far are dropped
+//   since the next row is found without them
+static const char* analyze_skip_row(struct analyze_scanner* scanner, const char* p)
+{
+  // Declare needed variables
+  const char* end = p < scanner->data_end ? memchr(p, '\n', scanner->data_end - p) : NULL;
+
+  scanner->separators = 0;
+
+  return end == NULL ? scanner->data_end : end + 1;
+}
+
+// Function called to find the separator ending the column starting at p, the 64 characters from
+//   p are scanned when the separators found so far are used up, and NULL is returned if the
+//   column is longer than that
+static const char* analyze_find_separator(struct analyze_scanner* scanner, const char* p)
+{
+  // Declare needed variables
+  const char* separator;
+
+  // Scan the next characters if needed
+  if (scanner->separators == 0)
+  {
+    analyze_scan(scanner, p);
+    if (scanner->separators == 0)
+    {
+      return NULL;
+    }
+  }
+
+  // Take the first separator left
+  separator = scanner->base + __builtin_ctzll(scanner->separators);
+  scanner->separators &= scanner->separators - 1;
+
+  return separator;
+}
+
+// Function called to find the commas and the line feeds in the 64 characters starting at p, 8
+//   characters at a time, a byte of a word is zero where the character matches once the word is
+//   XORed with the character repeated, the zero bytes are turned into their top bit without any
+//   carry between bytes, and a multiplication gathers the 8 top bits into a byte, the characters
+//   past the end of the log read as line feeds
+static void analyze_scan(struct analyze_scanner* scanner, const char* p)
+{
+  // Declare needed variables
+  u_int64_t separators = 0;
+
+  // Loop through the words
+  for (u_int8_t i = 0; i < 8; i++)
+  {
+    u_int64_t word = analyze_load(p + i * 8, scanner->data_end);
+    u_int64_t commas = word ^ 0x2C2C2C2C2C2C2C2CULL;
+    u_int64_t line_feeds = word ^ 0x0A0A0A0A0A0A0A0AULL;
+
+    // Turn the matching bytes into their top bit
+    commas = ~(((commas & 0x7F7F7F7F7F7F7F7FULL) + 0x7F7F7F7F7F7F7F7FULL) | commas |
+      0x7F7F7F7F7F7F7F7FULL);
+    line_feeds = ~(((line_feeds & 0x7F7F7F7F7F7F7F7FULL) + 0x7F7F7F7F7F7F7F7FULL) | line_feeds |
+      0x7F7F7F7F7F7F7F7FULL);
+
+    // Gather the top bits
+    separators |= ((((commas | line_feeds) >> 7) * 0x0102040810204080ULL) >> 56) << (i * 8);
+  }
+
+  scanner->base = p;
+  scanner->separators = separators;
+}
+
+// Function called to parse the column between p and end as a number with an optional sign and
+//   fraction into an integer scaled by 10^decimals, the digits past the decimals are dropped, an
+//   empty column isn't present, and -1 is returned if the column isn't a number, the columns are
+//   short so the digits are simply taken one at a time
+static int8_t analyze_parse_number(const char* p, const char* end, u_int8_t decimals,
+  int64_t* value, u_int8_t* present)
+{
+  // Declare needed variables
+  const char* digits;
+  u_int64_t number = 0;
+  u_int8_t negative = 0;
+  u_int8_t count = 0;
+
+  // Check if the column is empty
+  *present = 0;
+  if (p == end)
+  {
+    return 0;
+  }
+
+  // Parse the sign and the integer part
+  if (*p == '-')
+  {
+    negative = 1;
+    p++;
+  }
+  digits = p;
+  while (p < end && (u_int8_t)(*p - '0') < 10)
+  {
+    number = number * 10 + (*p - '0');
+    p++;
+  }
+  if (p == digits || p - digits > ANALYZE_MAX_DIGITS)
+  {
+    return -1;
+  }
+
+  // Parse the fraction, keeping its first decimals digits
+  if (p < end && *p == '.')
+  {
+    p++;
+    digits = p;
+    while (p < end && (u_int8_t)(*p - '0') < 10)
+    {
+      if (count < decimals)
+      {
+        number = number * 10 + (*p - '0');
+        count++;
+      }
+      p++;
+    }
+  }
+  if (p != end)
+  {
+    return -1;
+  }
+  number *= analyze_powers[decimals - count];
+
+  *value = negative ? -(int64_t)number : (int64_t)number;
+  *present = 1;
+
+  return 0;
+}
+
+// Function called to load 8 characters into a word with the first one in the lowest byte, the
+//   characters past the end of the log read as line feeds
+static u_int64_t analyze_load(const char* p, const char* data_end)
+{
+  // Declare needed variables
+  u_int8_t bytes[8];
+  u_int64_t word;
+
+  // Load the characters
+  if (data_end - p >= 8)
+  {
+    memcpy(&word, p, sizeof(word));
+  }
+  else
+  {
+    memset(bytes, '\n', sizeof(bytes));
+    if (data_end > p)
+    {
+      memcpy(bytes, p, data_end - p);
+    }
+    memcpy(&word, bytes, sizeof(word));
+  }
+
+  return le64toh(word);
+}
+
+// Function called to find the window with an index, adding it if it isn't there yet, NULL is
+//   returned if there is no memory for it
+static struct analyze_window* analyze_get_window(struct analyze_table* table, int64_t index)
+{
+  // Declare needed variables
+  struct analyze_window* window;
+  u_int32_t slot;
+
+  // Check the last window found first
+  if (table->count > 0 && table->windows[table->last].index == index)
+  {
+    return &table->windows[table->last];
+  }
+
+  // Make the hash table twice as large as soon as it is half full
+  if ((table->count + 1) * 2 > table->slot_count)
+  {
+    u_int32_t slot_count = table->slot_count == 0 ? 64 : table->slot_count * 2;
+    u_int32_t* slots = calloc(slot_count, sizeof(*slots));
+    if (slots == NULL)
+    {
+      fprintf(stderr, "analyze_get_window: calloc() failed!\n");
+      return NULL;
+    }
+    for (u_int32_t i = 0; i < table->count; i++)
+    {
+      slot = ((u_int64_t)table->windows[i].index * 0x9E3779B97F4A7C15ULL >> 32) &
+        (slot_count - 1);
+      while (slots[slot] != 0)
+      {
+        slot = (slot + 1) & (slot_count - 1);
+      }
+      slots[slot] = i + 1;
+    }
+    free(table->slots);
+    table->slots = slots;
+    table->slot_count = slot_count;
+  }
+
+  // Look the window up
+  slot = ((u_int64_t)index * 0x9E3779B97F4A7C15ULL >> 32) & (table->slot_count - 1);
+  while (table->slots[slot] != 0)
+  {
+    if (table->windows[table->slots[slot] - 1].index == index)
+    {
+      table->last = table->slots[slot] - 1;
+      return &table->windows[table->last];
+    }
+    slot = (slot + 1) & (table->slot_count - 1);
+  }
+
+  // Add it
+  if (table->count == table->capacity)
+  {
+    u_int32_t capacity = table->capacity == 0 ? 16 : table->capacity * 2;
+    struct analyze_window* windows = realloc(table->windows, capacity * sizeof(*windows));
+    if (windows == NULL)
+    {
+      fprintf(stderr, "analyze_get_window: realloc() failed!\n");
+      return NULL;
+    }
+    table->windows = windows;
+    table->capacity = capacity;
+  }
+  window = &table->windows[table->count];
+  memset(window, 0, sizeof(*window));
+  window->index = index;
+  window->temperature_min = INT32_MAX;
+  window->temperature_max = INT32_MIN;
+  window->fan_speed_min = UINT32_MAX;
+  table->slots[slot] = table->count + 1;
+  table->last = table->count++;
+
+  return window;
+}
+
+// Function called to add a row to a window
+static void analyze_add_row(struct analyze_window* window, const struct analyze_row* row)
+{
+  // Declare needed variables
+  int32_t temperature_bin = (row->temperature - ANALYZE_MIN_TEMPERATURE) /
+    ANALYZE_TEMPERATURE_BIN_SIZE;
+  u_int32_t fan_speed_bin = row->fan_speed / ANALYZE_FAN_SPEED_BIN_SIZE;
+
+  // Add the temperature
+  window->samples++;
+  window->temperature_sum += row->temperature;
+  if (row->temperature < window->temperature_min)
+  {
+    window->temperature_min = row->temperature;
+  }
+  if (row->temperature > window->temperature_max)
+  {
+    window->temperature_max = row->temperature;
+  }
+  if (temperature_bin < 0 || row->temperature < ANALYZE_MIN_TEMPERATURE)
+  {
+    temperature_bin = 0;
+  }
+  else if (temperature_bin >= ANALYZE_TEMPERATURE_BINS)
+  {
+    temperature_bin = ANALYZE_TEMPERATURE_BINS - 1;
+  }
+  window->temperature_histogram[temperature_bin]++;
+
+  // Add the fan speed
+  if (!row->has_fan_speed)
+  {
+    return;
+  }
+  window->fan_samples++;
+  window->fan_speed_sum += row->fan_speed;
+  if (row->fan_speed < window->fan_speed_min)
+  {
+    window->fan_speed_min = row->fan_speed;
+  }
+  if (row->fan_speed > window->fan_speed_max)
+  {
+    window->fan_speed_max = row->fan_speed;
+  }
+  if (fan_speed_bin >= ANALYZE_FAN_SPEED_BINS)
+  {
+    fan_speed_bin = ANALYZE_FAN_SPEED_BINS - 1;
+  }
+  window->fan_speed_histogram[fan_speed_bin]++;
+
+  // Add both to the correlation sums, with the temperature in degrees
+  double x = row->fan_speed;
+  double y = row->temperature / 100.0;
+  window->pairs++;
+  window->sum_x += x;
+  window->sum_y += y;
+  window->sum_xx += x * x;
+  window->sum_yy += y * y;
+  window->sum_xy += x * y;
+}
+
+// Function called to merge a window into another one
+static void analyze_merge_window(struct analyze_window* window,
+  const struct analyze_window* other)
+{
+  window->samples += other->samples;
+  window->temperature_sum += other->temperature_sum;
+  if (other->temperature_min < window->temperature_min)
+  {
+    window->temperature_min = other->temperature_min;
+  }
+  if (other->temperature_max > window->temperature_max)
+  {
+    window->temperature_max = other->temperature_max;
+  }
+  window->time_above += other->time_above;
+  window->fan_samples += other->fan_samples;
+  window->fan_speed_sum += other->fan_speed_sum;
+  if (other->fan_speed_min < window->fan_speed_min)
+  {
+    window->fan_speed_min = other->fan_speed_min;
+  }
+  if (other->fan_speed_max > window->fan_speed_max)
+  {
+    window->fan_speed_max = other->fan_speed_max;
+  }
+  window->pairs += other->pairs;
+  window->sum_x += other->sum_x;
+  window->sum_y += other->sum_y;
+  window->sum_xx += other->sum_xx;
+  window->sum_yy += other->sum_yy;
+  window->sum_xy += other->sum_xy;
+  for (u_int32_t i = 0; i < ANALYZE_TEMPERATURE_BINS; i++)
+  {
+    window->temperature_histogram[i] += other->temperature_histogram[i];
+  }
+  for (u_int32_t i = 0; i < ANALYZE_FAN_SPEED_BINS; i++)
+  {
+    window->fan_speed_histogram[i] += other->fan_speed_histogram[i];
+  }
+}
+
+// Function called to empty a table while keeping its memory for the next chunk
+static void analyze_clear_table(struct analyze_table* table)
+{
+  if (table->slots != NULL)
+  {
+    memset(table->slots, 0, table->slot_count * sizeof(*table->slots));
+  }
+  table->count = 0;
+  table->last = 0;
+}
+
+// Function called to free the memory of a table
+static void analyze_free_table(struct analyze_table* table)
+{
+  free(table->windows);
+  free(table->slots);
+  memset(table, 0, sizeof(*table));
+}
+
+// Function called by qsort() to order windows by time
+static int analyze_compare_windows(const void* a, const void* b)
+{
+  // Declare needed variables
+  int64_t index_a = ((const struct analyze_window*)a)->index;
+  int64_t index_b = ((const struct analyze_window*)b)->index;
+
+  return (index_a > index_b) - (index_a < index_b);
+}
+
+// Function called to print a window as a CSV row, the percentiles are worked out from the
+//   histograms and kept within the minimum and the maximum, and the fan columns and the
+//   correlation are left empty when there is nothing to work them out from
+static void analyze_print_window(const struct analyze_window* window, const char* label,
+  FILE* stream)
+{
+  // Declare needed variables
+  static const u_int32_t percents[] = { 50, 95, 99 };
+
+  // Print the temperatures
+  fprintf(stream, "%s,%llu,%.2f,%.2f,%.2f", label, (unsigned long long)window->samples,
+    window->temperature_min / 100.0, window->temperature_max / 100.0,
+    (double)window->temperature_sum / window->samples / 100);
+  for (u_int8_t i = 0; i < sizeof(percents) / sizeof(percents[0]); i++)
+  {
+    double value = ANALYZE_MIN_TEMPERATURE + analyze_get_percentile(
+      window->temperature_histogram, ANALYZE_TEMPERATURE_BINS, window->samples, percents[i]) *
+      ANALYZE_TEMPERATURE_BIN_SIZE;
+    value = fmin(fmax(value, window->temperature_min), window->temperature_max);
+    fprintf(stream, ",%.2f", value / 100);
+  }
+  fprintf(stream, ",%.1f,%llu", window->time_above / 1000.0,
+    (unsigned long long)window->fan_samples);
+
+  // Print the fan speeds
+  if (window->fan_samples == 0)
+  {
+    fprintf(stream, ",,,,,,,\n");
+    return;
+  }
+  fprintf(stream, ",%u,%u,%.1f", window->fan_speed_min, window->fan_speed_max,
+    (double)window->fan_speed_sum / window->fan_samples);
+  for (u_int8_t i = 0; i < sizeof(percents) / sizeof(percents[0]); i++)
+  {
+    double value = analyze_get_percentile(window->fan_speed_histogram, ANALYZE_FAN_SPEED_BINS,
+      window->fan_samples, percents[i]) * ANALYZE_FAN_SPEED_BIN_SIZE;
+    value = fmin(fmax(value, window->fan_speed_min), window->fan_speed_max);
+    fprintf(stream, ",%.0f", value);
+  }
+
+  // Print the correlation of the fan speed with the temperature
+  double n = window->pairs;
+  double variance_x = n * window->sum_xx - window->sum_x * window->sum_x;
+  double variance_y = n * window->sum_yy - window->sum_y * window->sum_y;
+  if (window->pairs < 2 || variance_x <= 0 || variance_y <= 0)
+  {
+    fprintf(stream, ",\n");
+    return;
+  }
+  fprintf(stream, ",%.3f\n", (n * window->sum_xy - window->sum_x * window->sum_y) /
+    sqrt(variance_x * variance_y));
+}
+
+// Function called to find where a percentile of the values of a histogram falls in bins, the
+//   values of the bin it falls in are taken as spread evenly across it
+static double analyze_get_percentile(const u_int64_t* histogram, u_int32_t bin_count,
+  u_int64_t count, u_int32_t percent)
+{
+  // Declare needed variables
+  double target = (double)count * percent / 100;
+  u_int64_t seen = 0;
+
+  // Walk the bins until enough values were seen
+  for (u_int32_t i = 0; i < bin_count; i++)
+  {
+    if (histogram[i] > 0 && seen + histogram[i] >= target)
+    {
+      return i + (target - seen) / histogram[i];
+    }
+    seen += histogram[i];
+  }
+
+  return bin_count;
+}
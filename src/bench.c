@@ -0,0 +1,718 @@
+/*
+ * Copyright (C) 2021 Stonyx
+ * http://www.stonyx.com
+ *
+ * Copyright (C) 2020 Guillaume Valadon
+ * guillaume@valadon.net
+ */
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "it8528_utils.h"
+#include "it8528_cache.h"
+#include "it8528_transport.h"
+#include "it8528_emulator.h"
+#include "it8528_trace.h"
+#include "it8528_lock.h"
+#include "it8528.h"
+#include "panq_shm.h"
+#include "bench.h"
+
+// Define the structure holding the state of a shared memory reader thread
+struct bench_shm_reader
+{
+  pthread_t thread;
+  const char* name;
+  u_int64_t nanoseconds;
+  u_int64_t failures;
+};
+
+// Define the structure holding the result of a protocol benchmark
+struct bench_result
+{
+  const char* name;
+  u_int32_t iterations;
+  u_int32_t failures;
+  u_int64_t p50;
+  u_int64_t p99;
+  u_int64_t p999;
+  double mean;
+  double throughput;
+};
+
+// Define the protocol benchmarks
+#define BENCH_PROTOCOL_READ 0
+#define BENCH_PROTOCOL_WRITE 1
+#define BENCH_PROTOCOL_SPEED 2
+#define BENCH_PROTOCOL_SWEEP 3
+#define BENCH_PROTOCOL_COUNT 4
+
+// Define the protocol benchmark names
+static const char* bench_protocol_names[] = { "read", "write", "rpm_read", "sweep" };
+
+// Declare the flag telling the shared memory writer thread to stop
+static volatile int bench_shm_stop;
+
+// Declare functions
+static u_int64_t bench_get_time(void);
+static u_int64_t bench_lock_run(u_int32_t acquisitions);
+static void* bench_shm_write(void* argument);
+static void* bench_shm_read(void* argument);
+static void bench_protocol_run(u_int8_t benchmark, u_int32_t iterations, u_int64_t* latencies,
+  struct bench_result* result);
+static int bench_compare_u64(const void* a, const void* b);
+
+// Function called to measure the cost of reading the shared memory region with a growing number of
+//   readers while a writer keeps publishing, the cost per read should stay flat since readers
+//   never write to the region
+int8_t bench_shm(u_int32_t max_readers)
+{
+  // Declare needed variables
+  char name[64];
+  struct panq_shm shm;
+  pthread_t writer;
+  struct bench_shm_reader* readers;
+
+  // Create a private region so that a running daemon isn't disturbed
+  snprintf(name, sizeof(name), "%s-bench-%d", PANQ_SHM_NAME, getpid());
+  if (panq_shm_create(name, &shm) != 0)
+  {
+    fprintf(stderr, "bench_shm: panq_shm_create() failed!\n");
+    return -1;
+  }
+
+  // Allocate the readers
+  readers = calloc(max_readers, sizeof(*readers));
+  if (readers == NULL)
+  {
+    panq_shm_destroy(name, &shm);
+    return -1;
+  }
+
+  // Start the writer
+  bench_shm_stop = 0;
+  if (pthread_create(&writer, NULL, bench_shm_write, &shm) != 0)
+  {
+    fprintf(stderr, "bench_shm: pthread_create() failed!\n");
+    free(readers);
+    panq_shm_destroy(name, &shm);
+    return -1;
+  }
+
+  // Run the readers, doubling their number each round
+  printf("%8s %12s %12s\n", "readers", "ns/read", "failures");
+  for (u_int32_t count = 1; count <= max_readers; count *= 2)
+  {
+    // Declare needed variables
+    u_int64_t nanoseconds = 0;
+    u_int64_t failures = 0;
+    u_int32_t started = 0;
+
+    // Start the readers
+    for (u_int32_t i = 0; i < count; i++)
+    {
+      readers[i].name = name;
+      if (pthread_create(&readers[i].thread, NULL, bench_shm_read, &readers[i]) != 0)
+      {
+        fprintf(stderr, "bench_shm: pthread_create() failed!\n");
+        break;
+      }
+      started++;
+    }
+
+    // Wait for the readers and add up their results
+    for (u_int32_t i = 0; i < started; i++)
+    {
+      pthread_join(readers[i].thread, NULL);
+      nanoseconds += readers[i].nanoseconds;
+      failures += readers[i].failures;
+    }
+
+    // Print the average cost of a read
+    if (started > 0)
+    {
+      printf("%8u %12.1f %12llu\n", started,
+        (double)nanoseconds / ((u_int64_t)started * BENCH_SHM_READS),
+        (unsigned long long)failures);
+    }
+  }
+
+  // Stop the writer and clean up
+  bench_shm_stop = 1;
+  pthread_join(writer, NULL);
+  free(readers);
+  panq_shm_destroy(name, &shm);
+
+  return 0;
+}
+
+// Function called to measure the cost of a single port access and of a complete register read
+//   with every transport that can be opened, restoring the open transport afterwards
+int8_t bench_transport(void)
+{
+  // Declare needed variables
+  const struct it8528_transport* saved = it8528_transport;
+  u_int8_t byte;
+
+  // Print the header
+  printf("%-10s %12s %16s\n", "transport", "ns/byte", "ns/transaction");
+
+  // Loop through the transports
+  for (u_int8_t i = 0; it8528_transports[i] != NULL; i++)
+  {
+    // Open the transport, skipping the ones that aren't available here
+    if (it8528_open_transport(it8528_transports[i]->name) != 0)
+    {
+      printf("%-10s %12s %16s\n", it8528_transports[i]->name, "-", "-");
+      continue;
+    }
+
+    // Make sure there is a chip behind the transport
+    if (it8528_check_if_present() != 0)
+    {
+      printf("%-10s %12s %16s\n", it8528_transports[i]->name, "no chip", "-");
+      continue;
+    }
+
+    // Time reads of the status port
+    u_int64_t start = bench_get_time();
+    for (u_int32_t j = 0; j < BENCH_TRANSPORT_BYTES; j++)
+    {
+      it8528_inb(IT8528_COMM_PORT_2);
+    }
+    u_int64_t byte_nanoseconds = bench_get_time() - start;
+
+    // Time reads of the first temperature register
+    u_int32_t failures = 0;
+    start = bench_get_time();
+    for (u_int32_t j = 0; j < BENCH_TRANSPORT_TRANSACTIONS; j++)
+    {
+      if (it8528_get_byte(0x00, 0x06, &byte) != 0)
+      {
+        failures++;
+      }
+    }
+    u_int64_t transaction_nanoseconds = bench_get_time() - start;
+
+    // Print the results
+    printf("%-10s %12.1f %16.1f", it8528_transports[i]->name,
+      (double)byte_nanoseconds / BENCH_TRANSPORT_BYTES,
+      (double)transaction_nanoseconds / BENCH_TRANSPORT_TRANSACTIONS);
+    if (failures > 0)
+    {
+      printf(" (%u failures)", failures);
+    }
+    printf("\n");
+  }
+
+  // Restore the transport that was open
+  it8528_close_transport();
+  if (saved->open != NULL && it8528_open_transport(saved->name) != 0)
+  {
+    return -1;
+  }
+
+  return 0;
+}
+
+// Function called to measure the latency percentiles and throughput of single reads, writes,
+//   16 bit RPM reads, and full sensor sweeps against the emulated chip and save the results as
+//   JSON so that regressions in the hot path are visible
+int8_t bench_protocol(u_int32_t iterations, u_int64_t delay, const char* output_path)
+{
+  // Declare needed variables
+  struct bench_result results[BENCH_PROTOCOL_COUNT];
+  u_int64_t* latencies;
+
+  // Open the emulated chip with the requested response delay
+  if (it8528_open_transport("emulated") != 0)
+  {
+    fprintf(stderr, "bench_protocol: it8528_open_transport() failed!\n");
+    return -1;
+  }
+  it8528_emulator_set_delays(delay, delay);
+
+  // Disable the cache so that every operation reaches the chip
+  for (u_int8_t i = 0; i < IT8528_CACHE_CLASSES; i++)
+  {
+    it8528_cache_set_max_age(i, 0);
+  }
+
+  // Allocate the latencies
+  latencies = malloc(iterations * sizeof(*latencies));
+  if (latencies == NULL)
+  {
+    return -1;
+  }
+
+  // Run the benchmarks
+  printf("%-10s %10s %10s %10s %10s %12s\n", "benchmark", "p50 ns", "p99 ns", "p999 ns", "mean ns",
+    "ops/s");
+  for (u_int8_t i = 0; i < BENCH_PROTOCOL_COUNT; i++)
+  {
+    // Run the benchmark
+    bench_protocol_run(i, iterations, latencies, &results[i]);
+
+    // Print the result
+    printf("%-10s %10llu %10llu %10llu %10.0f %12.0f", results[i].name,
+      (unsigned long long)results[i].p50, (unsigned long long)results[i].p99,
+      (unsigned long long)results[i].p999, results[i].mean, results[i].throughput);
+    if (results[i].failures > 0)
+    {
+      printf(" (%u failures)", results[i].failures);
+    }
+    printf("\n");
+  }
+
+  free(latencies);
+
+  // Check if the results should be saved
+  if (output_path == NULL)
+  {
+    return 0;
+  }
+
+  // Save the results
+  FILE* file = fopen(output_path, "w");
+  if (file == NULL)
+  {
+    fprintf(stderr, "bench_protocol: fopen() failed!\n");
+    return -1;
+  }
+  fprintf(file, "{\n  \"transport\": \"emulated\",\n  \"delay_ns\": %llu,\n",
+    (unsigned long long)delay);
+  fprintf(file, "  \"iterations\": %u,\n  \"results\": [\n", iterations);
+  for (u_int8_t i = 0; i < BENCH_PROTOCOL_COUNT; i++)
+  {
+    fprintf(file, "    { \"name\": \"%s\", \"failures\": %u, \"p50_ns\": %llu, "
+      "\"p99_ns\": %llu, \"p999_ns\": %llu, \"mean_ns\": %.1f, \"ops_per_second\": %.1f }%s\n",
+      results[i].name, results[i].failures, (unsigned long long)results[i].p50,
+      (unsigned long long)results[i].p99, (unsigned long long)results[i].p999, results[i].mean,
+      results[i].throughput, i + 1 < BENCH_PROTOCOL_COUNT ? "," : "");
+  }
+  fprintf(file, "  ]\n}\n");
+  fclose(file);
+
+  return 0;
+}
+
+// Function called to measure the overhead of the transaction counters on register reads from the
+//   emulated chip, rounds with the counters off and on alternate so that drifts in the speed of
+//   the machine hit both the same way, the probes can't be turned off at run time but are a nop
+//   until a tracer attaches to them
+int8_t bench_trace(u_int32_t iterations)
+{
+  // Declare needed variables
+  u_int64_t nanoseconds[2] = { 0, 0 };
+  u_int32_t failures = 0;
+  u_int8_t byte;
+
+  // Open the emulated chip without any response delay so that the overhead isn't hidden
+  if (it8528_open_transport("emulated") != 0)
+  {
+    fprintf(stderr, "bench_trace: it8528_open_transport() failed!\n");
+    return -1;
+  }
+  it8528_emulator_set_delays(0, 0);
+
+  // Disable the cache so that every read reaches the chip
+  for (u_int8_t i = 0; i < IT8528_CACHE_CLASSES; i++)
+  {
+    it8528_cache_set_max_age(i, 0);
+  }
+
+  // Time the reads with the counters off and on in alternating rounds
+  for (u_int32_t round = 0; round < BENCH_TRACE_ROUNDS * 2; round++)
+  {
+    u_int8_t enabled = round % 2;
+    it8528_trace_set_enabled(enabled);
+    u_int64_t start = bench_get_time();
+    for (u_int32_t i = 0; i < iterations; i++)
+    {
+      if (it8528_get_byte(0x00, 0x06, &byte) != 0)
+      {
+        failures++;
+      }
+    }
+    nanoseconds[enabled] += bench_get_time() - start;
+  }
+  it8528_trace_set_enabled(1);
+
+  // Time the counter update of a transaction on its own
+  u_int64_t start = bench_get_time();
+  for (u_int32_t i = 0; i < iterations; i++)
+  {
+    it8528_trace_end(IT8528_TRACE_OP_READ, 0x0600, it8528_trace_begin(), 0);
+  }
+  u_int64_t update = bench_get_time() - start;
+
+  // Print the results
+  double off = (double)nanoseconds[0] / ((u_int64_t)iterations * BENCH_TRACE_ROUNDS);
+  double on = (double)nanoseconds[1] / ((u_int64_t)iterations * BENCH_TRACE_ROUNDS);
+  printf("probes              %s\n", IT8528_TRACE_SDT ? "sdt" : "none");
+  printf("counter update ns   %.1f\n", (double)update / iterations);
+  printf("read counters off   %.1f ns\n", off);
+  printf("read counters on    %.1f ns\n", on);
+  printf("overhead            %.1f ns (%.2f%%)\n", on - off, off > 0 ? (on - off) * 100 / off : 0);
+  if (failures > 0)
+  {
+    printf("failures            %u\n", failures);
+  }
+
+  return 0;
+}
+
+// Function called to measure how long reads take and how they fail while the emulated chip is
+//   wedged, and how long the circuit breaker takes to let reads through again once it recovers
+int8_t bench_fault(u_int32_t reads)
+{
+  // Declare needed variables
+  u_int32_t counts[-IT8528_ERROR_RESYNC + 1];
+  u_int64_t max_nanoseconds[-IT8528_ERROR_RESYNC + 1];
+  struct it8528_fault_stats stats;
+  u_int64_t healthy_max = 0;
+  u_int32_t attempts = 0;
+  u_int8_t byte = 0;
+  int8_t ret = -1;
+  struct timespec ts = {
+    .tv_sec = 0,
+    .tv_nsec = BENCH_FAULT_RETRY_INTERVAL
+  };
+
+  // Open the emulated chip without any response delay
+  if (it8528_open_transport("emulated") != 0)
+  {
+    fprintf(stderr, "bench_fault: it8528_open_transport() failed!\n");
+    return -1;
+  }
+  it8528_emulator_set_delays(0, 0);
+
+  // Disable the cache so that every read reaches the chip
+  for (u_int8_t i = 0; i < IT8528_CACHE_CLASSES; i++)
+  {
+    it8528_cache_set_max_age(i, 0);
+  }
+
+  // Time the reads from the healthy chip
+  for (u_int32_t i = 0; i < reads; i++)
+  {
+    u_int64_t start = bench_get_time();
+    it8528_get_byte(0x00, 0x06, &byte);
+    u_int64_t elapsed = bench_get_time() - start;
+    if (elapsed > healthy_max)
+    {
+      healthy_max = elapsed;
+    }
+  }
+
+  // Time the reads from the wedged chip and sort them by error code
+  memset(counts, 0, sizeof(counts));
+  memset(max_nanoseconds, 0, sizeof(max_nanoseconds));
+  it8528_emulator_set_wedged(1);
+  for (u_int32_t i = 0; i < reads; i++)
+  {
+    u_int64_t start = bench_get_time();
+    ret = it8528_get_byte(0x00, 0x06, &byte);
+    u_int64_t elapsed = bench_get_time() - start;
+    u_int8_t index = ret <= 0 && ret >= IT8528_ERROR_RESYNC ? -ret : -IT8528_ERROR;
+    counts[index]++;
+    if (elapsed > max_nanoseconds[index])
+    {
+      max_nanoseconds[index] = elapsed;
+    }
+  }
+
+  // Unwedge the chip and retry until a read gets through
+  it8528_emulator_set_wedged(0);
+  u_int64_t start = bench_get_time();
+  while (attempts < BENCH_FAULT_MAX_ATTEMPTS)
+  {
+    attempts++;
+    ret = it8528_get_byte(0x00, 0x06, &byte);
+    if (ret == 0)
+    {
+      break;
+    }
+    nanosleep(&ts, NULL);
+  }
+  u_int64_t recovery = bench_get_time() - start;
+  it8528_get_fault_stats(&stats);
+
+  // Print the results
+  printf("transaction timeout    %u ms\n", IT8528_DEFAULT_TRANSACTION_TIMEOUT);
+  printf("healthy read max       %.1f us\n", healthy_max / 1e3);
+  for (u_int8_t i = 0; i <= -IT8528_ERROR_RESYNC; i++)
+  {
+    if (counts[i] > 0)
+    {
+      printf("wedged read, %s: %u, max %.3f ms\n", i == 0 ? "success" : it8528_strerror(-i),
+        counts[i], max_nanoseconds[i] / 1e6);
+    }
+  }
+  printf("breaker trips          %llu\n", (unsigned long long)stats.breaker_trips);
+  if (ret == 0)
+  {
+    printf("recovered after        %.3f s, %u attempts\n", recovery / 1e9, attempts);
+    printf("drained bytes          %llu\n", (unsigned long long)stats.drained_bytes);
+    printf("read after recovery    %u (expected %u)\n", byte,
+      it8528_emulator_get_register(0x0600));
+  }
+  else
+  {
+    printf("not recovered after    %.3f s, %s\n", recovery / 1e9, it8528_strerror(ret));
+  }
+
+  return 0;
+}
+
+// Function called to check that a process killed while waiting for the lock in the control class
+//   doesn't hold back the telemetry requests that come after it, the telemetry acquisitions are
+//   timed before and after a waiter is killed on a private shared memory lock
+int8_t bench_lock(u_int32_t acquisitions)
+{
+  // Declare needed variables
+  u_int64_t before;
+  u_int64_t after;
+  u_int8_t byte = 0;
+  int fds[2];
+  pid_t pid;
+  struct timespec ts = {
+    .tv_sec = 0,
+    .tv_nsec = BENCH_LOCK_WAITER_DELAY
+  };
+
+  // Open a lock no other process uses
+  if (it8528_lock_open("private") != 0)
+  {
+    fprintf(stderr, "bench_lock: it8528_lock_open() failed!\n");
+    return -1;
+  }
+
+  // Time the acquisitions without any waiter
+  before = bench_lock_run(acquisitions);
+
+  // Start a child that waits for the lock in the control class once we hold it
+  if (pipe(fds) != 0)
+  {
+    fprintf(stderr, "bench_lock: pipe() failed!\n");
+    return -1;
+  }
+  pid = fork();
+  if (pid < 0)
+  {
+    fprintf(stderr, "bench_lock: fork() failed!\n");
+    close(fds[0]);
+    close(fds[1]);
+    return -1;
+  }
+  if (pid == 0)
+  {
+    close(fds[1]);
+    if (read(fds[0], &byte, 1) == 1)
+    {
+      it8528_lock_acquire(IT8528_LOCK_CLASS_CONTROL);
+    }
+    _exit(EXIT_SUCCESS);
+  }
+  close(fds[0]);
+  if (it8528_lock_acquire(IT8528_LOCK_CLASS_TELEMETRY) != 0)
+  {
+    fprintf(stderr, "bench_lock: it8528_lock_acquire() failed!\n");
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    close(fds[1]);
+    return -1;
+  }
+  if (write(fds[1], &byte, 1) != 1)
+  {
+    fprintf(stderr, "bench_lock: write() failed!\n");
+  }
+  close(fds[1]);
+
+  // Kill the child while it waits and let the lock go
+  nanosleep(&ts, NULL);
+  kill(pid, SIGKILL);
+  waitpid(pid, NULL, 0);
+  it8528_lock_release();
+
+  // Time the acquisitions after the waiter died
+  after = bench_lock_run(acquisitions);
+  it8528_lock_close();
+
+  // Print the results
+  printf("turn timeout           %u ms\n", IT8528_LOCK_TURN_TIMEOUT);
+  printf("telemetry max before   %.3f ms\n", before / 1e6);
+  printf("telemetry max after    %.3f ms\n", after / 1e6);
+  printf("dead waiter ignored    %s\n",
+    after < (u_int64_t)IT8528_LOCK_TURN_TIMEOUT * 1000000 ? "yes" : "no");
+
+  return 0;
+}
+
+// Function called to run one protocol benchmark and compute its percentiles
+static void bench_protocol_run(u_int8_t benchmark, u_int32_t iterations, u_int64_t* latencies,
+  struct bench_result* result)
+{
+  // Declare needed variables
+  struct it8528_snapshot snapshot;
+  u_int64_t total = 0;
+  u_int16_t speed;
+  u_int8_t byte;
+  int8_t ret = 0;
+
+  memset(result, 0, sizeof(*result));
+  result->name = bench_protocol_names[benchmark];
+  result->iterations = iterations;
+
+  // Time every operation on its own
+  u_int64_t start = bench_get_time();
+  for (u_int32_t i = 0; i < iterations; i++)
+  {
+    u_int64_t operation_start = bench_get_time();
+    switch (benchmark)
+    {
+      case BENCH_PROTOCOL_READ:
+        ret = it8528_get_byte(0x00, 0x06, &byte);
+        break;
+      case BENCH_PROTOCOL_WRITE:
+        ret = it8528_set_byte(0x2E, 0x02, i & 0xFF);
+        break;
+      case BENCH_PROTOCOL_SPEED:
+        ret = it8528_get_fan_speed(0, &speed);
+        break;
+      case BENCH_PROTOCOL_SWEEP:
+        ret = it8528_get_snapshot(&snapshot);
+        break;
+    }
+    latencies[i] = bench_get_time() - operation_start;
+    if (ret != 0)
+    {
+      result->failures++;
+    }
+  }
+  u_int64_t elapsed = bench_get_time() - start;
+
+  // Compute the percentiles, mean, and throughput
+  qsort(latencies, iterations, sizeof(*latencies), bench_compare_u64);
+  for (u_int32_t i = 0; i < iterations; i++)
+  {
+    total += latencies[i];
+  }
+  result->p50 = latencies[(u_int64_t)iterations * 50 / 100];
+  result->p99 = latencies[(u_int64_t)iterations * 99 / 100];
+  result->p999 = latencies[(u_int64_t)iterations * 999 / 1000];
+  result->mean = (double)total / iterations;
+  result->throughput = elapsed > 0 ? iterations * 1e9 / elapsed : 0;
+}
+
+// Function called to take and release the lock in the telemetry class a number of times and get
+//   the longest time in nanoseconds it took to take it
+static u_int64_t bench_lock_run(u_int32_t acquisitions)
+{
+  // Declare needed variables
+  u_int64_t max = 0;
+
+  for (u_int32_t i = 0; i < acquisitions; i++)
+  {
+    u_int64_t start = bench_get_time();
+    it8528_lock_acquire(IT8528_LOCK_CLASS_TELEMETRY);
+    u_int64_t elapsed = bench_get_time() - start;
+    it8528_lock_release();
+    if (elapsed > max)
+    {
+      max = elapsed;
+    }
+  }
+
+  return max;
+}
+
+// Function called to get the monotonic time in nanoseconds
+static u_int64_t bench_get_time(void)
+{
+  // Declare needed variables
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (u_int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Function called by the shared memory writer thread to publish new data at a steady rate
+static void* bench_shm_write(void* argument)
+{
+  // Declare needed variables
+  struct panq_shm* shm = argument;
+  struct panq_shm_data data;
+  struct timespec ts = {
+    .tv_sec = 0,
+    .tv_nsec = BENCH_SHM_PUBLISH_INTERVAL
+  };
+
+  // Publish until told to stop
+  memset(&data, 0, sizeof(data));
+  while (!bench_shm_stop)
+  {
+    data.samples++;
+    data.time = bench_get_time();
+    panq_shm_publish(shm, &data);
+    nanosleep(&ts, NULL);
+  }
+
+  return NULL;
+}
+
+// Function called by a shared memory reader thread to time its reads
+static void* bench_shm_read(void* argument)
+{
+  // Declare needed variables
+  struct bench_shm_reader* reader = argument;
+  struct panq_shm shm;
+  struct panq_shm_data data;
+
+  // Open the region like any other consumer would
+  reader->failures = 0;
+  reader->nanoseconds = 0;
+  if (panq_shm_open(reader->name, &shm) != 0)
+  {
+    reader->failures = BENCH_SHM_READS;
+    return NULL;
+  }
+
+  // Time the reads using the CPU time of the thread so that readers sharing a core with each
+  //   other don't count the time they spent waiting for it
+  struct timespec start;
+  struct timespec end;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+  for (u_int32_t i = 0; i < BENCH_SHM_READS; i++)
+  {
+    if (panq_shm_read(&shm, &data) != 0)
+    {
+      reader->failures++;
+    }
+  }
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+  reader->nanoseconds = (u_int64_t)(end.tv_sec - start.tv_sec) * 1000000000 + end.tv_nsec -
+    start.tv_nsec;
+
+  panq_shm_close(&shm);
+
+  return NULL;
+}
+
+// Function called to compare two unsigned 64 bit integers when sorting
+static int bench_compare_u64(const void* a, const void* b)
+{
+  // Declare needed variables
+  u_int64_t value_a = *(const u_int64_t*)a;
+  u_int64_t value_b = *(const u_int64_t*)b;
+
+  return (value_a > value_b) - (value_a < value_b);
+}
@@ -7,6 +7,8 @@
  */
 
 #include <dlfcn.h>
+#include <getopt.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -14,105 +16,1359 @@
 #include <time.h>
 #include <unistd.h>
 #include "it8528_utils.h"
+#include "it8528_cache.h"
+#include "it8528_lock.h"
+#include "it8528_transport.h"
 #include "it8528.h"
+#include "it8528_profile.h"
+#include "panq_shm.h"
+#include "daemon.h"
+#include "exporter.h"
+#include "bench.h"
+#include "thermal_model.h"
+#include "fan_control.h"
+#include "logger.h"
+#include "history.h"
+#include "hwmon.h"
+#include "discover.h"
+#include "realtime.h"
+#include "analyze.h"
 #include "commands.h"
 
+// Declare functions
+static int get_command_length(int argc, char** argv);
+static int8_t run_command(int argc, char** argv);
+static int8_t parse_name(const char* text, const char* prefix, u_int8_t* number, char** rest);
+static int8_t parse_speed(const char* text, u_int8_t* speed);
+static int8_t enter_realtime(void);
+static const char* get_socket_path(void);
+
+// Function called to get access to the IT8528 chip, only the first call does any work so that
+//   commands which may be answered by a running daemon only pay for it when needed and a batch
+//   of commands only pays for it once, a failure is remembered as well
+int8_t access_chip(void)
+{
+  // Declare needed variables
+  static int8_t accessed = 0;
+
+  // Check if we already tried to access the chip
+  if (accessed != 0)
+  {
+    return accessed > 0 ? 0 : -1;
+  }
+  accessed = -1;
+
+  // Load the model profile
+  if (load_profile() != 0)
+  {
+    return -1;
+  }
+
+  // Open the selected transport, or the first one that works if none was selected
+  if (it8528_open_transport(getenv("PANQ_TRANSPORT")) != 0)
+  {
+    fprintf(stderr, "access_chip: it8528_open_transport() failed!\n");
+    return -1;
+  }
+
+  // Check if a group should be able to take the lock as well
+  char* lock_group = getenv("PANQ_LOCK_GROUP");
+  if (lock_group != NULL && it8528_lock_set_group(lock_group) != 0)
+  {
+    fprintf(stderr, "Invalid lock group!\n");
+    return -1;
+  }
+
+  // Open the lock shared with the other processes talking to the chip, the emulated chip gets a
+  //   lock of its own by default so that it never waits for the processes using the real one
+  char* lock_name = getenv("PANQ_LOCK");
+  if (lock_name == NULL && it8528_transport == &it8528_emulated_transport)
+  {
+    lock_name = "private";
+  }
+  if (it8528_lock_open(lock_name) != 0)
+  {
+    fprintf(stderr, "Lock couldn't be opened, use shm, flock, private, none, or auto and set "
+      "PANQ_LOCK_GROUP to share the lock with the other users running panq!\n");
+    return -1;
+  }
+
+  // Check if the IT8528 chip is not present
+  if (it8528_check_if_present() != 0)
+  {
+    fprintf(stderr, "IT8528 chip not found!\n");
+    return -1;
+  }
+
+  // Check if a wait mode was selected
+  char* wait_mode_name = getenv("PANQ_WAIT_MODE");
+  if (wait_mode_name != NULL)
+  {
+    // Declare needed variables
+    u_int8_t wait_mode;
+
+    // Set the wait mode
+    if (it8528_parse_wait_mode(wait_mode_name, &wait_mode) != 0)
+    {
+      fprintf(stderr, "Invalid wait mode, use latency, balanced, or cpu!\n");
+      return -1;
+    }
+    it8528_set_wait_mode(wait_mode);
+  }
+
+  // Check if the cache max ages were changed
+  char* cache_max_ages = getenv("PANQ_CACHE_MAX_AGE");
+  if (cache_max_ages != NULL && it8528_cache_parse_max_ages(cache_max_ages) != 0)
+  {
+    fprintf(stderr, "Invalid cache max ages, use a list like temperature=1000,fan_speed=250!\n");
+    return -1;
+  }
+
+  // Check if the transaction timeout was changed
+  char* transaction_timeout = getenv("PANQ_TRANSACTION_TIMEOUT");
+  if (transaction_timeout != NULL)
+  {
+    // Declare needed variables
+    char* end;
+    unsigned long timeout = strtoul(transaction_timeout, &end, 10);
+
+    // Set the timeout
+    if (*transaction_timeout == '\0' || *end != '\0' || timeout == 0 ||
+      timeout > IT8528_MAX_TRANSACTION_TIMEOUT)
+    {
+      fprintf(stderr, "Invalid transaction timeout, use a number of milliseconds up to %u!\n",
+        IT8528_MAX_TRANSACTION_TIMEOUT);
+      return -1;
+    }
+    it8528_set_transaction_timeout(timeout);
+  }
+
+  // Check if the fan register refresh period was changed
+  char* fan_refresh = getenv("PANQ_FAN_REFRESH");
+  if (fan_refresh != NULL)
+  {
+    // Declare needed variables
+    char* end;
+    unsigned long refresh = strtoul(fan_refresh, &end, 10);
+
+    // Set the refresh period
+    if (*fan_refresh == '\0' || *end != '\0')
+    {
+      fprintf(stderr, "Invalid fan refresh period, use a number of milliseconds!\n");
+      return -1;
+    }
+    it8528_set_fan_refresh(refresh);
+  }
+
+  accessed = 1;
+
+  return 0;
+}
+
+// Function called to load the model profile from PANQ_MODEL_CONF or the default model.conf file,
+//   only the default file may be missing
+int8_t load_profile(void)
+{
+  // Declare needed variables
+  static u_int8_t loaded = 0;
+  char* path = getenv("PANQ_MODEL_CONF");
+
+  // Check if we already loaded the profile
+  if (loaded)
+  {
+    return 0;
+  }
+
+  // Load the profile
+  if (it8528_profile_load(path != NULL ? path : IT8528_PROFILE_PATH, path != NULL) != 0)
+  {
+    fprintf(stderr, "load_profile: it8528_profile_load() failed!\n");
+    return -1;
+  }
+
+  loaded = 1;
+
+  return 0;
+}
+
+// Function called to check if the arguments are a list of commands that can be run one after the
+//   other in the same process, tempN, fanN, fanN speed_percentage, fanN=speed_percentage,
+//   fans N=speed_percentage..., and log
+u_int8_t is_command_list(int argc, char** argv)
+{
+  for (int i = 0; i < argc;)
+  {
+    // Declare needed variables
+    int length = get_command_length(argc - i, argv + i);
+
+    if (length == 0)
+    {
+      return 0;
+    }
+    i += length;
+  }
+
+  return argc > 0;
+}
+
+// Function called to run a list of commands one after the other so that the process startup, the
+//   capability check, and the chip probe are paid once for all of them, every command is checked
+//   before any is run unless replies is set, in which case every command prints exactly one line,
+//   its result, ok, or error followed by the command, and an unknown command is only an error
+int8_t run_commands(int argc, char** argv, u_int8_t replies)
+{
+  // Declare needed variables
+  int8_t ret = 0;
+
+  // Make sure every command is known before running any
+  if (!replies && !is_command_list(argc, argv))
+  {
+    fprintf(stderr, "Unknown command!\n");
+    return -1;
+  }
+
+  // Loop through the commands
+  for (int i = 0; i < argc;)
+  {
+    // Declare needed variables
+    int length = get_command_length(argc - i, argv + i);
+    int8_t result;
+
+    // Run the command, an unknown one only takes its own argument
+    if (length == 0)
+    {
+      fprintf(stderr, "Unknown command %s!\n", argv[i]);
+      result = -1;
+      length = 1;
+    }
+    else
+    {
+      result = run_command(length, argv + i);
+    }
+
+    // Reply for the commands that don't print anything on success and for the failures
+    if (replies && result != 0)
+    {
+      printf("error %s\n", argv[i]);
+    }
+    else if (replies && (strcmp(argv[i], "fans") == 0 || length > 1 || strchr(argv[i], '=')))
+    {
+      printf("ok\n");
+    }
+    if (result != 0)
+    {
+      ret = -1;
+    }
+
+    i += length;
+  }
+
+  return ret;
+}
+
+// Function called to run the analyze command which summarizes logs written by the log command,
+//   the original epoch,rpm,temp rows, the rows of panq log, or the CSV of panq log --interval,
+//   into windows of time without touching the chip
+void analyze_command(int argc, char** argv)
+{
+  // Declare needed variables
+  static const struct option options[] = {
+    { "window", required_argument, NULL, 'w' },
+    { "threshold", required_argument, NULL, 't' },
+    { "max-gap", required_argument, NULL, 'g' },
+    { "threads", required_argument, NULL, 'j' },
+    { NULL, 0, NULL, 0 }
+  };
+  struct analyze_config config = {
+    .window = ANALYZE_DEFAULT_WINDOW,
+    .threshold = ANALYZE_DEFAULT_THRESHOLD,
+    .max_gap = ANALYZE_DEFAULT_MAX_GAP,
+    .threads = 0
+  };
+  struct analyze_stats stats;
+  unsigned long threads;
+  long processors;
+  char* end;
+  int option;
+
+  // Parse the options
+  while ((option = getopt_long(argc, argv, "w:t:g:j:", options, NULL)) != -1)
+  {
+    switch (option)
+    {
+      case 'w':
+        if (history_parse_duration(optarg, &config.window) != 0)
+        {
+          fprintf(stderr, "Invalid window, use a number followed by ms, s, m, h, d, or w!\n");
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 't':
+        config.threshold = strtod(optarg, &end);
+        if (end == optarg || *end != '\0')
+        {
+          fprintf(stderr, "Invalid threshold, use a number of degrees!\n");
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'g':
+        if (history_parse_duration(optarg, &config.max_gap) != 0)
+        {
+          fprintf(stderr, "Invalid gap, use a number followed by ms, s, m, h, d, or w!\n");
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'j':
+        threads = strtoul(optarg, &end, 10);
+        if (end == optarg || *end != '\0' || threads == 0 || threads > ANALYZE_MAX_THREADS)
+        {
+          fprintf(stderr, "Invalid number of threads, use 1 to %u!\n", ANALYZE_MAX_THREADS);
+          exit(EXIT_FAILURE);
+        }
+        config.threads = threads;
+        break;
+      default:
+        exit(EXIT_FAILURE);
+    }
+  }
+
+  // Make sure logs were supplied
+  if (optind == argc)
+  {
+    fprintf(stderr, "Usage: panq analyze [--window 1h] [--threshold degrees] [--max-gap 10m] "
+      "[--threads N] log_path...\n");
+    exit(EXIT_FAILURE);
+  }
+
+  // Use a thread per processor by default
+  if (config.threads == 0)
+  {
+    processors = sysconf(_SC_NPROCESSORS_ONLN);
+    config.threads = processors < 1 ? 1 : processors > ANALYZE_MAX_THREADS ?
+      ANALYZE_MAX_THREADS : processors;
+  }
+
+  // Analyze the logs and print how fast it went
+  if (analyze_run(argv + optind, argc - optind, &config, stdout, &stats) != 0)
+  {
+    fprintf(stderr, "analyze_command: analyze_run() failed!\n");
+    exit(EXIT_FAILURE);
+  }
+  analyze_print_stats(&stats, stderr);
+}
+
+// Function called to run the batch command which runs the commands read from the standard input,
+//   any number per line, printing one line per command as soon as it is done so that panq can
+//   run as a coprocess, empty lines and lines starting with # are skipped
+void batch_command(void)
+{
+  // Declare needed variables
+  char* arguments[COMMANDS_MAX_ARGUMENTS];
+  char* line = NULL;
+  size_t size = 0;
+  int8_t ret = 0;
+
+  // Flush every reply as soon as its line is complete
+  setvbuf(stdout, NULL, _IOLBF, 0);
+
+  // Loop through the lines
+  while (getline(&line, &size, stdin) >= 0)
+  {
+    // Declare needed variables
+    int count = 0;
+
+    // Split the line into arguments
+    for (char* token = strtok(line, " \t\r\n"); token != NULL; token = strtok(NULL, " \t\r\n"))
+    {
+      if (count == COMMANDS_MAX_ARGUMENTS)
+      {
+        count = -1;
+        break;
+      }
+      arguments[count++] = token;
+    }
+
+    // Check if the line is too long, empty, or a comment
+    if (count < 0)
+    {
+      fprintf(stderr, "Too many arguments!\n");
+      printf("error %s\n", arguments[0]);
+      ret = -1;
+      continue;
+    }
+    if (count == 0 || arguments[0][0] == '#')
+    {
+      continue;
+    }
+
+    // Run the commands of the line
+    if (run_commands(count, arguments, 1) != 0)
+    {
+      ret = -1;
+    }
+  }
+  free(line);
+
+  // Exit with a failure if any command failed
+  if (ret != 0)
+  {
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Function called to run the bench command which benchmarks the protocol layer against the
+//   emulated chip
+void bench_command(int argc, char** argv)
+{
+  // Declare needed variables
+  static const struct option options[] = {
+    { "delay", required_argument, NULL, 'd' },
+    { "iterations", required_argument, NULL, 'i' },
+    { "output", required_argument, NULL, 'o' },
+    { NULL, 0, NULL, 0 }
+  };
+  unsigned long long delay = 0;
+  unsigned long iterations = BENCH_PROTOCOL_ITERATIONS;
+  char* output_path = NULL;
+  char* end;
+  int option;
+
+  // Parse the options
+  while ((option = getopt_long(argc, argv, "d:i:o:", options, NULL)) != -1)
+  {
+    switch (option)
+    {
+      case 'd':
+        delay = strtoull(optarg, &end, 10);
+        if (end == optarg || *end != '\0' || *optarg == '-')
+        {
+          fprintf(stderr, "Invalid delay, use a number of nanoseconds!\n");
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'i':
+        iterations = strtoul(optarg, &end, 10);
+        if (end == optarg || *end != '\0' || iterations == 0 || iterations > UINT32_MAX)
+        {
+          fprintf(stderr, "Invalid number of iterations!\n");
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'o':
+        output_path = optarg;
+        break;
+      default:
+        exit(EXIT_FAILURE);
+    }
+  }
+
+  // Run the benchmarks
+  if (bench_protocol(iterations, delay, output_path) != 0)
+  {
+    fprintf(stderr, "bench_command: bench_protocol() failed!\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Function called to run the bench-fault command which measures the reads from a wedged chip and
+//   its recovery
+void bench_fault_command(void)
+{
+  if (bench_fault(BENCH_FAULT_READS) != 0)
+  {
+    fprintf(stderr, "bench_fault_command: bench_fault() failed!\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Function called to run the bench-lock command which checks that a process killed while waiting
+//   for the lock doesn't hold back the others
+void bench_lock_command(void)
+{
+  if (bench_lock(BENCH_LOCK_ACQUISITIONS) != 0)
+  {
+    fprintf(stderr, "bench_lock_command: bench_lock() failed!\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Function called to run the bench-shm command which measures the cost of a shared memory read
+//   as the number of readers grows
+void bench_shm_command(const char* max_readers)
+{
+  // Declare needed variables
+  unsigned long readers = BENCH_SHM_DEFAULT_READERS;
+  char* end;
+
+  // Make sure the maximum number of readers is valid if one was given
+  if (max_readers != NULL)
+  {
+    readers = strtoul(max_readers, &end, 10);
+    if (end == max_readers || *end != '\0' || readers == 0 || readers > BENCH_SHM_MAX_READERS)
+    {
+      fprintf(stderr, "Invalid number of readers!\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (bench_shm(readers) != 0)
+  {
+    fprintf(stderr, "bench_shm_command: bench_shm() failed!\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Function called to run the bench-trace command which measures the overhead of the transaction
+//   counters
+void bench_trace_command(const char* iterations)
+{
+  // Declare needed variables
+  unsigned long count = BENCH_TRACE_ITERATIONS;
+  char* end;
+
+  // Make sure the number of iterations is valid if one was given
+  if (iterations != NULL)
+  {
+    count = strtoul(iterations, &end, 10);
+    if (end == iterations || *end != '\0' || count == 0 || count > UINT32_MAX)
+    {
+      fprintf(stderr, "Invalid number of iterations!\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  if (bench_trace(count) != 0)
+  {
+    fprintf(stderr, "bench_trace_command: bench_trace() failed!\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Function called to run the bench-transport command which measures the cost of every transport
+//   that can be opened
+void bench_transport_command(void)
+{
+  if (bench_transport() != 0)
+  {
+    fprintf(stderr, "bench_transport_command: bench_transport() failed!\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Function called to run the calibrate command which calibrates the handshake wait and shows how
+//   many polls and how much wall time each handshake of a read took
+void calibrate_command(void)
+{
+  // Declare needed variables
+  struct it8528_wait_calibration calibration;
+  struct it8528_handshake handshake;
+  u_int8_t byte;
+
+  // Get access to the chip
+  if (access_chip() != 0)
+  {
+    exit(EXIT_FAILURE);
+  }
+
+  // Calibrate the handshake wait
+  if (it8528_calibrate_wait(&calibration) != 0)
+  {
+    fprintf(stderr, "calibrate_command: it8528_calibrate_wait() failed!\n");
+    exit(EXIT_FAILURE);
+  }
+
+  // Print the calibration
+  printf("Handshakes:         %u\n", calibration.handshakes);
+  printf("Median polls:       %u\n", calibration.median_polls);
+  printf("Maximum polls:      %u\n", calibration.max_polls);
+  printf("Median latency:     %llu ns\n", (unsigned long long)calibration.median_nanoseconds);
+  printf("Maximum latency:    %llu ns\n", (unsigned long long)calibration.max_nanoseconds);
+  printf("Busy polls:         %u\n", calibration.spin_polls);
+
+  // Read the first temperature register with each wait mode and print the last handshake
+  for (u_int8_t mode = IT8528_WAIT_MODE_LATENCY; mode <= IT8528_WAIT_MODE_CPU; mode++)
+  {
+    it8528_set_wait_mode(mode);
+    if (it8528_get_byte(0x00, 0x06, &byte) != 0)
+    {
+      fprintf(stderr, "calibrate_command: it8528_get_byte() failed!\n");
+      exit(EXIT_FAILURE);
+    }
+    it8528_get_last_handshake(&handshake);
+    printf("%-8s handshake:  %u polls, %llu ns\n", it8528_get_wait_mode_name(mode), handshake.polls,
+      (unsigned long long)handshake.nanoseconds);
+  }
+
+  // Print the accumulated statistics
+  printf("\n");
+  it8528_print_wait_stats(stdout);
+}
+
 // Function called to run the check command
 void check_command(void)
 {
+  // Get access to the chip
+  if (access_chip() != 0)
+  {
+    exit(EXIT_FAILURE);
+  }
+
   // Check if the IT8528 chip is present
   if (it8528_check_if_present())
   {
     printf("IT8528 detected.\n");
   }
-  else
+  else
+  {
+    printf("IT8528 not detected.\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Function called to run the daemon command, a NULL socket path uses the one named by PANQ_SOCKET
+//   or the default one
+void daemon_command(const char* socket_path)
+{
+  // Declare needed variables
+  char* hwmon_path = getenv("PANQ_HWMON");
+
+  // Get access to the chip
+  if (access_chip() != 0)
+  {
+    exit(EXIT_FAILURE);
+  }
+
+  // Enter the real-time mode if one was selected
+  if (enter_realtime() != 0)
+  {
+    exit(EXIT_FAILURE);
+  }
+
+  // Check if the hwmon style tree was moved or turned off
+  if (hwmon_path == NULL)
+  {
+    hwmon_path = HWMON_PATH;
+  }
+  else if (strcmp(hwmon_path, "none") == 0)
+  {
+    hwmon_path = NULL;
+  }
+
+  // Check if the socket path was left to PANQ_SOCKET or the default
+  if (socket_path == NULL)
+  {
+    socket_path = get_socket_path();
+  }
+
+  // Run the daemon until it is told to stop, appending every sample to the history file named
+  //   by PANQ_HISTORY if there is one and writing it to the hwmon style tree
+  if (daemon_run(socket_path, getenv("PANQ_HISTORY"), hwmon_path) != 0)
+  {
+    fprintf(stderr, "daemon_command: daemon_run() failed!\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Function called to run the discover command which finds the sensors and fans that are wired up
+//   and writes the presence map used to only sample them from then on
+void discover_command(int argc, char** argv)
+{
+  // Declare needed variables
+  static const struct option options[] = {
+    { "passes", required_argument, NULL, 'p' },
+    { "interval", required_argument, NULL, 'i' },
+    { "dry-run", no_argument, NULL, 'n' },
+    { NULL, 0, NULL, 0 }
+  };
+  struct it8528_presence presence;
+  unsigned long passes = DISCOVER_DEFAULT_PASSES;
+  unsigned long interval = DISCOVER_DEFAULT_INTERVAL;
+  u_int8_t dry_run = 0;
+  char* end;
+  int option;
+
+  // Parse the options
+  while ((option = getopt_long(argc, argv, "p:i:n", options, NULL)) != -1)
+  {
+    switch (option)
+    {
+      case 'p':
+        passes = strtoul(optarg, &end, 10);
+        if (end == optarg || *end != '\0' || passes < DISCOVER_MIN_PASSES ||
+          passes > DISCOVER_MAX_PASSES)
+        {
+          fprintf(stderr, "Invalid number of passes, use %u to %u!\n", DISCOVER_MIN_PASSES,
+            DISCOVER_MAX_PASSES);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'i':
+        interval = strtoul(optarg, &end, 10);
+        if (end == optarg || *end != '\0' || interval > 60000)
+        {
+          fprintf(stderr, "Invalid interval, use a number of milliseconds up to 60000!\n");
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'n':
+        dry_run = 1;
+        break;
+      default:
+        exit(EXIT_FAILURE);
+    }
+  }
+
+  // Make sure there are no extra arguments
+  if (optind != argc)
+  {
+    fprintf(stderr, "Usage: panq discover [--passes N] [--interval milliseconds] [--dry-run]\n");
+    exit(EXIT_FAILURE);
+  }
+
+  // Get access to the chip
+  if (access_chip() != 0)
+  {
+    exit(EXIT_FAILURE);
+  }
+
+  // Sweep every sensor and fan
+  if (discover_run(passes, interval, &presence, stdout) != 0)
+  {
+    fprintf(stderr, "discover_command: discover_run() failed!\n");
+    exit(EXIT_FAILURE);
+  }
+
+  // Write the presence map
+  if (!dry_run)
+  {
+    if (it8528_profile_write_presence(&presence) != 0)
+    {
+      fprintf(stderr, "discover_command: it8528_profile_write_presence() failed!\n");
+      exit(EXIT_FAILURE);
+    }
+    printf("Presence map written to %s\n", IT8528_PRESENCE_PATH);
+  }
+}
+
+// Function called to run the exporter command which serves the metrics of all sensors to
+//   Prometheus
+void exporter_command(int argc, char** argv)
+{
+  // Declare needed variables
+  static const struct option options[] = {
+    { "listen", required_argument, NULL, 'l' },
+    { "interval", required_argument, NULL, 'i' },
+    { "check", no_argument, NULL, 'c' },
+    { NULL, 0, NULL, 0 }
+  };
+  char* listen_address = EXPORTER_DEFAULT_LISTEN;
+  unsigned long interval = EXPORTER_SAMPLE_INTERVAL;
+  u_int8_t check = 0;
+  char* end;
+  int option;
+
+  // Parse the options
+  while ((option = getopt_long(argc, argv, "l:i:c", options, NULL)) != -1)
+  {
+    switch (option)
+    {
+      case 'l':
+        listen_address = optarg;
+        break;
+      case 'i':
+        interval = strtoul(optarg, &end, 10);
+        if (end == optarg || *end != '\0' || interval == 0 || interval > UINT32_MAX)
+        {
+          fprintf(stderr, "Invalid sampling interval!\n");
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'c':
+        check = 1;
+        break;
+      default:
+        exit(EXIT_FAILURE);
+    }
+  }
+
+  // Make sure there are no extra arguments
+  if (optind != argc)
+  {
+    fprintf(stderr, "Usage: panq exporter [--listen address:port] [--interval milliseconds] "
+      "[--check]\n");
+    exit(EXIT_FAILURE);
+  }
+
+  // Check the metrics against the emulated chip instead of serving them if asked to
+  if (check)
+  {
+    if (exporter_check() != 0)
+    {
+      fprintf(stderr, "exporter_command: exporter_check() failed!\n");
+      exit(EXIT_FAILURE);
+    }
+    return;
+  }
+
+  // Get access to the chip
+  if (access_chip() != 0)
+  {
+    exit(EXIT_FAILURE);
+  }
+
+  // Run the exporter until it is told to stop
+  if (exporter_run(listen_address, interval) != 0)
+  {
+    fprintf(stderr, "exporter_command: exporter_run() failed!\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Function called to run the fan command for the fanN command of the model profile
+int8_t fan_command(u_int8_t fan_number, u_int8_t* speed)
+{
+  // Declare needed variables
+  u_int8_t fan_id;
+  u_int8_t status;
+
+  // Get the fan ID from the model profile
+  if (load_profile() != 0)
+  {
+    return -1;
+  }
+  if (it8528_profile_get_fan_id(fan_number, &fan_id) != 0)
+  {
+    fprintf(stderr, "Unknown fan!\n");
+    return -1;
+  }
+
+  // Check if no speed was supplied and a running daemon can answer the request
+  if (speed == NULL)
+  {
+    // Declare needed variables
+    u_int16_t rpm;
+
+    // Get the fan RPM from the daemon
+    if (daemon_client_get_fan_speed(get_socket_path(), fan_id, &rpm) == 0)
+    {
+      // Print the fan RPM
+      printf("%u RPM\n", rpm);
+      return 0;
+    }
+  }
+
+  // Get access to the chip
+  if (access_chip() != 0)
+  {
+    return -1;
+  }
+
+  // Get the fan status
+  if (it8528_get_fan_status(0, &status) != 0)
+  {
+    fprintf(stderr, "fan_command: it8528_get_fan_status() failed!\n");
+    return -1;
+  }
+
+  // Check the fan status
+  if (status == 0)
+  {
+    fprintf(stderr, "Incorrect fan status!\n");
+    return -1;
+  }
+
+  // Check if no speed was supplied
+  if (speed == NULL)
+  {
+    // Declare needed variables
+    u_int16_t rpm;
+
+    // Get the fan RPM
+    if (it8528_get_fan_speed(fan_id, &rpm) != 0)
+    {
+      fprintf(stderr, "fan_command: it8528_get_fan_speed() failed!\n");
+      return -1;
+    }
+
+    // Print the fan RPM
+    printf("%u RPM\n", rpm);
+  }
+  else
+  {
+    // Make sure the speed is valid
+    if (*speed > 100)
+    {
+      fprintf(stderr, "Invalid percent!\n");
+      return -1;
+    }
+
+    // Set the fan speed
+    if (it8528_set_fan_speed(fan_id, *speed) != 0)
+    {
+      fprintf(stderr, "fan_command: it8528_set_fan_speed() failed!\n");
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+// Function called to run the fan-control command which drives fan groups from their temperature
+//   sensors as described in a configuration file, either on the chip until a SIGINT or a SIGTERM
+//   signal is received or against the emulated chip for a number of simulated seconds
+void fan_control_command(int argc, char** argv)
+{
+  // Declare needed variables
+  static const struct option options[] = {
+    { "simulate", required_argument, NULL, 's' },
+    { NULL, 0, NULL, 0 }
+  };
+  struct fan_control control;
+  unsigned long seconds = 0;
+  char* end;
+  int option;
+
+  // Parse the options
+  while ((option = getopt_long(argc, argv, "s:", options, NULL)) != -1)
+  {
+    switch (option)
+    {
+      case 's':
+        seconds = strtoul(optarg, &end, 10);
+        if (end == optarg || *end != '\0' || seconds == 0 || seconds > UINT32_MAX)
+        {
+          fprintf(stderr, "Invalid number of simulated seconds!\n");
+          exit(EXIT_FAILURE);
+        }
+        break;
+      default:
+        exit(EXIT_FAILURE);
+    }
+  }
+
+  // Make sure a configuration file was supplied
+  if (optind != argc - 1)
+  {
+    fprintf(stderr, "Usage: panq fan-control [--simulate seconds] config_path\n");
+    exit(EXIT_FAILURE);
+  }
+
+  // Load the configuration
+  if (fan_control_load(argv[optind], &control) != 0)
+  {
+    fprintf(stderr, "fan_control_command: fan_control_load() failed!\n");
+    exit(EXIT_FAILURE);
+  }
+
+  // Check if the control loop should run against the emulated chip
+  if (seconds != 0)
+  {
+    if (fan_control_simulate(&control, seconds) != 0)
+    {
+      fprintf(stderr, "fan_control_command: fan_control_simulate() failed!\n");
+      exit(EXIT_FAILURE);
+    }
+  }
+  else
+  {
+    // Get access to the chip
+    if (access_chip() != 0)
+    {
+      exit(EXIT_FAILURE);
+    }
+
+    // Enter the real-time mode if one was selected
+    if (enter_realtime() != 0)
+    {
+      exit(EXIT_FAILURE);
+    }
+
+    // Run the control loop
+    if (fan_control_run(&control) != 0)
+    {
+      fprintf(stderr, "fan_control_command: fan_control_run() failed!\n");
+      exit(EXIT_FAILURE);
+    }
+
+    // Print how late the loop woke up if it ran in the real-time mode
+    if (realtime_is_enabled())
+    {
+      realtime_print_stats(stderr);
+    }
+  }
+
+  // Print how every group did
+  fan_control_print_report(&control, stdout);
+}
+
+// Function called to run the fans command which sets the speed of several of the fans of the
+//   fanN commands at once from arguments like 1=40, every argument is checked before the chip
+//   is touched
+int8_t fans_command(int argc, char** argv)
+{
+  // Declare needed variables
+  struct it8528_fan_setting settings[IT8528_PROFILE_MAX_NAMES];
+  u_int8_t count = 0;
+  u_int8_t status;
+
+  // Load the model profile
+  if (load_profile() != 0)
+  {
+    return -1;
+  }
+
+  // Make sure at least one fan was supplied
+  if (argc < 2 || argc - 1 > IT8528_PROFILE_MAX_NAMES)
+  {
+    fprintf(stderr, "Usage: panq fans fan_number=speed_percentage...\n");
+    return -1;
+  }
+
+  // Loop through the arguments
+  for (int i = 1; i < argc; i++)
+  {
+    // Declare needed variables
+    char* end;
+    unsigned long number = strtoul(argv[i], &end, 10);
+    unsigned long speed;
+
+    // Make sure the fan number is valid and get its fan ID from the model profile
+    if (end == argv[i] || *end != '=' || number > IT8528_PROFILE_MAX_NAMES ||
+      it8528_profile_get_fan_id(number, &settings[count].fan_id) != 0)
+    {
+      fprintf(stderr, "Invalid fan %s!\n", argv[i]);
+      return -1;
+    }
+
+    // Make sure the speed is valid
+    char* speed_text = end + 1;
+    speed = strtoul(speed_text, &end, 10);
+    if (end == speed_text || *end != '\0' || speed > 100)
+    {
+      fprintf(stderr, "Invalid percent!\n");
+      return -1;
+    }
+
+    settings[count].speed = speed;
+    count++;
+  }
+
+  // Get access to the chip
+  if (access_chip() != 0)
   {
-    printf("IT8528 not detected.\n");
-    exit(EXIT_FAILURE);
+    return -1;
   }
-}
-
-// Function called to run the fan command
-void fan_command(u_int8_t fan_id, u_int8_t* speed)
-{
-  // Declare needed variables
-  u_int8_t status;
 
   // Get the fan status
   if (it8528_get_fan_status(0, &status) != 0)
   {
-    fprintf(stderr, "fan_command: it8528_get_fan_status() failed!\n");
-    exit(EXIT_FAILURE);
+    fprintf(stderr, "fans_command: it8528_get_fan_status() failed!\n");
+    return -1;
   }
 
   // Check the fan status
   if (status == 0)
   {
     fprintf(stderr, "Incorrect fan status!\n");
-    exit(EXIT_FAILURE);
+    return -1;
   }
 
-  // Check if no speed was supplied
-  if (speed == NULL)
+  // Set the fan speeds
+  if (it8528_set_fan_speeds(settings, count) != 0)
   {
-    // Declare needed variables
-    u_int16_t rpm;
+    fprintf(stderr, "fans_command: it8528_set_fan_speeds() failed!\n");
+    return -1;
+  }
 
-    // Get the fan RPM
-    if (it8528_get_fan_speed(fan_id, &rpm) != 0)
+  return 0;
+}
+
+// Function called to run the history command which prints the samples of a history file within a
+//   time range or a summary of the file
+void history_command(int argc, char** argv)
+{
+  // Declare needed variables
+  static const struct option options[] = {
+    { "from", required_argument, NULL, 'f' },
+    { "to", required_argument, NULL, 't' },
+    { "step", required_argument, NULL, 's' },
+    { "info", no_argument, NULL, 'i' },
+    { NULL, 0, NULL, 0 }
+  };
+  struct history_query query = {
+    .from = INT64_MIN,
+    .to = INT64_MAX,
+    .step = 0
+  };
+  u_int8_t info = 0;
+  int option;
+
+  // Parse the options
+  while ((option = getopt_long(argc, argv, "f:t:s:i", options, NULL)) != -1)
+  {
+    switch (option)
     {
-      fprintf(stderr, "fan_command: it8528_get_fan_speed() failed!\n");
+      case 'f':
+        if (history_parse_time(optarg, &query.from) != 0)
+        {
+          fprintf(stderr, "Invalid time, use now, -duration, or seconds since the epoch!\n");
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 't':
+        if (history_parse_time(optarg, &query.to) != 0)
+        {
+          fprintf(stderr, "Invalid time, use now, -duration, or seconds since the epoch!\n");
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 's':
+        if (history_parse_duration(optarg, &query.step) != 0)
+        {
+          fprintf(stderr, "Invalid step, use a number followed by ms, s, m, h, d, or w!\n");
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'i':
+        info = 1;
+        break;
+      default:
+        exit(EXIT_FAILURE);
+    }
+  }
+
+  // Make sure a history file was supplied
+  if (optind != argc - 1)
+  {
+    fprintf(stderr, "Usage: panq history [--from time] [--to time] [--step duration] [--info] "
+      "history_path\n");
+    exit(EXIT_FAILURE);
+  }
+
+  // Check if only the summary should be printed
+  if (info)
+  {
+    if (history_print_info(argv[optind], stdout) != 0)
+    {
+      fprintf(stderr, "history_command: history_print_info() failed!\n");
       exit(EXIT_FAILURE);
     }
+    return;
+  }
 
-    // Print the fan RPM
-    printf("%u RPM\n", rpm);
+  // Print the samples within the range
+  if (history_query(argv[optind], &query, stdout) != 0)
+  {
+    fprintf(stderr, "history_command: history_query() failed!\n");
+    exit(EXIT_FAILURE);
   }
-  else
+}
+
+// Function called to run the log command, without options it prints a single row like
+//   log_row_command(), with options it samples every sensor and fan of the model profile on a
+//   fixed interval and writes the samples as CSV, JSON lines, or a compact binary log, or converts
+//   a binary log back to text
+void log_command(int argc, char** argv)
+{
+  // Declare needed variables
+  static const struct option options[] = {
+    { "interval", required_argument, NULL, 'i' },
+    { "format", required_argument, NULL, 'f' },
+    { "count", required_argument, NULL, 'c' },
+    { "output", required_argument, NULL, 'o' },
+    { "flush-size", required_argument, NULL, 's' },
+    { "flush-interval", required_argument, NULL, 't' },
+    { "decode", required_argument, NULL, 'd' },
+    { NULL, 0, NULL, 0 }
+  };
+  struct logger_config config = {
+    .format = LOGGER_FORMAT_CSV,
+    .interval = LOGGER_DEFAULT_INTERVAL,
+    .count = 0,
+    .flush_size = LOGGER_DEFAULT_FLUSH_SIZE,
+    .flush_interval = LOGGER_DEFAULT_FLUSH_INTERVAL,
+    .output_path = NULL
+  };
+  struct logger_stats stats;
+  char* input_path = NULL;
+  unsigned long long number;
+  u_int8_t invalid = 0;
+  char* end;
+  int option;
+
+  // Check if there are no options
+  if (argc == 1)
   {
-    // Make sure the speed is valid
-    if (*speed > 100)
+    if (log_row_command() != 0)
     {
-      fprintf(stderr, "Invalid percent!\n");
       exit(EXIT_FAILURE);
     }
+    return;
+  }
 
-    // Set the fan speed
-    if (it8528_set_fan_speed(fan_id, *speed) != 0)
+  // Parse the options
+  while ((option = getopt_long(argc, argv, "i:f:c:o:s:t:d:", options, NULL)) != -1)
+  {
+    switch (option)
     {
-      fprintf(stderr, "fan_command: it8528_set_fan_speed() failed!\n");
+      case 'i':
+        if (logger_parse_interval(optarg, &config.interval) != 0)
+        {
+          fprintf(stderr, "Invalid interval, use a number followed by ns, us, ms, or s!\n");
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'f':
+        if (logger_parse_format(optarg, &config.format) != 0)
+        {
+          fprintf(stderr, "Invalid format, use csv, jsonl, or binary!\n");
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'c':
+        number = strtoull(optarg, &end, 10);
+        invalid |= end == optarg || *end != '\0' || *optarg == '-';
+        config.count = number;
+        break;
+      case 'o':
+        config.output_path = optarg;
+        break;
+      case 's':
+        number = strtoull(optarg, &end, 10);
+        invalid |= end == optarg || *end != '\0' || *optarg == '-' ||
+          number > LOGGER_MAX_FLUSH_SIZE;
+        config.flush_size = number;
+        break;
+      case 't':
+        number = strtoull(optarg, &end, 10);
+        invalid |= end == optarg || *end != '\0' || *optarg == '-' || number > UINT32_MAX;
+        config.flush_interval = number;
+        break;
+      case 'd':
+        input_path = optarg;
+        break;
+      default:
+        exit(EXIT_FAILURE);
+    }
+  }
+
+  // Make sure the numbers are valid and there are no extra arguments
+  if (invalid || optind != argc)
+  {
+    fprintf(stderr, "Usage: panq log [--interval 250ms] [--format csv|jsonl|binary] [--count n] "
+      "[--output path] [--flush-size bytes] [--flush-interval milliseconds] "
+      "[--decode binary_log_path]\n");
+    exit(EXIT_FAILURE);
+  }
+
+  // Check if a binary log should be converted
+  if (input_path != NULL)
+  {
+    if (logger_decode(input_path, &config, &stats) != 0)
+    {
+      fprintf(stderr, "log_command: logger_decode() failed!\n");
       exit(EXIT_FAILURE);
     }
+    return;
   }
-}
 
-// Function called to run the log command which prints the fan speed and the temperature
-void log_command(void)
-{
-  u_int8_t status_value = 0xFF;
-  int8_t status_ret = it8528_get_fan_status(0, &status_value);
-  if (status_ret != 0 && status_value != 0)
+  // Get access to the chip
+  if (access_chip() != 0)
   {
-    fprintf(stderr, "Incorrect fan status!\n");
     exit(EXIT_FAILURE);
   }
 
-  u_int16_t speed_value;
-  if (it8528_get_fan_speed(0, &speed_value) != 0)
+  // Enter the real-time mode if one was selected
+  if (enter_realtime() != 0)
   {
-    fprintf(stderr, "Can't get fan speed!\n");
     exit(EXIT_FAILURE);
   }
 
-  double temperature_value = 0;
-  if (it8528_get_temperature(0, &temperature_value) != 0)
+  // Log until we are told to stop or we took enough samples
+  if (logger_run(&config, &stats) != 0)
   {
-    fprintf(stderr, "Can't get the temperature!\n");
+    fprintf(stderr, "log_command: logger_run() failed!\n");
     exit(EXIT_FAILURE);
   }
-  printf("%ld,%d,%.2f\n", time(NULL), speed_value, temperature_value);
 
-  exit(EXIT_SUCCESS);
+  // Print how well the deadlines were kept
+  logger_print_stats(&stats, stderr);
+  if (realtime_is_enabled())
+  {
+    realtime_print_stats(stderr);
+  }
+}
+
+// Function called to run the log command without options which prints a complete row with the
+//   speed, PWM, and status of every fan, every temperature, and every power supply status from
+//   one snapshot
+int8_t log_row_command(void)
+{
+  // Declare needed variables
+  struct it8528_snapshot snapshot;
+
+  // Get access to the chip
+  if (access_chip() != 0)
+  {
+    return -1;
+  }
+
+  // Take a snapshot
+  if (it8528_get_snapshot(&snapshot) != 0)
+  {
+    fprintf(stderr, "log_row_command: it8528_get_snapshot() failed!\n");
+    return -1;
+  }
+
+  // Print the row, leaving out values that couldn't be read
+  printf("%ld", (long)snapshot.time.tv_sec);
+  for (u_int8_t i = 0; i < IT8528_FAN_COUNT; i++)
+  {
+    if (snapshot.fan_valid[i])
+    {
+      printf(",%u", snapshot.fan_speeds[i]);
+    }
+    else
+    {
+      printf(",");
+    }
+  }
+  for (u_int8_t i = 0; i < IT8528_SENSOR_COUNT; i++)
+  {
+    if (snapshot.temperature_valid[i])
+    {
+      printf(",%.2f", snapshot.temperatures[i]);
+    }
+    else
+    {
+      printf(",");
+    }
+  }
+  for (u_int8_t i = 0; i < IT8528_FAN_COUNT; i++)
+  {
+    if (snapshot.fan_valid[i])
+    {
+      printf(",%u,%u", snapshot.fan_pwms[i], snapshot.fan_statuses[i]);
+    }
+    else
+    {
+      printf(",,");
+    }
+  }
+  for (u_int8_t i = 0; i < IT8528_POWER_SUPPLY_COUNT; i++)
+  {
+    if (snapshot.power_supply_valid[i])
+    {
+      printf(",%u", snapshot.power_supply_statuses[i]);
+    }
+    else
+    {
+      printf(",");
+    }
+  }
+  printf("\n");
+
+  return 0;
 }
 
 // Function called to run the test command which compares the PanQ function with the QNAP ones
@@ -125,6 +1381,12 @@ void test_command(char* libuLinux_hal_path)
     exit(EXIT_FAILURE);
   }
 
+  // Get access to the chip
+  if (access_chip() != 0)
+  {
+    exit(EXIT_FAILURE);
+  }
+
   void* handle;
   char* error;
 
@@ -229,19 +1491,328 @@ void test_command(char* libuLinux_hal_path)
   dlclose(handle);
 }
 
+// Function called to run the profile command which shows the model profile in use
+void profile_command(void)
+{
+  // Load the model profile
+  if (load_profile() != 0)
+  {
+    exit(EXIT_FAILURE);
+  }
+
+  // Print the profile
+  it8528_profile_print(stdout);
+}
+
+// Function called to run the shm-read command which prints the latest readings published by the
+//   daemon to shared memory without needing any capability
+void shm_read_command(void)
+{
+  // Declare needed variables
+  struct panq_shm shm;
+  struct panq_shm_data data;
+
+  // Open the region and read it
+  if (panq_shm_open(PANQ_SHM_NAME, &shm) != 0)
+  {
+    fprintf(stderr, "No running daemon found!\n");
+    exit(EXIT_FAILURE);
+  }
+  if (panq_shm_read(&shm, &data) != 0)
+  {
+    fprintf(stderr, "shm_read_command: panq_shm_read() failed!\n");
+    exit(EXIT_FAILURE);
+  }
+  panq_shm_close(&shm);
+
+  // Print the readings
+  printf("time %lld.%09lld\n", (long long)(data.time / 1000000000),
+    (long long)(data.time % 1000000000));
+  printf("samples %llu\n", (unsigned long long)data.samples);
+  for (u_int8_t i = 0; i < PANQ_SHM_SENSOR_COUNT; i++)
+  {
+    if (data.sensors[i].valid)
+    {
+      printf("temperature%u %.2f\n", data.sensors[i].id, data.sensors[i].temperature / 1000.0);
+    }
+  }
+  for (u_int8_t i = 0; i < PANQ_SHM_FAN_COUNT; i++)
+  {
+    if (data.fans[i].valid)
+    {
+      printf("fan%u %u RPM, %u%% PWM, status %u\n", data.fans[i].id, data.fans[i].speed,
+        data.fans[i].pwm, data.fans[i].status);
+    }
+  }
+  for (u_int8_t i = 0; i < PANQ_SHM_POWER_SUPPLY_COUNT; i++)
+  {
+    if (data.power_supply_valid[i])
+    {
+      printf("power_supply%u status %u\n", i + 1, data.power_supply_statuses[i]);
+    }
+  }
+}
+
+// Function called to run the stats command which prints the statistics of a running daemon, or
+//   the minimum, maximum, and average of every reading over a window from its rollup rings
+void stats_command(int argc, char** argv)
+{
+  // Declare needed variables
+  static const struct option options[] = {
+    { "window", required_argument, NULL, 'w' },
+    { NULL, 0, NULL, 0 }
+  };
+  int64_t window = 0;
+  int option;
+
+  // Parse the options
+  while ((option = getopt_long(argc, argv, "w:", options, NULL)) != -1)
+  {
+    switch (option)
+    {
+      case 'w':
+        if (history_parse_duration(optarg, &window) != 0 || window < 1000 ||
+          window / 1000 > UINT32_MAX)
+        {
+          fprintf(stderr, "Invalid window, use a number followed by s, m, h, d, or w!\n");
+          exit(EXIT_FAILURE);
+        }
+        break;
+      default:
+        exit(EXIT_FAILURE);
+    }
+  }
+
+  // Make sure there are no extra arguments
+  if (optind != argc)
+  {
+    fprintf(stderr, "Usage: panq stats [--window duration]\n");
+    exit(EXIT_FAILURE);
+  }
+
+  // Check if the rollup of a window was asked for
+  if (window != 0)
+  {
+    if (daemon_client_print_rollup(get_socket_path(), window / 1000, stdout) != 0)
+    {
+      fprintf(stderr, "No running daemon found!\n");
+      exit(EXIT_FAILURE);
+    }
+    return;
+  }
+
+  // Print the statistics
+  if (daemon_client_print_stats(get_socket_path(), stdout) != 0)
+  {
+    fprintf(stderr, "No running daemon found!\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
 // Function called to run the temperature command
-void temperature_command(u_int8_t sensor_id)
+int8_t temperature_command(u_int8_t sensor_number)
 {
   // Declare needed variables
+  u_int8_t sensor_id;
   double temperature;
 
+  // Get the sensor ID from the model profile
+  if (load_profile() != 0)
+  {
+    return -1;
+  }
+  if (it8528_profile_get_sensor_id(sensor_number, &sensor_id) != 0)
+  {
+    fprintf(stderr, "Unknown temperature sensor!\n");
+    return -1;
+  }
+
+  // Check if a running daemon can answer the request
+  if (daemon_client_get_temperature(get_socket_path(), sensor_id, &temperature) == 0)
+  {
+    // Print the temperature
+    printf("%.2f °C\n", temperature);
+    return 0;
+  }
+
+  // Get access to the chip
+  if (access_chip() != 0)
+  {
+    return -1;
+  }
+
   // Get the temperature
   if (it8528_get_temperature(sensor_id, &temperature) != 0)
   {
     fprintf(stderr, "temperature_command: it8528_get_temperature failed!\n");
-    exit(EXIT_FAILURE);
+    return -1;
   }
 
   // Print the temperature
   printf("%.2f °C\n", temperature);
-}
\ No newline at end of file
+
+  return 0;
+}
+
+// Function called to get the number of arguments taken by the command at the start of a list of
+//   commands, or 0 if it isn't a command that can be part of a list
+static int get_command_length(int argc, char** argv)
+{
+  // Declare needed variables
+  u_int8_t number;
+  char* rest;
+  int length = 1;
+
+  // Check the commands
+  if (parse_name(argv[0], "temp", &number, &rest) == 0 && *rest == '\0')
+  {
+    return 1;
+  }
+  if (parse_name(argv[0], "fan", &number, &rest) == 0)
+  {
+    // Check if the speed is the next argument
+    if (*rest == '\0' && argc > 1 && argv[1][0] != '\0' &&
+      strspn(argv[1], "0123456789") == strlen(argv[1]))
+    {
+      return 2;
+    }
+    return 1;
+  }
+  if (strcmp(argv[0], "fans") == 0)
+  {
+    // Take every following argument like 1=40
+    while (length < argc && parse_name(argv[length], "", &number, &rest) == 0 && *rest == '=')
+    {
+      length++;
+    }
+    return length > 1 ? length : 0;
+  }
+  if (strcmp(argv[0], "log") == 0)
+  {
+    return 1;
+  }
+
+  return 0;
+}
+
+// Function called to run a command of a list of commands
+static int8_t run_command(int argc, char** argv)
+{
+  // Declare needed variables
+  u_int8_t number;
+  u_int8_t speed;
+  char* rest;
+
+  // Check if this is a temperature
+  if (parse_name(argv[0], "temp", &number, &rest) == 0)
+  {
+    return temperature_command(number);
+  }
+
+  // Check if this is a fan speed to get or set
+  if (parse_name(argv[0], "fan", &number, &rest) == 0)
+  {
+    // Check if there is no speed
+    if (*rest == '\0' && argc == 1)
+    {
+      return fan_command(number, NULL);
+    }
+
+    // Make sure the speed is valid
+    if (parse_speed(*rest == '=' ? rest + 1 : argv[1], &speed) != 0)
+    {
+      fprintf(stderr, "Invalid percent!\n");
+      return -1;
+    }
+
+    return fan_command(number, &speed);
+  }
+
+  // Check if this is several fan speeds to set
+  if (strcmp(argv[0], "fans") == 0)
+  {
+    return fans_command(argc, argv);
+  }
+
+  return log_row_command();
+}
+
+// Function called to convert the number following the prefix of a command such as fan1 or
+//   temp5, the number can be followed by the end of the text or an = sign that rest points to
+static int8_t parse_name(const char* text, const char* prefix, u_int8_t* number, char** rest)
+{
+  // Declare needed variables
+  size_t length = strlen(prefix);
+  unsigned long value;
+
+  // Make sure the text starts with the prefix and a digit
+  if (strncmp(text, prefix, length) != 0 || text[length] < '0' || text[length] > '9')
+  {
+    return -1;
+  }
+
+  // Make sure the number is in range and followed by the end of the text or an = sign
+  value = strtoul(text + length, rest, 10);
+  if ((**rest != '\0' && **rest != '=') || value < 1 || value > 255)
+  {
+    return -1;
+  }
+
+  *number = value;
+
+  return 0;
+}
+
+// Function called to convert a speed percentage
+static int8_t parse_speed(const char* text, u_int8_t* speed)
+{
+  // Declare needed variables
+  char* end;
+  unsigned long value = strtoul(text, &end, 10);
+
+  // Make sure the whole text is a percentage
+  if (end == text || *end != '\0' || value > 100)
+  {
+    return -1;
+  }
+
+  *speed = value;
+
+  return 0;
+}
+
+// Function called to enter the real-time mode selected by PANQ_REALTIME before a resident loop
+//   starts
+static int8_t enter_realtime(void)
+{
+  // Declare needed variables
+  char* mode = getenv("PANQ_REALTIME");
+  struct realtime_config config;
+
+  // Check if a mode was selected
+  if (mode == NULL)
+  {
+    return 0;
+  }
+
+  // Parse and enter it
+  if (realtime_parse(mode, &config) != 0)
+  {
+    fprintf(stderr, "Invalid real-time mode, use a list like on, fifo=10, cpu=1, or bound=500, or "
+      "off!\n");
+    return -1;
+  }
+  realtime_enter(&config);
+
+  return 0;
+}
+
+// Function called to get the path of the socket the daemon answers on, the one named by
+//   PANQ_SOCKET or the default one
+static const char* get_socket_path(void)
+{
+  // Declare needed variables
+  const char* socket_path = getenv("PANQ_SOCKET");
+
+  return socket_path != NULL && *socket_path != '\0' ? socket_path : DAEMON_SOCKET_PATH;
+}
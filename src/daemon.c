@@ -0,0 +1,993 @@
+/*
+ * Copyright (C) 2021 Stonyx
+ * http://www.stonyx.com
+ *
+ * Copyright (C) 2020 Guillaume Valadon
+ * guillaume@valadon.net
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include "it8528_utils.h"
+#include "it8528_cache.h"
+#include "it8528_lock.h"
+#include "it8528_trace.h"
+#include "it8528.h"
+#include "panq_shm.h"
+#include "history.h"
+#include "hwmon.h"
+#include "realtime.h"
+#include "rollup.h"
+#include "daemon.h"
+
+// Declare the latest snapshot
+static struct it8528_snapshot daemon_snapshot;
+static int64_t daemon_snapshot_time;
+
+// Make sure the fixed layout of the shared memory region has room for every sensor and fan
+_Static_assert(PANQ_SHM_SENSOR_COUNT == IT8528_SENSOR_COUNT, "sensor count mismatch");
+_Static_assert(PANQ_SHM_FAN_COUNT == IT8528_FAN_COUNT, "fan count mismatch");
+_Static_assert(PANQ_SHM_POWER_SUPPLY_COUNT == IT8528_POWER_SUPPLY_COUNT,
+  "power supply count mismatch");
+
+// Declare the shared memory region the latest snapshot is published to
+static struct panq_shm daemon_shm;
+static struct panq_shm_data daemon_shm_data;
+
+// Declare the history file every snapshot is appended to
+static struct history daemon_history;
+
+// Declare the hwmon style tree every snapshot is written to
+static struct hwmon daemon_hwmon;
+
+// Declare the flag set by the signal handler when the daemon should stop
+static volatile sig_atomic_t daemon_stop = 0;
+
+// Define the structure holding a client connection, the part of its requests received so far,
+//   and the response being sent to it, a client that makes no progress within
+//   DAEMON_CLIENT_TIMEOUT milliseconds is dropped so that it can't hold a slot for long
+struct daemon_client
+{
+  int64_t deadline;
+  size_t length;
+  u_int8_t request[sizeof(struct daemon_header) + DAEMON_MAX_ITEMS * sizeof(struct daemon_item)];
+  u_int8_t* response;
+  size_t response_length;
+  size_t offset;
+};
+
+// Declare functions
+static void daemon_handle_signal(int signal);
+static int64_t daemon_get_time(void);
+static int64_t daemon_get_nanoseconds(void);
+static int8_t daemon_arm_timer(int fd, int64_t deadline);
+static void daemon_sample(void);
+static void daemon_publish(void);
+static void daemon_fill_item(struct daemon_item* item);
+static int8_t daemon_check_socket(const char* socket_path);
+static int8_t daemon_handle_client(int fd, struct daemon_client* client);
+static int8_t daemon_handle_request(struct daemon_client* client);
+static int8_t daemon_handle_read(struct daemon_client* client, struct daemon_header* header,
+  const u_int8_t* payload);
+static int8_t daemon_handle_stats(struct daemon_client* client, struct daemon_header* header);
+static int8_t daemon_handle_rollup(struct daemon_client* client, struct daemon_header* header,
+  const u_int8_t* payload);
+static int8_t daemon_set_response(struct daemon_client* client, struct daemon_header* header,
+  const void* payload, size_t length);
+static int8_t daemon_send_response(int fd, struct daemon_client* client);
+static int daemon_connect(const char* socket_path);
+static int8_t daemon_client_print_text(const char* socket_path, u_int8_t op, const void* payload,
+  u_int32_t length, FILE* stream);
+
+// Function called to run the daemon which samples all sensors and answers client requests over a
+//   Unix socket until it receives a SIGINT or a SIGTERM signal, every sample is also appended to
+//   the history file and written to the hwmon style tree if there are ones, samples are taken
+//   when a timer armed at absolute deadlines fires so that the time spent answering clients
+//   doesn't add up, and how late every wakeup was is recorded
+int8_t daemon_run(const char* socket_path, const char* history_path, const char* hwmon_path)
+{
+  // Declare needed variables
+  static struct daemon_client clients[DAEMON_MAX_CLIENTS + DAEMON_FIRST_CLIENT];
+  struct sockaddr_un address;
+  struct pollfd fds[DAEMON_MAX_CLIENTS + DAEMON_FIRST_CLIENT];
+  nfds_t count = DAEMON_FIRST_CLIENT;
+  int64_t next_sample;
+  u_int64_t expirations;
+
+  // Make sure the socket path fits in the socket address
+  if (strlen(socket_path) >= sizeof(address.sun_path))
+  {
+    fprintf(stderr, "daemon_run: socket path too long!\n");
+    return -1;
+  }
+
+  // Make sure no other daemon answers on the socket
+  if (daemon_check_socket(socket_path) != 0)
+  {
+    return -1;
+  }
+
+  // Calibrate the handshake wait against the chip since the daemon does many reads
+  struct it8528_wait_calibration calibration;
+  if (it8528_calibrate_wait(&calibration) != 0)
+  {
+    fprintf(stderr, "daemon_run: it8528_calibrate_wait() failed!\n");
+  }
+
+  // Install the signal handlers
+  signal(SIGINT, daemon_handle_signal);
+  signal(SIGTERM, daemon_handle_signal);
+  signal(SIGPIPE, SIG_IGN);
+
+  // Create the listening socket
+  fds[0].fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fds[0].fd < 0)
+  {
+    fprintf(stderr, "daemon_run: socket() failed!\n");
+    return -1;
+  }
+  fds[0].events = POLLIN;
+
+  // Create the sample timer
+  fds[1].fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (fds[1].fd < 0)
+  {
+    fprintf(stderr, "daemon_run: timerfd_create() failed!\n");
+    close(fds[0].fd);
+    return -1;
+  }
+  fds[1].events = POLLIN;
+
+  // Bind the socket, a stale one left behind by a previous daemon was removed above
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, socket_path);
+  if (bind(fds[0].fd, (struct sockaddr*)&address, sizeof(address)) != 0)
+  {
+    fprintf(stderr, "daemon_run: bind() failed!\n");
+    close(fds[0].fd);
+    close(fds[1].fd);
+    return -1;
+  }
+
+  // Allow unprivileged clients to connect since reads don't need any capability, every client is
+  //   served without blocking so none of them can stall the sampling
+  chmod(socket_path, 0666);
+
+  // Start listening
+  if (listen(fds[0].fd, DAEMON_MAX_CLIENTS) != 0)
+  {
+    fprintf(stderr, "daemon_run: listen() failed!\n");
+    close(fds[0].fd);
+    close(fds[1].fd);
+    unlink(socket_path);
+    return -1;
+  }
+
+  // Create the shared memory region, the daemon still serves the socket without it
+  if (panq_shm_create(PANQ_SHM_NAME, &daemon_shm) != 0)
+  {
+    fprintf(stderr, "daemon_run: panq_shm_create() failed!\n");
+  }
+
+  // Open the history file, the daemon still serves the socket without it
+  if (history_path != NULL && history_open(history_path, &daemon_history) != 0)
+  {
+    fprintf(stderr, "daemon_run: history_open() failed!\n");
+  }
+
+  // Prepare the hwmon style tree, the daemon still serves the socket without it
+  if (hwmon_path != NULL && hwmon_open(hwmon_path, &daemon_hwmon) != 0)
+  {
+    fprintf(stderr, "daemon_run: hwmon_open() failed!\n");
+  }
+
+  // Start with empty rollup rings
+  rollup_reset();
+
+  // Make sure every sample reads registers no older than half the interval so that a cached
+  //   value is never published twice
+  it8528_cache_limit_age(DAEMON_SAMPLE_INTERVAL / 2);
+
+  // Take the first sample and arm the timer for the next one
+  daemon_sample();
+  next_sample = daemon_get_nanoseconds() + DAEMON_SAMPLE_INTERVAL * 1000000LL;
+  if (daemon_arm_timer(fds[1].fd, next_sample) != 0)
+  {
+    fprintf(stderr, "daemon_run: daemon_arm_timer() failed!\n");
+    daemon_stop = 1;
+  }
+
+  // Loop until we are told to stop
+  while (!daemon_stop)
+  {
+    // Calculate how long we can wait before the oldest client times out
+    int64_t now = daemon_get_time();
+    int timeout = -1;
+    for (nfds_t i = DAEMON_FIRST_CLIENT; i < count; i++)
+    {
+      int64_t remaining = clients[i].deadline > now ? clients[i].deadline - now : 0;
+      if (timeout < 0 || remaining < timeout)
+      {
+        timeout = remaining;
+      }
+    }
+
+    // Wait for a connection, a request, room to send a response, or the next sample
+    if (poll(fds, count, timeout) < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+
+      fprintf(stderr, "daemon_run: poll() failed!\n");
+      break;
+    }
+
+    // Check if the next sample is due, recording how late we woke up for it
+    if ((fds[1].revents & POLLIN) &&
+      read(fds[1].fd, &expirations, sizeof(expirations)) == sizeof(expirations))
+    {
+      realtime_record_wakeup(next_sample, daemon_get_nanoseconds());
+      daemon_sample();
+      next_sample += DAEMON_SAMPLE_INTERVAL * 1000000LL;
+
+      // Skip any samples we missed instead of sampling in a burst
+      if (next_sample <= daemon_get_nanoseconds())
+      {
+        next_sample = daemon_get_nanoseconds() + DAEMON_SAMPLE_INTERVAL * 1000000LL;
+      }
+      if (daemon_arm_timer(fds[1].fd, next_sample) != 0)
+      {
+        fprintf(stderr, "daemon_run: daemon_arm_timer() failed!\n");
+        break;
+      }
+    }
+
+    // Handle the clients that sent a request, have room for their response, hung up, or timed
+    //   out, walking backwards so that the last client can be moved into the slot of a removed one
+    now = daemon_get_time();
+    for (nfds_t i = count - 1; i >= DAEMON_FIRST_CLIENT; i--)
+    {
+      // Check if the client has nothing to do and has time left
+      if (fds[i].revents == 0 && clients[i].deadline > now)
+      {
+        continue;
+      }
+
+      // Check if the client is done, either hung up, sent a bad request, or too slow
+      if (fds[i].revents == 0 || (fds[i].revents & (POLLIN | POLLOUT)) == 0 ||
+        daemon_handle_client(fds[i].fd, &clients[i]) != 1)
+      {
+        close(fds[i].fd);
+        free(clients[i].response);
+        count--;
+        fds[i] = fds[count];
+        clients[i] = clients[count];
+      }
+      else
+      {
+        // Wait for room in the socket buffer while a response is being sent
+        fds[i].events = clients[i].response != NULL ? POLLOUT : POLLIN;
+      }
+    }
+
+    // Check if there is a new client
+    if (fds[0].revents & POLLIN)
+    {
+      // Accept the client
+      int fd = accept4(fds[0].fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+      if (fd >= 0)
+      {
+        // Make sure there is room for the client
+        if (count >= DAEMON_MAX_CLIENTS + DAEMON_FIRST_CLIENT)
+        {
+          close(fd);
+        }
+        else
+        {
+          // Add the client
+          fds[count].fd = fd;
+          fds[count].events = POLLIN;
+          fds[count].revents = 0;
+          clients[count].deadline = daemon_get_time() + DAEMON_CLIENT_TIMEOUT;
+          clients[count].length = 0;
+          clients[count].response = NULL;
+          count++;
+        }
+      }
+    }
+  }
+
+  // Close the timer and all the sockets, free the responses left to send, and remove the socket
+  //   file
+  for (nfds_t i = 0; i < count; i++)
+  {
+    close(fds[i].fd);
+    if (i >= DAEMON_FIRST_CLIENT)
+    {
+      free(clients[i].response);
+    }
+  }
+  unlink(socket_path);
+
+  // Remove the shared memory region
+  if (daemon_shm.region != NULL)
+  {
+    panq_shm_destroy(PANQ_SHM_NAME, &daemon_shm);
+  }
+
+  // Close the history file
+  history_close(&daemon_history);
+
+  // Remove the hwmon style tree
+  hwmon_close(&daemon_hwmon);
+
+  // Remove the age limit
+  it8528_cache_limit_age(IT8528_CACHE_DEFAULT_MAX_AGE);
+
+  return 0;
+}
+
+// Function called to read items from a running daemon
+int8_t daemon_client_read(const char* socket_path, struct daemon_item* items, u_int16_t count)
+{
+  // Declare needed variables
+  struct daemon_header header;
+  int fd;
+
+  // Make sure the number of items is valid
+  if (count == 0 || count > DAEMON_MAX_ITEMS)
+  {
+    return -1;
+  }
+
+  // Connect to the daemon
+  fd = daemon_connect(socket_path);
+  if (fd < 0)
+  {
+    return -1;
+  }
+
+  // Send the request header and the requested items
+  memset(&header, 0, sizeof(header));
+  header.magic = DAEMON_PROTOCOL_MAGIC;
+  header.version = DAEMON_PROTOCOL_VERSION;
+  header.op = DAEMON_OP_READ;
+  header.length = count * sizeof(struct daemon_item);
+  if (send(fd, &header, sizeof(header), MSG_NOSIGNAL | MSG_MORE) != sizeof(header) ||
+      send(fd, items, header.length, MSG_NOSIGNAL) != header.length)
+  {
+    close(fd);
+    return -1;
+  }
+
+  // Receive the response header and the answered items
+  if (recv(fd, &header, sizeof(header), MSG_WAITALL) != sizeof(header) ||
+      header.magic != DAEMON_PROTOCOL_MAGIC || header.status != 0 ||
+      header.length != count * sizeof(struct daemon_item) ||
+      recv(fd, items, header.length, MSG_WAITALL) != header.length)
+  {
+    close(fd);
+    return -1;
+  }
+
+  close(fd);
+
+  return 0;
+}
+
+// Function called to get a temperature from a running daemon
+int8_t daemon_client_get_temperature(const char* socket_path, u_int8_t sensor_id,
+  double* temperature)
+{
+  // Declare needed variables
+  struct daemon_item item = {
+    .type = DAEMON_ITEM_TEMPERATURE,
+    .id = sensor_id
+  };
+
+  // Read the item
+  if (daemon_client_read(socket_path, &item, 1) != 0 || item.status != 0)
+  {
+    return -1;
+  }
+
+  // Convert the value from millidegrees
+  *temperature = item.value / 1000.0;
+
+  return 0;
+}
+
+// Function called to get a fan speed from a running daemon
+int8_t daemon_client_get_fan_speed(const char* socket_path, u_int8_t fan_id, u_int16_t* speed)
+{
+  // Declare needed variables
+  struct daemon_item item = {
+    .type = DAEMON_ITEM_FAN_SPEED,
+    .id = fan_id
+  };
+
+  // Read the item
+  if (daemon_client_read(socket_path, &item, 1) != 0 || item.status != 0)
+  {
+    return -1;
+  }
+
+  *speed = item.value;
+
+  return 0;
+}
+
+// Function called to print the statistics of a running daemon
+int8_t daemon_client_print_stats(const char* socket_path, FILE* stream)
+{
+  return daemon_client_print_text(socket_path, DAEMON_OP_STATS, NULL, 0, stream);
+}
+
+// Function called to print the minimum, maximum, and average of every temperature and fan speed
+//   over the last window seconds from the rollup rings of a running daemon
+int8_t daemon_client_print_rollup(const char* socket_path, u_int32_t window, FILE* stream)
+{
+  return daemon_client_print_text(socket_path, DAEMON_OP_ROLLUP, &window, sizeof(window), stream);
+}
+
+// Function called when the daemon receives a SIGINT or a SIGTERM signal
+static void daemon_handle_signal(int signal)
+{
+  daemon_stop = 1;
+}
+
+// Function called to get the monotonic time in milliseconds
+static int64_t daemon_get_time(void)
+{
+  // Declare needed variables
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Function called to get the monotonic time in nanoseconds
+static int64_t daemon_get_nanoseconds(void)
+{
+  // Declare needed variables
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Function called to arm the sample timer so that it fires once at a monotonic deadline in
+//   nanoseconds
+static int8_t daemon_arm_timer(int fd, int64_t deadline)
+{
+  // Declare needed variables
+  struct itimerspec its = {
+    .it_value.tv_sec = deadline / 1000000000,
+    .it_value.tv_nsec = deadline % 1000000000
+  };
+
+  return timerfd_settime(fd, TFD_TIMER_ABSTIME, &its, NULL) == 0 ? 0 : -1;
+}
+
+// Function called to sample all the sensors and fans
+static void daemon_sample(void)
+{
+  // Take a snapshot, invalid values are flagged in the snapshot itself
+  it8528_get_snapshot(&daemon_snapshot);
+  daemon_snapshot_time = daemon_get_time();
+
+  // Publish the snapshot and add it to the rollup rings
+  daemon_publish();
+  rollup_add(&daemon_snapshot, daemon_snapshot_time);
+
+  // Append the snapshot to the history file, giving up on the file if it fails
+  if (daemon_history.chunk != NULL && history_append(&daemon_history, &daemon_snapshot) != 0)
+  {
+    fprintf(stderr, "daemon_sample: history_append() failed!\n");
+    history_close(&daemon_history);
+  }
+
+  // Write the snapshot to the hwmon style tree, giving up on the tree if it fails
+  if (daemon_hwmon.name[0] != '\0' && hwmon_update(&daemon_hwmon, &daemon_snapshot) != 0)
+  {
+    fprintf(stderr, "daemon_sample: hwmon_update() failed!\n");
+    hwmon_close(&daemon_hwmon);
+  }
+}
+
+// Function called to publish the latest snapshot to the shared memory region
+static void daemon_publish(void)
+{
+  // Check if there is a shared memory region
+  if (daemon_shm.region == NULL)
+  {
+    return;
+  }
+
+  // Convert the snapshot to the fixed layout of the region
+  daemon_shm_data.time = (int64_t)daemon_snapshot.time.tv_sec * 1000000000 +
+    daemon_snapshot.time.tv_nsec;
+  daemon_shm_data.samples++;
+  for (u_int8_t i = 0; i < IT8528_SENSOR_COUNT; i++)
+  {
+    daemon_shm_data.sensors[i].id = it8528_sensor_ids[i];
+    daemon_shm_data.sensors[i].valid = daemon_snapshot.temperature_valid[i];
+    daemon_shm_data.sensors[i].temperature = (int32_t)(daemon_snapshot.temperatures[i] * 1000);
+  }
+  for (u_int8_t i = 0; i < IT8528_FAN_COUNT; i++)
+  {
+    daemon_shm_data.fans[i].id = it8528_fan_ids[i];
+    daemon_shm_data.fans[i].valid = daemon_snapshot.fan_valid[i];
+    daemon_shm_data.fans[i].speed = daemon_snapshot.fan_speeds[i];
+    daemon_shm_data.fans[i].pwm = daemon_snapshot.fan_pwms[i];
+    daemon_shm_data.fans[i].status = daemon_snapshot.fan_statuses[i];
+  }
+  for (u_int8_t i = 0; i < IT8528_POWER_SUPPLY_COUNT; i++)
+  {
+    daemon_shm_data.power_supply_valid[i] = daemon_snapshot.power_supply_valid[i];
+    daemon_shm_data.power_supply_statuses[i] = daemon_snapshot.power_supply_statuses[i];
+  }
+
+  // Publish the data
+  panq_shm_publish(&daemon_shm, &daemon_shm_data);
+}
+
+// Function called to fill in the status and value of a requested item from the latest snapshot
+static void daemon_fill_item(struct daemon_item* item)
+{
+  // Assume the item is unknown
+  item->status = -1;
+  item->value = 0;
+
+  // Look for the item in the latest snapshot
+  switch (item->type)
+  {
+    case DAEMON_ITEM_TEMPERATURE:
+      for (u_int8_t i = 0; i < IT8528_SENSOR_COUNT; i++)
+      {
+        if (it8528_sensor_ids[i] == item->id && daemon_snapshot.temperature_valid[i])
+        {
+          item->status = 0;
+          item->value = (int32_t)(daemon_snapshot.temperatures[i] * 1000);
+          break;
+        }
+      }
+      break;
+    case DAEMON_ITEM_FAN_SPEED:
+    case DAEMON_ITEM_FAN_PWM:
+    case DAEMON_ITEM_FAN_STATUS:
+      for (u_int8_t i = 0; i < IT8528_FAN_COUNT; i++)
+      {
+        if (it8528_fan_ids[i] == item->id && daemon_snapshot.fan_valid[i])
+        {
+          item->status = 0;
+          item->value = item->type == DAEMON_ITEM_FAN_SPEED ? daemon_snapshot.fan_speeds[i] :
+            item->type == DAEMON_ITEM_FAN_PWM ? daemon_snapshot.fan_pwms[i] :
+            daemon_snapshot.fan_statuses[i];
+          break;
+        }
+      }
+      break;
+    case DAEMON_ITEM_POWER_SUPPLY_STATUS:
+      if (item->id > 0 && item->id <= IT8528_POWER_SUPPLY_COUNT &&
+          daemon_snapshot.power_supply_valid[item->id - 1])
+      {
+        item->status = 0;
+        item->value = daemon_snapshot.power_supply_statuses[item->id - 1];
+      }
+      break;
+  }
+}
+
+// Function called to check that no daemon answers on the socket path, a socket nobody listens on
+//   is left behind by a daemon that didn't stop cleanly and is removed
+static int8_t daemon_check_socket(const char* socket_path)
+{
+  // Declare needed variables
+  struct sockaddr_un address;
+  int fd;
+  int ret;
+
+  // Try to connect to the socket
+  fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+  {
+    fprintf(stderr, "daemon_check_socket: socket() failed!\n");
+    return -1;
+  }
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, socket_path);
+  ret = connect(fd, (struct sockaddr*)&address, sizeof(address));
+  close(fd);
+
+  // Check if another daemon answered
+  if (ret == 0)
+  {
+    fprintf(stderr, "daemon_check_socket: another daemon is running on %s!\n", socket_path);
+    return -1;
+  }
+
+  // Remove the stale socket
+  if (errno == ECONNREFUSED)
+  {
+    unlink(socket_path);
+  }
+
+  return 0;
+}
+
+// Function called to send the rest of the response of a client, receive more of its requests,
+//   and answer every request that is complete, returns 1 while the client is still connected and
+//   -1 once it hung up or sent a bad request
+static int8_t daemon_handle_client(int fd, struct daemon_client* client)
+{
+  // Declare needed variables
+  size_t length = client->length;
+  size_t offset = client->offset;
+  ssize_t received;
+  int8_t ret = 0;
+
+  // Send the rest of the response first, the next requests wait in the socket meanwhile
+  if (client->response != NULL && daemon_send_response(fd, client) < 0)
+  {
+    return -1;
+  }
+
+  // Check if the response was sent
+  if (client->response == NULL)
+  {
+    // Receive what the client sent so far
+    received = recv(fd, client->request + client->length,
+      sizeof(client->request) - client->length, MSG_DONTWAIT);
+    if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+    {
+      return -1;
+    }
+    if (received > 0)
+    {
+      client->length += received;
+    }
+
+    // Answer every complete request until one of the responses doesn't fit in the socket buffer
+    while (ret == 0 && (ret = daemon_handle_request(client)) == 0)
+    {
+      ret = daemon_send_response(fd, client);
+    }
+    if (ret < 0)
+    {
+      return -1;
+    }
+  }
+
+  // Give the client more time as long as it makes progress
+  if (client->length != length || client->offset != offset)
+  {
+    client->deadline = daemon_get_time() + DAEMON_CLIENT_TIMEOUT;
+  }
+
+  return 1;
+}
+
+// Function called to answer the first request received from a client if it is complete, the
+//   response is left in the client and the request is removed, returns 1 if the request isn't
+//   complete yet, 0 once it was answered, and -1 if it is invalid
+static int8_t daemon_handle_request(struct daemon_client* client)
+{
+  // Declare needed variables
+  struct daemon_header header;
+  const u_int8_t* payload = client->request + sizeof(header);
+  int8_t ret;
+
+  // Check if the request header is complete and valid
+  if (client->length < sizeof(header))
+  {
+    return 1;
+  }
+  memcpy(&header, client->request, sizeof(header));
+  if (header.magic != DAEMON_PROTOCOL_MAGIC || header.version != DAEMON_PROTOCOL_VERSION ||
+      header.length > sizeof(client->request) - sizeof(header))
+  {
+    return -1;
+  }
+
+  // Check if the payload is complete
+  size_t request_length = sizeof(header) + header.length;
+  if (client->length < request_length)
+  {
+    return 1;
+  }
+
+  // Calculate the age of the sample in milliseconds
+  int64_t age = daemon_get_time() - daemon_snapshot_time;
+  header.age = age > 0xFFFF ? 0xFFFF : age;
+  header.status = 0;
+
+  // Call the correct operation
+  switch (header.op)
+  {
+    case DAEMON_OP_READ:
+      ret = daemon_handle_read(client, &header, payload);
+      break;
+    case DAEMON_OP_STATS:
+      ret = daemon_handle_stats(client, &header);
+      break;
+    case DAEMON_OP_ROLLUP:
+      ret = daemon_handle_rollup(client, &header, payload);
+      break;
+    default:
+      ret = -1;
+      break;
+  }
+
+  // Remove the request, keeping any request received after it
+  client->length -= request_length;
+  memmove(client->request, client->request + request_length, client->length);
+
+  return ret;
+}
+
+// Function called to answer a read request
+static int8_t daemon_handle_read(struct daemon_client* client, struct daemon_header* header,
+  const u_int8_t* payload)
+{
+  // Declare needed variables
+  struct daemon_item items[DAEMON_MAX_ITEMS];
+  u_int16_t count;
+
+  // Make sure the payload is valid
+  if (header->length == 0 || header->length > sizeof(items) ||
+      header->length % sizeof(struct daemon_item) != 0)
+  {
+    return -1;
+  }
+
+  // Fill in the requested items
+  memcpy(items, payload, header->length);
+  count = header->length / sizeof(struct daemon_item);
+  for (u_int16_t i = 0; i < count; i++)
+  {
+    daemon_fill_item(&items[i]);
+  }
+
+  return daemon_set_response(client, header, items, header->length);
+}
+
+// Function called to answer a stats request
+static int8_t daemon_handle_stats(struct daemon_client* client, struct daemon_header* header)
+{
+  // Declare needed variables
+  char* text = NULL;
+  size_t length = 0;
+  FILE* stream;
+  int8_t ret;
+
+  // Make sure there is no payload
+  if (header->length != 0)
+  {
+    return -1;
+  }
+
+  // Print the statistics into a buffer
+  stream = open_memstream(&text, &length);
+  if (stream == NULL)
+  {
+    return -1;
+  }
+  it8528_print_wait_stats(stream);
+  it8528_print_fault_stats(stream);
+  it8528_cache_print_stats(stream);
+  it8528_lock_print_stats(stream);
+  it8528_trace_print(stream);
+  realtime_print_stats(stream);
+  fclose(stream);
+
+  // Answer with the text
+  ret = daemon_set_response(client, header, text, length);
+  free(text);
+
+  return ret;
+}
+
+// Function called to answer a rollup request whose payload is the window in seconds
+static int8_t daemon_handle_rollup(struct daemon_client* client, struct daemon_header* header,
+  const u_int8_t* payload)
+{
+  // Declare needed variables
+  u_int32_t window;
+  char* text = NULL;
+  size_t length = 0;
+  FILE* stream;
+  int8_t ret;
+
+  // Get the window
+  if (header->length != sizeof(window))
+  {
+    return -1;
+  }
+  memcpy(&window, payload, sizeof(window));
+
+  // Print the merged buckets into a buffer
+  stream = open_memstream(&text, &length);
+  if (stream == NULL)
+  {
+    return -1;
+  }
+  rollup_print((int64_t)window * 1000, daemon_get_time(), stream);
+  fclose(stream);
+
+  // Answer with the text
+  ret = daemon_set_response(client, header, text, length);
+  free(text);
+
+  return ret;
+}
+
+// Function called to build the response of a client from the response header and a payload
+static int8_t daemon_set_response(struct daemon_client* client, struct daemon_header* header,
+  const void* payload, size_t length)
+{
+  // Allocate the response
+  client->response = malloc(sizeof(*header) + length);
+  if (client->response == NULL)
+  {
+    fprintf(stderr, "daemon_set_response: malloc() failed!\n");
+    return -1;
+  }
+
+  // Copy the header and the payload
+  header->length = length;
+  memcpy(client->response, header, sizeof(*header));
+  memcpy(client->response + sizeof(*header), payload, length);
+  client->response_length = sizeof(*header) + length;
+  client->offset = 0;
+
+  return 0;
+}
+
+// Function called to send as much of the response of a client as the socket takes without
+//   blocking, returns 1 if some of it is left, 0 once it was all sent, and -1 if the client is
+//   gone
+static int8_t daemon_send_response(int fd, struct daemon_client* client)
+{
+  // Send what the socket takes
+  ssize_t length = send(fd, client->response + client->offset,
+    client->response_length - client->offset, MSG_NOSIGNAL | MSG_DONTWAIT);
+  if (length < 0)
+  {
+    if (errno != EAGAIN && errno != EWOULDBLOCK)
+    {
+      return -1;
+    }
+    length = 0;
+  }
+  client->offset += length;
+
+  // Check if some of the response is left
+  if (client->offset < client->response_length)
+  {
+    return 1;
+  }
+
+  // Free the response
+  free(client->response);
+  client->response = NULL;
+
+  return 0;
+}
+
+// Function called to connect to a running daemon
+static int daemon_connect(const char* socket_path)
+{
+  // Declare needed variables
+  struct sockaddr_un address;
+  int fd;
+
+  // Make sure the socket path fits in the socket address
+  if (strlen(socket_path) >= sizeof(address.sun_path))
+  {
+    return -1;
+  }
+
+  // Create the socket
+  fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+  {
+    return -1;
+  }
+
+  // Connect to the daemon
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, socket_path);
+  if (connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0)
+  {
+    close(fd);
+    return -1;
+  }
+
+  // Make sure a wedged daemon can't stall the client
+  struct timeval tv = {
+    .tv_sec = 0,
+    .tv_usec = DAEMON_CLIENT_TIMEOUT * 1000
+  };
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+  return fd;
+}
+
+// Function called to send a request with an optional payload to a running daemon and print the
+//   text it answers with
+static int8_t daemon_client_print_text(const char* socket_path, u_int8_t op, const void* payload,
+  u_int32_t length, FILE* stream)
+{
+  // Declare needed variables
+  struct daemon_header header;
+  char buffer[4096];
+  int fd;
+
+  // Connect to the daemon
+  fd = daemon_connect(socket_path);
+  if (fd < 0)
+  {
+    return -1;
+  }
+
+  // Send the request header and the payload
+  memset(&header, 0, sizeof(header));
+  header.magic = DAEMON_PROTOCOL_MAGIC;
+  header.version = DAEMON_PROTOCOL_VERSION;
+  header.op = op;
+  header.length = length;
+  if (send(fd, &header, sizeof(header), MSG_NOSIGNAL | (length > 0 ? MSG_MORE : 0)) !=
+      sizeof(header) || (length > 0 && send(fd, payload, length, MSG_NOSIGNAL) != length))
+  {
+    close(fd);
+    return -1;
+  }
+
+  // Receive the response header
+  if (recv(fd, &header, sizeof(header), MSG_WAITALL) != sizeof(header) ||
+      header.magic != DAEMON_PROTOCOL_MAGIC || header.status != 0)
+  {
+    close(fd);
+    return -1;
+  }
+
+  // Receive the text and print it
+  while (header.length > 0)
+  {
+    ssize_t received = recv(fd, buffer, header.length < sizeof(buffer) ? header.length :
+      sizeof(buffer), 0);
+    if (received <= 0)
+    {
+      close(fd);
+      return -1;
+    }
+    fwrite(buffer, 1, received, stream);
+    header.length -= received;
+  }
+
+  close(fd);
+
+  return 0;
+}
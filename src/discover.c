@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2021 Stonyx
+ * http://www.stonyx.com
+ *
+ * Copyright (C) 2020 Guillaume Valadon
+ * guillaume@valadon.net
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+#include "it8528.h"
+#include "it8528_profile.h"
+#include "discover.h"
+
+// Declare the names of the verdicts
+static const char* const discover_verdicts[] = {
+  [DISCOVER_PRESENT] = "present",
+  [DISCOVER_UNREADABLE] = "unreadable",
+  [DISCOVER_OUT_OF_RANGE] = "out of range",
+  [DISCOVER_UNSTABLE] = "unstable",
+  [DISCOVER_FAULTY] = "faulty"
+};
+
+// Function called to find the sensors and fans that are wired up by reading every sensor and fan
+//   the chip knows about in planned block reads for a number of passes interval milliseconds
+//   apart, a sensor is present if every reading is a plausible temperature and the readings stay
+//   close to each other, and a fan is present if its status is fine and every reading is a
+//   plausible and steady speed, the verdicts are printed to the stream
+int8_t discover_run(u_int8_t passes, u_int32_t interval, struct it8528_presence* presence,
+  FILE* stream)
+{
+  // Declare needed variables
+  struct it8528_read_plan plan;
+  struct it8528_snapshot snapshot;
+  u_int8_t sensor_verdicts[IT8528_SENSOR_COUNT];
+  u_int8_t fan_verdicts[IT8528_FAN_COUNT];
+  double temperature_mins[IT8528_SENSOR_COUNT];
+  double temperature_maxs[IT8528_SENSOR_COUNT];
+  u_int16_t fan_speed_mins[IT8528_FAN_COUNT];
+  u_int16_t fan_speed_maxs[IT8528_FAN_COUNT];
+  u_int8_t sensor_count = 0;
+  u_int8_t fan_count = 0;
+  u_int8_t failures = 0;
+  struct timespec ts = {
+    .tv_sec = interval / 1000,
+    .tv_nsec = (interval % 1000) * 1000000
+  };
+
+  // Plan the reads of every sensor and fan
+  it8528_plan_snapshot(&plan, NULL, NULL);
+  memset(sensor_verdicts, DISCOVER_PRESENT, sizeof(sensor_verdicts));
+  memset(fan_verdicts, DISCOVER_PRESENT, sizeof(fan_verdicts));
+
+  // Loop through the passes
+  for (u_int8_t pass = 0; pass < passes; pass++)
+  {
+    // Wait between passes so that the readings can drift
+    if (pass > 0)
+    {
+      nanosleep(&ts, NULL);
+    }
+
+    // Read every register from the chip, never from the cache, the values that couldn't be read
+    //   are flagged in the snapshot
+    if (it8528_read_snapshot(&plan, 0, &snapshot) != 0)
+    {
+      failures++;
+    }
+
+    // Check the temperatures, a sensor keeps the first reason it was found missing for
+    for (u_int8_t i = 0; i < IT8528_SENSOR_COUNT; i++)
+    {
+      double temperature = snapshot.temperatures[i];
+      if (sensor_verdicts[i] != DISCOVER_PRESENT)
+      {
+        continue;
+      }
+      if (!snapshot.temperature_valid[i])
+      {
+        sensor_verdicts[i] = DISCOVER_UNREADABLE;
+        continue;
+      }
+      if (temperature < DISCOVER_MIN_TEMPERATURE || temperature > DISCOVER_MAX_TEMPERATURE)
+      {
+        sensor_verdicts[i] = DISCOVER_OUT_OF_RANGE;
+        continue;
+      }
+      if (pass == 0 || temperature < temperature_mins[i])
+      {
+        temperature_mins[i] = temperature;
+      }
+      if (pass == 0 || temperature > temperature_maxs[i])
+      {
+        temperature_maxs[i] = temperature;
+      }
+    }
+
+    // Check the fans
+    for (u_int8_t i = 0; i < IT8528_FAN_COUNT; i++)
+    {
+      u_int16_t speed = snapshot.fan_speeds[i];
+      if (fan_verdicts[i] != DISCOVER_PRESENT)
+      {
+        continue;
+      }
+      if (!snapshot.fan_valid[i])
+      {
+        fan_verdicts[i] = DISCOVER_UNREADABLE;
+        continue;
+      }
+      if (snapshot.fan_statuses[i] == 0)
+      {
+        fan_verdicts[i] = DISCOVER_FAULTY;
+        continue;
+      }
+      if (speed < DISCOVER_MIN_FAN_SPEED || speed > DISCOVER_MAX_FAN_SPEED)
+      {
+        fan_verdicts[i] = DISCOVER_OUT_OF_RANGE;
+        continue;
+      }
+      if (pass == 0 || speed < fan_speed_mins[i])
+      {
+        fan_speed_mins[i] = speed;
+      }
+      if (pass == 0 || speed > fan_speed_maxs[i])
+      {
+        fan_speed_maxs[i] = speed;
+      }
+    }
+  }
+
+  // Make sure the chip answered at all
+  if (failures == passes)
+  {
+    fprintf(stderr, "discover_run: it8528_read_snapshot() failed!\n");
+    return -1;
+  }
+
+  // Build the presence map, leaving out the readings that moved too much to be a real sensor or
+  //   fan
+  memset(presence, 0, sizeof(*presence));
+  presence->magic = IT8528_PRESENCE_MAGIC;
+  presence->version = IT8528_PRESENCE_VERSION;
+  presence->size = sizeof(*presence);
+  presence->created = time(NULL);
+  for (u_int8_t i = 0; i < IT8528_SENSOR_COUNT; i++)
+  {
+    if (sensor_verdicts[i] == DISCOVER_PRESENT &&
+      temperature_maxs[i] - temperature_mins[i] > DISCOVER_MAX_TEMPERATURE_SPREAD)
+    {
+      sensor_verdicts[i] = DISCOVER_UNSTABLE;
+    }
+    presence->sensor_present[i] = sensor_verdicts[i] == DISCOVER_PRESENT;
+    sensor_count += presence->sensor_present[i];
+  }
+  for (u_int8_t i = 0; i < IT8528_FAN_COUNT; i++)
+  {
+    if (fan_verdicts[i] == DISCOVER_PRESENT && fan_speed_maxs[i] - fan_speed_mins[i] >
+      (u_int32_t)fan_speed_mins[i] * DISCOVER_MAX_FAN_SPREAD / 100)
+    {
+      fan_verdicts[i] = DISCOVER_UNSTABLE;
+    }
+    presence->fan_present[i] = fan_verdicts[i] == DISCOVER_PRESENT;
+    fan_count += presence->fan_present[i];
+  }
+
+  // Print the verdicts
+  for (u_int8_t i = 0; i < IT8528_SENSOR_COUNT; i++)
+  {
+    if (sensor_verdicts[i] == DISCOVER_PRESENT || sensor_verdicts[i] == DISCOVER_UNSTABLE)
+    {
+      fprintf(stream, "sensor %-12u %-13s %.0f to %.0f °C\n", it8528_sensor_ids[i],
+        discover_verdicts[sensor_verdicts[i]], temperature_mins[i], temperature_maxs[i]);
+    }
+    else
+    {
+      fprintf(stream, "sensor %-12u %s\n", it8528_sensor_ids[i],
+        discover_verdicts[sensor_verdicts[i]]);
+    }
+  }
+  for (u_int8_t i = 0; i < IT8528_FAN_COUNT; i++)
+  {
+    if (fan_verdicts[i] == DISCOVER_PRESENT || fan_verdicts[i] == DISCOVER_UNSTABLE)
+    {
+      fprintf(stream, "fan %-15u %-13s %u to %u RPM\n", it8528_fan_ids[i],
+        discover_verdicts[fan_verdicts[i]], fan_speed_mins[i], fan_speed_maxs[i]);
+    }
+    else
+    {
+      fprintf(stream, "fan %-15u %s\n", it8528_fan_ids[i], discover_verdicts[fan_verdicts[i]]);
+    }
+  }
+  fprintf(stream, "Sensors present:    %u of %u\n", sensor_count, IT8528_SENSOR_COUNT);
+  fprintf(stream, "Fans present:       %u of %u\n", fan_count, IT8528_FAN_COUNT);
+
+  return 0;
+}
@@ -0,0 +1,885 @@
+/*
+ * Copyright (C) 2021 Stonyx
+ * http://www.stonyx.com
+ *
+ * Copyright (C) 2020 Guillaume Valadon
+ * guillaume@valadon.net
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+#include "it8528_utils.h"
+#include "it8528_cache.h"
+#include "it8528_lock.h"
+#include "it8528_trace.h"
+#include "it8528_transport.h"
+#include "it8528_emulator.h"
+#include "it8528.h"
+#include "exporter.h"
+
+// Define the structure holding a client connection and the part of its request received so far,
+//   a response that didn't fit in the socket buffer at once is copied to the client along with
+//   how much of it was sent so that the rest can be sent once the socket has room for it
+struct exporter_client
+{
+  int64_t deadline;
+  size_t length;
+  char request[EXPORTER_REQUEST_SIZE];
+  char* response;
+  size_t response_length;
+  size_t offset;
+  u_int64_t start;
+  u_int8_t metrics;
+};
+
+// Define the response sent for anything but the metrics
+static const char exporter_not_found[] =
+  "HTTP/1.1 404 Not Found\r\n"
+  "Content-Type: text/plain\r\n"
+  "Content-Length: 10\r\n"
+  "Connection: close\r\n"
+  "\r\n"
+  "Not Found\n";
+
+// Declare the latest snapshot and its sampling statistics
+static struct it8528_snapshot exporter_snapshot;
+static u_int64_t exporter_samples;
+static u_int64_t exporter_sample_errors;
+static u_int64_t exporter_sample_nanoseconds;
+
+// Declare the scrape statistics, times are in nanoseconds
+static u_int64_t exporter_scrapes;
+static u_int64_t exporter_scrape_nanoseconds;
+static u_int64_t exporter_max_scrape_nanoseconds;
+
+// Declare the prebuilt response holding the metrics of the latest snapshot
+static char* exporter_response = NULL;
+static size_t exporter_response_length = 0;
+
+// Declare the flag set by the signal handler when the exporter should stop
+static volatile sig_atomic_t exporter_stop = 0;
+
+// Declare functions
+static void exporter_handle_signal(int signal);
+static u_int64_t exporter_get_time(void);
+static int exporter_listen(const char* listen_address);
+static void exporter_sample(void);
+static void exporter_build(void);
+static void exporter_print_family(FILE* stream, const char* name, const char* type,
+  const char* help);
+static int8_t exporter_handle_client(int fd, struct exporter_client* client);
+static int8_t exporter_send_response(int fd, struct exporter_client* client,
+  const char* response, size_t response_length);
+
+// Function called to run the exporter which samples all sensors every interval milliseconds and
+//   answers Prometheus scrapes of /metrics over HTTP until it receives a SIGINT or a SIGTERM signal
+// The response is rebuilt once per sample so that a scrape never touches the chip and only costs
+//   a send of the prebuilt buffer
+int8_t exporter_run(const char* listen_address, u_int32_t interval)
+{
+  // Declare needed variables
+  static struct exporter_client clients[EXPORTER_MAX_CLIENTS + 1];
+  struct pollfd fds[EXPORTER_MAX_CLIENTS + 1];
+  nfds_t count = 1;
+  u_int64_t next_sample;
+
+  // Calibrate the handshake wait against the chip since the exporter does many reads
+  struct it8528_wait_calibration calibration;
+  if (it8528_calibrate_wait(&calibration) != 0)
+  {
+    fprintf(stderr, "exporter_run: it8528_calibrate_wait() failed!\n");
+  }
+
+  // Install the signal handlers
+  signal(SIGINT, exporter_handle_signal);
+  signal(SIGTERM, exporter_handle_signal);
+  signal(SIGPIPE, SIG_IGN);
+
+  // Create the listening socket
+  fds[0].fd = exporter_listen(listen_address);
+  if (fds[0].fd < 0)
+  {
+    fprintf(stderr, "exporter_run: exporter_listen() failed!\n");
+    return -1;
+  }
+  fds[0].events = POLLIN;
+
+  // Make sure every sample reads registers no older than half the sampling interval so that a
+  //   cached value is never exported twice
+  it8528_cache_limit_age(interval / 2);
+
+  // Take the first sample
+  exporter_sample();
+  next_sample = exporter_get_time() + (u_int64_t)interval * 1000000;
+
+  // Loop until we are told to stop
+  while (!exporter_stop)
+  {
+    // Calculate how long we can wait before the next sample is due or the oldest client times
+    //   out
+    u_int64_t now = exporter_get_time();
+    u_int64_t wake = next_sample;
+    for (nfds_t i = 1; i < count; i++)
+    {
+      if ((u_int64_t)clients[i].deadline < wake)
+      {
+        wake = clients[i].deadline;
+      }
+    }
+    int timeout = wake > now ? (wake - now + 999999) / 1000000 : 0;
+
+    // Wait for a connection, a request, or the next sample
+    if (poll(fds, count, timeout) < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+
+      fprintf(stderr, "exporter_run: poll() failed!\n");
+      break;
+    }
+
+    // Check if the next sample is due
+    if (exporter_get_time() >= next_sample)
+    {
+      exporter_sample();
+      next_sample += (u_int64_t)interval * 1000000;
+
+      // Skip any samples we missed instead of sampling in a burst
+      if (next_sample <= exporter_get_time())
+      {
+        next_sample = exporter_get_time() + (u_int64_t)interval * 1000000;
+      }
+    }
+
+    // Handle the clients that sent a request, hung up, or timed out, walking backwards so that
+    //   the last client can be moved into the slot of a removed one
+    now = exporter_get_time();
+    for (nfds_t i = count - 1; i > 0; i--)
+    {
+      // Check if the client is still sending its request and has time left
+      if (fds[i].revents == 0 && (u_int64_t)clients[i].deadline > now)
+      {
+        continue;
+      }
+
+      // Check if the client is done, either answered, hung up, or too slow
+      if (fds[i].revents == 0 || (fds[i].revents & (POLLIN | POLLOUT)) == 0 ||
+          exporter_handle_client(fds[i].fd, &clients[i]) != 1)
+      {
+        close(fds[i].fd);
+        free(clients[i].response);
+        count--;
+        fds[i] = fds[count];
+        clients[i] = clients[count];
+      }
+      else
+      {
+        // Wait for room in the socket buffer once the client is being answered
+        fds[i].events = clients[i].response != NULL ? POLLOUT : POLLIN;
+      }
+    }
+
+    // Check if there is a new client
+    if (fds[0].revents & POLLIN)
+    {
+      // Accept the client
+      int fd = accept4(fds[0].fd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+      if (fd >= 0)
+      {
+        // Make sure there is room for the client
+        if (count > EXPORTER_MAX_CLIENTS)
+        {
+          close(fd);
+        }
+        else
+        {
+          // Add the client
+          fds[count].fd = fd;
+          fds[count].events = POLLIN;
+          fds[count].revents = 0;
+          clients[count].deadline = exporter_get_time() +
+            (u_int64_t)EXPORTER_CLIENT_TIMEOUT * 1000000;
+          clients[count].length = 0;
+          clients[count].response = NULL;
+          count++;
+        }
+      }
+    }
+  }
+
+  // Close all the sockets and free the responses left to send
+  for (nfds_t i = 0; i < count; i++)
+  {
+    close(fds[i].fd);
+    if (i > 0)
+    {
+      free(clients[i].response);
+    }
+  }
+
+  // Free the response
+  free(exporter_response);
+  exporter_response = NULL;
+  exporter_response_length = 0;
+
+  return 0;
+}
+
+// Function called to check that the fan status metrics follow the status of the fans of the
+//   emulated chip, a faulty fan must be exported as 0 and a working fan as 1 like the fan command,
+//   hwmon, and discover read them
+int8_t exporter_check(void)
+{
+  // Declare needed variables
+  char faulty[64];
+  char working[64];
+  int8_t ret = 0;
+
+  // Open the emulated chip without any response delay and flag the first fan as faulty
+  if (it8528_open_transport("emulated") != 0)
+  {
+    fprintf(stderr, "exporter_check: it8528_open_transport() failed!\n");
+    return -1;
+  }
+  it8528_emulator_set_delays(0, 0);
+  it8528_emulator_set_register(EXPORTER_CHECK_STATUS_COMMAND, 0x01);
+
+  // Sample the chip and build the metrics
+  exporter_sample();
+  if (exporter_response == NULL)
+  {
+    fprintf(stderr, "exporter_check: exporter_sample() failed!\n");
+    return -1;
+  }
+
+  // Look for the help text and the status of the faulty fan and of the working fan next to it
+  snprintf(faulty, sizeof(faulty), "\npanq_fan_status{fan=\"%u\"} 0\n", it8528_fan_ids[0]);
+  snprintf(working, sizeof(working), "\npanq_fan_status{fan=\"%u\"} 1\n", it8528_fan_ids[1]);
+  if (strstr(exporter_response, "# HELP panq_fan_status Status of a fan, 1 if the fan is working"
+    " and 0 if it is faulty.\n") == NULL)
+  {
+    fprintf(stderr, "exporter_check: wrong panq_fan_status help text!\n");
+    ret = -1;
+  }
+  if (strstr(exporter_response, faulty) == NULL)
+  {
+    fprintf(stderr, "exporter_check: faulty fan %u not exported as 0!\n", it8528_fan_ids[0]);
+    ret = -1;
+  }
+  if (strstr(exporter_response, working) == NULL)
+  {
+    fprintf(stderr, "exporter_check: working fan %u not exported as 1!\n", it8528_fan_ids[1]);
+    ret = -1;
+  }
+
+  // Print the result
+  printf("fan status mapping     %s\n", ret == 0 ? "ok" : "wrong");
+
+  return ret;
+}
+
+// Function called when the exporter receives a SIGINT or a SIGTERM signal
+static void exporter_handle_signal(int signal)
+{
+  exporter_stop = 1;
+}
+
+// Function called to get the monotonic time in nanoseconds
+static u_int64_t exporter_get_time(void)
+{
+  // Declare needed variables
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (u_int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Function called to create a socket listening on an address like 127.0.0.1:9528 or [::1]:9528
+static int exporter_listen(const char* listen_address)
+{
+  // Declare needed variables
+  struct addrinfo hints;
+  struct addrinfo* addresses;
+  char* host = strdup(listen_address);
+  char* port;
+  int fd = -1;
+
+  // Make sure we got a copy of the address
+  if (host == NULL)
+  {
+    return -1;
+  }
+
+  // Split the address into its host and port, removing the brackets around an IPv6 host
+  port = strrchr(host, ':');
+  if (port == NULL || port == host || port[1] == '\0')
+  {
+    fprintf(stderr, "exporter_listen: invalid listen address!\n");
+    free(host);
+    return -1;
+  }
+  *port++ = '\0';
+  char* name = host;
+  if (name[0] == '[' && name[strlen(name) - 1] == ']')
+  {
+    name[strlen(name) - 1] = '\0';
+    name++;
+  }
+
+  // Resolve the address
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+  if (getaddrinfo(name, port, &hints, &addresses) != 0)
+  {
+    fprintf(stderr, "exporter_listen: getaddrinfo() failed!\n");
+    free(host);
+    return -1;
+  }
+
+  // Create, bind, and listen on a socket for the first address that works
+  for (struct addrinfo* address = addresses; address != NULL; address = address->ai_next)
+  {
+    // Create the socket
+    fd = socket(address->ai_family, address->ai_socktype | SOCK_CLOEXEC, address->ai_protocol);
+    if (fd < 0)
+    {
+      continue;
+    }
+
+    // Allow a restarted exporter to reuse the port straight away
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    // Bind the socket and start listening
+    if (bind(fd, address->ai_addr, address->ai_addrlen) == 0 &&
+        listen(fd, EXPORTER_MAX_CLIENTS) == 0)
+    {
+      break;
+    }
+    close(fd);
+    fd = -1;
+  }
+
+  freeaddrinfo(addresses);
+  free(host);
+
+  return fd;
+}
+
+// Function called to sample all the sensors and fans and rebuild the response
+static void exporter_sample(void)
+{
+  // Take a snapshot, invalid values are flagged in the snapshot itself
+  u_int64_t start = exporter_get_time();
+  if (it8528_get_snapshot(&exporter_snapshot) != 0)
+  {
+    exporter_sample_errors++;
+  }
+  exporter_sample_nanoseconds = exporter_get_time() - start;
+  exporter_samples++;
+
+  // Rebuild the response from the new snapshot
+  exporter_build();
+}
+
+// Function called to build the response holding the metrics of the latest snapshot in the
+//   Prometheus text format, the previous response is kept if building fails
+static void exporter_build(void)
+{
+  // Declare needed variables
+  char* body = NULL;
+  size_t body_length = 0;
+  char header[256];
+  FILE* stream;
+
+  // Print the metrics into a buffer
+  stream = open_memstream(&body, &body_length);
+  if (stream == NULL)
+  {
+    fprintf(stderr, "exporter_build: open_memstream() failed!\n");
+    return;
+  }
+
+  // Print the temperatures
+  exporter_print_family(stream, "panq_temperature_celsius", "gauge",
+    "Temperature of a sensor.");
+  for (u_int8_t i = 0; i < IT8528_SENSOR_COUNT; i++)
+  {
+    if (exporter_snapshot.temperature_valid[i])
+    {
+      fprintf(stream, "panq_temperature_celsius{sensor=\"%u\"} %.2f\n", it8528_sensor_ids[i],
+        exporter_snapshot.temperatures[i]);
+    }
+  }
+
+  // Print the fan speeds, PWMs, and statuses
+  exporter_print_family(stream, "panq_fan_speed_rpm", "gauge", "Speed of a fan.");
+  for (u_int8_t i = 0; i < IT8528_FAN_COUNT; i++)
+  {
+    if (exporter_snapshot.fan_valid[i])
+    {
+      fprintf(stream, "panq_fan_speed_rpm{fan=\"%u\"} %u\n", it8528_fan_ids[i],
+        exporter_snapshot.fan_speeds[i]);
+    }
+  }
+  exporter_print_family(stream, "panq_fan_pwm_percent", "gauge", "PWM duty cycle of a fan.");
+  for (u_int8_t i = 0; i < IT8528_FAN_COUNT; i++)
+  {
+    if (exporter_snapshot.fan_valid[i])
+    {
+      fprintf(stream, "panq_fan_pwm_percent{fan=\"%u\"} %u\n", it8528_fan_ids[i],
+        exporter_snapshot.fan_pwms[i]);
+    }
+  }
+  exporter_print_family(stream, "panq_fan_status", "gauge",
+    "Status of a fan, 1 if the fan is working and 0 if it is faulty.");
+  for (u_int8_t i = 0; i < IT8528_FAN_COUNT; i++)
+  {
+    if (exporter_snapshot.fan_valid[i])
+    {
+      fprintf(stream, "panq_fan_status{fan=\"%u\"} %u\n", it8528_fan_ids[i],
+        exporter_snapshot.fan_statuses[i]);
+    }
+  }
+
+  // Print the power supply statuses
+  exporter_print_family(stream, "panq_power_supply_status", "gauge",
+    "Status of a power supply.");
+  for (u_int8_t i = 0; i < IT8528_POWER_SUPPLY_COUNT; i++)
+  {
+    if (exporter_snapshot.power_supply_valid[i])
+    {
+      fprintf(stream, "panq_power_supply_status{power_supply=\"%u\"} %u\n", i + 1,
+        exporter_snapshot.power_supply_statuses[i]);
+    }
+  }
+
+  // Print the sampling statistics
+  exporter_print_family(stream, "panq_sample_timestamp_seconds", "gauge",
+    "Wall time the latest sample was taken at.");
+  fprintf(stream, "panq_sample_timestamp_seconds %ld.%09ld\n",
+    (long)exporter_snapshot.time.tv_sec, exporter_snapshot.time.tv_nsec);
+  exporter_print_family(stream, "panq_sample_duration_seconds", "gauge",
+    "Time taken by the latest sample.");
+  fprintf(stream, "panq_sample_duration_seconds %.9f\n", exporter_sample_nanoseconds / 1e9);
+  exporter_print_family(stream, "panq_samples_total", "counter", "Samples taken.");
+  fprintf(stream, "panq_samples_total %llu\n", (unsigned long long)exporter_samples);
+  exporter_print_family(stream, "panq_sample_errors_total", "counter",
+    "Samples where at least one register couldn't be read.");
+  fprintf(stream, "panq_sample_errors_total %llu\n", (unsigned long long)exporter_sample_errors);
+
+  // Print the handshake statistics, every retry of a handshake is a poll of the status port
+  exporter_print_family(stream, "panq_handshakes_total", "counter", "Handshakes with the chip.");
+  for (u_int8_t i = 0; i < IT8528_HANDSHAKE_KINDS; i++)
+  {
+    struct it8528_handshake_stats stats;
+    it8528_get_handshake_stats(i, &stats);
+    fprintf(stream, "panq_handshakes_total{kind=\"%s\"} %llu\n", it8528_get_handshake_name(i),
+      (unsigned long long)stats.count);
+  }
+  exporter_print_family(stream, "panq_handshake_polls_total", "counter",
+    "Status port polls made while waiting for a handshake.");
+  for (u_int8_t i = 0; i < IT8528_HANDSHAKE_KINDS; i++)
+  {
+    struct it8528_handshake_stats stats;
+    it8528_get_handshake_stats(i, &stats);
+    fprintf(stream, "panq_handshake_polls_total{kind=\"%s\"} %llu\n",
+      it8528_get_handshake_name(i), (unsigned long long)stats.polls);
+  }
+  exporter_print_family(stream, "panq_handshake_timeouts_total", "counter",
+    "Handshakes that timed out.");
+  for (u_int8_t i = 0; i < IT8528_HANDSHAKE_KINDS; i++)
+  {
+    struct it8528_handshake_stats stats;
+    it8528_get_handshake_stats(i, &stats);
+    fprintf(stream, "panq_handshake_timeouts_total{kind=\"%s\"} %llu\n",
+      it8528_get_handshake_name(i), (unsigned long long)stats.timeouts);
+  }
+  exporter_print_family(stream, "panq_handshake_seconds_total", "counter",
+    "Time spent waiting for handshakes.");
+  for (u_int8_t i = 0; i < IT8528_HANDSHAKE_KINDS; i++)
+  {
+    struct it8528_handshake_stats stats;
+    it8528_get_handshake_stats(i, &stats);
+    fprintf(stream, "panq_handshake_seconds_total{kind=\"%s\"} %.9f\n",
+      it8528_get_handshake_name(i), stats.nanoseconds / 1e9);
+  }
+  exporter_print_family(stream, "panq_handshake_max_seconds", "gauge",
+    "Longest wait for a handshake.");
+  for (u_int8_t i = 0; i < IT8528_HANDSHAKE_KINDS; i++)
+  {
+    struct it8528_handshake_stats stats;
+    it8528_get_handshake_stats(i, &stats);
+    fprintf(stream, "panq_handshake_max_seconds{kind=\"%s\"} %.9f\n",
+      it8528_get_handshake_name(i), stats.max_nanoseconds / 1e9);
+  }
+
+  // Print the failed transaction and circuit breaker statistics
+  struct it8528_fault_stats fault_stats;
+  it8528_get_fault_stats(&fault_stats);
+  exporter_print_family(stream, "panq_transaction_failures_total", "counter",
+    "Transactions with the chip that failed.");
+  fprintf(stream, "panq_transaction_failures_total %llu\n",
+    (unsigned long long)fault_stats.failures);
+  exporter_print_family(stream, "panq_transaction_deadline_misses_total", "counter",
+    "Transactions with the chip cut short by their deadline.");
+  fprintf(stream, "panq_transaction_deadline_misses_total %llu\n",
+    (unsigned long long)fault_stats.deadline_misses);
+  exporter_print_family(stream, "panq_breaker_state", "gauge",
+    "State of the circuit breaker guarding the chip.");
+  for (u_int8_t i = IT8528_BREAKER_CLOSED; i <= IT8528_BREAKER_HALF_OPEN; i++)
+  {
+    fprintf(stream, "panq_breaker_state{state=\"%s\"} %u\n", it8528_get_breaker_state_name(i),
+      fault_stats.breaker_state == i);
+  }
+  exporter_print_family(stream, "panq_breaker_trips_total", "counter",
+    "Times the circuit breaker opened.");
+  fprintf(stream, "panq_breaker_trips_total %llu\n", (unsigned long long)fault_stats.breaker_trips);
+  exporter_print_family(stream, "panq_breaker_fast_failures_total", "counter",
+    "Transactions refused while the circuit breaker was open.");
+  fprintf(stream, "panq_breaker_fast_failures_total %llu\n",
+    (unsigned long long)fault_stats.fast_failures);
+  exporter_print_family(stream, "panq_breaker_recoveries_total", "counter",
+    "Times the chip was recovered and the circuit breaker closed again.");
+  fprintf(stream, "panq_breaker_recoveries_total %llu\n",
+    (unsigned long long)fault_stats.recoveries);
+
+  // Print the cache statistics
+  exporter_print_family(stream, "panq_cache_hits_total", "counter",
+    "Register reads answered by the cache.");
+  for (u_int8_t i = 0; i < IT8528_CACHE_CLASSES; i++)
+  {
+    struct it8528_cache_stats stats;
+    it8528_cache_get_stats(i, &stats);
+    fprintf(stream, "panq_cache_hits_total{class=\"%s\"} %llu\n", it8528_cache_get_class_name(i),
+      (unsigned long long)stats.hits);
+  }
+  exporter_print_family(stream, "panq_cache_misses_total", "counter",
+    "Register reads that went to the chip.");
+  for (u_int8_t i = 0; i < IT8528_CACHE_CLASSES; i++)
+  {
+    struct it8528_cache_stats stats;
+    it8528_cache_get_stats(i, &stats);
+    fprintf(stream, "panq_cache_misses_total{class=\"%s\"} %llu\n",
+      it8528_cache_get_class_name(i), (unsigned long long)stats.misses);
+  }
+
+  // Print the lock statistics
+  struct it8528_lock_stats lock_stats;
+  it8528_lock_get_stats(&lock_stats);
+  exporter_print_family(stream, "panq_lock_acquisitions_total", "counter",
+    "Acquisitions of the lock shared with the other processes.");
+  fprintf(stream, "panq_lock_acquisitions_total %llu\n",
+    (unsigned long long)lock_stats.acquisitions);
+  exporter_print_family(stream, "panq_lock_contentions_total", "counter",
+    "Acquisitions that had to wait for another process.");
+  fprintf(stream, "panq_lock_contentions_total %llu\n",
+    (unsigned long long)lock_stats.contentions);
+  exporter_print_family(stream, "panq_lock_timeouts_total", "counter",
+    "Acquisitions that gave up waiting.");
+  fprintf(stream, "panq_lock_timeouts_total %llu\n", (unsigned long long)lock_stats.timeouts);
+  exporter_print_family(stream, "panq_lock_recoveries_total", "counter",
+    "Acquisitions that recovered the lock from a dead owner.");
+  fprintf(stream, "panq_lock_recoveries_total %llu\n",
+    (unsigned long long)lock_stats.recoveries);
+  exporter_print_family(stream, "panq_lock_wait_seconds_total", "counter",
+    "Time spent waiting for the lock.");
+  fprintf(stream, "panq_lock_wait_seconds_total %.9f\n", lock_stats.wait_nanoseconds / 1e9);
+  exporter_print_family(stream, "panq_lock_hold_seconds_total", "counter",
+    "Time spent holding the lock.");
+  fprintf(stream, "panq_lock_hold_seconds_total %.9f\n", lock_stats.hold_nanoseconds / 1e9);
+  exporter_print_family(stream, "panq_lock_preemptions_total", "counter",
+    "Block reads that handed the lock over to a request of a higher class.");
+  fprintf(stream, "panq_lock_preemptions_total %llu\n",
+    (unsigned long long)lock_stats.preemptions);
+  exporter_print_family(stream, "panq_lock_class_acquisitions_total", "counter",
+    "Acquisitions of the lock by priority class.");
+  for (u_int8_t i = 0; i < IT8528_LOCK_CLASSES; i++)
+  {
+    fprintf(stream, "panq_lock_class_acquisitions_total{class=\"%s\"} %llu\n",
+      it8528_lock_get_class_name(i), (unsigned long long)lock_stats.class_acquisitions[i]);
+  }
+  exporter_print_family(stream, "panq_lock_class_timeouts_total", "counter",
+    "Requests that missed their deadline by priority class.");
+  for (u_int8_t i = 0; i < IT8528_LOCK_CLASSES; i++)
+  {
+    fprintf(stream, "panq_lock_class_timeouts_total{class=\"%s\"} %llu\n",
+      it8528_lock_get_class_name(i), (unsigned long long)lock_stats.class_timeouts[i]);
+  }
+  exporter_print_family(stream, "panq_lock_class_wait_seconds_total", "counter",
+    "Time spent queueing for the lock by priority class.");
+  for (u_int8_t i = 0; i < IT8528_LOCK_CLASSES; i++)
+  {
+    fprintf(stream, "panq_lock_class_wait_seconds_total{class=\"%s\"} %.9f\n",
+      it8528_lock_get_class_name(i), lock_stats.class_wait_nanoseconds[i] / 1e9);
+  }
+  exporter_print_family(stream, "panq_lock_class_wait_max_seconds", "gauge",
+    "Longest queueing for the lock by priority class.");
+  for (u_int8_t i = 0; i < IT8528_LOCK_CLASSES; i++)
+  {
+    fprintf(stream, "panq_lock_class_wait_max_seconds{class=\"%s\"} %.9f\n",
+      it8528_lock_get_class_name(i), lock_stats.class_max_wait_nanoseconds[i] / 1e9);
+  }
+
+  // Print the latency histogram of every operation, the buckets are cumulative
+  exporter_print_family(stream, "panq_operation_duration_seconds", "histogram",
+    "Latency of the chip transactions, lock waits, and handshakes.");
+  for (u_int8_t i = 0; i < IT8528_TRACE_OPS; i++)
+  {
+    // Declare needed variables
+    struct it8528_trace_counters counters;
+    const char* name = it8528_trace_get_op_name(i);
+    u_int64_t cumulative = 0;
+
+    it8528_trace_get_counters(i, &counters);
+    for (u_int8_t j = 0; j < IT8528_TRACE_BUCKETS - 1; j++)
+    {
+      cumulative += counters.buckets[j];
+      fprintf(stream, "panq_operation_duration_seconds_bucket{op=\"%s\",le=\"%.9f\"} %llu\n",
+        name, (it8528_trace_get_bucket_limit(j) + 1) / 1e9, (unsigned long long)cumulative);
+    }
+    fprintf(stream, "panq_operation_duration_seconds_bucket{op=\"%s\",le=\"+Inf\"} %llu\n", name,
+      (unsigned long long)counters.count);
+    fprintf(stream, "panq_operation_duration_seconds_sum{op=\"%s\"} %.9f\n", name,
+      counters.nanoseconds / 1e9);
+    fprintf(stream, "panq_operation_duration_seconds_count{op=\"%s\"} %llu\n", name,
+      (unsigned long long)counters.count);
+  }
+  exporter_print_family(stream, "panq_operation_errors_total", "counter",
+    "Chip transactions, lock waits, and handshakes that failed.");
+  for (u_int8_t i = 0; i < IT8528_TRACE_OPS; i++)
+  {
+    struct it8528_trace_counters counters;
+    it8528_trace_get_counters(i, &counters);
+    fprintf(stream, "panq_operation_errors_total{op=\"%s\"} %llu\n",
+      it8528_trace_get_op_name(i), (unsigned long long)counters.errors);
+  }
+  exporter_print_family(stream, "panq_operation_retries_total", "counter",
+    "Handshakes that went back to sleep before the chip was ready.");
+  for (u_int8_t i = 0; i < IT8528_TRACE_OPS; i++)
+  {
+    struct it8528_trace_counters counters;
+    it8528_trace_get_counters(i, &counters);
+    fprintf(stream, "panq_operation_retries_total{op=\"%s\"} %llu\n",
+      it8528_trace_get_op_name(i), (unsigned long long)counters.retries);
+  }
+
+  // Print the transactions of every register
+  struct it8528_trace_register* registers = malloc(IT8528_TRACE_REGISTERS * sizeof(*registers));
+  if (registers != NULL)
+  {
+    u_int16_t count = it8528_trace_get_registers(registers);
+    exporter_print_family(stream, "panq_register_transactions_total", "counter",
+      "Chip transactions by register and direction.");
+    for (u_int16_t i = 0; i < count; i++)
+    {
+      fprintf(stream, "panq_register_transactions_total{register=\"0x%04X\",op=\"read\"} %llu\n",
+        registers[i].command, (unsigned long long)registers[i].reads);
+      fprintf(stream, "panq_register_transactions_total{register=\"0x%04X\",op=\"write\"} %llu\n",
+        registers[i].command, (unsigned long long)registers[i].writes);
+    }
+    exporter_print_family(stream, "panq_register_errors_total", "counter",
+      "Chip transactions that failed by register.");
+    for (u_int16_t i = 0; i < count; i++)
+    {
+      fprintf(stream, "panq_register_errors_total{register=\"0x%04X\"} %llu\n",
+        registers[i].command, (unsigned long long)registers[i].errors);
+    }
+    exporter_print_family(stream, "panq_register_seconds_total", "counter",
+      "Time spent in chip transactions by register.");
+    for (u_int16_t i = 0; i < count; i++)
+    {
+      fprintf(stream, "panq_register_seconds_total{register=\"0x%04X\"} %.9f\n",
+        registers[i].command, registers[i].nanoseconds / 1e9);
+    }
+    exporter_print_family(stream, "panq_register_max_seconds", "gauge",
+      "Longest chip transaction by register.");
+    for (u_int16_t i = 0; i < count; i++)
+    {
+      fprintf(stream, "panq_register_max_seconds{register=\"0x%04X\"} %.9f\n",
+        registers[i].command, registers[i].max_nanoseconds / 1e9);
+    }
+    free(registers);
+  }
+
+  // Print the fan register write statistics
+  struct it8528_fan_write_stats fan_write_stats;
+  it8528_get_fan_write_stats(&fan_write_stats);
+  exporter_print_family(stream, "panq_fan_register_writes_total", "counter",
+    "Fan mode and PWM register writes that reached the chip.");
+  fprintf(stream, "panq_fan_register_writes_total %llu\n",
+    (unsigned long long)fan_write_stats.writes);
+  exporter_print_family(stream, "panq_fan_register_writes_suppressed_total", "counter",
+    "Fan mode and PWM register writes skipped since they wouldn't change the register.");
+  fprintf(stream, "panq_fan_register_writes_suppressed_total %llu\n",
+    (unsigned long long)fan_write_stats.suppressed);
+
+  // Print the scrape statistics, they lag behind by up to one sample since the response is only
+  //   rebuilt when a new sample lands
+  exporter_print_family(stream, "panq_scrapes_total", "counter", "Scrapes answered.");
+  fprintf(stream, "panq_scrapes_total %llu\n", (unsigned long long)exporter_scrapes);
+  exporter_print_family(stream, "panq_scrape_seconds_total", "counter",
+    "Time spent answering scrapes.");
+  fprintf(stream, "panq_scrape_seconds_total %.9f\n", exporter_scrape_nanoseconds / 1e9);
+  exporter_print_family(stream, "panq_scrape_max_seconds", "gauge",
+    "Longest time spent answering a scrape.");
+  fprintf(stream, "panq_scrape_max_seconds %.9f\n", exporter_max_scrape_nanoseconds / 1e9);
+
+  // Close the buffer
+  if (fclose(stream) != 0 || body == NULL)
+  {
+    fprintf(stderr, "exporter_build: fclose() failed!\n");
+    free(body);
+    return;
+  }
+
+  // Prepend the HTTP header to the metrics
+  int header_length = snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\n"
+    "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+    "Content-Length: %zu\r\n"
+    "Connection: close\r\n"
+    "\r\n", body_length);
+  char* response = malloc(header_length + body_length);
+  if (response == NULL)
+  {
+    fprintf(stderr, "exporter_build: malloc() failed!\n");
+    free(body);
+    return;
+  }
+  memcpy(response, header, header_length);
+  memcpy(response + header_length, body, body_length);
+  free(body);
+
+  // Replace the previous response
+  free(exporter_response);
+  exporter_response = response;
+  exporter_response_length = header_length + body_length;
+}
+
+// Function called to print the help and type lines of a metric family
+static void exporter_print_family(FILE* stream, const char* name, const char* type,
+  const char* help)
+{
+  fprintf(stream, "# HELP %s %s\n", name, help);
+  fprintf(stream, "# TYPE %s %s\n", name, type);
+}
+
+// Function called to receive more of the request of a client and answer it once it is complete,
+//   returns 1 if the request or the response isn't complete yet and 0 once the client was answered
+static int8_t exporter_handle_client(int fd, struct exporter_client* client)
+{
+  // Check if the client is being answered
+  if (client->response != NULL)
+  {
+    return exporter_send_response(fd, client, client->response, client->response_length);
+  }
+
+  // Receive what the client sent so far, keeping room for a terminating null character
+  ssize_t length = recv(fd, client->request + client->length,
+    sizeof(client->request) - client->length - 1, MSG_DONTWAIT);
+  if (length <= 0)
+  {
+    return length < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) ? 1 : -1;
+  }
+  client->length += length;
+  client->request[client->length] = '\0';
+
+  // Check if the request header is complete
+  if (strstr(client->request, "\r\n\r\n") == NULL && strstr(client->request, "\n\n") == NULL)
+  {
+    // Give up on requests that don't fit in the buffer
+    return client->length < sizeof(client->request) - 1 ? 1 : -1;
+  }
+
+  // Send the prebuilt metrics for a request of /metrics and a not found response for anything
+  //   else
+  const char* response = exporter_not_found;
+  size_t response_length = sizeof(exporter_not_found) - 1;
+  if (exporter_response != NULL && (strncmp(client->request, "GET /metrics ", 13) == 0 ||
+      strncmp(client->request, "GET /metrics?", 13) == 0))
+  {
+    response = exporter_response;
+    response_length = exporter_response_length;
+  }
+  client->start = exporter_get_time();
+  client->metrics = response == exporter_response;
+  client->offset = 0;
+
+  return exporter_send_response(fd, client, response, response_length);
+}
+
+// Function called to send as much of the rest of a response as the socket takes without blocking,
+//   the first time some of it is left the response is copied to the client since the prebuilt
+//   metrics are replaced by the next sample, a client that stops reading is dropped once its
+//   deadline passes, returns 1 if some of the response is left and 0 once it was all sent
+static int8_t exporter_send_response(int fd, struct exporter_client* client,
+  const char* response, size_t response_length)
+{
+  // Send what the socket takes
+  ssize_t length = send(fd, response + client->offset, response_length - client->offset,
+    MSG_NOSIGNAL | MSG_DONTWAIT);
+  if (length < 0)
+  {
+    if (errno != EAGAIN && errno != EWOULDBLOCK)
+    {
+      return -1;
+    }
+    length = 0;
+  }
+  client->offset += length;
+
+  // Check if some of the response is left
+  if (client->offset < response_length)
+  {
+    // Keep a copy of the response
+    if (client->response == NULL)
+    {
+      client->response = malloc(response_length);
+      if (client->response == NULL)
+      {
+        fprintf(stderr, "exporter_send_response: malloc() failed!\n");
+        return -1;
+      }
+      memcpy(client->response, response, response_length);
+      client->response_length = response_length;
+    }
+
+    // Give the client more time as long as it reads
+    if (length > 0)
+    {
+      client->deadline = exporter_get_time() + (u_int64_t)EXPORTER_CLIENT_TIMEOUT * 1000000;
+    }
+
+    return 1;
+  }
+
+  // Update the scrape statistics
+  if (client->metrics)
+  {
+    u_int64_t nanoseconds = exporter_get_time() - client->start;
+    exporter_scrapes++;
+    exporter_scrape_nanoseconds += nanoseconds;
+    if (nanoseconds > exporter_max_scrape_nanoseconds)
+    {
+      exporter_max_scrape_nanoseconds = nanoseconds;
+    }
+  }
+
+  return 0;
+}
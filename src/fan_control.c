@@ -0,0 +1,996 @@
+/*
+ * Copyright (C) 2021 Stonyx
+ * http://www.stonyx.com
+ *
+ * Copyright (C) 2020 Guillaume Valadon
+ * guillaume@valadon.net
+ */
+
+#include <ctype.h>
+#include <math.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+#include "it8528_cache.h"
+#include "it8528_emulator.h"
+#include "it8528_lock.h"
+#include "it8528_transport.h"
+#include "it8528.h"
+#include "realtime.h"
+#include "thermal_model.h"
+#include "fan_control.h"
+
+// Define the constants of the thermal model used by the simulation, every fan group heats a mass
+//   of FAN_CONTROL_PLANT_CAPACITY J/K with the load and loses heat to the ambient air through a
+//   conductance in W/K that grows with the airflow
+#define FAN_CONTROL_PLANT_AMBIENT 25.0
+#define FAN_CONTROL_PLANT_CAPACITY 200.0
+#define FAN_CONTROL_PLANT_IDLE_POWER 20.0
+#define FAN_CONTROL_PLANT_LOAD_POWER 60.0
+#define FAN_CONTROL_PLANT_LOAD_PERIOD 600.0
+#define FAN_CONTROL_PLANT_STILL_CONDUCTANCE 0.5
+#define FAN_CONTROL_PLANT_AIRFLOW_CONDUCTANCE 2.5
+#define FAN_CONTROL_PLANT_STEP 0.1
+
+// Declare the names of the control modes
+static const char* const fan_control_modes[] = {
+  [FAN_CONTROL_MODE_PID] = "pid",
+  [FAN_CONTROL_MODE_CURVE] = "curve",
+  [FAN_CONTROL_MODE_PREDICTIVE] = "predictive"
+};
+
+// Declare the flag set by the signal handler when the control loop should stop
+static volatile sig_atomic_t fan_control_stop = 0;
+
+// Declare functions
+static int8_t fan_control_parse_line(struct fan_control* control, struct fan_control_group* group,
+  char* key, char* value);
+static int8_t fan_control_parse_ids(char* value, u_int8_t* ids, u_int8_t* count, u_int8_t max,
+  const u_int8_t* valid_ids, u_int8_t valid_count);
+static int8_t fan_control_parse_curve(char* value, struct fan_control_group* group);
+static int8_t fan_control_parse_number(const char* value, double* number);
+static int8_t fan_control_check_group(struct fan_control_group* group);
+static double fan_control_compute(struct fan_control_group* group, double dt, double load);
+static int8_t fan_control_predict(struct fan_control_group* group, double load, double* output);
+static double fan_control_get_prediction(struct fan_control_group* group, double speed,
+  double load);
+static double fan_control_interpolate(struct fan_control_group* group, double temperature);
+static int8_t fan_control_apply(struct fan_control_group* group, u_int8_t speed);
+static int8_t fan_control_release(struct fan_control* control);
+static void fan_control_update_load(struct fan_control* control);
+static char* fan_control_trim(char* text);
+static void fan_control_handle_signal(int signal);
+
+// Function called to load a configuration file made of global key = value lines followed by one
+//   [group] section per fan group, see the README file for the keys
+int8_t fan_control_load(const char* path, struct fan_control* control)
+{
+  // Declare needed variables
+  FILE* file;
+  char line[256];
+  u_int32_t line_number = 0;
+  struct fan_control_group* group = NULL;
+  int8_t ret = 0;
+
+  // Open the file
+  file = fopen(path, "r");
+  if (file == NULL)
+  {
+    fprintf(stderr, "fan_control_load: fopen() failed!\n");
+    return -1;
+  }
+
+  // Start from the defaults
+  memset(control, 0, sizeof(*control));
+  control->interval = FAN_CONTROL_DEFAULT_INTERVAL;
+
+  // Loop through the lines
+  while (fgets(line, sizeof(line), file) != NULL)
+  {
+    line_number++;
+
+    // Remove the comment and the surrounding whitespace
+    char* comment = strchr(line, '#');
+    if (comment != NULL)
+    {
+      *comment = '\0';
+    }
+    char* text = fan_control_trim(line);
+    if (*text == '\0')
+    {
+      continue;
+    }
+
+    // Check if this line starts a new group
+    if (strcmp(text, "[group]") == 0)
+    {
+      // Make sure there is room for the group
+      if (control->group_count == FAN_CONTROL_MAX_GROUPS)
+      {
+        fprintf(stderr, "%s:%u: too many groups!\n", path, line_number);
+        ret = -1;
+        break;
+      }
+
+      // Set the defaults of the group
+      group = &control->groups[control->group_count++];
+      group->mode = FAN_CONTROL_MODE_PID;
+      group->target = 50;
+      group->kp = 5;
+      group->ki = 0.05;
+      group->hysteresis = 1;
+      group->min = 20;
+      group->max = 100;
+      group->slew = 10;
+      group->horizon = FAN_CONTROL_DEFAULT_HORIZON;
+      group->forgetting = THERMAL_MODEL_DEFAULT_FORGETTING;
+      group->deadband = FAN_CONTROL_DEFAULT_DEADBAND;
+      group->applied = -1;
+      continue;
+    }
+
+    // Split the key and the value
+    char* separator = strchr(text, '=');
+    if (separator == NULL)
+    {
+      fprintf(stderr, "%s:%u: expected key = value!\n", path, line_number);
+      ret = -1;
+      break;
+    }
+    *separator = '\0';
+
+    // Parse the key and the value
+    if (fan_control_parse_line(control, group, fan_control_trim(text),
+      fan_control_trim(separator + 1)) != 0)
+    {
+      fprintf(stderr, "%s:%u: invalid %s!\n", path, line_number, fan_control_trim(text));
+      ret = -1;
+      break;
+    }
+  }
+
+  fclose(file);
+
+  // Make sure there is at least one group
+  if (ret == 0 && control->group_count == 0)
+  {
+    fprintf(stderr, "%s: no [group] section!\n", path);
+    ret = -1;
+  }
+
+  // Make sure every group is complete
+  for (u_int8_t i = 0; ret == 0 && i < control->group_count; i++)
+  {
+    if (fan_control_check_group(&control->groups[i]) != 0)
+    {
+      fprintf(stderr, "%s: group %u needs fans, sensors, min <= max <= 100, and a curve in curve "
+        "mode!\n", path, i + 1);
+      ret = -1;
+    }
+  }
+
+  // Start the thermal models of the sensors, only the predictive groups feed them
+  for (u_int8_t i = 0; ret == 0 && i < control->group_count; i++)
+  {
+    for (u_int8_t j = 0; j < control->groups[i].sensor_count; j++)
+    {
+      thermal_model_init(&control->groups[i].models[j], control->groups[i].forgetting);
+    }
+  }
+
+  return ret;
+}
+
+// Function called to run one iteration of the control loop dt seconds after the previous one,
+//   a group whose temperature can't be read runs its fans at the maximum speed
+int8_t fan_control_step(struct fan_control* control, double dt)
+{
+  // Declare needed variables
+  int8_t ret = 0;
+
+  // Loop through the groups
+  for (u_int8_t i = 0; i < control->group_count; i++)
+  {
+    // Declare needed variables
+    struct fan_control_group* group = &control->groups[i];
+    double sensor_temperatures[FAN_CONTROL_MAX_SENSORS];
+    double temperature = -INFINITY;
+    double output;
+
+    // Get the hottest temperature of the group, the speeds depend on these reads so they go
+    //   before the telemetry of the other processes
+    u_int8_t read_class = it8528_lock_set_read_class(IT8528_LOCK_CLASS_ALARM);
+    for (u_int8_t j = 0; j < group->sensor_count; j++)
+    {
+      // Get the temperature
+      if (it8528_get_temperature(group->sensor_ids[j], &sensor_temperatures[j]) != 0)
+      {
+        fprintf(stderr, "fan_control_step: it8528_get_temperature() failed!\n");
+        temperature = NAN;
+        break;
+      }
+      if (sensor_temperatures[j] > temperature)
+      {
+        temperature = sensor_temperatures[j];
+      }
+    }
+    it8528_lock_set_read_class(read_class);
+
+    // Check if a temperature couldn't be read
+    if (isnan(temperature))
+    {
+      group->output = group->max;
+      fan_control_apply(group, (u_int8_t)group->max);
+      for (u_int8_t j = 0; j < group->sensor_count; j++)
+      {
+        thermal_model_restart(&group->models[j]);
+      }
+      ret = -1;
+      continue;
+    }
+
+    // Feed the thermal model of every sensor its reading along with the speed and the load since
+    //   the previous iteration, a model starts over if the speed the fans ran at isn't known
+    if (group->mode == FAN_CONTROL_MODE_PREDICTIVE)
+    {
+      for (u_int8_t j = 0; j < group->sensor_count; j++)
+      {
+        thermal_model_observe(&group->models[j], sensor_temperatures[j], group->applied / 100.0,
+          group->previous_load, group->started && group->applied >= 0 ? dt : 0);
+        group->sensor_temperatures[j] = sensor_temperatures[j];
+      }
+      group->previous_load = control->load;
+    }
+
+    // Update the metrics
+    group->steps++;
+    if (group->steps > 1)
+    {
+      group->elapsed += dt;
+      if (temperature > group->target)
+      {
+        group->time_above_target += dt;
+      }
+    }
+    if (group->steps == 1 || temperature > group->max_temperature)
+    {
+      group->max_temperature = temperature;
+    }
+
+    // Only let the controlled temperature drop once the temperature fell below it by the
+    //   hysteresis so that a temperature hovering around a threshold doesn't make the fans hunt
+    if (!group->started || temperature > group->temperature)
+    {
+      group->temperature = temperature;
+    }
+    else if (temperature < group->temperature - group->hysteresis)
+    {
+      group->temperature = temperature + group->hysteresis;
+    }
+
+    // Compute the output
+    output = fan_control_compute(group, group->started ? dt : 0, control->load);
+
+    // Limit how fast the output changes
+    if (group->started && group->slew > 0 && dt > 0)
+    {
+      if (output > group->output + group->slew * dt)
+      {
+        output = group->output + group->slew * dt;
+      }
+      else if (output < group->output - group->slew * dt)
+      {
+        output = group->output - group->slew * dt;
+      }
+    }
+
+    // Clamp the output
+    if (output < group->min)
+    {
+      output = group->min;
+    }
+    else if (output > group->max)
+    {
+      output = group->max;
+    }
+    group->output = output;
+    group->started = 1;
+    if (group->steps > 1)
+    {
+      group->speed_sum += output * dt;
+    }
+
+    // Apply the output
+    if (fan_control_apply(group, (u_int8_t)lround(output)) != 0)
+    {
+      ret = -1;
+    }
+  }
+
+  return ret;
+}
+
+// Function called to run the control loop every interval until a SIGINT or a SIGTERM signal is
+//   received or FAN_CONTROL_MAX_FAILED_STEPS iterations in a row failed, the fans are left at the
+//   maximum speed of their group either way since nothing controls them afterwards
+int8_t fan_control_run(struct fan_control* control)
+{
+  // Declare needed variables
+  struct timespec deadline;
+  struct timespec previous;
+  struct timespec now;
+  u_int32_t failed_steps = 0;
+  int8_t ret = 0;
+
+  // Install the signal handlers
+  signal(SIGINT, fan_control_handle_signal);
+  signal(SIGTERM, fan_control_handle_signal);
+
+  // Make sure every temperature is read again at each iteration
+  it8528_cache_limit_age(control->interval / 2);
+  fan_control_update_load(control);
+
+  // Loop until we are asked to stop
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  previous = deadline;
+  while (!fan_control_stop)
+  {
+    // Run an iteration
+    fan_control_update_load(control);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (fan_control_step(control, (now.tv_sec - previous.tv_sec) +
+      (now.tv_nsec - previous.tv_nsec) / 1e9) != 0)
+    {
+      // Give up once the chip kept failing
+      if (++failed_steps == FAN_CONTROL_MAX_FAILED_STEPS)
+      {
+        fprintf(stderr, "fan_control_run: %u iterations in a row failed, giving up!\n",
+          failed_steps);
+        ret = -1;
+        break;
+      }
+    }
+    else
+    {
+      failed_steps = 0;
+    }
+    previous = now;
+
+    // Sleep until the next iteration, skipping the iterations that were missed
+    deadline.tv_sec += control->interval / 1000;
+    deadline.tv_nsec += (control->interval % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000)
+    {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (now.tv_sec > deadline.tv_sec ||
+      (now.tv_sec == deadline.tv_sec && now.tv_nsec > deadline.tv_nsec))
+    {
+      deadline = now;
+    }
+    if (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == 0)
+    {
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      realtime_record_wakeup((int64_t)deadline.tv_sec * 1000000000 + deadline.tv_nsec,
+        (int64_t)now.tv_sec * 1000000000 + now.tv_nsec);
+    }
+  }
+
+  // Leave the fans at the maximum speed of their group
+  if (fan_control_release(control) != 0)
+  {
+    fprintf(stderr, "fan_control_run: fan_control_release() failed!\n");
+    ret = -1;
+  }
+
+  it8528_cache_limit_age(IT8528_CACHE_DEFAULT_MAX_AGE);
+
+  return ret;
+}
+
+// Function called to run the control loop for the given number of simulated seconds against the
+//   emulated chip, the thermal model reads the PWMs the loop writes to the chip and writes back the
+//   temperatures of the sensors of every group while the load alternates between idle and full
+//   every half FAN_CONTROL_PLANT_LOAD_PERIOD, the loop is told the load like it would read it from
+//   the CPU times
+int8_t fan_control_simulate(struct fan_control* control, u_int32_t seconds)
+{
+  // Declare needed variables
+  double temperatures[FAN_CONTROL_MAX_GROUPS];
+  double dt = control->interval / 1000.0;
+  u_int64_t iterations = (u_int64_t)seconds * 1000 / control->interval;
+  double time = 0;
+
+  // Open the emulated chip and disable the cache since the simulated time runs much faster than
+  //   the monotonic clock
+  if (it8528_open_transport("emulated") != 0)
+  {
+    fprintf(stderr, "fan_control_simulate: it8528_open_transport() failed!\n");
+    return -1;
+  }
+  for (u_int8_t i = 0; i < IT8528_CACHE_CLASSES; i++)
+  {
+    it8528_cache_set_max_age(i, 0);
+  }
+
+  // Start every group at the ambient temperature
+  for (u_int8_t i = 0; i < control->group_count; i++)
+  {
+    temperatures[i] = FAN_CONTROL_PLANT_AMBIENT;
+  }
+
+  // Loop through the iterations
+  for (u_int64_t iteration = 0; iteration < iterations; iteration++)
+  {
+    // Write the temperatures of the model to the emulated chip
+    for (u_int8_t i = 0; i < control->group_count; i++)
+    {
+      for (u_int8_t j = 0; j < control->groups[i].sensor_count; j++)
+      {
+        // Declare needed variables
+        u_int16_t command;
+
+        it8528_get_temperature_command(control->groups[i].sensor_ids[j], &command);
+        it8528_emulator_set_register(command, (u_int8_t)lround(temperatures[i]));
+      }
+    }
+
+    // Run an iteration
+    control->load = fmod(time, FAN_CONTROL_PLANT_LOAD_PERIOD) < FAN_CONTROL_PLANT_LOAD_PERIOD / 2 ?
+      1 : 0;
+    if (fan_control_step(control, dt) != 0)
+    {
+      fprintf(stderr, "fan_control_simulate: fan_control_step() failed!\n");
+      return -1;
+    }
+
+    // Advance the thermal model until the next iteration
+    for (double elapsed = 0; elapsed < dt; elapsed += FAN_CONTROL_PLANT_STEP)
+    {
+      // Declare needed variables
+      double power = fmod(time, FAN_CONTROL_PLANT_LOAD_PERIOD) < FAN_CONTROL_PLANT_LOAD_PERIOD / 2 ?
+        FAN_CONTROL_PLANT_LOAD_POWER : FAN_CONTROL_PLANT_IDLE_POWER;
+      double step = dt - elapsed < FAN_CONTROL_PLANT_STEP ? dt - elapsed : FAN_CONTROL_PLANT_STEP;
+
+      for (u_int8_t i = 0; i < control->group_count; i++)
+      {
+        // Declare needed variables
+        u_int16_t command;
+
+        // Get the airflow of the group from the PWM register of its first fan, the register holds
+        //   100 * speed / 255 as written by it8528_set_fan_speed
+        it8528_get_fan_pwm_command(control->groups[i].fan_ids[0], &command);
+        double airflow = it8528_emulator_get_register(command) * 2.55 / 100;
+        if (airflow > 1)
+        {
+          airflow = 1;
+        }
+
+        // Heat the group with the load and cool it with the airflow
+        double conductance = FAN_CONTROL_PLANT_STILL_CONDUCTANCE +
+          FAN_CONTROL_PLANT_AIRFLOW_CONDUCTANCE * airflow;
+        temperatures[i] += step * (power - conductance *
+          (temperatures[i] - FAN_CONTROL_PLANT_AMBIENT)) / FAN_CONTROL_PLANT_CAPACITY;
+      }
+
+      time += step;
+    }
+  }
+
+  return 0;
+}
+
+// Function called to print how every group did
+void fan_control_print_report(struct fan_control* control, FILE* stream)
+{
+  // Declare needed variables
+  struct it8528_fan_write_stats stats;
+
+  // Print how every group did
+  for (u_int8_t i = 0; i < control->group_count; i++)
+  {
+    // Declare needed variables
+    struct fan_control_group* group = &control->groups[i];
+    double elapsed = group->elapsed > 0 ? group->elapsed : 1;
+
+    fprintf(stream, "Group %u (%s, target %.1f °C):\n", i + 1, fan_control_modes[group->mode],
+      group->target);
+    fprintf(stream, "  Iterations:         %llu\n", (unsigned long long)group->steps);
+    fprintf(stream, "  Time above target:  %.1f s (%.1f %%)\n", group->time_above_target,
+      100 * group->time_above_target / elapsed);
+    fprintf(stream, "  Peak temperature:   %.1f °C\n", group->max_temperature);
+    fprintf(stream, "  Mean speed:         %.1f %%\n", group->speed_sum / elapsed);
+    fprintf(stream, "  Speed changes:      %llu\n", (unsigned long long)group->changes);
+
+    // Print how often the thermal models picked the speed and how well they predicted the
+    //   temperatures, the worst sensor is shown
+    if (group->mode == FAN_CONTROL_MODE_PREDICTIVE)
+    {
+      // Declare needed variables
+      double error = 0;
+
+      for (u_int8_t j = 0; j < group->sensor_count; j++)
+      {
+        if (thermal_model_get_error(&group->models[j]) > error)
+        {
+          error = thermal_model_get_error(&group->models[j]);
+        }
+      }
+      fprintf(stream, "  Predicted speeds:   %llu (%.1f %%)\n",
+        (unsigned long long)group->predicted_steps,
+        100.0 * group->predicted_steps / (group->steps > 0 ? group->steps : 1));
+      fprintf(stream, "  Model error:        %.3f °C/s\n", error);
+    }
+  }
+
+  // Print how many fan register writes reached the chip and how many were skipped
+  it8528_get_fan_write_stats(&stats);
+  fprintf(stream, "Fan register writes:  %llu\n", (unsigned long long)stats.writes);
+  fprintf(stream, "Suppressed writes:    %llu\n", (unsigned long long)stats.suppressed);
+  fprintf(stream, "Refreshed writes:     %llu\n", (unsigned long long)stats.refreshes);
+}
+
+// Function called to parse a key and its value, keys before the first group are global
+static int8_t fan_control_parse_line(struct fan_control* control, struct fan_control_group* group,
+  char* key, char* value)
+{
+  // Check if this is a global key
+  if (group == NULL)
+  {
+    // Declare needed variables
+    double interval;
+
+    if (strcmp(key, "interval") == 0 && fan_control_parse_number(value, &interval) == 0 &&
+      interval >= 10 && interval <= 60000)
+    {
+      control->interval = (u_int32_t)interval;
+      return 0;
+    }
+
+    return -1;
+  }
+
+  // Parse the group key
+  if (strcmp(key, "fans") == 0)
+  {
+    return fan_control_parse_ids(value, group->fan_ids, &group->fan_count, FAN_CONTROL_MAX_FANS,
+      it8528_fan_ids, IT8528_FAN_COUNT);
+  }
+  if (strcmp(key, "sensors") == 0)
+  {
+    return fan_control_parse_ids(value, group->sensor_ids, &group->sensor_count,
+      FAN_CONTROL_MAX_SENSORS, it8528_sensor_ids, IT8528_SENSOR_COUNT);
+  }
+  if (strcmp(key, "mode") == 0)
+  {
+    if (strcmp(value, "pid") == 0)
+    {
+      group->mode = FAN_CONTROL_MODE_PID;
+      return 0;
+    }
+    if (strcmp(value, "curve") == 0)
+    {
+      group->mode = FAN_CONTROL_MODE_CURVE;
+      return 0;
+    }
+    if (strcmp(value, "predictive") == 0)
+    {
+      group->mode = FAN_CONTROL_MODE_PREDICTIVE;
+      return 0;
+    }
+    return -1;
+  }
+  if (strcmp(key, "curve") == 0)
+  {
+    return fan_control_parse_curve(value, group);
+  }
+  if (strcmp(key, "target") == 0)
+  {
+    return fan_control_parse_number(value, &group->target);
+  }
+  if (strcmp(key, "kp") == 0)
+  {
+    return fan_control_parse_number(value, &group->kp);
+  }
+  if (strcmp(key, "ki") == 0)
+  {
+    return fan_control_parse_number(value, &group->ki);
+  }
+  if (strcmp(key, "kd") == 0)
+  {
+    return fan_control_parse_number(value, &group->kd);
+  }
+  if (strcmp(key, "hysteresis") == 0)
+  {
+    return fan_control_parse_number(value, &group->hysteresis) == 0 && group->hysteresis >= 0 ?
+      0 : -1;
+  }
+  if (strcmp(key, "min") == 0)
+  {
+    return fan_control_parse_number(value, &group->min);
+  }
+  if (strcmp(key, "max") == 0)
+  {
+    return fan_control_parse_number(value, &group->max);
+  }
+  if (strcmp(key, "slew") == 0)
+  {
+    return fan_control_parse_number(value, &group->slew) == 0 && group->slew >= 0 ? 0 : -1;
+  }
+  if (strcmp(key, "horizon") == 0)
+  {
+    return fan_control_parse_number(value, &group->horizon) == 0 && group->horizon > 0 &&
+      group->horizon <= FAN_CONTROL_MAX_HORIZON ? 0 : -1;
+  }
+  if (strcmp(key, "forgetting") == 0)
+  {
+    return fan_control_parse_number(value, &group->forgetting) == 0 &&
+      group->forgetting >= 0.9 && group->forgetting <= 1 ? 0 : -1;
+  }
+  if (strcmp(key, "deadband") == 0)
+  {
+    return fan_control_parse_number(value, &group->deadband) == 0 && group->deadband >= 0 ?
+      0 : -1;
+  }
+
+  return -1;
+}
+
+// Function called to parse a comma or space separated list of IDs that must all be valid IDs
+static int8_t fan_control_parse_ids(char* value, u_int8_t* ids, u_int8_t* count, u_int8_t max,
+  const u_int8_t* valid_ids, u_int8_t valid_count)
+{
+  // Declare needed variables
+  char* saveptr;
+
+  // Loop through the IDs
+  *count = 0;
+  for (char* token = strtok_r(value, ", \t", &saveptr); token != NULL;
+    token = strtok_r(NULL, ", \t", &saveptr))
+  {
+    // Declare needed variables
+    char* end;
+    unsigned long id = strtoul(token, &end, 10);
+    u_int8_t valid = 0;
+
+    // Make sure the ID is valid
+    for (u_int8_t i = 0; *end == '\0' && i < valid_count; i++)
+    {
+      if (valid_ids[i] == id)
+      {
+        valid = 1;
+        break;
+      }
+    }
+    if (!valid || *count == max)
+    {
+      return -1;
+    }
+
+    ids[(*count)++] = id;
+  }
+
+  return *count > 0 ? 0 : -1;
+}
+
+// Function called to parse a curve made of temperature:speed points in increasing temperature
+//   order, for example "40:30 50:60 60:100"
+static int8_t fan_control_parse_curve(char* value, struct fan_control_group* group)
+{
+  // Declare needed variables
+  char* saveptr;
+
+  // Loop through the points
+  group->curve_count = 0;
+  for (char* token = strtok_r(value, ", \t", &saveptr); token != NULL;
+    token = strtok_r(NULL, ", \t", &saveptr))
+  {
+    // Split the point
+    char* separator = strchr(token, ':');
+    if (separator == NULL || group->curve_count == FAN_CONTROL_MAX_POINTS)
+    {
+      return -1;
+    }
+    *separator = '\0';
+
+    // Convert the point
+    u_int8_t i = group->curve_count;
+    if (fan_control_parse_number(token, &group->curve_temperatures[i]) != 0 ||
+      fan_control_parse_number(separator + 1, &group->curve_speeds[i]) != 0 ||
+      (i > 0 && group->curve_temperatures[i] <= group->curve_temperatures[i - 1]))
+    {
+      return -1;
+    }
+    group->curve_count++;
+  }
+
+  return group->curve_count >= 2 ? 0 : -1;
+}
+
+// Function called to parse a number
+static int8_t fan_control_parse_number(const char* value, double* number)
+{
+  // Declare needed variables
+  char* end;
+
+  *number = strtod(value, &end);
+
+  return end != value && *end == '\0' ? 0 : -1;
+}
+
+// Function called to make sure a group is complete
+static int8_t fan_control_check_group(struct fan_control_group* group)
+{
+  if (group->fan_count == 0 || group->sensor_count == 0 || group->min < 0 ||
+    group->min > group->max || group->max > 100 ||
+    (group->mode == FAN_CONTROL_MODE_CURVE && group->curve_count < 2))
+  {
+    return -1;
+  }
+
+  return 0;
+}
+
+// Function called to compute the speed a group asks for from its controlled temperature, a
+//   predictive group falls back to its curve if it has one or to its PID controller otherwise
+//   until its thermal models can be used
+static double fan_control_compute(struct fan_control_group* group, double dt, double load)
+{
+  // Check if the group can pick its speed from the predicted temperatures
+  if (group->mode == FAN_CONTROL_MODE_PREDICTIVE)
+  {
+    // Declare needed variables
+    double output;
+
+    if (fan_control_predict(group, load, &output) == 0)
+    {
+      group->predicted_steps++;
+      return output;
+    }
+  }
+
+  // Check if the group follows a curve
+  if (group->mode == FAN_CONTROL_MODE_CURVE ||
+    (group->mode == FAN_CONTROL_MODE_PREDICTIVE && group->curve_count >= 2))
+  {
+    return fan_control_interpolate(group, group->temperature);
+  }
+
+  // Declare needed variables
+  double error = group->temperature - group->target;
+  double derivative = dt > 0 ? (error - group->previous_error) / dt : 0;
+  double integral = group->integral + error * dt;
+  double output = group->kp * error + group->ki * integral + group->kd * derivative;
+
+  // Only keep integrating while the output isn't pinned against a clamp in the same direction to
+  //   avoid winding up while the fans are already at their minimum or maximum speed
+  if ((output < group->max || error < 0) && (output > group->min || error > 0))
+  {
+    group->integral = integral;
+  }
+  group->previous_error = error;
+
+  return output;
+}
+
+// Function called to pick the lowest speed that keeps every sensor of a group at or below the
+//   target horizon seconds from now if the load stays the same, the predicted temperature drops as
+//   the speed goes up so the speed is found by bisection, and the speed is kept unless the new one
+//   is at least the deadband away so that the fans don't follow the noise of the readings, -1 is
+//   returned if a thermal model can't be used yet
+static int8_t fan_control_predict(struct fan_control_group* group, double load, double* output)
+{
+  // Declare needed variables
+  double low = group->min;
+  double high = group->max;
+  double speed;
+
+  // Make sure every model can be used
+  for (u_int8_t j = 0; j < group->sensor_count; j++)
+  {
+    if (!thermal_model_is_usable(&group->models[j], group->sensor_temperatures[j]))
+    {
+      return -1;
+    }
+  }
+
+  // Check if the slowest or the fastest speed settles it, otherwise look for the speed in between
+  if (fan_control_get_prediction(group, low, load) <= group->target)
+  {
+    speed = low;
+  }
+  else if (fan_control_get_prediction(group, high, load) >= group->target)
+  {
+    speed = high;
+  }
+  else
+  {
+    for (u_int8_t i = 0; i < 12; i++)
+    {
+      speed = (low + high) / 2;
+      if (fan_control_get_prediction(group, speed, load) > group->target)
+      {
+        low = speed;
+      }
+      else
+      {
+        high = speed;
+      }
+    }
+    speed = high;
+  }
+
+  // Keep the speed if the new one is too close to it
+  *output = group->started && fabs(speed - group->output) < group->deadband ? group->output :
+    speed;
+
+  return 0;
+}
+
+// Function called to get the hottest temperature the thermal models of a group predict horizon
+//   seconds from now at a speed and a load
+static double fan_control_get_prediction(struct fan_control_group* group, double speed,
+  double load)
+{
+  // Declare needed variables
+  double prediction = -INFINITY;
+
+  for (u_int8_t j = 0; j < group->sensor_count; j++)
+  {
+    double temperature = thermal_model_predict(&group->models[j], group->sensor_temperatures[j],
+      speed / 100, load, group->horizon);
+    if (temperature > prediction)
+    {
+      prediction = temperature;
+    }
+  }
+
+  return prediction;
+}
+
+// Function called to get the speed of a curve at a temperature by linear interpolation
+static double fan_control_interpolate(struct fan_control_group* group, double temperature)
+{
+  // Check if the temperature is outside of the curve
+  if (temperature <= group->curve_temperatures[0])
+  {
+    return group->curve_speeds[0];
+  }
+  if (temperature >= group->curve_temperatures[group->curve_count - 1])
+  {
+    return group->curve_speeds[group->curve_count - 1];
+  }
+
+  // Find the segment holding the temperature
+  u_int8_t i = 1;
+  while (temperature > group->curve_temperatures[i])
+  {
+    i++;
+  }
+
+  return group->curve_speeds[i - 1] + (group->curve_speeds[i] - group->curve_speeds[i - 1]) *
+    (temperature - group->curve_temperatures[i - 1]) /
+    (group->curve_temperatures[i] - group->curve_temperatures[i - 1]);
+}
+
+// Function called to set the speed of every fan of a group
+static int8_t fan_control_apply(struct fan_control_group* group, u_int8_t speed)
+{
+  // Count the speed changes
+  if (group->applied != speed)
+  {
+    group->changes++;
+  }
+
+  // Set the speed of every fan every time, the writes that wouldn't change anything are skipped
+  //   by it8528_set_fan_speed until its refresh period elapses
+  for (u_int8_t i = 0; i < group->fan_count; i++)
+  {
+    if (it8528_set_fan_speed(group->fan_ids[i], speed) != 0)
+    {
+      fprintf(stderr, "fan_control_apply: it8528_set_fan_speed() failed!\n");
+      group->applied = -1;
+      return -1;
+    }
+  }
+  group->applied = speed;
+
+  return 0;
+}
+
+// Function called to set the fans of every group to the maximum speed of the group, which is the
+//   safe speed to leave them at once the loop stops, every group is tried even if one fails
+static int8_t fan_control_release(struct fan_control* control)
+{
+  // Declare needed variables
+  int8_t ret = 0;
+
+  for (u_int8_t i = 0; i < control->group_count; i++)
+  {
+    // Declare needed variables
+    struct fan_control_group* group = &control->groups[i];
+
+    for (u_int8_t j = 0; j < group->fan_count; j++)
+    {
+      if (it8528_set_fan_speed(group->fan_ids[j], (u_int8_t)group->max) != 0)
+      {
+        fprintf(stderr, "fan_control_release: it8528_set_fan_speed() failed!\n");
+        ret = -1;
+      }
+    }
+  }
+
+  return ret;
+}
+
+// Function called to work out the load as the fraction of the time the CPUs were busy since the
+//   previous call from the first line of /proc/stat, the load is left as it was if it can't be read
+static void fan_control_update_load(struct fan_control* control)
+{
+  // Declare needed variables
+  unsigned long long times[8] = { 0 };
+  u_int64_t busy = 0;
+  u_int64_t total = 0;
+  FILE* file;
+  int count;
+
+  // Read the times spent in every state
+  file = fopen("/proc/stat", "r");
+  if (file == NULL)
+  {
+    return;
+  }
+  count = fscanf(file, "cpu %llu %llu %llu %llu %llu %llu %llu %llu", &times[0], &times[1],
+    &times[2], &times[3], &times[4], &times[5], &times[6], &times[7]);
+  fclose(file);
+  if (count < 4)
+  {
+    return;
+  }
+
+  // Count every state but idle and I/O wait as busy
+  for (u_int8_t i = 0; i < 8; i++)
+  {
+    total += times[i];
+    if (i != 3 && i != 4)
+    {
+      busy += times[i];
+    }
+  }
+  if (control->cpu_total != 0 && total > control->cpu_total)
+  {
+    control->load = (double)(busy - control->cpu_busy) / (total - control->cpu_total);
+  }
+  control->cpu_busy = busy;
+  control->cpu_total = total;
+}
+
+// Function called to remove the whitespace around a string
+static char* fan_control_trim(char* text)
+{
+  // Declare needed variables
+  char* end;
+
+  while (isspace((unsigned char)*text))
+  {
+    text++;
+  }
+  end = text + strlen(text);
+  while (end > text && isspace((unsigned char)end[-1]))
+  {
+    *--end = '\0';
+  }
+
+  return text;
+}
+
+// Function called when the control loop receives a SIGINT or a SIGTERM signal
+static void fan_control_handle_signal(int signal)
+{
+  fan_control_stop = 1;
+}
@@ -0,0 +1,1149 @@
+/*
+ * Copyright (C) 2021 Stonyx
+ * http://www.stonyx.com
+ *
+ * Copyright (C) 2020 Guillaume Valadon
+ * guillaume@valadon.net
+ */
+
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+#include "it8528.h"
+#include "it8528_profile.h"
+#include "history.h"
+
+// Define constants
+#define HISTORY_DATA_BITS (8 * (HISTORY_CHUNK_SIZE - HISTORY_CHUNK_HEADER_SIZE))
+#define HISTORY_TIME_BITS 68
+#define HISTORY_VALUE_BITS 44
+
+// Define the kinds of values, averages over a step are kept for all of them but the statuses
+//   where the worst one is kept
+#define HISTORY_KIND_TEMPERATURE 0
+#define HISTORY_KIND_FAN_SPEED 1
+#define HISTORY_KIND_FAN_PWM 2
+#define HISTORY_KIND_STATUS 3
+
+// Make sure the chunk structure has the size of a chunk
+_Static_assert(sizeof(struct history_chunk) == HISTORY_CHUNK_SIZE, "chunk size mismatch");
+_Static_assert(sizeof(struct history_header) <= HISTORY_HEADER_SIZE, "header size mismatch");
+
+// Define the structure holding the state of the decoder of a chunk
+struct history_reader
+{
+  const u_int8_t* data;
+  u_int32_t position;
+  u_int32_t bits;
+  u_int32_t remaining;
+  u_int16_t value_count;
+  int64_t time;
+  int64_t delta;
+  int32_t values[HISTORY_MAX_VALUES];
+  u_int8_t valid[HISTORY_MAX_VALUES];
+};
+
+// Declare the CRC-32 table, built on first use
+static u_int32_t history_crc_table[256];
+
+// Declare functions
+static int8_t history_set_layout(struct history* history, const struct history_header* header);
+static int8_t history_map_chunk(struct history* history);
+static int8_t history_seal_chunk(struct history* history);
+static u_int32_t history_checksum(const struct history_chunk* chunk);
+static int64_t history_get_time(void);
+static void history_put_bits(u_int8_t* data, u_int32_t* position, u_int64_t value,
+  u_int8_t count);
+static int8_t history_get_bits(struct history_reader* reader, u_int8_t count, u_int64_t* value);
+static int8_t history_get_prefix(struct history_reader* reader, u_int8_t* prefix);
+static int8_t history_get_delta(struct history_reader* reader, const u_int8_t* lengths,
+  int64_t* delta);
+static void history_put_time(u_int8_t* data, u_int32_t* position, int64_t delta);
+static void history_put_value(u_int8_t* data, u_int32_t* position, int64_t delta);
+static void history_reader_start(struct history_reader* reader, const struct history_chunk* chunk,
+  u_int32_t count, u_int32_t bits, u_int16_t value_count);
+static int8_t history_reader_next(struct history_reader* reader);
+static int8_t history_map_file(const char* path, const u_int8_t** file, size_t* size);
+static void history_print_row(FILE* stream, int64_t time, const struct history_header* header,
+  const u_int8_t* kinds, const double* values, const u_int8_t* valid);
+
+// Function called to open a history file to append samples to it, creating it with the sensors
+//   and fans of the model profile if it doesn't exist
+// A chunk that wasn't sealed when the previous writer stopped is dropped so at most one chunk is
+//   lost by a crash, every sealed chunk is flushed to the disk before the next one is started
+int8_t history_open(const char* path, struct history* history)
+{
+  // Declare needed variables
+  struct history_header header;
+  struct history_chunk chunk;
+  struct stat status;
+
+  // Open the file and make sure there is no other writer
+  memset(history, 0, sizeof(*history));
+  history->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (history->fd < 0)
+  {
+    fprintf(stderr, "history_open: open() failed!\n");
+    return -1;
+  }
+  if (flock(history->fd, LOCK_EX | LOCK_NB) != 0)
+  {
+    fprintf(stderr, "history_open: flock() failed, is another writer running?\n");
+    close(history->fd);
+    history->fd = -1;
+    return -1;
+  }
+  if (fstat(history->fd, &status) != 0)
+  {
+    fprintf(stderr, "history_open: fstat() failed!\n");
+    close(history->fd);
+    history->fd = -1;
+    return -1;
+  }
+
+  // Check if the file is new
+  if (status.st_size < HISTORY_HEADER_SIZE)
+  {
+    // Declare needed variables
+    const struct it8528_profile* profile = it8528_profile_get();
+    u_int8_t page[HISTORY_HEADER_SIZE];
+
+    // Build the header from the sensors and fans of the model profile
+    memset(&header, 0, sizeof(header));
+    header.magic = HISTORY_MAGIC;
+    header.version = HISTORY_VERSION;
+    header.chunk_size = HISTORY_CHUNK_SIZE;
+    header.created = history_get_time();
+    for (u_int8_t i = 0; i < IT8528_SENSOR_COUNT; i++)
+    {
+      if (profile->sensor_present[i])
+      {
+        header.sensor_ids[header.sensor_count++] = it8528_sensor_ids[i];
+      }
+    }
+    for (u_int8_t i = 0; i < IT8528_FAN_COUNT; i++)
+    {
+      if (profile->fan_present[i])
+      {
+        header.fan_ids[header.fan_count++] = it8528_fan_ids[i];
+      }
+    }
+    header.power_supply_count = profile->plan.power_supply_index >= 0 ?
+      IT8528_POWER_SUPPLY_COUNT : 0;
+
+    // Write the header
+    memset(page, 0, sizeof(page));
+    memcpy(page, &header, sizeof(header));
+    if (pwrite(history->fd, page, sizeof(page), 0) != sizeof(page) || fsync(history->fd) != 0)
+    {
+      fprintf(stderr, "history_open: pwrite() failed!\n");
+      close(history->fd);
+      history->fd = -1;
+      return -1;
+    }
+    history->chunk_index = 0;
+  }
+  else
+  {
+    // Read and check the header
+    if (pread(history->fd, &header, sizeof(header), 0) != sizeof(header) ||
+        header.magic != HISTORY_MAGIC || header.version != HISTORY_VERSION ||
+        header.chunk_size != HISTORY_CHUNK_SIZE)
+    {
+      fprintf(stderr, "history_open: invalid history file!\n");
+      close(history->fd);
+      history->fd = -1;
+      return -1;
+    }
+
+    // Find the first chunk that wasn't sealed, only the last sealed chunk could have been torn
+    //   by a crash so it is the only one whose checksum is checked
+    u_int32_t count = (status.st_size - HISTORY_HEADER_SIZE) / HISTORY_CHUNK_SIZE;
+    for (history->chunk_index = 0; history->chunk_index < count; history->chunk_index++)
+    {
+      if (pread(history->fd, &chunk, sizeof(chunk.magic), HISTORY_HEADER_SIZE +
+          (off_t)history->chunk_index * HISTORY_CHUNK_SIZE) != sizeof(chunk.magic) ||
+          chunk.magic != HISTORY_CHUNK_SEALED)
+      {
+        break;
+      }
+    }
+    if (history->chunk_index > 0 && (pread(history->fd, &chunk, sizeof(chunk),
+        HISTORY_HEADER_SIZE + (off_t)(history->chunk_index - 1) * HISTORY_CHUNK_SIZE) !=
+        sizeof(chunk) || chunk.checksum != history_checksum(&chunk)))
+    {
+      fprintf(stderr, "history_open: dropping a torn chunk!\n");
+      history->chunk_index--;
+    }
+  }
+
+  // Get the columns from the header
+  if (history_set_layout(history, &header) != 0)
+  {
+    fprintf(stderr, "history_open: history_set_layout() failed!\n");
+    close(history->fd);
+    history->fd = -1;
+    return -1;
+  }
+
+  // Map the active chunk, dropping anything after it
+  if (ftruncate(history->fd, HISTORY_HEADER_SIZE + (off_t)history->chunk_index *
+      HISTORY_CHUNK_SIZE) != 0 || history_map_chunk(history) != 0)
+  {
+    fprintf(stderr, "history_open: history_map_chunk() failed!\n");
+    close(history->fd);
+    history->fd = -1;
+    return -1;
+  }
+
+  return 0;
+}
+
+// Function called to append a snapshot to a history file
+int8_t history_append(struct history* history, const struct it8528_snapshot* snapshot)
+{
+  // Declare needed variables
+  int64_t time = (int64_t)snapshot->time.tv_sec * 1000 + snapshot->time.tv_nsec / 1000000;
+  int32_t values[HISTORY_MAX_VALUES];
+  u_int8_t valid[HISTORY_MAX_VALUES];
+  u_int16_t count = 0;
+
+  // Convert the temperatures to hundredths of a degree
+  for (u_int8_t i = 0; i < history->sensor_count; i++)
+  {
+    u_int8_t index = history->sensor_indexes[i];
+    valid[count] = snapshot->temperature_valid[index];
+    values[count] = valid[count] ? (int32_t)(snapshot->temperatures[index] * 100 +
+      (snapshot->temperatures[index] < 0 ? -0.5 : 0.5)) : 0;
+    count++;
+  }
+
+  // Copy the fan speeds, PWMs, and statuses
+  for (u_int8_t i = 0; i < history->fan_count; i++)
+  {
+    u_int8_t index = history->fan_indexes[i];
+    u_int8_t fan_valid = snapshot->fan_valid[index];
+    valid[count] = fan_valid;
+    values[count++] = fan_valid ? snapshot->fan_speeds[index] : 0;
+    valid[count] = fan_valid;
+    values[count++] = fan_valid ? snapshot->fan_pwms[index] : 0;
+    valid[count] = fan_valid;
+    values[count++] = fan_valid ? snapshot->fan_statuses[index] : 0;
+  }
+
+  // Copy the power supply statuses
+  for (u_int8_t i = 0; i < history->power_supply_count; i++)
+  {
+    valid[count] = snapshot->power_supply_valid[i];
+    values[count] = valid[count] ? snapshot->power_supply_statuses[i] : 0;
+    count++;
+  }
+
+  // Seal the active chunk and start a new one if the sample might not fit
+  if (history->chunk->bits + history->max_sample_bits > HISTORY_DATA_BITS &&
+      history_seal_chunk(history) != 0)
+  {
+    fprintf(stderr, "history_append: history_seal_chunk() failed!\n");
+    return -1;
+  }
+
+  // Check if this is the first sample of the chunk
+  struct history_chunk* chunk = history->chunk;
+  if (chunk->count == 0)
+  {
+    chunk->first_time = time;
+    history->previous_time = time;
+    history->previous_delta = 0;
+  }
+
+  // Write the delta of the time delta
+  u_int32_t position = chunk->bits;
+  int64_t delta = time - history->previous_time;
+  history_put_time(chunk->data, &position, delta - history->previous_delta);
+  history->previous_time = time;
+  history->previous_delta = delta;
+
+  // Write the validity of every value if it changed
+  if (memcmp(valid, history->valid, history->value_count) != 0)
+  {
+    history_put_bits(chunk->data, &position, 1, 1);
+    for (u_int16_t i = 0; i < history->value_count; i++)
+    {
+      history_put_bits(chunk->data, &position, valid[i], 1);
+    }
+    memcpy(history->valid, valid, history->value_count);
+  }
+  else
+  {
+    history_put_bits(chunk->data, &position, 0, 1);
+  }
+
+  // Write the delta of every valid value
+  for (u_int16_t i = 0; i < history->value_count; i++)
+  {
+    if (valid[i])
+    {
+      history_put_value(chunk->data, &position, (int64_t)values[i] - history->values[i]);
+      history->values[i] = values[i];
+    }
+  }
+
+  // Publish the sample to the readers, the count is stored last
+  chunk->last_time = time;
+  __atomic_store_n(&chunk->bits, position, __ATOMIC_RELEASE);
+  __atomic_store_n(&chunk->count, chunk->count + 1, __ATOMIC_RELEASE);
+
+  return 0;
+}
+
+// Function called to close a history file, the active chunk is sealed so that the samples it
+//   holds are kept
+void history_close(struct history* history)
+{
+  // Seal the active chunk if it holds samples
+  if (history->chunk != NULL && history->chunk->count > 0 && history_seal_chunk(history) != 0)
+  {
+    fprintf(stderr, "history_close: history_seal_chunk() failed!\n");
+  }
+
+  // Drop the empty active chunk
+  if (history->chunk != NULL)
+  {
+    munmap(history->chunk, HISTORY_CHUNK_SIZE);
+    history->chunk = NULL;
+    if (ftruncate(history->fd, HISTORY_HEADER_SIZE + (off_t)history->chunk_index *
+        HISTORY_CHUNK_SIZE) != 0)
+    {
+      fprintf(stderr, "history_close: ftruncate() failed!\n");
+    }
+  }
+
+  // Close the file
+  if (history->fd > 0)
+  {
+    close(history->fd);
+    history->fd = -1;
+  }
+}
+
+// Function called to print the samples of a history file within a time range as CSV, only the
+//   chunks overlapping the range are decoded and they are found with a binary search
+int8_t history_query(const char* path, const struct history_query* query, FILE* stream)
+{
+  // Declare needed variables
+  const u_int8_t* file;
+  size_t size;
+  static struct history_reader reader;
+  u_int8_t kinds[HISTORY_MAX_VALUES];
+  double sums[HISTORY_MAX_VALUES];
+  u_int32_t counts[HISTORY_MAX_VALUES];
+  double values[HISTORY_MAX_VALUES];
+  u_int8_t valid[HISTORY_MAX_VALUES];
+  int64_t bucket = INT64_MIN;
+  int8_t ret = 0;
+
+  // Map the file
+  if (history_map_file(path, &file, &size) != 0)
+  {
+    fprintf(stderr, "history_query: history_map_file() failed!\n");
+    return -1;
+  }
+  const struct history_header* header = (const struct history_header*)file;
+  const struct history_chunk* chunks = (const struct history_chunk*)(file + HISTORY_HEADER_SIZE);
+  u_int32_t chunk_count = (size - HISTORY_HEADER_SIZE) / HISTORY_CHUNK_SIZE;
+  u_int16_t value_count = header->sensor_count + 3 * header->fan_count +
+    header->power_supply_count;
+
+  // Get the kind of every value and print the column names
+  u_int16_t count = 0;
+  fprintf(stream, "time_ms");
+  for (u_int8_t i = 0; i < header->sensor_count; i++)
+  {
+    kinds[count++] = HISTORY_KIND_TEMPERATURE;
+    fprintf(stream, ",temperature_%u", header->sensor_ids[i]);
+  }
+  for (u_int8_t i = 0; i < header->fan_count; i++)
+  {
+    kinds[count++] = HISTORY_KIND_FAN_SPEED;
+    kinds[count++] = HISTORY_KIND_FAN_PWM;
+    kinds[count++] = HISTORY_KIND_STATUS;
+    fprintf(stream, ",fan_%u_rpm,fan_%u_pwm,fan_%u_status", header->fan_ids[i],
+      header->fan_ids[i], header->fan_ids[i]);
+  }
+  for (u_int8_t i = 0; i < header->power_supply_count; i++)
+  {
+    kinds[count++] = HISTORY_KIND_STATUS;
+    fprintf(stream, ",power_supply_%u", i + 1);
+  }
+  fprintf(stream, "\n");
+
+  // Find the first chunk whose last sample isn't before the range
+  u_int32_t low = 0;
+  u_int32_t high = chunk_count;
+  while (low < high)
+  {
+    u_int32_t middle = low + (high - low) / 2;
+    if (chunks[middle].last_time < query->from)
+    {
+      low = middle + 1;
+    }
+    else
+    {
+      high = middle;
+    }
+  }
+
+  // Loop through the chunks until one starts after the range
+  for (u_int32_t i = low; i < chunk_count && chunks[i].first_time <= query->to; i++)
+  {
+    // Declare needed variables
+    const struct history_chunk* chunk = &chunks[i];
+    u_int32_t magic = __atomic_load_n(&chunk->magic, __ATOMIC_ACQUIRE);
+    u_int32_t samples;
+    u_int32_t bits;
+
+    // Get the number of samples of the chunk, checking the checksum of sealed chunks and
+    //   reading the count of the active chunk before its number of used bits
+    if (magic == HISTORY_CHUNK_SEALED)
+    {
+      if (chunk->checksum != history_checksum(chunk))
+      {
+        fprintf(stderr, "history_query: skipping corrupted chunk %u!\n", i);
+        continue;
+      }
+      samples = chunk->count;
+      bits = chunk->bits;
+    }
+    else if (magic == HISTORY_CHUNK_ACTIVE)
+    {
+      samples = __atomic_load_n(&chunk->count, __ATOMIC_ACQUIRE);
+      bits = __atomic_load_n(&chunk->bits, __ATOMIC_ACQUIRE);
+    }
+    else
+    {
+      continue;
+    }
+
+    // Decode the samples of the chunk
+    history_reader_start(&reader, chunk, samples, bits, value_count);
+    int8_t next;
+    while ((next = history_reader_next(&reader)) == 0)
+    {
+      // Skip the samples outside of the range
+      if (reader.time < query->from)
+      {
+        continue;
+      }
+      if (reader.time > query->to)
+      {
+        break;
+      }
+
+      // Check if every sample should be printed
+      if (query->step == 0)
+      {
+        for (u_int16_t j = 0; j < value_count; j++)
+        {
+          values[j] = reader.values[j];
+        }
+        history_print_row(stream, reader.time, header, kinds, values, reader.valid);
+        continue;
+      }
+
+      // Print the previous step once a sample of a new step arrives
+      int64_t sample_bucket = reader.time - ((reader.time % query->step) + query->step) %
+        query->step;
+      if (sample_bucket != bucket)
+      {
+        if (bucket != INT64_MIN)
+        {
+          for (u_int16_t j = 0; j < value_count; j++)
+          {
+            valid[j] = counts[j] > 0;
+            values[j] = kinds[j] == HISTORY_KIND_STATUS || counts[j] == 0 ? sums[j] :
+              sums[j] / counts[j];
+          }
+          history_print_row(stream, bucket, header, kinds, values, valid);
+        }
+        bucket = sample_bucket;
+        memset(sums, 0, sizeof(sums));
+        memset(counts, 0, sizeof(counts));
+      }
+
+      // Add the sample to the step, keeping the worst status
+      for (u_int16_t j = 0; j < value_count; j++)
+      {
+        if (reader.valid[j])
+        {
+          if (kinds[j] == HISTORY_KIND_STATUS)
+          {
+            if (counts[j] == 0 || reader.values[j] > sums[j])
+            {
+              sums[j] = reader.values[j];
+            }
+          }
+          else
+          {
+            sums[j] += reader.values[j];
+          }
+          counts[j]++;
+        }
+      }
+    }
+    if (next < 0)
+    {
+      fprintf(stderr, "history_query: chunk %u is corrupted!\n", i);
+      ret = -1;
+    }
+  }
+
+  // Print the last step
+  if (query->step != 0 && bucket != INT64_MIN)
+  {
+    for (u_int16_t j = 0; j < value_count; j++)
+    {
+      valid[j] = counts[j] > 0;
+      values[j] = kinds[j] == HISTORY_KIND_STATUS || counts[j] == 0 ? sums[j] :
+        sums[j] / counts[j];
+    }
+    history_print_row(stream, bucket, header, kinds, values, valid);
+  }
+
+  munmap((void*)file, size);
+
+  return ret;
+}
+
+// Function called to print a summary of a history file
+int8_t history_print_info(const char* path, FILE* stream)
+{
+  // Declare needed variables
+  const u_int8_t* file;
+  size_t size;
+  u_int64_t samples = 0;
+  u_int64_t bits = 0;
+  u_int32_t sealed = 0;
+  u_int32_t corrupted = 0;
+
+  // Map the file
+  if (history_map_file(path, &file, &size) != 0)
+  {
+    fprintf(stderr, "history_print_info: history_map_file() failed!\n");
+    return -1;
+  }
+  const struct history_header* header = (const struct history_header*)file;
+  const struct history_chunk* chunks = (const struct history_chunk*)(file + HISTORY_HEADER_SIZE);
+  u_int32_t chunk_count = (size - HISTORY_HEADER_SIZE) / HISTORY_CHUNK_SIZE;
+
+  // Count the samples of every chunk
+  for (u_int32_t i = 0; i < chunk_count; i++)
+  {
+    if (chunks[i].magic == HISTORY_CHUNK_SEALED)
+    {
+      sealed++;
+      if (chunks[i].checksum != history_checksum(&chunks[i]))
+      {
+        corrupted++;
+        continue;
+      }
+    }
+    else if (chunks[i].magic != HISTORY_CHUNK_ACTIVE)
+    {
+      continue;
+    }
+    samples += chunks[i].count;
+    bits += chunks[i].bits;
+  }
+
+  // Print the summary
+  fprintf(stream, "sensors            %u\n", header->sensor_count);
+  fprintf(stream, "fans               %u\n", header->fan_count);
+  fprintf(stream, "power_supplies     %u\n", header->power_supply_count);
+  fprintf(stream, "chunks             %u\n", chunk_count);
+  fprintf(stream, "sealed_chunks      %u\n", sealed);
+  fprintf(stream, "corrupted_chunks   %u\n", corrupted);
+  fprintf(stream, "samples            %llu\n", (unsigned long long)samples);
+  if (chunk_count > 0)
+  {
+    fprintf(stream, "first_time_ms      %lld\n", (long long)chunks[0].first_time);
+    fprintf(stream, "last_time_ms       %lld\n", (long long)chunks[chunk_count - 1].last_time);
+  }
+  fprintf(stream, "file_bytes         %llu\n", (unsigned long long)size);
+  if (samples > 0)
+  {
+    fprintf(stream, "bits_per_sample    %.1f\n", (double)bits / samples);
+    fprintf(stream, "bytes_per_sample   %.1f\n", (double)size / samples);
+  }
+
+  munmap((void*)file, size);
+
+  return 0;
+}
+
+// Function called to convert a time like now, -2h, -30d, or a number of seconds since the epoch
+//   to wall clock milliseconds
+int8_t history_parse_time(const char* text, int64_t* time)
+{
+  // Declare needed variables
+  int64_t duration;
+  char* end;
+
+  // Check if the time is now or relative to now
+  if (strcmp(text, "now") == 0)
+  {
+    *time = history_get_time();
+    return 0;
+  }
+  if (text[0] == '-')
+  {
+    if (history_parse_duration(text + 1, &duration) != 0)
+    {
+      return -1;
+    }
+    *time = history_get_time() - duration;
+    return 0;
+  }
+
+  // Convert the seconds since the epoch
+  long long seconds = strtoll(text, &end, 10);
+  if (end == text || *end != '\0')
+  {
+    return -1;
+  }
+  *time = seconds * 1000;
+
+  return 0;
+}
+
+// Function called to convert a duration like 500ms, 10s, 5m, 2h, 30d, or 1w to milliseconds, a
+//   number without a unit is in seconds
+int8_t history_parse_duration(const char* text, int64_t* duration)
+{
+  // Declare needed variables
+  char* end;
+  int64_t multiplier;
+  long long value;
+
+  // Make sure there is a positive number that strtoll didn't have to cut short
+  errno = 0;
+  value = strtoll(text, &end, 10);
+  if (end == text || value <= 0 || errno == ERANGE || strchr(text, '-') != NULL)
+  {
+    return -1;
+  }
+
+  // Get the number of milliseconds in the unit
+  if (strcmp(end, "ms") == 0)
+  {
+    multiplier = 1;
+  }
+  else if (strcmp(end, "s") == 0 || *end == '\0')
+  {
+    multiplier = 1000;
+  }
+  else if (strcmp(end, "m") == 0)
+  {
+    multiplier = 60000;
+  }
+  else if (strcmp(end, "h") == 0)
+  {
+    multiplier = 3600000;
+  }
+  else if (strcmp(end, "d") == 0)
+  {
+    multiplier = 86400000;
+  }
+  else if (strcmp(end, "w") == 0)
+  {
+    multiplier = 604800000;
+  }
+  else
+  {
+    return -1;
+  }
+
+  // Convert the number to milliseconds unless it would overflow
+  if (value > INT64_MAX / multiplier)
+  {
+    return -1;
+  }
+  *duration = value * multiplier;
+
+  return 0;
+}
+
+// Function called to get the columns of a history file from its header
+static int8_t history_set_layout(struct history* history, const struct history_header* header)
+{
+  // Make sure the counts are valid
+  if (header->sensor_count > IT8528_SENSOR_COUNT || header->fan_count > IT8528_FAN_COUNT ||
+      header->power_supply_count > IT8528_POWER_SUPPLY_COUNT)
+  {
+    return -1;
+  }
+
+  // Find the index of every sensor
+  for (u_int8_t i = 0; i < header->sensor_count; i++)
+  {
+    u_int8_t j;
+    for (j = 0; j < IT8528_SENSOR_COUNT && it8528_sensor_ids[j] != header->sensor_ids[i]; j++);
+    if (j == IT8528_SENSOR_COUNT)
+    {
+      return -1;
+    }
+    history->sensor_indexes[i] = j;
+  }
+
+  // Find the index of every fan
+  for (u_int8_t i = 0; i < header->fan_count; i++)
+  {
+    u_int8_t j;
+    for (j = 0; j < IT8528_FAN_COUNT && it8528_fan_ids[j] != header->fan_ids[i]; j++);
+    if (j == IT8528_FAN_COUNT)
+    {
+      return -1;
+    }
+    history->fan_indexes[i] = j;
+  }
+
+  history->sensor_count = header->sensor_count;
+  history->fan_count = header->fan_count;
+  history->power_supply_count = header->power_supply_count;
+  history->value_count = header->sensor_count + 3 * header->fan_count +
+    header->power_supply_count;
+
+  // Calculate the worst case size of a sample, a new validity bitmap and the largest delta of
+  //   the time and of every value
+  history->max_sample_bits = HISTORY_TIME_BITS + 1 + history->value_count +
+    history->value_count * HISTORY_VALUE_BITS;
+
+  return 0;
+}
+
+// Function called to extend the file with a new chunk, map it, and reset the encoder
+static int8_t history_map_chunk(struct history* history)
+{
+  // Declare needed variables
+  off_t offset = HISTORY_HEADER_SIZE + (off_t)history->chunk_index * HISTORY_CHUNK_SIZE;
+
+  // Extend the file and map the chunk
+  if (ftruncate(history->fd, offset + HISTORY_CHUNK_SIZE) != 0)
+  {
+    fprintf(stderr, "history_map_chunk: ftruncate() failed!\n");
+    return -1;
+  }
+  history->chunk = mmap(NULL, HISTORY_CHUNK_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+    history->fd, offset);
+  if (history->chunk == MAP_FAILED)
+  {
+    fprintf(stderr, "history_map_chunk: mmap() failed!\n");
+    history->chunk = NULL;
+    return -1;
+  }
+
+  // Start the chunk from scratch, every value is encoded against zero and invalid
+  memset(history->chunk, 0, HISTORY_CHUNK_SIZE);
+  memset(history->values, 0, sizeof(history->values));
+  memset(history->valid, 0, sizeof(history->valid));
+  history->previous_time = 0;
+  history->previous_delta = 0;
+  __atomic_store_n(&history->chunk->magic, HISTORY_CHUNK_ACTIVE, __ATOMIC_RELEASE);
+
+  return 0;
+}
+
+// Function called to seal the active chunk, flush it to the disk, and start the next one
+static int8_t history_seal_chunk(struct history* history)
+{
+  // Store the checksum and then the sealed magic
+  history->chunk->checksum = history_checksum(history->chunk);
+  __atomic_store_n(&history->chunk->magic, HISTORY_CHUNK_SEALED, __ATOMIC_RELEASE);
+
+  // Flush the chunk to the disk
+  if (msync(history->chunk, HISTORY_CHUNK_SIZE, MS_SYNC) != 0)
+  {
+    fprintf(stderr, "history_seal_chunk: msync() failed!\n");
+  }
+  munmap(history->chunk, HISTORY_CHUNK_SIZE);
+  history->chunk = NULL;
+
+  // Start the next chunk
+  history->chunk_index++;
+  return history_map_chunk(history);
+}
+
+// Function called to calculate the CRC-32 of a chunk, everything but the magic and the checksum
+//   is covered
+static u_int32_t history_checksum(const struct history_chunk* chunk)
+{
+  // Declare needed variables
+  const u_int8_t* bytes = (const u_int8_t*)chunk + 8;
+  u_int32_t crc = 0xFFFFFFFF;
+
+  // Build the table on first use
+  if (history_crc_table[1] == 0)
+  {
+    for (u_int32_t i = 0; i < 256; i++)
+    {
+      u_int32_t value = i;
+      for (u_int8_t j = 0; j < 8; j++)
+      {
+        value = value & 1 ? (value >> 1) ^ 0xEDB88320 : value >> 1;
+      }
+      history_crc_table[i] = value;
+    }
+  }
+
+  // Calculate the CRC of the used part of the chunk
+  size_t length = HISTORY_CHUNK_HEADER_SIZE - 8 + (chunk->bits + 7) / 8;
+  for (size_t i = 0; i < length; i++)
+  {
+    crc = history_crc_table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+  }
+
+  return crc ^ 0xFFFFFFFF;
+}
+
+// Function called to get the wall clock time in milliseconds
+static int64_t history_get_time(void)
+{
+  // Declare needed variables
+  struct timespec ts;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+
+  return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Function called to write the low count bits of a value, most significant bit first, the data
+//   must be zeroed beforehand
+static void history_put_bits(u_int8_t* data, u_int32_t* position, u_int64_t value,
+  u_int8_t count)
+{
+  while (count > 0)
+  {
+    u_int8_t free = 8 - (*position & 7);
+    u_int8_t length = count < free ? count : free;
+    data[*position >> 3] |= ((value >> (count - length)) & ((1 << length) - 1)) <<
+      (free - length);
+    *position += length;
+    count -= length;
+  }
+}
+
+// Function called to read count bits, most significant bit first
+static int8_t history_get_bits(struct history_reader* reader, u_int8_t count, u_int64_t* value)
+{
+  // Make sure the bits were written
+  if (reader->position + count > reader->bits)
+  {
+    return -1;
+  }
+
+  // Read the bits a byte at a time
+  *value = 0;
+  while (count > 0)
+  {
+    u_int8_t available = 8 - (reader->position & 7);
+    u_int8_t length = count < available ? count : available;
+    *value = (*value << length) | ((reader->data[reader->position >> 3] >>
+      (available - length)) & ((1 << length) - 1));
+    reader->position += length;
+    count -= length;
+  }
+
+  return 0;
+}
+
+// Function called to read the up to four leading one bits that tell how a delta was encoded
+static int8_t history_get_prefix(struct history_reader* reader, u_int8_t* prefix)
+{
+  // Declare needed variables
+  u_int64_t bit = 1;
+
+  // Count the ones until a zero or the fourth one
+  for (*prefix = 0; *prefix < 4 && bit == 1; (*prefix) += bit)
+  {
+    if (history_get_bits(reader, 1, &bit) != 0)
+    {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+// Function called to read a delta written by history_put_time() or history_put_value() given the
+//   number of bits that follow each prefix, a delta is usually read from a single 64 bit load of
+//   the bits at the position instead of a bit at a time
+static int8_t history_get_delta(struct history_reader* reader, const u_int8_t* lengths,
+  int64_t* delta)
+{
+  // Declare needed variables
+  u_int32_t byte = reader->position >> 3;
+  u_int64_t bits;
+  u_int8_t prefix;
+
+  // Check if the 8 bytes at the position were written
+  if (byte + 8 <= (reader->bits + 7) / 8)
+  {
+    // Load the bits, at least 57 of them are usable after dropping the bits already read
+    u_int64_t window;
+    memcpy(&window, reader->data + byte, sizeof(window));
+    window = be64toh(window) << (reader->position & 7);
+
+    // Count the leading ones and check if the whole delta is within the usable bits
+    prefix = ~window == 0 ? 4 : __builtin_clzll(~window);
+    prefix = prefix < 4 ? prefix : 4;
+    u_int8_t prefix_length = prefix < 4 ? prefix + 1 : 4;
+    u_int8_t length = lengths[prefix];
+    if (prefix_length + length <= 57)
+    {
+      bits = length > 0 ? (window << prefix_length) >> (64 - length) : 0;
+      reader->position += prefix_length + length;
+      if (reader->position > reader->bits)
+      {
+        return -1;
+      }
+      *delta = (int64_t)(bits >> 1) ^ -(int64_t)(bits & 1);
+      return 0;
+    }
+  }
+
+  // Read the prefix and the delta a bit at a time
+  if (history_get_prefix(reader, &prefix) != 0 ||
+      history_get_bits(reader, lengths[prefix], &bits) != 0)
+  {
+    return -1;
+  }
+  *delta = (int64_t)(bits >> 1) ^ -(int64_t)(bits & 1);
+
+  return 0;
+}
+
+// Function called to write the delta of the time delta, a single zero bit when samples are
+//   evenly spaced, otherwise 10, 110, 1110, or 1111 followed by 7, 9, 12, or 64 zigzag bits
+static void history_put_time(u_int8_t* data, u_int32_t* position, int64_t delta)
+{
+  // Declare needed variables
+  u_int64_t zigzag = ((u_int64_t)delta << 1) ^ (u_int64_t)(delta >> 63);
+
+  // Write the delta with the smallest encoding that fits
+  if (zigzag == 0)
+  {
+    history_put_bits(data, position, 0x0, 1);
+  }
+  else if (zigzag < (1 << 7))
+  {
+    history_put_bits(data, position, 0x2, 2);
+    history_put_bits(data, position, zigzag, 7);
+  }
+  else if (zigzag < (1 << 9))
+  {
+    history_put_bits(data, position, 0x6, 3);
+    history_put_bits(data, position, zigzag, 9);
+  }
+  else if (zigzag < (1 << 12))
+  {
+    history_put_bits(data, position, 0xE, 4);
+    history_put_bits(data, position, zigzag, 12);
+  }
+  else
+  {
+    history_put_bits(data, position, 0xF, 4);
+    history_put_bits(data, position, zigzag, 64);
+  }
+}
+
+// Function called to write the delta of a value, a single zero bit when it didn't change,
+//   otherwise 10, 110, 1110, or 1111 followed by 4, 8, 16, or 40 zigzag bits
+static void history_put_value(u_int8_t* data, u_int32_t* position, int64_t delta)
+{
+  // Declare needed variables
+  u_int64_t zigzag = ((u_int64_t)delta << 1) ^ (u_int64_t)(delta >> 63);
+
+  // Write the delta with the smallest encoding that fits
+  if (zigzag == 0)
+  {
+    history_put_bits(data, position, 0x0, 1);
+  }
+  else if (zigzag < (1 << 4))
+  {
+    history_put_bits(data, position, 0x2, 2);
+    history_put_bits(data, position, zigzag, 4);
+  }
+  else if (zigzag < (1 << 8))
+  {
+    history_put_bits(data, position, 0x6, 3);
+    history_put_bits(data, position, zigzag, 8);
+  }
+  else if (zigzag < (1 << 16))
+  {
+    history_put_bits(data, position, 0xE, 4);
+    history_put_bits(data, position, zigzag, 16);
+  }
+  else
+  {
+    history_put_bits(data, position, 0xF, 4);
+    history_put_bits(data, position, zigzag, 40);
+  }
+}
+
+// Function called to start decoding a chunk
+static void history_reader_start(struct history_reader* reader, const struct history_chunk* chunk,
+  u_int32_t count, u_int32_t bits, u_int16_t value_count)
+{
+  reader->data = chunk->data;
+  reader->position = 0;
+  reader->bits = bits < HISTORY_DATA_BITS ? bits : HISTORY_DATA_BITS;
+  reader->remaining = count;
+  reader->value_count = value_count;
+  reader->time = chunk->first_time;
+  reader->delta = 0;
+  memset(reader->values, 0, sizeof(reader->values));
+  memset(reader->valid, 0, sizeof(reader->valid));
+}
+
+// Function called to decode the next sample of a chunk, returns 1 once every sample was decoded
+static int8_t history_reader_next(struct history_reader* reader)
+{
+  // Declare needed variables
+  static const u_int8_t time_lengths[] = { 0, 7, 9, 12, 64 };
+  static const u_int8_t value_lengths[] = { 0, 4, 8, 16, 40 };
+  u_int64_t bits;
+  int64_t delta;
+
+  // Check if every sample was decoded
+  if (reader->remaining == 0)
+  {
+    return 1;
+  }
+  reader->remaining--;
+
+  // Read the delta of the time delta
+  if (history_get_delta(reader, time_lengths, &delta) != 0)
+  {
+    return -1;
+  }
+  reader->delta += delta;
+  reader->time += reader->delta;
+
+  // Read the validity of every value if it changed
+  if (history_get_bits(reader, 1, &bits) != 0)
+  {
+    return -1;
+  }
+  if (bits)
+  {
+    for (u_int16_t i = 0; i < reader->value_count; i++)
+    {
+      if (history_get_bits(reader, 1, &bits) != 0)
+      {
+        return -1;
+      }
+      reader->valid[i] = bits;
+    }
+  }
+
+  // Read the delta of every valid value
+  for (u_int16_t i = 0; i < reader->value_count; i++)
+  {
+    if (reader->valid[i])
+    {
+      if (history_get_delta(reader, value_lengths, &delta) != 0)
+      {
+        return -1;
+      }
+      reader->values[i] += delta;
+    }
+  }
+
+  return 0;
+}
+
+// Function called to map a whole history file for reading and check its header
+static int8_t history_map_file(const char* path, const u_int8_t** file, size_t* size)
+{
+  // Declare needed variables
+  struct stat status;
+  int fd;
+
+  // Open the file
+  fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    fprintf(stderr, "history_map_file: open() failed!\n");
+    return -1;
+  }
+  if (fstat(fd, &status) != 0 || status.st_size < HISTORY_HEADER_SIZE)
+  {
+    fprintf(stderr, "history_map_file: invalid history file!\n");
+    close(fd);
+    return -1;
+  }
+
+  // Map the file, the mapping stays valid once the file is closed
+  *size = status.st_size;
+  *file = mmap(NULL, *size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (*file == MAP_FAILED)
+  {
+    fprintf(stderr, "history_map_file: mmap() failed!\n");
+    return -1;
+  }
+
+  // Check the header
+  const struct history_header* header = (const struct history_header*)*file;
+  if (header->magic != HISTORY_MAGIC || header->version != HISTORY_VERSION ||
+      header->chunk_size != HISTORY_CHUNK_SIZE || header->sensor_count > IT8528_SENSOR_COUNT ||
+      header->fan_count > IT8528_FAN_COUNT ||
+      header->power_supply_count > IT8528_POWER_SUPPLY_COUNT)
+  {
+    fprintf(stderr, "history_map_file: invalid history file!\n");
+    munmap((void*)*file, *size);
+    return -1;
+  }
+
+  return 0;
+}
+
+// Function called to print a row of values, temperatures are converted back to degrees
+static void history_print_row(FILE* stream, int64_t time, const struct history_header* header,
+  const u_int8_t* kinds, const double* values, const u_int8_t* valid)
+{
+  // Declare needed variables
+  u_int16_t count = header->sensor_count + 3 * header->fan_count + header->power_supply_count;
+
+  // Print the values, leaving out the invalid ones
+  fprintf(stream, "%lld", (long long)time);
+  for (u_int16_t i = 0; i < count; i++)
+  {
+    if (!valid[i])
+    {
+      fputc(',', stream);
+    }
+    else if (kinds[i] == HISTORY_KIND_TEMPERATURE)
+    {
+      fprintf(stream, ",%.2f", values[i] / 100);
+    }
+    else if (kinds[i] == HISTORY_KIND_STATUS || values[i] == (int64_t)values[i])
+    {
+      fprintf(stream, ",%lld", (long long)values[i]);
+    }
+    else
+    {
+      fprintf(stream, ",%.1f", values[i]);
+    }
+  }
+  fputc('\n', stream);
+}
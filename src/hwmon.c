@@ -0,0 +1,363 @@
+/*
+ * Copyright (C) 2021 Stonyx
+ * http://www.stonyx.com
+ *
+ * Copyright (C) 2020 Guillaume Valadon
+ * guillaume@valadon.net
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+#include "it8528.h"
+#include "it8528_profile.h"
+#include "hwmon.h"
+
+// Declare functions
+static int8_t hwmon_write_generation(int fd, const struct it8528_snapshot* snapshot);
+static int8_t hwmon_write_file(int fd, const char* file, const char* format, ...);
+static void hwmon_remove_generation(struct hwmon* hwmon, u_int64_t generation);
+static void hwmon_remove_directory(int parent_fd, const char* directory);
+
+// Function called to prepare a hwmon style tree at a path, anything left behind by a previous
+//   daemon is removed but the path must not be a real file or directory
+int8_t hwmon_open(const char* path, struct hwmon* hwmon)
+{
+  // Declare needed variables
+  const char* name = strrchr(path, '/');
+  char parent[PATH_MAX];
+  char prefix[HWMON_MAX_NAME_LENGTH + 2];
+  struct stat status;
+  struct dirent* entry;
+  DIR* directory;
+
+  // Split the path into its parent directory and its name
+  memset(hwmon, 0, sizeof(*hwmon));
+  hwmon->parent_fd = -1;
+  if (name == NULL)
+  {
+    strcpy(parent, ".");
+    name = path;
+  }
+  else
+  {
+    snprintf(parent, sizeof(parent), "%.*s", name == path ? 1 : (int)(name - path), path);
+    name++;
+  }
+  if (name[0] == '\0' || strlen(name) >= sizeof(hwmon->name))
+  {
+    fprintf(stderr, "hwmon_open: invalid path!\n");
+    return -1;
+  }
+
+  // Open the parent directory, every name is resolved relative to it from now on
+  hwmon->parent_fd = open(parent, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (hwmon->parent_fd < 0)
+  {
+    fprintf(stderr, "hwmon_open: open() failed!\n");
+    return -1;
+  }
+
+  // Make sure we won't replace something that isn't ours
+  if (fstatat(hwmon->parent_fd, name, &status, AT_SYMLINK_NOFOLLOW) == 0 &&
+      !S_ISLNK(status.st_mode))
+  {
+    fprintf(stderr, "hwmon_open: %s exists and isn't a symbolic link!\n", path);
+    close(hwmon->parent_fd);
+    hwmon->parent_fd = -1;
+    return -1;
+  }
+
+  // Remove the link and the generations left behind by a previous daemon
+  unlinkat(hwmon->parent_fd, name, 0);
+  snprintf(prefix, sizeof(prefix), ".%s.", name);
+  directory = fdopendir(dup(hwmon->parent_fd));
+  if (directory != NULL)
+  {
+    while ((entry = readdir(directory)) != NULL)
+    {
+      if (strncmp(entry->d_name, prefix, strlen(prefix)) != 0)
+      {
+        continue;
+      }
+      if (unlinkat(hwmon->parent_fd, entry->d_name, 0) != 0)
+      {
+        hwmon_remove_directory(hwmon->parent_fd, entry->d_name);
+      }
+    }
+    closedir(directory);
+  }
+
+  strcpy(hwmon->name, name);
+
+  return 0;
+}
+
+// Function called to write a snapshot as a new generation of the tree and switch the link over
+//   to it with a single rename so that readers see either the previous or the new generation
+int8_t hwmon_update(struct hwmon* hwmon, const struct it8528_snapshot* snapshot)
+{
+  // Declare needed variables
+  u_int64_t generation = hwmon->generation + 1;
+  char directory[HWMON_MAX_NAME_LENGTH + 24];
+  char link[HWMON_MAX_NAME_LENGTH + 8];
+  int fd;
+
+  // Create the directory of the new generation
+  snprintf(directory, sizeof(directory), ".%s.%llu", hwmon->name,
+    (unsigned long long)generation);
+  snprintf(link, sizeof(link), ".%s.new", hwmon->name);
+  if (mkdirat(hwmon->parent_fd, directory, 0755) != 0)
+  {
+    fprintf(stderr, "hwmon_update: mkdirat() failed!\n");
+    return -1;
+  }
+  fd = openat(hwmon->parent_fd, directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    fprintf(stderr, "hwmon_update: openat() failed!\n");
+    unlinkat(hwmon->parent_fd, directory, AT_REMOVEDIR);
+    return -1;
+  }
+
+  // Fill it in
+  if (hwmon_write_generation(fd, snapshot) != 0)
+  {
+    fprintf(stderr, "hwmon_update: hwmon_write_generation() failed!\n");
+    close(fd);
+    hwmon_remove_directory(hwmon->parent_fd, directory);
+    return -1;
+  }
+  close(fd);
+
+  // Point a new link at it and move the link over the current one
+  unlinkat(hwmon->parent_fd, link, 0);
+  if (symlinkat(directory, hwmon->parent_fd, link) != 0 ||
+      renameat(hwmon->parent_fd, link, hwmon->parent_fd, hwmon->name) != 0)
+  {
+    fprintf(stderr, "hwmon_update: renameat() failed!\n");
+    unlinkat(hwmon->parent_fd, link, 0);
+    hwmon_remove_directory(hwmon->parent_fd, directory);
+    return -1;
+  }
+
+  // Remove the generation before the previous one, nobody can reach it through the link anymore
+  //   and readers had a whole generation to finish with it
+  if (generation > 2)
+  {
+    hwmon_remove_generation(hwmon, generation - 2);
+  }
+  hwmon->generation = generation;
+
+  return 0;
+}
+
+// Function called to remove the tree
+void hwmon_close(struct hwmon* hwmon)
+{
+  // Check if the tree is open
+  if (hwmon->name[0] == '\0')
+  {
+    return;
+  }
+
+  // Remove the link and the generations it can still point to
+  unlinkat(hwmon->parent_fd, hwmon->name, 0);
+  if (hwmon->generation > 0)
+  {
+    hwmon_remove_generation(hwmon, hwmon->generation);
+  }
+  if (hwmon->generation > 1)
+  {
+    hwmon_remove_generation(hwmon, hwmon->generation - 1);
+  }
+
+  // Close the parent directory
+  close(hwmon->parent_fd);
+  memset(hwmon, 0, sizeof(*hwmon));
+  hwmon->parent_fd = -1;
+}
+
+// Function called to write the files of a generation in the style of the hwmon sysfs interface,
+//   the numbers are the ones of the tempN and fanN commands, temperatures are in millidegrees,
+//   PWM percentages are scaled to 0 to 255, and the files of unreadable values are left out
+static int8_t hwmon_write_generation(int fd, const struct it8528_snapshot* snapshot)
+{
+  // Declare needed variables
+  const struct it8528_profile* profile = it8528_profile_get();
+  char file[32];
+  u_int8_t id;
+  u_int8_t j;
+
+  // Write the name of the device and the time of the snapshot
+  if (hwmon_write_file(fd, "name", "%s\n", HWMON_NAME) != 0 ||
+      hwmon_write_file(fd, "update_time", "%lld\n", (long long)snapshot->time.tv_sec) != 0)
+  {
+    return -1;
+  }
+
+  // Write the temperatures
+  for (u_int8_t number = 1; number <= profile->sensor_name_count; number++)
+  {
+    if (it8528_profile_get_sensor_id(number, &id) != 0)
+    {
+      continue;
+    }
+    for (j = 0; j < IT8528_SENSOR_COUNT && it8528_sensor_ids[j] != id; j++);
+    if (j == IT8528_SENSOR_COUNT || !snapshot->temperature_valid[j])
+    {
+      continue;
+    }
+
+    double temperature = snapshot->temperatures[j] * 1000;
+    snprintf(file, sizeof(file), "temp%u_input", number);
+    if (hwmon_write_file(fd, file, "%d\n",
+        (int32_t)(temperature + (temperature < 0 ? -0.5 : 0.5))) != 0)
+    {
+      return -1;
+    }
+  }
+
+  // Write the fans, a fan that couldn't be read is reported as faulty
+  for (u_int8_t number = 1; number <= profile->fan_name_count; number++)
+  {
+    if (it8528_profile_get_fan_id(number, &id) != 0)
+    {
+      continue;
+    }
+    for (j = 0; j < IT8528_FAN_COUNT && it8528_fan_ids[j] != id; j++);
+    if (j == IT8528_FAN_COUNT)
+    {
+      continue;
+    }
+
+    snprintf(file, sizeof(file), "fan%u_fault", number);
+    if (hwmon_write_file(fd, file, "%u\n",
+        !snapshot->fan_valid[j] || snapshot->fan_statuses[j] == 0) != 0)
+    {
+      return -1;
+    }
+    if (!snapshot->fan_valid[j])
+    {
+      continue;
+    }
+    snprintf(file, sizeof(file), "fan%u_input", number);
+    if (hwmon_write_file(fd, file, "%u\n", snapshot->fan_speeds[j]) != 0)
+    {
+      return -1;
+    }
+    snprintf(file, sizeof(file), "pwm%u", number);
+    if (hwmon_write_file(fd, file, "%u\n", (snapshot->fan_pwms[j] * 255 + 50) / 100) != 0)
+    {
+      return -1;
+    }
+  }
+
+  // Write the power supply statuses
+  for (u_int8_t i = 0; i < IT8528_POWER_SUPPLY_COUNT; i++)
+  {
+    if (!snapshot->power_supply_valid[i])
+    {
+      continue;
+    }
+    snprintf(file, sizeof(file), "psu%u_status", i + 1);
+    if (hwmon_write_file(fd, file, "%u\n", snapshot->power_supply_statuses[i]) != 0)
+    {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+// Function called to write a formatted value to a new file of a directory
+static int8_t hwmon_write_file(int fd, const char* file, const char* format, ...)
+{
+  // Declare needed variables
+  char buffer[64];
+  va_list arguments;
+  int length;
+  int file_fd;
+
+  // Format the value
+  va_start(arguments, format);
+  length = vsnprintf(buffer, sizeof(buffer), format, arguments);
+  va_end(arguments);
+  if (length < 0 || length >= (int)sizeof(buffer))
+  {
+    fprintf(stderr, "hwmon_write_file: vsnprintf() failed!\n");
+    return -1;
+  }
+
+  // Write it to the file
+  file_fd = openat(fd, file, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0444);
+  if (file_fd < 0)
+  {
+    fprintf(stderr, "hwmon_write_file: openat() failed!\n");
+    return -1;
+  }
+  if (write(file_fd, buffer, length) != length)
+  {
+    fprintf(stderr, "hwmon_write_file: write() failed!\n");
+    close(file_fd);
+    return -1;
+  }
+  close(file_fd);
+
+  return 0;
+}
+
+// Function called to remove the directory of a generation
+static void hwmon_remove_generation(struct hwmon* hwmon, u_int64_t generation)
+{
+  // Declare needed variables
+  char directory[HWMON_MAX_NAME_LENGTH + 24];
+
+  snprintf(directory, sizeof(directory), ".%s.%llu", hwmon->name,
+    (unsigned long long)generation);
+  hwmon_remove_directory(hwmon->parent_fd, directory);
+}
+
+// Function called to remove a directory holding only files
+static void hwmon_remove_directory(int parent_fd, const char* directory)
+{
+  // Declare needed variables
+  struct dirent* entry;
+  DIR* stream;
+  int fd;
+
+  // Remove the files
+  fd = openat(parent_fd, directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0)
+  {
+    return;
+  }
+  stream = fdopendir(fd);
+  if (stream == NULL)
+  {
+    close(fd);
+    return;
+  }
+  while ((entry = readdir(stream)) != NULL)
+  {
+    if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0)
+    {
+      unlinkat(fd, entry->d_name, 0);
+    }
+  }
+  closedir(stream);
+
+  // Remove the directory itself
+  if (unlinkat(parent_fd, directory, AT_REMOVEDIR) != 0)
+  {
+    fprintf(stderr, "hwmon_remove_directory: unlinkat() failed!\n");
+  }
+}
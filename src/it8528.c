@@ -8,135 +8,600 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/io.h>
+#include <time.h>
 #include "it8528_utils.h"
+#include "it8528_cache.h"
+#include "it8528_lock.h"
 #include "it8528.h"
+#include "it8528_profile.h"
 
 // Define macros
 #define BYTE1(x) x & 0xFF
 #define BYTE2(x) (x >> 8) & 0xFF
 
+// Define constants
+#define IT8528_POWER_SUPPLY_COMMAND 0x4500
+
+// Define the sensor and fan IDs based on the switch statements in this file, fan IDs 10 and 11
+//   are left out since they only have a speed and only exist with redundant power supplies
+const u_int8_t it8528_sensor_ids[IT8528_SENSOR_COUNT] = {
+  0, 1, 5, 6, 7, 10, 11, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32,
+  33, 34, 35, 36, 37, 38
+};
+const u_int8_t it8528_fan_ids[IT8528_FAN_COUNT] = {
+  0, 1, 2, 3, 4, 5, 6, 7, 20, 21, 22, 23, 24, 25, 30, 31, 32, 33, 34, 35
+};
+
+// Define the structure holding the shadow copy of a fan mode or PWM register
+struct it8528_fan_register
+{
+  u_int8_t valid;
+  u_int8_t value;
+  u_int64_t time;
+};
+
+// Declare the shadow copies of the mode and PWM registers of every fan group in the order of the
+//   switch statement in the it8528_get_fan_group function, and the write statistics
+static struct it8528_fan_register it8528_fan_registers[IT8528_FAN_GROUPS][2];
+static u_int32_t it8528_fan_refresh = IT8528_DEFAULT_FAN_REFRESH;
+static struct it8528_fan_write_stats it8528_fan_write_stats;
+
+// Declare functions
+static int8_t it8528_get_fan_group(u_int8_t fan_id, u_int8_t* group, u_int16_t* mode_command,
+  u_int16_t* pwm_command);
+static int8_t it8528_set_fan_register(struct it8528_fan_register* shadow, u_int16_t command,
+  u_int8_t value);
+static int8_t it8528_get_fan_status_command(u_int8_t fan_id, u_int16_t* command);
+static int8_t it8528_get_fan_speed_commands(u_int8_t fan_id, u_int16_t* command1,
+  u_int16_t* command2);
+static u_int8_t it8528_convert_fan_status(u_int8_t fan_id, u_int8_t byte);
+static u_int8_t it8528_convert_fan_pwm(u_int8_t byte);
+static u_int8_t it8528_convert_power_supply_status(u_int8_t power_supply_id, u_int8_t byte);
+static void it8528_add_plan_command(struct it8528_read_plan* plan, u_int16_t command,
+  u_int8_t register_class);
+static int it8528_find_plan_command(const struct it8528_read_plan* plan, u_int16_t command);
+static int it8528_compare_commands(const void* a, const void* b);
+static int it8528_compare_plan_entries(const void* a, const void* b);
+
 // Function called to get the fan status
 int8_t it8528_get_fan_status(u_int8_t fan_id, u_int8_t* status)
 {
   // Declare needed variables
   u_int16_t command;
+  u_int8_t byte;
 
-  // The following switch statement is a copy of the switch statement found in the
-  //   libuLinux_hal.so library's ec_sys_get_fan_pwm function as decompiled by IDA
-  switch (fan_id)
+  // Get the command
+  if (it8528_get_fan_status_command(fan_id, &command) != 0)
   {
-    case 0:
-    case 1:
-    case 2:
-    case 3:
-    case 4:
-    case 5:
-      command = 0x0242;
-      break;
-    case 6:
-    case 7:
-      command = 0x0244;
-      break;
-    case 10:
-    case 11:
-      fprintf(stderr, "it8528_get_fan_status: invalid fan ID!\n");
-      return -1;
-    case 20:
-    case 21:
-    case 22:
-    case 23:
-    case 24:
-    case 25:
-      command = 0x0259;
-      break;
-    case 30:
-    case 31:
-    case 32:
-    case 33:
-    case 34:
-    case 35:
-      command = 0x025A;
-      break;
-    default:
-      fprintf(stderr, "it8528_get_fan_status: invalid fan ID!\n");
-      return -1;
+    fprintf(stderr, "it8528_get_fan_status: invalid fan ID!\n");
+    return -1;
+  }
+
+  // Get a byte
+  if (it8528_cache_get_byte(IT8528_CACHE_CLASS_FAN_STATUS, BYTE1(command), BYTE2(command),
+      IT8528_CACHE_DEFAULT_MAX_AGE, &byte) != 0)
+  {
+    fprintf(stderr, "it8528_get_fan_status: it8528_get_byte() failed!\n");
+    return -1;
   }
 
+  // Convert the byte to the status value
+  *status = it8528_convert_fan_status(fan_id, byte);
+
+  return 0;
+}
+
+// Function called to get the fan PWM
+int8_t it8528_get_fan_pwm(u_int8_t fan_id, u_int8_t* pwm)
+{
   // Declare needed variables
+  u_int16_t command;
   u_int8_t byte;
 
-  // The following if statement is a copy of the if statement found in the libuLinux_hal.so library's
-  //   ec_sys_get_fan_status function as decompiled by IDA
-  if (fan_id > 5)
+  // Get the command
+  if (it8528_get_fan_pwm_command(fan_id, &command) != 0)
   {
-    if (fan_id > 7)
+    fprintf(stderr, "it8528_get_fan_pwm: invalid fan ID!\n");
+    return -1;
+  }
+
+  // Get a byte
+  if (it8528_cache_get_byte(IT8528_CACHE_CLASS_FAN_PWM, BYTE1(command), BYTE2(command),
+      IT8528_CACHE_DEFAULT_MAX_AGE, &byte) != 0)
+  {
+    fprintf(stderr, "it8528_get_fan_pwm: it8528_get_byte() failed!\n");
+    return -1;
+  }
+
+  // Convert the byte to the pwm value
+  *pwm = it8528_convert_fan_pwm(byte);
+
+  return 0;
+}
+
+// Function called to get the fan speed in RPM
+int8_t it8528_get_fan_speed(u_int8_t fan_id, u_int16_t* speed)
+{
+  // Declare needed variables
+  u_int16_t command1;
+  u_int16_t command2;
+  u_int8_t byte = 0;
+
+  // Get the commands
+  if (it8528_get_fan_speed_commands(fan_id, &command1, &command2) != 0)
+  {
+    fprintf(stderr, "it8528_get_fan_speed: invalid fan ID!\n");
+    return -1;
+  }
+
+  // Get a byte
+  if (it8528_cache_get_byte(IT8528_CACHE_CLASS_FAN_SPEED, BYTE1(command1), BYTE2(command1),
+      IT8528_CACHE_DEFAULT_MAX_AGE, &byte) != 0)
+  {
+    fprintf(stderr, "it8528_get_fan_speed: it8528_get_byte() failed!\n");
+    return -1;
+  }
+
+  // Add the first byte to the speed value
+  *speed = byte;
+  *speed <<= 8;
+
+  // Get a second byte
+  if (it8528_cache_get_byte(IT8528_CACHE_CLASS_FAN_SPEED, BYTE1(command2), BYTE2(command2),
+      IT8528_CACHE_DEFAULT_MAX_AGE, &byte) != 0)
+  {
+    fprintf(stderr, "it8528_get_fan_speed: it8528_get_byte() failed!\n");
+    return -1;
+  }
+
+  // Add the second byte to the speed value
+  *speed |= byte;
+
+  return 0;
+}
+
+// Function called to set the fan speed in percentage
+int8_t it8528_set_fan_speed(u_int8_t fan_id, u_int8_t speed)
+{
+  // Declare needed variables
+  u_int16_t command1;
+  u_int16_t command2;
+  u_int8_t group;
+
+  // Get the commands
+  if (it8528_get_fan_group(fan_id, &group, &command1, &command2) != 0)
+  {
+    fprintf(stderr, "it8528_set_fan_speed: invalid fan ID!\n");
+    return -1;
+  }
+
+  // Hold the lock shared with the other processes across both writes
+  if (it8528_acquire_lock(IT8528_LOCK_CLASS_CONTROL) != 0)
+  {
+    fprintf(stderr, "it8528_set_fan_speed: it8528_acquire_lock() failed!\n");
+    return -1;
+  }
+
+  // Set a byte
+  if (it8528_set_fan_register(&it8528_fan_registers[group][0], command1, 0x10) != 0)
+  {
+    fprintf(stderr, "it8528_set_fan_speed: it8528_set_fan_register() failed!\n");
+    it8528_lock_release();
+    return -1;
+  }
+
+  // The following formula is a copy of the formula in the libuLinux_hal.so library's
+  //   ec_sys_set_fan_speed function as decompiled by IDA
+  u_int8_t normalized_speed = 100 * speed / 255;
+
+  // Set a second byte
+  if (it8528_set_fan_register(&it8528_fan_registers[group][1], command2, normalized_speed) != 0)
+  {
+    fprintf(stderr, "it8528_set_fan_speed: it8528_set_fan_register() failed!\n");
+    it8528_lock_release();
+    return -1;
+  }
+
+  it8528_lock_release();
+
+  return 0;
+}
+
+// Function called to set the speed in percentage of several fans at once, every fan ID and speed
+//   is checked before anything is written, then the mode registers of the fan groups are written
+//   followed by their PWM registers back to back under the lock so that the new speeds land
+//   together, fans sharing a group must be given the same speed
+int8_t it8528_set_fan_speeds(const struct it8528_fan_setting* settings, u_int8_t count)
+{
+  // Declare needed variables
+  u_int16_t mode_commands[IT8528_FAN_GROUPS];
+  u_int16_t pwm_commands[IT8528_FAN_GROUPS];
+  u_int8_t speeds[IT8528_FAN_GROUPS];
+  u_int8_t groups[IT8528_FAN_GROUPS];
+  u_int8_t group_count = 0;
+
+  // Loop through the settings to check them and collect the fan groups in order
+  for (u_int8_t i = 0; i < count; i++)
+  {
+    // Declare needed variables
+    u_int16_t mode_command;
+    u_int16_t pwm_command;
+    u_int8_t group;
+    u_int8_t j;
+
+    // Make sure the fan ID and the speed are valid
+    if (it8528_get_fan_group(settings[i].fan_id, &group, &mode_command, &pwm_command) != 0)
     {
-      if (fan_id <= 19 || fan_id > 25)
-      {
-        if (fan_id > 29 && fan_id <= 35)
-        {
-          // Get a byte
-          if (it8528_get_byte(BYTE1(command), BYTE2(command), &byte) != 0)
-          {
-            fprintf(stderr, "it8528_get_fan_status: it8528_get_byte() failed!\n");
-            return -1;
-          }
-
-          // Convert the byte to the status value
-          *status = (((int32_t)byte >> (fan_id - 30)) & 0x01) == 0;
-        }
-      }
-      else
+      fprintf(stderr, "it8528_set_fan_speeds: invalid fan ID!\n");
+      return -1;
+    }
+    if (settings[i].speed > 100)
+    {
+      fprintf(stderr, "it8528_set_fan_speeds: invalid speed!\n");
+      return -1;
+    }
+
+    // Check if the group was already given a speed
+    for (j = 0; j < group_count; j++)
+    {
+      if (groups[j] == group)
       {
-        // Get a byte
-        if (it8528_get_byte(BYTE1(command), BYTE2(command), &byte) != 0)
-        {
-          fprintf(stderr, "it8528_get_fan_status: it8528_get_byte() failed!\n");
-          return -1;
-        }
-
-        // Convert the byte to the status value
-        *status = (((int32_t)byte >> (fan_id - 20)) & 0x01) == 0;
+        break;
       }
     }
-    else
+    if (j < group_count)
     {
-      // Get a byte
-      if (it8528_get_byte(BYTE1(command), BYTE2(command), &byte) != 0)
+      if (speeds[j] != settings[i].speed)
       {
-        fprintf(stderr, "it8528_get_fan_status: it8528_get_byte() failed!\n");
+        fprintf(stderr, "it8528_set_fan_speeds: conflicting speeds for fans sharing a PWM!\n");
         return -1;
       }
+      continue;
+    }
+
+    // Add the group
+    groups[group_count] = group;
+    mode_commands[group_count] = mode_command;
+    pwm_commands[group_count] = pwm_command;
+    speeds[group_count] = settings[i].speed;
+    group_count++;
+  }
+
+  // Hold the lock shared with the other processes across the whole batch
+  if (it8528_acquire_lock(IT8528_LOCK_CLASS_CONTROL) != 0)
+  {
+    fprintf(stderr, "it8528_set_fan_speeds: it8528_acquire_lock() failed!\n");
+    return -1;
+  }
 
-      // Convert the byte to the status value
-      *status = (((int32_t)byte >> (fan_id - 6)) & 0x01) == 0;
+  // Set the mode byte of every group
+  for (u_int8_t i = 0; i < group_count; i++)
+  {
+    if (it8528_set_fan_register(&it8528_fan_registers[groups[i]][0], mode_commands[i], 0x10) != 0)
+    {
+      fprintf(stderr, "it8528_set_fan_speeds: it8528_set_fan_register() failed!\n");
+      it8528_lock_release();
+      return -1;
     }
   }
-  else
+
+  // Set the PWM byte of every group, see it8528_set_fan_speed
+  for (u_int8_t i = 0; i < group_count; i++)
+  {
+    if (it8528_set_fan_register(&it8528_fan_registers[groups[i]][1], pwm_commands[i],
+      100 * speeds[i] / 255) != 0)
+    {
+      fprintf(stderr, "it8528_set_fan_speeds: it8528_set_fan_register() failed!\n");
+      it8528_lock_release();
+      return -1;
+    }
+  }
+
+  it8528_lock_release();
+
+  return 0;
+}
+
+// Function called to set how many milliseconds a fan register write that was skipped because the
+//   register already holds the value can be trusted before it is written again anyway, 0 writes
+//   every time
+void it8528_set_fan_refresh(u_int32_t refresh)
+{
+  it8528_fan_refresh = refresh;
+}
+
+// Function called to get the fan register write statistics
+void it8528_get_fan_write_stats(struct it8528_fan_write_stats* stats)
+{
+  *stats = it8528_fan_write_stats;
+}
+
+// Function called to print the fan register write statistics
+void it8528_print_fan_write_stats(FILE* stream)
+{
+  fprintf(stream, "fan_refresh %u\n", it8528_fan_refresh);
+  fprintf(stream, "fan_writes %llu\n", (unsigned long long)it8528_fan_write_stats.writes);
+  fprintf(stream, "fan_writes_suppressed %llu\n",
+    (unsigned long long)it8528_fan_write_stats.suppressed);
+  fprintf(stream, "fan_writes_refreshed %llu\n",
+    (unsigned long long)it8528_fan_write_stats.refreshes);
+}
+
+// Function called to get the temperature
+int8_t it8528_get_temperature(u_int8_t sensor_id, double* temperature)
+{
+  // Declare needed variables
+  u_int16_t command;
+  u_int8_t byte;
+
+  // Get the command
+  if (it8528_get_temperature_command(sensor_id, &command) != 0)
+  {
+    fprintf(stderr, "it8528_get_temperature: invalid sensor ID!\n");
+    return -1;
+  }
+
+  // Get a byte
+  if (it8528_cache_get_byte(IT8528_CACHE_CLASS_TEMPERATURE, BYTE1(command), BYTE2(command),
+      IT8528_CACHE_DEFAULT_MAX_AGE, &byte) != 0)
   {
+    fprintf(stderr, "it8528_get_temperature: it8528_get_byte() failed!\n");
+    return -1;
+  }
+
+  // Convert the byte to the temperature value
+  *temperature = (double)byte;
+
+  return 0;
+}
+
+// Function called to get the power supply status
+int8_t i8528_get_power_supply_status(u_int8_t power_supply_id, u_int8_t* status)
+{
+  // Check if the power supply ID is valid
+  if (power_supply_id > 0 && power_supply_id <= 2)
+  {
+    // Declare needed variables
+    u_int8_t byte;
+
     // Get a byte
-    if (it8528_get_byte(BYTE1(command), BYTE2(command), &byte) != 0)
+    if (it8528_cache_get_byte(IT8528_CACHE_CLASS_POWER_SUPPLY, BYTE1(IT8528_POWER_SUPPLY_COMMAND),
+      BYTE2(IT8528_POWER_SUPPLY_COMMAND), IT8528_CACHE_DEFAULT_MAX_AGE, &byte) != 0)
     {
-      fprintf(stderr, "it8528_get_fan_status: it8528_get_byte() failed!\n");
+      fprintf(stderr, "it8528_get_power_supply_status: it8528_get_byte() failed!\n");
       return -1;
     }
 
     // Convert the byte to the status value
-    *status = (((int32_t)byte >> fan_id) & 0x01) == 0;
+    *status = it8528_convert_power_supply_status(power_supply_id, byte);
+  }
+  else
+  {
+    fprintf(stderr, "it8528_get_power_supply_status: invalid power supply ID!\n");
+    return -1;
   }
 
   return 0;
 }
 
-// Function called to get the fan PWM
-int8_t it8528_get_fan_pwm(u_int8_t fan_id, u_int8_t* pwm)
+// Function called to plan the reads needed for a snapshot of the present sensors and fans and of
+//   the power supplies as a sorted list of unique commands so that shared registers are only read
+//   once and consecutive registers can be read as blocks, the presence arrays are indexed the same
+//   way as the it8528_sensor_ids and it8528_fan_ids arrays and NULL means every sensor or fan
+void it8528_plan_snapshot(struct it8528_read_plan* plan, const u_int8_t* sensor_present,
+  const u_int8_t* fan_present)
 {
   // Declare needed variables
-  u_int16_t command;
+  u_int16_t command1;
+  u_int16_t command2;
+
+  plan->count = 0;
+
+  // Add the temperature commands
+  for (u_int8_t i = 0; i < IT8528_SENSOR_COUNT; i++)
+  {
+    if ((sensor_present == NULL || sensor_present[i]) &&
+      it8528_get_temperature_command(it8528_sensor_ids[i], &command1) == 0)
+    {
+      it8528_add_plan_command(plan, command1, IT8528_CACHE_CLASS_TEMPERATURE);
+    }
+  }
+
+  // Add the fan commands
+  for (u_int8_t i = 0; i < IT8528_FAN_COUNT; i++)
+  {
+    // Skip the fans that aren't present
+    if (fan_present != NULL && !fan_present[i])
+    {
+      continue;
+    }
 
+    if (it8528_get_fan_speed_commands(it8528_fan_ids[i], &command1, &command2) == 0)
+    {
+      it8528_add_plan_command(plan, command1, IT8528_CACHE_CLASS_FAN_SPEED);
+      it8528_add_plan_command(plan, command2, IT8528_CACHE_CLASS_FAN_SPEED);
+    }
+    if (it8528_get_fan_pwm_command(it8528_fan_ids[i], &command1) == 0)
+    {
+      it8528_add_plan_command(plan, command1, IT8528_CACHE_CLASS_FAN_PWM);
+    }
+    if (it8528_get_fan_status_command(it8528_fan_ids[i], &command1) == 0)
+    {
+      it8528_add_plan_command(plan, command1, IT8528_CACHE_CLASS_FAN_STATUS);
+    }
+  }
+
+  // Add the power supply command
+  it8528_add_plan_command(plan, IT8528_POWER_SUPPLY_COMMAND, IT8528_CACHE_CLASS_POWER_SUPPLY);
+
+  // Sort the commands so that consecutive ones can be read as blocks, keeping every class next
+  //   to its command by sorting both as one value
+  u_int32_t entries[IT8528_MAX_PLAN_COMMANDS];
+  for (u_int16_t i = 0; i < plan->count; i++)
+  {
+    entries[i] = (plan->commands[i] << 8) | plan->classes[i];
+  }
+  qsort(entries, plan->count, sizeof(entries[0]), it8528_compare_plan_entries);
+  for (u_int16_t i = 0; i < plan->count; i++)
+  {
+    plan->commands[i] = entries[i] >> 8;
+    plan->classes[i] = entries[i] & 0xFF;
+  }
+
+  // Index the command of every sensor
+  for (u_int8_t i = 0; i < IT8528_SENSOR_COUNT; i++)
+  {
+    plan->temperature_indexes[i] = -1;
+    if ((sensor_present == NULL || sensor_present[i]) &&
+      it8528_get_temperature_command(it8528_sensor_ids[i], &command1) == 0)
+    {
+      plan->temperature_indexes[i] = it8528_find_plan_command(plan, command1);
+    }
+  }
+
+  // Index the commands of every fan
+  for (u_int8_t i = 0; i < IT8528_FAN_COUNT; i++)
+  {
+    for (u_int8_t j = 0; j < IT8528_FAN_PLAN_COMMANDS; j++)
+    {
+      plan->fan_indexes[i][j] = -1;
+    }
+    if (fan_present != NULL && !fan_present[i])
+    {
+      continue;
+    }
+    if (it8528_get_fan_speed_commands(it8528_fan_ids[i], &command1, &command2) == 0)
+    {
+      plan->fan_indexes[i][0] = it8528_find_plan_command(plan, command1);
+      plan->fan_indexes[i][1] = it8528_find_plan_command(plan, command2);
+    }
+    if (it8528_get_fan_pwm_command(it8528_fan_ids[i], &command1) == 0)
+    {
+      plan->fan_indexes[i][2] = it8528_find_plan_command(plan, command1);
+    }
+    if (it8528_get_fan_status_command(it8528_fan_ids[i], &command1) == 0)
+    {
+      plan->fan_indexes[i][3] = it8528_find_plan_command(plan, command1);
+    }
+  }
+
+  // Index the power supply command
+  plan->power_supply_index = it8528_find_plan_command(plan, IT8528_POWER_SUPPLY_COMMAND);
+}
+
+// Function called to get a snapshot of the sensors and fans of the model profile and of the power
+//   supplies in one planned pass
+int8_t it8528_get_snapshot(struct it8528_snapshot* snapshot)
+{
+  return it8528_read_snapshot(&it8528_profile_get()->plan, IT8528_CACHE_DEFAULT_MAX_AGE,
+    snapshot);
+}
+
+// Function called to get a snapshot of the sensors and fans of a read plan and of the power
+//   supplies in one pass, using the cached bytes that are at most max age milliseconds old
+int8_t it8528_read_snapshot(const struct it8528_read_plan* plan, int32_t max_age,
+  struct it8528_snapshot* snapshot)
+{
+  // Declare needed variables
+  u_int8_t bytes[IT8528_MAX_PLAN_COMMANDS];
+  u_int8_t valid[IT8528_MAX_PLAN_COMMANDS];
+  int8_t ret = 0;
+
+  // Take the timestamp of the snapshot
+  memset(snapshot, 0, sizeof(*snapshot));
+  clock_gettime(CLOCK_REALTIME, &snapshot->time);
+
+  // Get the bytes that are fresh enough from the cache
+  for (u_int16_t i = 0; i < plan->count; i++)
+  {
+    valid[i] = it8528_cache_lookup(plan->classes[i], plan->commands[i], max_age,
+      &bytes[i]) == 0;
+  }
+
+  // Read every run of consecutive commands that weren't cached as a block
+  for (u_int16_t i = 0; i < plan->count;)
+  {
+    // Skip the cached commands
+    if (valid[i])
+    {
+      i++;
+      continue;
+    }
+
+    // Find the end of the run
+    u_int16_t j = i + 1;
+    while (j < plan->count && !valid[j] && plan->commands[j] == plan->commands[j - 1] + 1)
+    {
+      j++;
+    }
+
+    // Read the block and cache it
+    if (it8528_read_block(plan->commands[i], j - i, &bytes[i]) == 0)
+    {
+      for (u_int16_t k = i; k < j; k++)
+      {
+        valid[k] = 1;
+        it8528_cache_store(plan->commands[k], bytes[k]);
+      }
+    }
+    else
+    {
+      fprintf(stderr, "it8528_get_snapshot: it8528_read_block() failed!\n");
+      ret = -1;
+    }
+
+    i = j;
+  }
+
+  // Convert the temperatures
+  for (u_int8_t i = 0; i < IT8528_SENSOR_COUNT; i++)
+  {
+    int16_t index = plan->temperature_indexes[i];
+    if (index >= 0 && valid[index])
+    {
+      snapshot->temperature_valid[i] = 1;
+      snapshot->temperatures[i] = (double)bytes[index];
+    }
+  }
+
+  // Convert the fan speeds, PWMs, and statuses
+  for (u_int8_t i = 0; i < IT8528_FAN_COUNT; i++)
+  {
+    const int16_t* indexes = plan->fan_indexes[i];
+    if (indexes[0] >= 0 && valid[indexes[0]] && indexes[1] >= 0 && valid[indexes[1]] &&
+        indexes[2] >= 0 && valid[indexes[2]] && indexes[3] >= 0 && valid[indexes[3]])
+    {
+      snapshot->fan_valid[i] = 1;
+      snapshot->fan_speeds[i] = (bytes[indexes[0]] << 8) | bytes[indexes[1]];
+      snapshot->fan_pwms[i] = it8528_convert_fan_pwm(bytes[indexes[2]]);
+      snapshot->fan_statuses[i] = it8528_convert_fan_status(it8528_fan_ids[i],
+        bytes[indexes[3]]);
+    }
+  }
+
+  // Convert the power supply statuses
+  if (plan->power_supply_index >= 0 && valid[plan->power_supply_index])
+  {
+    for (u_int8_t i = 0; i < IT8528_POWER_SUPPLY_COUNT; i++)
+    {
+      snapshot->power_supply_valid[i] = 1;
+      snapshot->power_supply_statuses[i] = it8528_convert_power_supply_status(i + 1,
+        bytes[plan->power_supply_index]);
+    }
+  }
+
+  return ret;
+}
+
+// Function called to get the fan group of a fan, the index of its shadow copies, and the commands
+//   used to write its mode and PWM
+static int8_t it8528_get_fan_group(u_int8_t fan_id, u_int8_t* group, u_int16_t* mode_command,
+  u_int16_t* pwm_command)
+{
   // The following switch statement is a copy of the switch statement found in the
-  //   libuLinux_hal.so library's ec_sys_get_fan_pwm function as decompiled by IDA
+  //   libuLinux_hal.so library's ec_sys_get_fan_speed function as decompiled by IDA
   switch (fan_id)
   {
     case 0:
@@ -145,11 +610,15 @@ int8_t it8528_get_fan_pwm(u_int8_t fan_id, u_int8_t* pwm)
     case 3:
     case 4:
     case 5:
-      command = 0x022E;
+      *mode_command = 0x0220;
+      *pwm_command = 0x022E;
+      *group = 0;
       break;
     case 6:
     case 7:
-      command = 0x024B;
+      *mode_command = 0x0223;
+      *pwm_command = 0x024B;
+      *group = 1;
       break;
     case 20:
     case 21:
@@ -157,7 +626,9 @@ int8_t it8528_get_fan_pwm(u_int8_t fan_id, u_int8_t* pwm)
     case 23:
     case 24:
     case 25:
-      command = 0x022F;
+      *mode_command = 0x0221;
+      *pwm_command = 0x022F;
+      *group = 2;
       break;
     case 30:
     case 31:
@@ -165,40 +636,63 @@ int8_t it8528_get_fan_pwm(u_int8_t fan_id, u_int8_t* pwm)
     case 33:
     case 34:
     case 35:
-      command = 0x023B;
+      *mode_command = 0x0222;
+      *pwm_command = 0x023B;
+      *group = 3;
       break;
     default:
-      fprintf(stderr, "it8528_get_fan_pwm: invalid fan ID!\n");
       return -1;
   }
 
+  return 0;
+}
+
+// Function called to write a fan register unless its shadow copy shows it already holds the
+//   value and was written less than the refresh period ago
+static int8_t it8528_set_fan_register(struct it8528_fan_register* shadow, u_int16_t command,
+  u_int8_t value)
+{
   // Declare needed variables
-  u_int8_t byte;
+  struct timespec ts;
+  u_int64_t now;
 
-  // Get a byte
-  if (it8528_get_byte(BYTE1(command), BYTE2(command), &byte) != 0)
+  // Get the monotonic time in nanoseconds
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  now = (u_int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+
+  // Check if the register already holds the value
+  if (shadow->valid && shadow->value == value)
   {
-    fprintf(stderr, "it8528_get_fan_pwm: it8528_get_byte() failed!\n");
+    // Skip the write unless it is time to refresh the register
+    if (now - shadow->time < (u_int64_t)it8528_fan_refresh * 1000000)
+    {
+      it8528_fan_write_stats.suppressed++;
+      return 0;
+    }
+    it8528_fan_write_stats.refreshes++;
+  }
+
+  // Write the register, forgetting what it holds if the write failed
+  if (it8528_set_byte(BYTE1(command), BYTE2(command), value) != 0)
+  {
+    shadow->valid = 0;
     return -1;
   }
+  it8528_fan_write_stats.writes++;
 
-  // Convert the byte to the pwm value
-  // The following formula is a copy of the formula in the libuLinux_hal.so library's
-  //   ec_sys_get_fan_pwm function as decompiled by IDA
-  *pwm = ((int32_t)((u_int64_t)(0x51999999E1 * byte) >> 32) >> 5) - byte / 0x808081;
+  // Update the shadow copy
+  shadow->valid = 1;
+  shadow->value = value;
+  shadow->time = now;
 
   return 0;
 }
 
-// Function called to get the fan speed in RPM
-int8_t it8528_get_fan_speed(u_int8_t fan_id, u_int16_t* speed)
+// Function called to get the command used to read the status of a fan
+static int8_t it8528_get_fan_status_command(u_int8_t fan_id, u_int16_t* command)
 {
-  // Declare needed variables
-  u_int16_t command1;
-  u_int16_t command2;
-
   // The following switch statement is a copy of the switch statement found in the
-  //   libuLinux_hal.so library's ec_sys_get_fan_speed function as decompiled by IDA
+  //   libuLinux_hal.so library's ec_sys_get_fan_pwm function as decompiled by IDA
   switch (fan_id)
   {
     case 0:
@@ -207,34 +701,22 @@ int8_t it8528_get_fan_speed(u_int8_t fan_id, u_int16_t* speed)
     case 3:
     case 4:
     case 5:
-      command1 = 2 * (fan_id + 0x0312);
-      command2 = 2 * fan_id + 0x0625;
+      *command = 0x0242;
       break;
     case 6:
     case 7:
-      command1 = 2 * (fan_id + 0x030A);
-      command2 = 2 * (fan_id - 0x06) + 0x621;
+      *command = 0x0244;
       break;
-    // The following fan ID seems to be only valid if in the model.conf file in the System IO
-    //   section the REDUNDANT_POWER_INFO value is set to yes
     case 10:
-      command1 = 0x065B;
-      command2 = 0x065A;
-      break;
-    // The following fan ID seems to be only valid if in the model.conf file in the System IO
-    //   section the REDUNDANT_POWER_INFO value is set to yes
     case 11:
-      command1 = 0x065E;
-      command2 = 0x065D;
-      break;
+      return -1;
     case 20:
     case 21:
     case 22:
     case 23:
     case 24:
     case 25:
-      command1 = 2 * (fan_id + 0x030E);
-      command2 = 2 * (fan_id - 0x14) + 0x0645;
+      *command = 0x0259;
       break;
     case 30:
     case 31:
@@ -242,48 +724,61 @@ int8_t it8528_get_fan_speed(u_int8_t fan_id, u_int16_t* speed)
     case 33:
     case 34:
     case 35:
-      command1 = 2 * (fan_id + 0x02F8);
-      command2 = 2 * (fan_id - 0x1E) + 0x062D;
+      *command = 0x025A;
       break;
     default:
-      fprintf(stderr, "it8528_get_fan_speed: invalid fan ID!\n");
       return -1;
   }
 
-  // Declare needed variables
-  u_int8_t byte = 0;
-
-  // Get a byte
-  if (it8528_get_byte(BYTE1(command1), BYTE2(command1), &byte) != 0)
-  {
-    fprintf(stderr, "it8528_get_fan_speed: it8528_get_byte() failed!\n");
-    return -1;
-  }
-
-  // Add the first byte to the speed value
-  *speed = byte;
-  *speed <<= 8;
+  return 0;
+}
 
-  // Get a second byte
-  if (it8528_get_byte(BYTE1(command2), BYTE2(command2), &byte) != 0)
+// Function called to get the command used to read the PWM of a fan
+int8_t it8528_get_fan_pwm_command(u_int8_t fan_id, u_int16_t* command)
+{
+  // The following switch statement is a copy of the switch statement found in the
+  //   libuLinux_hal.so library's ec_sys_get_fan_pwm function as decompiled by IDA
+  switch (fan_id)
   {
-    fprintf(stderr, "it8528_get_fan_speed: it8528_get_byte() failed!\n");
-    return -1;
+    case 0:
+    case 1:
+    case 2:
+    case 3:
+    case 4:
+    case 5:
+      *command = 0x022E;
+      break;
+    case 6:
+    case 7:
+      *command = 0x024B;
+      break;
+    case 20:
+    case 21:
+    case 22:
+    case 23:
+    case 24:
+    case 25:
+      *command = 0x022F;
+      break;
+    case 30:
+    case 31:
+    case 32:
+    case 33:
+    case 34:
+    case 35:
+      *command = 0x023B;
+      break;
+    default:
+      return -1;
   }
 
-  // Add the second byte to the speed value
-  *speed |= byte;
-
   return 0;
 }
 
-// Function called to set the fan speed in percentage
-int8_t it8528_set_fan_speed(u_int8_t fan_id, u_int8_t speed)
+// Function called to get the commands used to read the high and low bytes of the speed of a fan
+static int8_t it8528_get_fan_speed_commands(u_int8_t fan_id, u_int16_t* command1,
+  u_int16_t* command2)
 {
-  // Declare needed variables
-  u_int16_t command1;
-  u_int16_t command2;
-
   // The following switch statement is a copy of the switch statement found in the
   //   libuLinux_hal.so library's ec_sys_get_fan_speed function as decompiled by IDA
   switch (fan_id)
@@ -294,13 +789,25 @@ int8_t it8528_set_fan_speed(u_int8_t fan_id, u_int8_t speed)
     case 3:
     case 4:
     case 5:
-      command1 = 0x0220;
-      command2 = 0x022E;
+      *command1 = 2 * (fan_id + 0x0312);
+      *command2 = 2 * fan_id + 0x0625;
       break;
     case 6:
     case 7:
-      command1 = 0x0223;
-      command2 = 0x024B;
+      *command1 = 2 * (fan_id + 0x030A);
+      *command2 = 2 * (fan_id - 0x06) + 0x621;
+      break;
+    // The following fan ID seems to be only valid if in the model.conf file in the System IO
+    //   section the REDUNDANT_POWER_INFO value is set to yes
+    case 10:
+      *command1 = 0x065B;
+      *command2 = 0x065A;
+      break;
+    // The following fan ID seems to be only valid if in the model.conf file in the System IO
+    //   section the REDUNDANT_POWER_INFO value is set to yes
+    case 11:
+      *command1 = 0x065E;
+      *command2 = 0x065D;
       break;
     case 20:
     case 21:
@@ -308,8 +815,8 @@ int8_t it8528_set_fan_speed(u_int8_t fan_id, u_int8_t speed)
     case 23:
     case 24:
     case 25:
-      command1 = 0x0221;
-      command2 = 0x022F;
+      *command1 = 2 * (fan_id + 0x030E);
+      *command2 = 2 * (fan_id - 0x14) + 0x0645;
       break;
     case 30:
     case 31:
@@ -317,59 +824,37 @@ int8_t it8528_set_fan_speed(u_int8_t fan_id, u_int8_t speed)
     case 33:
     case 34:
     case 35:
-      command1 = 0x0222;
-      command2 = 0x023B;
+      *command1 = 2 * (fan_id + 0x02F8);
+      *command2 = 2 * (fan_id - 0x1E) + 0x062D;
       break;
     default:
-      fprintf(stderr, "it8528_set_fan_speed: invalid fan ID!\n");
       return -1;
   }
 
-  // Set a byte
-  if (it8528_set_byte(BYTE1(command1), BYTE2(command1), 0x10) != 0)
-  {
-    fprintf(stderr, "it8528_set_fan_speed: it8528_set_byte() failed!\n");
-    return -1;
-  }
-
-  // The following formula is a copy of the formula in the libuLinux_hal.so library's
-  //   ec_sys_set_fan_speed function as decompiled by IDA
-  u_int8_t normalized_speed = 100 * speed / 255;
-
-  // Set a second byte
-  if (it8528_set_byte(BYTE1(command2), BYTE2(command2), normalized_speed) != 0)
-  {
-    fprintf(stderr, "it8528_set_fan_speed: it8528_set_byte() failed!\n");
-    return -1;
-  }
-
   return 0;
 }
 
-// Function called to get the temperature
-int8_t it8528_get_temperature(u_int8_t sensor_id, double* temperature)
+// Function called to get the command used to read a temperature
+int8_t it8528_get_temperature_command(u_int8_t sensor_id, u_int16_t* command)
 {
-  // Declare needed variables
-  u_int16_t command;
-
   // The following switch statement is a copy of the switch statement found in the
   //   libuLinux_hal.so library's ec_sys_get_temperature function as decompiled by IDA
   switch (sensor_id)
   {
     case 0:
     case 1:
-      command = sensor_id + 0x0600;
+      *command = sensor_id + 0x0600;
       break;
     case 5:
     case 6:
     case 7:
-      command = sensor_id + 0x05FD;
+      *command = sensor_id + 0x05FD;
       break;
     case 10:
-      command = 0x0659;
+      *command = 0x0659;
       break;
     case 11:
-      command = 0x065C;
+      *command = 0x065C;
       break;
     case 15:
     case 16:
@@ -395,55 +880,109 @@ int8_t it8528_get_temperature(u_int8_t sensor_id, double* temperature)
     case 36:
     case 37:
     case 38:
-      command = sensor_id + 0x05F7;
+      *command = sensor_id + 0x05F7;
       break;
     default:
-      fprintf(stderr, "it8528_get_temperature: invalid sensor ID!\n");
       return -1;
   }
 
-  // Declare needed variables
-  u_int8_t byte;
+  return 0;
+}
 
-  // Get a byte
-  if (it8528_get_byte(BYTE1(command), BYTE2(command), &byte) != 0)
+// Function called to convert a fan status byte to the status value of a fan
+static u_int8_t it8528_convert_fan_status(u_int8_t fan_id, u_int8_t byte)
+{
+  // The following if statement is a copy of the if statement found in the libuLinux_hal.so library's
+  //   ec_sys_get_fan_status function as decompiled by IDA
+  if (fan_id > 5)
   {
-    fprintf(stderr, "it8528_get_temperature: it8528_get_byte() failed!\n");
-    return -1;
+    if (fan_id > 7)
+    {
+      if (fan_id <= 19 || fan_id > 25)
+      {
+        return (((int32_t)byte >> (fan_id - 30)) & 0x01) == 0;
+      }
+      else
+      {
+        return (((int32_t)byte >> (fan_id - 20)) & 0x01) == 0;
+      }
+    }
+    else
+    {
+      return (((int32_t)byte >> (fan_id - 6)) & 0x01) == 0;
+    }
+  }
+  else
+  {
+    return (((int32_t)byte >> fan_id) & 0x01) == 0;
   }
+}
 
-  // Convert the byte to the temperature value
-  *temperature = (double)byte;
+// Function called to convert a fan PWM byte to the PWM value of a fan
+static u_int8_t it8528_convert_fan_pwm(u_int8_t byte)
+{
+  // The following formula is a copy of the formula in the libuLinux_hal.so library's
+  //   ec_sys_get_fan_pwm function as decompiled by IDA
+  return ((int32_t)((u_int64_t)(0x51999999E1 * byte) >> 32) >> 5) - byte / 0x808081;
+}
 
-  return 0;
+// Function called to convert a power supply status byte to the status value of a power supply
+static u_int8_t it8528_convert_power_supply_status(u_int8_t power_supply_id, u_int8_t byte)
+{
+  // The following formula is a copy of the formula in the libuLinux_hal.so library's
+  //   ec_sys_get_power_supply_status function as decompiled by IDA
+  return (((int32_t)byte >> power_supply_id) & 0x01) == 0;
 }
 
-// Function called to get the power supply status
-int8_t i8528_get_power_supply_status(u_int8_t power_supply_id, u_int8_t* status)
+// Function called to add a command to a read plan if it isn't already in it, a command shared by
+//   several register classes keeps the class with the shortest max age
+static void it8528_add_plan_command(struct it8528_read_plan* plan, u_int16_t command,
+  u_int8_t register_class)
 {
-  // Check if the power supply ID is valid
-  if (power_supply_id > 0 && power_supply_id <= 2)
+  // Check if the command is already in the plan
+  for (u_int16_t i = 0; i < plan->count; i++)
   {
-    // Declare needed variables
-    u_int8_t byte;
-
-    // Get a byte
-    if (it8528_get_byte(0x00, 0x45, &byte) != 0)
+    if (plan->commands[i] == command)
     {
-      fprintf(stderr, "it8528_get_power_supply_status: it8528_get_byte() failed!\n");
-      return -1;
+      if (it8528_cache_get_max_age(register_class) < it8528_cache_get_max_age(plan->classes[i]))
+      {
+        plan->classes[i] = register_class;
+      }
+      return;
     }
-
-    // Convert the byte to the status value
-    // The following formula is a copy of the formula in the libuLinux_hal.so library's
-    //   ec_sys_get_power_supply_status function as decompiled by IDA
-    *status = (((int32_t)byte >> power_supply_id) & 0x01) == 0;
   }
-  else
+
+  // Add the command if there is room for it
+  if (plan->count < IT8528_MAX_PLAN_COMMANDS)
   {
-    fprintf(stderr, "it8528_get_power_supply_status: invalid power supply ID!\n");
-    return -1;
+    plan->commands[plan->count] = command;
+    plan->classes[plan->count] = register_class;
+    plan->count++;
   }
+}
 
-  return 0;
-}
\ No newline at end of file
+// Function called to find the index of a command in a sorted read plan
+static int it8528_find_plan_command(const struct it8528_read_plan* plan, u_int16_t command)
+{
+  // Declare needed variables
+  u_int16_t* found = bsearch(&command, plan->commands, plan->count, sizeof(plan->commands[0]),
+    it8528_compare_commands);
+
+  return found == NULL ? -1 : found - plan->commands;
+}
+
+// Function called to compare two commands when sorting
+static int it8528_compare_commands(const void* a, const void* b)
+{
+  return *(const u_int16_t*)a - *(const u_int16_t*)b;
+}
+
+// Function called to compare two plan entries made of a command and a class when sorting
+static int it8528_compare_plan_entries(const void* a, const void* b)
+{
+  // Declare needed variables
+  u_int32_t value_a = *(const u_int32_t*)a;
+  u_int32_t value_b = *(const u_int32_t*)b;
+
+  return (value_a > value_b) - (value_a < value_b);
+}
@@ -0,0 +1,290 @@
+/*
+ * Copyright (C) 2021 Stonyx
+ * http://www.stonyx.com
+ *
+ * Copyright (C) 2020 Guillaume Valadon
+ * guillaume@valadon.net
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+#include "it8528_utils.h"
+#include "it8528_cache.h"
+
+// Define the structure holding a cached register
+struct it8528_cache_entry
+{
+  u_int16_t command;
+  u_int8_t used;
+  u_int8_t valid;
+  u_int8_t value;
+  u_int64_t time;
+};
+
+// Define the register class names
+static const char* it8528_cache_class_names[] = {
+  "temperature", "fan_speed", "fan_pwm", "fan_status", "power_supply"
+};
+
+// Declare the maximum ages in milliseconds of the register classes, temperatures and statuses
+//   change slowly while fan speeds only need sub-second freshness
+static u_int32_t it8528_cache_max_ages[IT8528_CACHE_CLASSES] = {
+  [IT8528_CACHE_CLASS_TEMPERATURE] = 1000,
+  [IT8528_CACHE_CLASS_FAN_SPEED] = 250,
+  [IT8528_CACHE_CLASS_FAN_PWM] = 1000,
+  [IT8528_CACHE_CLASS_FAN_STATUS] = 5000,
+  [IT8528_CACHE_CLASS_POWER_SUPPLY] = 5000
+};
+
+// Declare the cache state
+static struct it8528_cache_entry it8528_cache_entries[IT8528_CACHE_SIZE];
+static int32_t it8528_cache_age_limit = IT8528_CACHE_DEFAULT_MAX_AGE;
+static struct it8528_cache_stats it8528_cache_stats[IT8528_CACHE_CLASSES];
+static u_int64_t it8528_cache_invalidations;
+
+// Declare functions
+static struct it8528_cache_entry* it8528_cache_find(u_int16_t command, u_int8_t add);
+static u_int64_t it8528_cache_get_time(void);
+
+// Function called to read a byte through the cache, a max age of IT8528_CACHE_DEFAULT_MAX_AGE
+//   uses the max age of the register class
+int8_t it8528_cache_get_byte(u_int8_t register_class, u_int8_t command0, u_int8_t command1,
+  int32_t max_age, u_int8_t* value)
+{
+  // Declare needed variables
+  u_int16_t command = command0 | (command1 << 8);
+
+  // Check if the byte is cached
+  if (it8528_cache_lookup(register_class, command, max_age, value) == 0)
+  {
+    return 0;
+  }
+
+  // Get the byte from the chip
+  if (it8528_get_byte(command0, command1, value) != 0)
+  {
+    return -1;
+  }
+
+  // Cache the byte
+  it8528_cache_store(command, *value);
+
+  return 0;
+}
+
+// Function called to look up a cached byte that is at most max age milliseconds old
+int8_t it8528_cache_lookup(u_int8_t register_class, u_int16_t command, int32_t max_age,
+  u_int8_t* value)
+{
+  // Declare needed variables
+  struct it8528_cache_entry* entry = it8528_cache_find(command, 0);
+  struct it8528_cache_stats* stats = &it8528_cache_stats[register_class];
+
+  // Use the max age of the register class if none was passed in
+  if (max_age < 0)
+  {
+    max_age = it8528_cache_max_ages[register_class];
+  }
+
+  // Make sure the max age doesn't exceed the limit set by the caller
+  if (it8528_cache_age_limit >= 0 && max_age > it8528_cache_age_limit)
+  {
+    max_age = it8528_cache_age_limit;
+  }
+
+  // Check if the cached byte is fresh enough
+  if (entry != NULL && entry->valid &&
+      it8528_cache_get_time() - entry->time <= (u_int64_t)max_age * 1000000)
+  {
+    stats->hits++;
+    *value = entry->value;
+    return 0;
+  }
+
+  stats->misses++;
+
+  return -1;
+}
+
+// Function called to store a byte that was just read from the chip
+void it8528_cache_store(u_int16_t command, u_int8_t value)
+{
+  // Declare needed variables
+  struct it8528_cache_entry* entry = it8528_cache_find(command, 1);
+
+  // Check if there was room for the command
+  if (entry != NULL)
+  {
+    entry->valid = 1;
+    entry->value = value;
+    entry->time = it8528_cache_get_time();
+  }
+}
+
+// Function called to invalidate a cached byte after it was written to the chip
+void it8528_cache_invalidate(u_int16_t command)
+{
+  // Declare needed variables
+  struct it8528_cache_entry* entry = it8528_cache_find(command, 0);
+
+  // Check if the byte is cached
+  if (entry != NULL && entry->valid)
+  {
+    entry->valid = 0;
+    it8528_cache_invalidations++;
+  }
+}
+
+// Function called to set the max age in milliseconds of a register class, 0 disables caching
+void it8528_cache_set_max_age(u_int8_t register_class, u_int32_t max_age)
+{
+  if (register_class < IT8528_CACHE_CLASSES)
+  {
+    it8528_cache_max_ages[register_class] = max_age;
+  }
+}
+
+// Function called to get the max age in milliseconds of a register class
+u_int32_t it8528_cache_get_max_age(u_int8_t register_class)
+{
+  return register_class < IT8528_CACHE_CLASSES ? it8528_cache_max_ages[register_class] : 0;
+}
+
+// Function called to set the max ages of register classes from a comma separated list of
+//   class=milliseconds pairs, for example "temperature=2000,fan_speed=500", a max age is at most
+//   IT8528_CACHE_MAX_MAX_AGE so that it fits the signed differences the ages are compared with
+int8_t it8528_cache_parse_max_ages(const char* text)
+{
+  // Declare needed variables
+  char* copy = strdup(text);
+  char* saveptr;
+  int8_t ret = 0;
+
+  // Make sure the copy was made
+  if (copy == NULL)
+  {
+    return -1;
+  }
+
+  // Loop through the pairs
+  for (char* pair = strtok_r(copy, ",", &saveptr); pair != NULL;
+    pair = strtok_r(NULL, ",", &saveptr))
+  {
+    // Split the pair
+    char* separator = strchr(pair, '=');
+    char* end;
+    if (separator == NULL)
+    {
+      ret = -1;
+      break;
+    }
+    *separator = '\0';
+
+    // Look for the class
+    u_int8_t register_class;
+    for (register_class = 0; register_class < IT8528_CACHE_CLASSES; register_class++)
+    {
+      if (strcmp(pair, it8528_cache_class_names[register_class]) == 0)
+      {
+        break;
+      }
+    }
+
+    // Convert the max age
+    unsigned long max_age = strtoul(separator + 1, &end, 10);
+    if (register_class == IT8528_CACHE_CLASSES || *end != '\0' || end == separator + 1 ||
+      strchr(separator + 1, '-') != NULL || max_age > IT8528_CACHE_MAX_MAX_AGE)
+    {
+      ret = -1;
+      break;
+    }
+    it8528_cache_max_ages[register_class] = max_age;
+  }
+
+  free(copy);
+
+  return ret;
+}
+
+// Function called to make sure the following reads through the cache are at most max age
+//   milliseconds old whatever their class, IT8528_CACHE_DEFAULT_MAX_AGE removes the limit
+void it8528_cache_limit_age(int32_t max_age)
+{
+  it8528_cache_age_limit = max_age;
+}
+
+// Function called to get the statistics of a register class
+void it8528_cache_get_stats(u_int8_t register_class, struct it8528_cache_stats* stats)
+{
+  if (register_class < IT8528_CACHE_CLASSES)
+  {
+    *stats = it8528_cache_stats[register_class];
+  }
+}
+
+// Function called to get the name of a register class
+const char* it8528_cache_get_class_name(u_int8_t register_class)
+{
+  return register_class < IT8528_CACHE_CLASSES ? it8528_cache_class_names[register_class] : NULL;
+}
+
+// Function called to print the statistics of every register class
+void it8528_cache_print_stats(FILE* stream)
+{
+  for (u_int8_t i = 0; i < IT8528_CACHE_CLASSES; i++)
+  {
+    fprintf(stream, "cache_%s_max_age %u\n", it8528_cache_class_names[i],
+      it8528_cache_max_ages[i]);
+    fprintf(stream, "cache_%s_hits %llu\n", it8528_cache_class_names[i],
+      (unsigned long long)it8528_cache_stats[i].hits);
+    fprintf(stream, "cache_%s_misses %llu\n", it8528_cache_class_names[i],
+      (unsigned long long)it8528_cache_stats[i].misses);
+  }
+  fprintf(stream, "cache_invalidations %llu\n", (unsigned long long)it8528_cache_invalidations);
+}
+
+// Function called to find the entry of a command, adding it if asked to and there is room
+static struct it8528_cache_entry* it8528_cache_find(u_int16_t command, u_int8_t add)
+{
+  // Start at the slot the command hashes to and probe linearly
+  u_int16_t slot = (command ^ (command >> 8) ^ (command >> 5)) % IT8528_CACHE_SIZE;
+  for (u_int16_t i = 0; i < IT8528_CACHE_SIZE; i++)
+  {
+    struct it8528_cache_entry* entry = &it8528_cache_entries[(slot + i) % IT8528_CACHE_SIZE];
+
+    // Check if the slot holds the command
+    if (entry->used && entry->command == command)
+    {
+      return entry;
+    }
+
+    // Check if the slot is free, meaning the command isn't cached
+    if (!entry->used)
+    {
+      if (!add)
+      {
+        return NULL;
+      }
+
+      entry->used = 1;
+      entry->command = command;
+      return entry;
+    }
+  }
+
+  return NULL;
+}
+
+// Function called to get the monotonic time in nanoseconds
+static u_int64_t it8528_cache_get_time(void)
+{
+  // Declare needed variables
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (u_int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
@@ -0,0 +1,280 @@
+/*
+ * Copyright (C) 2021 Stonyx
+ * http://www.stonyx.com
+ *
+ * Copyright (C) 2020 Guillaume Valadon
+ * guillaume@valadon.net
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+#include "it8528_utils.h"
+#include "it8528_transport.h"
+#include "it8528_emulator.h"
+
+// Define the status bits of the second communication port
+#define IT8528_EMULATOR_OBF 0x01
+#define IT8528_EMULATOR_IBF 0x02
+
+// Define the states of a transaction
+#define IT8528_EMULATOR_IDLE 0
+#define IT8528_EMULATOR_COMMAND0 1
+#define IT8528_EMULATOR_COMMAND1 2
+#define IT8528_EMULATOR_VALUE 3
+
+// Declare the emulated chip state
+static u_int8_t it8528_emulator_registers[IT8528_EMULATOR_REGISTERS];
+static u_int8_t it8528_emulator_index;
+static u_int8_t it8528_emulator_output;
+static u_int8_t it8528_emulator_state;
+static u_int8_t it8528_emulator_write;
+static u_int16_t it8528_emulator_command;
+static u_int8_t it8528_emulator_output_pending;
+
+// Declare the wedged state, a wedged chip takes input but never answers a read, and the answer
+//   it still owes once it recovers
+static u_int8_t it8528_emulator_wedged;
+static u_int8_t it8528_emulator_late_output;
+
+// Declare the response delays in nanoseconds and when the chip will next be ready
+static u_int64_t it8528_emulator_input_delay;
+static u_int64_t it8528_emulator_output_delay;
+static u_int64_t it8528_emulator_input_ready;
+static u_int64_t it8528_emulator_output_ready;
+
+// Declare functions
+static int8_t it8528_emulator_open(void);
+static u_int8_t it8528_emulator_read_port(u_int16_t port);
+static void it8528_emulator_write_port(u_int8_t value, u_int16_t port);
+static u_int8_t it8528_emulator_get_status(void);
+static void it8528_emulator_write_data(u_int8_t value);
+static u_int64_t it8528_emulator_get_time(void);
+
+// Define the backend emulating an IT8528 chip in software so that everything can run without the
+//   hardware
+const struct it8528_transport it8528_emulated_transport = {
+  .name = "emulated",
+  .open = it8528_emulator_open,
+  .read_port = it8528_emulator_read_port,
+  .write_port = it8528_emulator_write_port
+};
+
+// Function called to reset the emulated chip to plausible readings
+void it8528_emulator_reset(void)
+{
+  // Clear the chip state
+  memset(it8528_emulator_registers, 0, sizeof(it8528_emulator_registers));
+  it8528_emulator_index = 0;
+  it8528_emulator_output = 0;
+  it8528_emulator_output_pending = 0;
+  it8528_emulator_wedged = 0;
+  it8528_emulator_late_output = 0;
+  it8528_emulator_state = IT8528_EMULATOR_IDLE;
+  it8528_emulator_input_ready = 0;
+  it8528_emulator_output_ready = 0;
+
+  // Set the temperatures to 40 °C, see it8528_get_temperature
+  for (u_int16_t command = 0x0600; command <= 0x0604; command++)
+  {
+    it8528_emulator_registers[command] = 40;
+  }
+  for (u_int16_t command = 0x0606; command <= 0x061D; command++)
+  {
+    it8528_emulator_registers[command] = 40;
+  }
+  it8528_emulator_registers[0x0659] = 40;
+  it8528_emulator_registers[0x065C] = 40;
+
+  // Set the fan speeds to 1200 RPM, see it8528_get_fan_speed
+  for (u_int16_t command = 0x0620; command <= 0x0637; command += 2)
+  {
+    it8528_emulator_registers[command] = 1200 >> 8;
+    it8528_emulator_registers[command + 1] = 1200 & 0xFF;
+  }
+  for (u_int16_t command = 0x0644; command <= 0x064F; command += 2)
+  {
+    it8528_emulator_registers[command] = 1200 >> 8;
+    it8528_emulator_registers[command + 1] = 1200 & 0xFF;
+  }
+
+  // Set the fan PWMs to 50 %, see it8528_get_fan_pwm
+  it8528_emulator_registers[0x022E] = 128;
+  it8528_emulator_registers[0x022F] = 128;
+  it8528_emulator_registers[0x023B] = 128;
+  it8528_emulator_registers[0x024B] = 128;
+}
+
+// Function called to get a register of the emulated chip
+u_int8_t it8528_emulator_get_register(u_int16_t command)
+{
+  return it8528_emulator_registers[command];
+}
+
+// Function called to set a register of the emulated chip
+void it8528_emulator_set_register(u_int16_t command, u_int8_t value)
+{
+  it8528_emulator_registers[command] = value;
+}
+
+// Function called to set how long in nanoseconds the emulated chip keeps the IBF bit set after
+//   every byte written to it and how long it takes to set the OBF bit after a read command
+void it8528_emulator_set_delays(u_int64_t input_delay, u_int64_t output_delay)
+{
+  it8528_emulator_input_delay = input_delay;
+  it8528_emulator_output_delay = output_delay;
+}
+
+// Function called to wedge or unwedge the emulated chip, while wedged the chip takes input but
+//   never answers a read, and once unwedged it puts the answer to the last read it ignored in the
+//   output buffer where nobody expects it
+void it8528_emulator_set_wedged(u_int8_t wedged)
+{
+  if (it8528_emulator_wedged && !wedged && it8528_emulator_late_output)
+  {
+    it8528_emulator_output_pending = 1;
+    it8528_emulator_output_ready = 0;
+    it8528_emulator_late_output = 0;
+  }
+  it8528_emulator_wedged = wedged;
+}
+
+// Function called to open the emulated chip
+static int8_t it8528_emulator_open(void)
+{
+  it8528_emulator_reset();
+
+  return 0;
+}
+
+// Function called to read a byte from a port of the emulated chip
+static u_int8_t it8528_emulator_read_port(u_int16_t port)
+{
+  switch (port)
+  {
+    case IT8528_ID_PORT_2:
+      // Return the chip ID, see it8528_check_if_present
+      if (it8528_emulator_index == 0x20)
+      {
+        return 0x85;
+      }
+      if (it8528_emulator_index == 0x21)
+      {
+        return 0x28;
+      }
+      return 0x00;
+    case IT8528_COMM_PORT_1:
+      // Return the output buffer and mark it as empty
+      it8528_emulator_output_pending = 0;
+      return it8528_emulator_output;
+    case IT8528_COMM_PORT_2:
+      return it8528_emulator_get_status();
+    default:
+      return 0xFF;
+  }
+}
+
+// Function called to write a byte to a port of the emulated chip
+static void it8528_emulator_write_port(u_int8_t value, u_int16_t port)
+{
+  switch (port)
+  {
+    case IT8528_ID_PORT_1:
+      it8528_emulator_index = value;
+      break;
+    case IT8528_COMM_PORT_1:
+      it8528_emulator_write_data(value);
+      it8528_emulator_input_ready = it8528_emulator_get_time() + it8528_emulator_input_delay;
+      break;
+    case IT8528_COMM_PORT_2:
+      it8528_emulator_input_ready = it8528_emulator_get_time() + it8528_emulator_input_delay;
+
+      // Start a transaction, see it8528_send_commands and it8528_set_byte
+      if (value == 0x88)
+      {
+        it8528_emulator_state = IT8528_EMULATOR_COMMAND0;
+      }
+      break;
+  }
+}
+
+// Function called when a byte is written to the first communication port of the emulated chip
+static void it8528_emulator_write_data(u_int8_t value)
+{
+  switch (it8528_emulator_state)
+  {
+    case IT8528_EMULATOR_COMMAND0:
+      // The first command has its highest bit set for writes
+      it8528_emulator_write = (value & 0x80) != 0;
+      it8528_emulator_command = value & 0x7F;
+      it8528_emulator_state = IT8528_EMULATOR_COMMAND1;
+      break;
+    case IT8528_EMULATOR_COMMAND1:
+      it8528_emulator_command |= value << 8;
+
+      // Check if this is a write, otherwise load the register into the output buffer
+      if (it8528_emulator_write)
+      {
+        it8528_emulator_state = IT8528_EMULATOR_VALUE;
+      }
+      else if (it8528_emulator_wedged)
+      {
+        it8528_emulator_output = it8528_emulator_registers[it8528_emulator_command];
+        it8528_emulator_late_output = 1;
+        it8528_emulator_state = IT8528_EMULATOR_IDLE;
+      }
+      else
+      {
+        it8528_emulator_output = it8528_emulator_registers[it8528_emulator_command];
+        it8528_emulator_output_pending = 1;
+        it8528_emulator_output_ready = it8528_emulator_get_time() + it8528_emulator_output_delay;
+        it8528_emulator_state = IT8528_EMULATOR_IDLE;
+      }
+      break;
+    case IT8528_EMULATOR_VALUE:
+      it8528_emulator_registers[it8528_emulator_command] = value;
+      it8528_emulator_state = IT8528_EMULATOR_IDLE;
+      break;
+  }
+}
+
+// Function called to get the status bits of the emulated chip from the response delays
+static u_int8_t it8528_emulator_get_status(void)
+{
+  // Declare needed variables
+  u_int64_t now = it8528_emulator_get_time();
+  u_int8_t status = 0;
+
+  // The input buffer is full until the chip had time to handle the last byte written to it
+  if (now < it8528_emulator_input_ready)
+  {
+    status |= IT8528_EMULATOR_IBF;
+  }
+
+  // The output buffer is full once the chip had time to load the requested register
+  if (it8528_emulator_output_pending && now >= it8528_emulator_output_ready)
+  {
+    status |= IT8528_EMULATOR_OBF;
+  }
+
+  return status;
+}
+
+// Function called to get the monotonic time in nanoseconds
+static u_int64_t it8528_emulator_get_time(void)
+{
+  // Declare needed variables
+  struct timespec ts;
+
+  // Skip the clock when there are no delays to keep the emulated chip as cheap as possible
+  if (it8528_emulator_input_delay == 0 && it8528_emulator_output_delay == 0)
+  {
+    return 0;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (u_int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
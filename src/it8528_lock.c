@@ -0,0 +1,749 @@
+/*
+ * Copyright (C) 2021 Stonyx
+ * http://www.stonyx.com
+ *
+ * Copyright (C) 2020 Guillaume Valadon
+ * guillaume@valadon.net
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <grp.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+#include "it8528_utils.h"
+#include "it8528_lock.h"
+#include "it8528_trace.h"
+
+// Define the kinds of lock
+#define IT8528_LOCK_NONE 0
+#define IT8528_LOCK_SHM 1
+#define IT8528_LOCK_FLOCK 2
+
+// Define how long in milliseconds to wait for another process to initialize the shared memory
+//   lock and how long in nanoseconds to sleep between two attempts at taking the file lock
+#define IT8528_LOCK_INIT_TIMEOUT 100
+#define IT8528_LOCK_FLOCK_SLEEP 50000
+
+// Define how long in nanoseconds to sleep between two checks of the requests of the higher
+//   classes while giving way to them
+#define IT8528_LOCK_TURN_SLEEP 20000
+
+// Define how many processes can say they are waiting for the shared memory mutex at once, the
+//   ones past that wait without holding back the lower classes
+#define IT8528_LOCK_WAITERS 64
+
+// Define the layout of the slot of a process waiting for the shared memory mutex, a single word
+//   holding its PID in the upper 22 bits, its class in the next 2 bits, and the monotonic time in
+//   milliseconds at which it gives up in the lower 40 bits, so that it is taken and left whole and
+//   a free slot is 0
+#define IT8528_LOCK_WAITER_PID_SHIFT 42
+#define IT8528_LOCK_WAITER_CLASS_SHIFT 40
+#define IT8528_LOCK_WAITER_EXPIRY_MASK 0xFFFFFFFFFFULL
+
+// Define the structure of the shared memory holding the lock, the magic is set once the mutex
+//   is initialized and the waiters are the processes waiting for the mutex, a waiter that died
+//   before leaving its slot is told apart by its PID or its expiry and its slot is taken back
+struct it8528_lock_region
+{
+  u_int32_t magic;
+  u_int32_t reserved;
+  pthread_mutex_t mutex;
+  u_int64_t waiters[IT8528_LOCK_WAITERS];
+};
+
+// Define the lock and class names
+static const char* it8528_lock_names[] = { "none", "shm", "flock" };
+static const char* it8528_lock_class_names[] = { "control", "alarm", "telemetry" };
+
+// Define the default deadline of every class
+static const u_int32_t it8528_lock_deadlines[] = { IT8528_LOCK_CONTROL_DEADLINE,
+  IT8528_LOCK_ALARM_DEADLINE, IT8528_LOCK_TELEMETRY_DEADLINE };
+
+// Declare the lock state, the depth lets a batch hold the lock across the transactions it is
+//   made of without releasing it in between
+static u_int8_t it8528_lock_kind = IT8528_LOCK_NONE;
+static struct it8528_lock_region* it8528_lock_region;
+static int it8528_lock_fd = -1;
+static u_int32_t it8528_lock_depth;
+static u_int64_t it8528_lock_acquired_time;
+static struct it8528_lock_stats it8528_lock_stats;
+
+// Declare the group allowed to take the lock besides its owner, none by default
+static gid_t it8528_lock_group = (gid_t)-1;
+
+// Declare the class the lock is held in and the class of the reads
+static u_int8_t it8528_lock_class = IT8528_LOCK_CLASS_TELEMETRY;
+static u_int8_t it8528_lock_read_class = IT8528_LOCK_CLASS_TELEMETRY;
+
+// Declare functions
+static int8_t it8528_lock_open_shm(u_int8_t private);
+static int8_t it8528_lock_open_flock(void);
+static void it8528_lock_restrict(int fd, u_int8_t created);
+static int8_t it8528_lock_take_shm(u_int8_t class, u_int64_t deadline);
+static int8_t it8528_lock_wait_flock(u_int64_t deadline);
+static u_int64_t* it8528_lock_add_waiter(u_int8_t class, u_int64_t deadline);
+static u_int8_t it8528_lock_has_priority_waiters(u_int8_t class);
+static u_int64_t it8528_lock_get_time(void);
+
+// Function called to open the lock shared with every other process talking to the chip, shm is a
+//   robust mutex in shared memory, flock is a file lock on IT8528_LOCK_FILE_PATH, private is a
+//   shared memory mutex only this process and its children can see, none disables locking, and a
+//   NULL name or auto uses the first of shm and flock that can be opened, a lock that was asked
+//   for but can't be opened is an error rather than a reason to run unlocked
+int8_t it8528_lock_open(const char* name)
+{
+  // Declare needed variables
+  int8_t ret;
+
+  // Close any lock already open
+  it8528_lock_close();
+
+  // Open the requested lock, or the first one that works if it should be picked automatically
+  if (name == NULL || strcmp(name, "auto") == 0)
+  {
+    ret = it8528_lock_open_shm(0) == 0 || it8528_lock_open_flock() == 0 ? 0 : -1;
+  }
+  else if (strcmp(name, "shm") == 0)
+  {
+    ret = it8528_lock_open_shm(0);
+  }
+  else if (strcmp(name, "private") == 0)
+  {
+    ret = it8528_lock_open_shm(1);
+  }
+  else if (strcmp(name, "flock") == 0)
+  {
+    ret = it8528_lock_open_flock();
+  }
+  else if (strcmp(name, "none") == 0)
+  {
+    return 0;
+  }
+  else
+  {
+    fprintf(stderr, "it8528_lock_open: unknown lock!\n");
+    return -1;
+  }
+
+  // Check if the lock couldn't be opened, which is usually a lock created by another user
+  if (ret != 0)
+  {
+    fprintf(stderr, "it8528_lock_open: no lock could be opened!\n");
+  }
+
+  return ret;
+}
+
+// Function called to let the members of a group, given by name or ID, take the lock as well as
+//   the user who created it, it must be called before the lock is opened
+int8_t it8528_lock_set_group(const char* name)
+{
+  // Declare needed variables
+  struct group* group = getgrnam(name);
+  char* end;
+  unsigned long id;
+
+  // Check if this is a group name
+  if (group != NULL)
+  {
+    it8528_lock_group = group->gr_gid;
+    return 0;
+  }
+
+  // Check if this is a group ID
+  id = strtoul(name, &end, 10);
+  if (*name == '\0' || *end != '\0' || id >= (gid_t)-1)
+  {
+    return -1;
+  }
+  it8528_lock_group = id;
+
+  return 0;
+}
+
+// Function called to close the lock, the shared memory is left in place for the other processes
+void it8528_lock_close(void)
+{
+  // Make sure the lock isn't held
+  while (it8528_lock_depth > 0)
+  {
+    it8528_lock_release();
+  }
+
+  // Close the lock
+  if (it8528_lock_region != NULL)
+  {
+    munmap(it8528_lock_region, sizeof(*it8528_lock_region));
+    it8528_lock_region = NULL;
+  }
+  if (it8528_lock_fd >= 0)
+  {
+    close(it8528_lock_fd);
+    it8528_lock_fd = -1;
+  }
+  it8528_lock_kind = IT8528_LOCK_NONE;
+}
+
+// Function called to take the lock in a priority class before a transaction or a batch of
+//   transactions, waiting at most the default deadline of the class
+int8_t it8528_lock_acquire(u_int8_t class)
+{
+  return it8528_lock_acquire_before(class, UINT64_MAX);
+}
+
+// Function called to take the lock in a priority class before a transaction or a batch of
+//   transactions, waiting until a monotonic deadline in nanoseconds such as the deadline of the
+//   transaction or the default deadline of the class if it comes first, nested calls only count
+//   the depth and stay in the class of the outer call
+int8_t it8528_lock_acquire_before(u_int8_t class, u_int64_t deadline)
+{
+  // Declare needed variables
+  u_int64_t start;
+  u_int64_t now;
+  int8_t ret;
+
+  // Check if there is nothing to lock or the lock is already held
+  if (it8528_lock_kind == IT8528_LOCK_NONE || it8528_lock_depth++ > 0)
+  {
+    return 0;
+  }
+
+  // Wait no longer than the class allows
+  start = it8528_lock_get_time();
+  if (deadline > start + (u_int64_t)it8528_lock_deadlines[class] * 1000000)
+  {
+    deadline = start + (u_int64_t)it8528_lock_deadlines[class] * 1000000;
+  }
+
+  // Take the lock, only the shared memory mutex lets the classes see each other so the file lock
+  //   is taken in arrival order
+  if (it8528_lock_kind == IT8528_LOCK_SHM)
+  {
+    ret = it8528_lock_take_shm(class, deadline);
+  }
+  else
+  {
+    ret = it8528_lock_wait_flock(deadline);
+  }
+
+  // Fire the probe and count the wait
+  now = it8528_lock_get_time();
+  IT8528_PROBE3(lock, class, now - start, ret);
+  it8528_trace_record(IT8528_TRACE_OP_LOCK, now - start, ret);
+
+  // Check if the lock couldn't be taken
+  if (ret != 0)
+  {
+    it8528_lock_depth--;
+    it8528_lock_stats.class_timeouts[class]++;
+    fprintf(stderr, "it8528_lock_acquire_before: %s lock couldn't be taken!\n",
+      it8528_lock_names[it8528_lock_kind]);
+    return -1;
+  }
+
+  // Update the statistics
+  it8528_lock_stats.acquisitions++;
+  it8528_lock_stats.wait_nanoseconds += now - start;
+  if (now - start > it8528_lock_stats.max_wait_nanoseconds)
+  {
+    it8528_lock_stats.max_wait_nanoseconds = now - start;
+  }
+  it8528_lock_stats.class_acquisitions[class]++;
+  it8528_lock_stats.class_wait_nanoseconds[class] += now - start;
+  if (now - start > it8528_lock_stats.class_max_wait_nanoseconds[class])
+  {
+    it8528_lock_stats.class_max_wait_nanoseconds[class] = now - start;
+  }
+  it8528_lock_acquired_time = now;
+  it8528_lock_class = class;
+
+  return 0;
+}
+
+// Function called between two transactions of a batch to hand the lock over to the requests of
+//   a higher class waiting for it, the batch then waits for the lock again in its own class
+// Only the outermost holder can give the lock away since the callers above it rely on it, and it
+//   takes the lock back before the same deadline as it8528_lock_acquire_before
+int8_t it8528_lock_yield(u_int64_t deadline)
+{
+  // Declare needed variables
+  u_int8_t class = it8528_lock_class;
+
+  // Check if there is no one to give way to
+  if (it8528_lock_kind != IT8528_LOCK_SHM || it8528_lock_depth != 1 ||
+      !it8528_lock_has_priority_waiters(class))
+  {
+    return 0;
+  }
+
+  // Hand the lock over and take it back
+  it8528_lock_stats.preemptions++;
+  it8528_lock_release();
+  if (it8528_lock_acquire_before(class, deadline) != 0)
+  {
+    fprintf(stderr, "it8528_lock_yield: it8528_lock_acquire_before() failed!\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+// Function called to release the lock after a transaction or a batch of transactions
+void it8528_lock_release(void)
+{
+  // Declare needed variables
+  u_int64_t hold;
+
+  // Check if there is nothing to unlock or the lock is still held by an outer call
+  if (it8528_lock_kind == IT8528_LOCK_NONE || it8528_lock_depth == 0 || --it8528_lock_depth > 0)
+  {
+    return;
+  }
+
+  // Update the statistics
+  hold = it8528_lock_get_time() - it8528_lock_acquired_time;
+  it8528_lock_stats.hold_nanoseconds += hold;
+  if (hold > it8528_lock_stats.max_hold_nanoseconds)
+  {
+    it8528_lock_stats.max_hold_nanoseconds = hold;
+  }
+
+  // Release the lock
+  if (it8528_lock_kind == IT8528_LOCK_SHM)
+  {
+    pthread_mutex_unlock(&it8528_lock_region->mutex);
+  }
+  else
+  {
+    flock(it8528_lock_fd, LOCK_UN);
+  }
+}
+
+// Function called to set the class the reads take the lock in, returns the previous class so
+//   that it can be restored
+u_int8_t it8528_lock_set_read_class(u_int8_t class)
+{
+  // Declare needed variables
+  u_int8_t previous = it8528_lock_read_class;
+
+  it8528_lock_read_class = class;
+
+  return previous;
+}
+
+// Function called to get the class the reads take the lock in
+u_int8_t it8528_lock_get_read_class(void)
+{
+  return it8528_lock_read_class;
+}
+
+// Function called to get the name of a class
+const char* it8528_lock_get_class_name(u_int8_t class)
+{
+  return it8528_lock_class_names[class];
+}
+
+// Function called to get the name of the open lock
+const char* it8528_lock_get_name(void)
+{
+  return it8528_lock_names[it8528_lock_kind];
+}
+
+// Function called to get the statistics of the lock
+void it8528_lock_get_stats(struct it8528_lock_stats* stats)
+{
+  *stats = it8528_lock_stats;
+}
+
+// Function called to print the statistics of the lock
+void it8528_lock_print_stats(FILE* stream)
+{
+  fprintf(stream, "lock %s\n", it8528_lock_get_name());
+  fprintf(stream, "lock_acquisitions %llu\n", (unsigned long long)it8528_lock_stats.acquisitions);
+  fprintf(stream, "lock_contentions %llu\n", (unsigned long long)it8528_lock_stats.contentions);
+  fprintf(stream, "lock_timeouts %llu\n", (unsigned long long)it8528_lock_stats.timeouts);
+  fprintf(stream, "lock_recoveries %llu\n", (unsigned long long)it8528_lock_stats.recoveries);
+  fprintf(stream, "lock_wait_ns %llu\n", (unsigned long long)it8528_lock_stats.wait_nanoseconds);
+  fprintf(stream, "lock_wait_max_ns %llu\n",
+    (unsigned long long)it8528_lock_stats.max_wait_nanoseconds);
+  fprintf(stream, "lock_hold_ns %llu\n", (unsigned long long)it8528_lock_stats.hold_nanoseconds);
+  fprintf(stream, "lock_hold_max_ns %llu\n",
+    (unsigned long long)it8528_lock_stats.max_hold_nanoseconds);
+  fprintf(stream, "lock_preemptions %llu\n", (unsigned long long)it8528_lock_stats.preemptions);
+
+  // Print the queueing delay of every class
+  for (u_int8_t i = 0; i < IT8528_LOCK_CLASSES; i++)
+  {
+    fprintf(stream, "lock_%s_acquisitions %llu\n", it8528_lock_class_names[i],
+      (unsigned long long)it8528_lock_stats.class_acquisitions[i]);
+    fprintf(stream, "lock_%s_timeouts %llu\n", it8528_lock_class_names[i],
+      (unsigned long long)it8528_lock_stats.class_timeouts[i]);
+    fprintf(stream, "lock_%s_wait_ns %llu\n", it8528_lock_class_names[i],
+      (unsigned long long)it8528_lock_stats.class_wait_nanoseconds[i]);
+    fprintf(stream, "lock_%s_wait_max_ns %llu\n", it8528_lock_class_names[i],
+      (unsigned long long)it8528_lock_stats.class_max_wait_nanoseconds[i]);
+  }
+}
+
+// Function called to open the shared memory mutex, creating and initializing it if this is the
+//   first process to use it, a private mutex gets a name of its own that is removed straight away
+//   so that only the children forked after this call share it
+static int8_t it8528_lock_open_shm(u_int8_t private)
+{
+  // Declare needed variables
+  struct it8528_lock_region* region;
+  char name[32] = IT8528_LOCK_SHM_NAME;
+  u_int8_t created = 1;
+  int fd;
+
+  // Create the shared memory or open it if it already exists
+  if (private)
+  {
+    snprintf(name, sizeof(name), "%s.%d", IT8528_LOCK_SHM_NAME, (int)getpid());
+  }
+  fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+  if (fd < 0 && errno == EEXIST && !private)
+  {
+    created = 0;
+    fd = shm_open(name, O_RDWR | O_CLOEXEC, 0);
+  }
+  if (fd < 0)
+  {
+    return -1;
+  }
+  if (private)
+  {
+    shm_unlink(name);
+  }
+
+  // Only let the owner and the lock group take the lock, and size the shared memory if we
+  //   created it
+  it8528_lock_restrict(fd, created);
+  if (created)
+  {
+    if (ftruncate(fd, sizeof(*region)) != 0)
+    {
+      close(fd);
+      if (!private)
+      {
+        shm_unlink(name);
+      }
+      return -1;
+    }
+  }
+  else
+  {
+    // Wait for the creator to size the shared memory
+    for (u_int32_t i = 0; ; i++)
+    {
+      // Declare needed variables
+      struct stat st;
+      struct timespec delay = { 0, 1000000 };
+
+      if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(*region))
+      {
+        break;
+      }
+      if (i == IT8528_LOCK_INIT_TIMEOUT)
+      {
+        close(fd);
+        return -1;
+      }
+      nanosleep(&delay, NULL);
+    }
+  }
+
+  // Map the shared memory
+  region = mmap(NULL, sizeof(*region), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (region == MAP_FAILED)
+  {
+    return -1;
+  }
+
+  // Check if we created the shared memory
+  if (created)
+  {
+    // Declare needed variables
+    pthread_mutexattr_t attr;
+
+    // Initialize a process shared mutex that is handed over when its owner dies
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&region->mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    // Publish the mutex
+    __atomic_store_n(&region->magic, IT8528_LOCK_MAGIC, __ATOMIC_RELEASE);
+  }
+  else
+  {
+    // Wait for the creator to initialize the mutex
+    for (u_int32_t i = 0; __atomic_load_n(&region->magic, __ATOMIC_ACQUIRE) != IT8528_LOCK_MAGIC;
+      i++)
+    {
+      // Declare needed variables
+      struct timespec delay = { 0, 1000000 };
+
+      if (i == IT8528_LOCK_INIT_TIMEOUT)
+      {
+        munmap(region, sizeof(*region));
+        return -1;
+      }
+      nanosleep(&delay, NULL);
+    }
+  }
+
+  it8528_lock_region = region;
+  it8528_lock_kind = IT8528_LOCK_SHM;
+
+  return 0;
+}
+
+// Function called to open the file lock
+static int8_t it8528_lock_open_flock(void)
+{
+  // Open the lock file, creating it if needed, and only let the owner and the lock group open it
+  it8528_lock_fd = open(IT8528_LOCK_FILE_PATH, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (it8528_lock_fd < 0)
+  {
+    return -1;
+  }
+  it8528_lock_restrict(it8528_lock_fd, 1);
+
+  it8528_lock_kind = IT8528_LOCK_FLOCK;
+
+  return 0;
+}
+
+// Function called to set the permissions of the shared memory or the lock file to read and write
+//   for its owner only, or for the lock group as well if one was set, a lock that already existed
+//   is only changed if we own it, which takes the permissions left by older versions away
+static void it8528_lock_restrict(int fd, u_int8_t created)
+{
+  // Declare needed variables
+  mode_t mode = it8528_lock_group != (gid_t)-1 ? 0660 : 0600;
+  struct stat st;
+
+  // Check if the lock is someone else's or already restricted
+  if (fstat(fd, &st) != 0 || (!created && st.st_uid != geteuid()) ||
+    ((st.st_mode & 0777) == mode &&
+      (it8528_lock_group == (gid_t)-1 || st.st_gid == it8528_lock_group)))
+  {
+    return;
+  }
+
+  // Restrict the permissions, a group that can't be set leaves the owner only
+  if (it8528_lock_group != (gid_t)-1 && fchown(fd, -1, it8528_lock_group) != 0)
+  {
+    fprintf(stderr, "it8528_lock_restrict: fchown() failed!\n");
+    mode = 0600;
+  }
+  fchmod(fd, mode);
+}
+
+// Function called to take the shared memory mutex in a class before a monotonic deadline in
+//   nanoseconds, the requests of the higher classes waiting for the mutex are let through first
+static int8_t it8528_lock_take_shm(u_int8_t class, u_int64_t deadline)
+{
+  // Declare needed variables
+  u_int64_t turn_deadline = it8528_lock_get_time() + (u_int64_t)IT8528_LOCK_TURN_TIMEOUT * 1000000;
+  u_int64_t* waiter;
+  int ret;
+
+  // Loop until the mutex is ours
+  while (1)
+  {
+    // Declare needed variables
+    u_int64_t now = it8528_lock_get_time();
+    u_int64_t remaining;
+    struct timespec timeout;
+
+    // Give way to the higher classes until they are done or the turn timeout expires
+    if (now < turn_deadline && it8528_lock_has_priority_waiters(class))
+    {
+      // Declare needed variables
+      struct timespec delay = { 0, IT8528_LOCK_TURN_SLEEP };
+
+      if (now >= deadline)
+      {
+        it8528_lock_stats.timeouts++;
+        return -1;
+      }
+      nanosleep(&delay, NULL);
+      continue;
+    }
+
+    // Let the lower classes know that we are waiting and try to take the mutex without waiting
+    waiter = it8528_lock_add_waiter(class, deadline);
+    ret = pthread_mutex_trylock(&it8528_lock_region->mutex);
+    if (ret == EBUSY)
+    {
+      // Convert the deadline to the realtime clock used by the mutex and wait for it
+      it8528_lock_stats.contentions++;
+      clock_gettime(CLOCK_REALTIME, &timeout);
+      now = it8528_lock_get_time();
+      remaining = deadline > now ? deadline - now : 0;
+      timeout.tv_sec += remaining / 1000000000;
+      timeout.tv_nsec += remaining % 1000000000;
+      if (timeout.tv_nsec >= 1000000000)
+      {
+        timeout.tv_sec++;
+        timeout.tv_nsec -= 1000000000;
+      }
+      ret = pthread_mutex_timedlock(&it8528_lock_region->mutex, &timeout);
+    }
+    if (waiter != NULL)
+    {
+      __atomic_store_n(waiter, 0, __ATOMIC_SEQ_CST);
+    }
+
+    // Check if the previous owner died while holding the mutex, the chip may be in the middle of
+    //   a transaction but the next one starts by clearing its buffer
+    if (ret == EOWNERDEAD)
+    {
+      pthread_mutex_consistent(&it8528_lock_region->mutex);
+      it8528_lock_stats.recoveries++;
+      ret = 0;
+    }
+
+    // Check if the mutex couldn't be taken
+    if (ret != 0)
+    {
+      if (ret == ETIMEDOUT)
+      {
+        it8528_lock_stats.timeouts++;
+      }
+      return -1;
+    }
+
+    // Check if a higher class started waiting while we were, the mutex doesn't wake its waiters
+    //   by class so it is handed over to them
+    if (it8528_lock_get_time() >= turn_deadline || !it8528_lock_has_priority_waiters(class))
+    {
+      return 0;
+    }
+    pthread_mutex_unlock(&it8528_lock_region->mutex);
+  }
+}
+
+// Function called to take the file lock before a monotonic deadline in nanoseconds
+static int8_t it8528_lock_wait_flock(u_int64_t deadline)
+{
+  // Try to take the lock without waiting first
+  if (flock(it8528_lock_fd, LOCK_EX | LOCK_NB) == 0)
+  {
+    return 0;
+  }
+  if (errno != EWOULDBLOCK)
+  {
+    return -1;
+  }
+  it8528_lock_stats.contentions++;
+
+  // Retry until the deadline
+  while (it8528_lock_get_time() < deadline)
+  {
+    // Declare needed variables
+    struct timespec delay = { 0, IT8528_LOCK_FLOCK_SLEEP };
+
+    nanosleep(&delay, NULL);
+    if (flock(it8528_lock_fd, LOCK_EX | LOCK_NB) == 0)
+    {
+      return 0;
+    }
+    if (errno != EWOULDBLOCK)
+    {
+      return -1;
+    }
+  }
+  it8528_lock_stats.timeouts++;
+
+  return -1;
+}
+
+// Function called to take a free slot to let the lower classes know that we are waiting for the
+//   shared memory mutex until a monotonic deadline in nanoseconds, NULL is returned if every slot
+//   is taken
+static u_int64_t* it8528_lock_add_waiter(u_int8_t class, u_int64_t deadline)
+{
+  // Declare needed variables
+  u_int64_t slot = (u_int64_t)getpid() << IT8528_LOCK_WAITER_PID_SHIFT |
+    (u_int64_t)class << IT8528_LOCK_WAITER_CLASS_SHIFT |
+    ((deadline / 1000000 + 1) & IT8528_LOCK_WAITER_EXPIRY_MASK);
+
+  for (u_int32_t i = 0; i < IT8528_LOCK_WAITERS; i++)
+  {
+    // Declare needed variables
+    u_int64_t free_slot = 0;
+
+    if (__atomic_load_n(&it8528_lock_region->waiters[i], __ATOMIC_RELAXED) == 0 &&
+      __atomic_compare_exchange_n(&it8528_lock_region->waiters[i], &free_slot, slot, 0,
+        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+    {
+      return &it8528_lock_region->waiters[i];
+    }
+  }
+
+  return NULL;
+}
+
+// Function called to check if a process is waiting for the shared memory mutex in a class higher
+//   than the given one
+static u_int8_t it8528_lock_has_priority_waiters(u_int8_t class)
+{
+  // Declare needed variables
+  u_int64_t now = it8528_lock_get_time() / 1000000;
+  u_int8_t found = 0;
+
+  for (u_int32_t i = 0; i < IT8528_LOCK_WAITERS && !found; i++)
+  {
+    // Declare needed variables
+    u_int64_t slot = __atomic_load_n(&it8528_lock_region->waiters[i], __ATOMIC_SEQ_CST);
+    u_int64_t expiry = slot & IT8528_LOCK_WAITER_EXPIRY_MASK;
+    pid_t pid = slot >> IT8528_LOCK_WAITER_PID_SHIFT;
+
+    // Check if the slot is free or the waiter is in a class that doesn't go before ours
+    if (slot == 0 || ((slot >> IT8528_LOCK_WAITER_CLASS_SHIFT) & 0x3) >= class)
+    {
+      continue;
+    }
+
+    // Take the slot back if the waiter should have given up a turn ago or died, a waiter killed
+    //   while waiting never leaves its slot and would otherwise hold back the lower classes for
+    //   good
+    if (now > expiry + IT8528_LOCK_TURN_TIMEOUT || (kill(pid, 0) != 0 && errno == ESRCH))
+    {
+      __atomic_compare_exchange_n(&it8528_lock_region->waiters[i], &slot, 0, 0,
+        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+      continue;
+    }
+
+    found = 1;
+  }
+
+  return found;
+}
+
+// Function called to get the monotonic time in nanoseconds
+static u_int64_t it8528_lock_get_time(void)
+{
+  // Declare needed variables
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (u_int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
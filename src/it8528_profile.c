@@ -0,0 +1,594 @@
+/*
+ * Copyright (C) 2021 Stonyx
+ * http://www.stonyx.com
+ *
+ * Copyright (C) 2020 Guillaume Valadon
+ * guillaume@valadon.net
+ */
+
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+#include "it8528.h"
+#include "it8528_profile.h"
+
+// Define the value of a fan or sensor name that isn't mapped to any chip ID
+#define IT8528_PROFILE_NO_ID 0xFF
+
+// Define the fan and sensor names used when there is no model.conf file or it doesn't list any,
+//   they are based on the fan and temperature related switch statements in the it8528.c file
+static const u_int8_t it8528_profile_default_fan_names[] = { 5, 7, 25, 35 };
+static const u_int8_t it8528_profile_default_sensor_names[] = { 1, 7, 10, 11, 38 };
+
+// Declare the profile in use
+static struct it8528_profile it8528_profile;
+static u_int8_t it8528_profile_loaded = 0;
+static u_int8_t it8528_profile_discovered = 0;
+
+// Declare functions
+static void it8528_profile_set_defaults(struct it8528_profile* profile);
+static int8_t it8528_profile_parse(const char* path, struct it8528_profile* profile);
+static int8_t it8528_profile_parse_name(const char* key, const char* prefix, const char* value,
+  u_int8_t* names, u_int8_t* count, u_int8_t* id);
+static int8_t it8528_profile_find_id(const u_int8_t* ids, u_int8_t count, u_int8_t id);
+static void it8528_profile_compile(struct it8528_profile* profile);
+static int8_t it8528_profile_read_cache(const struct stat* st, struct it8528_profile* profile);
+static void it8528_profile_write_cache(const struct it8528_profile* profile);
+static void it8528_profile_apply_presence(struct it8528_profile* profile);
+static char* it8528_profile_trim(char* text);
+
+// Function called to load the profile of the model described by a model.conf file, using the
+//   compiled profile cached in IT8528_PROFILE_CACHE_PATH when it was compiled from the same file,
+//   and using the built in profile when the file doesn't exist unless the file is required, such
+//   as a file the user named, in which case a file that can't be read is an error
+int8_t it8528_profile_load(const char* path, u_int8_t required)
+{
+  // Declare needed variables
+  struct it8528_profile profile;
+  struct stat st;
+
+  // Make sure a required file can be read
+  if (required && (stat(path, &st) != 0 || access(path, R_OK) != 0))
+  {
+    fprintf(stderr, "it8528_profile_load: %s can't be read!\n", path);
+    return -1;
+  }
+
+  // Check if there is no model.conf file
+  if (stat(path, &st) != 0)
+  {
+    it8528_profile_set_defaults(&profile);
+    it8528_profile_compile(&profile);
+  }
+  // Check if the cached profile wasn't compiled from this file
+  else if (it8528_profile_read_cache(&st, &profile) != 0)
+  {
+    // Parse and compile the file
+    if (it8528_profile_parse(path, &profile) != 0)
+    {
+      fprintf(stderr, "it8528_profile_load: it8528_profile_parse() failed!\n");
+      return -1;
+    }
+    profile.source_device = st.st_dev;
+    profile.source_inode = st.st_ino;
+    profile.source_size = st.st_size;
+    profile.source_mtime = st.st_mtime;
+    it8528_profile_compile(&profile);
+
+    // Cache the compiled profile for the next runs
+    it8528_profile_write_cache(&profile);
+  }
+
+  // Leave out the sensors and fans the discover command found missing, the presence map isn't
+  //   part of the cached profile since it is only valid until the next boot
+  it8528_profile_apply_presence(&profile);
+
+  it8528_profile = profile;
+  it8528_profile_loaded = 1;
+
+  return 0;
+}
+
+// Function called to get the profile in use, the built in profile is used if none was loaded
+const struct it8528_profile* it8528_profile_get(void)
+{
+  // Check if no profile was loaded
+  if (!it8528_profile_loaded)
+  {
+    it8528_profile_set_defaults(&it8528_profile);
+    it8528_profile_compile(&it8528_profile);
+    it8528_profile_loaded = 1;
+  }
+
+  return &it8528_profile;
+}
+
+// Function called to get the chip ID of the fan used by the fanN command
+int8_t it8528_profile_get_fan_id(u_int8_t number, u_int8_t* fan_id)
+{
+  // Declare needed variables
+  const struct it8528_profile* profile = it8528_profile_get();
+
+  // Make sure the fan is mapped
+  if (number < 1 || number > profile->fan_name_count ||
+    profile->fan_names[number - 1] == IT8528_PROFILE_NO_ID)
+  {
+    return -1;
+  }
+
+  *fan_id = profile->fan_names[number - 1];
+
+  return 0;
+}
+
+// Function called to get the chip ID of the sensor used by the tempN command
+int8_t it8528_profile_get_sensor_id(u_int8_t number, u_int8_t* sensor_id)
+{
+  // Declare needed variables
+  const struct it8528_profile* profile = it8528_profile_get();
+
+  // Make sure the sensor is mapped
+  if (number < 1 || number > profile->sensor_name_count ||
+    profile->sensor_names[number - 1] == IT8528_PROFILE_NO_ID)
+  {
+    return -1;
+  }
+
+  *sensor_id = profile->sensor_names[number - 1];
+
+  return 0;
+}
+
+// Function called to print the profile in use
+void it8528_profile_print(FILE* stream)
+{
+  // Declare needed variables
+  const struct it8528_profile* profile = it8528_profile_get();
+  u_int8_t count = 0;
+
+  fprintf(stream, "Model:              %s\n", profile->model[0] != '\0' ? profile->model : "-");
+  fprintf(stream, "Redundant power:    %s\n", profile->redundant_power ? "yes" : "no");
+
+  // Print the fan and sensor names
+  for (u_int8_t i = 0; i < profile->fan_name_count; i++)
+  {
+    if (profile->fan_names[i] != IT8528_PROFILE_NO_ID)
+    {
+      fprintf(stream, "fan%-16u ID %u\n", i + 1, profile->fan_names[i]);
+    }
+  }
+  for (u_int8_t i = 0; i < profile->sensor_name_count; i++)
+  {
+    if (profile->sensor_names[i] != IT8528_PROFILE_NO_ID)
+    {
+      fprintf(stream, "temp%-15u ID %u\n", i + 1, profile->sensor_names[i]);
+    }
+  }
+
+  // Print what a snapshot reads
+  for (u_int8_t i = 0; i < IT8528_SENSOR_COUNT; i++)
+  {
+    count += profile->sensor_present[i];
+  }
+  fprintf(stream, "Sensors sampled:    %u of %u\n", count, IT8528_SENSOR_COUNT);
+  count = 0;
+  for (u_int8_t i = 0; i < IT8528_FAN_COUNT; i++)
+  {
+    count += profile->fan_present[i];
+  }
+  fprintf(stream, "Fans sampled:       %u of %u\n", count, IT8528_FAN_COUNT);
+  fprintf(stream, "Registers read:     %u\n", profile->plan.count);
+  fprintf(stream, "Presence map:       %s\n", it8528_profile_discovered ? IT8528_PRESENCE_PATH :
+    "-");
+}
+
+// Function called to write the presence map found by the discover command, replacing the file
+//   atomically so that readers never see a partial map
+int8_t it8528_profile_write_presence(const struct it8528_presence* presence)
+{
+  // Declare needed variables
+  char path[sizeof(IT8528_PRESENCE_PATH) + 16];
+  int fd;
+
+  // Write the map to a temporary file
+  snprintf(path, sizeof(path), "%s.%d", IT8528_PRESENCE_PATH, (int)getpid());
+  fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0)
+  {
+    fprintf(stderr, "it8528_profile_write_presence: open() failed!\n");
+    return -1;
+  }
+  if (write(fd, presence, sizeof(*presence)) != sizeof(*presence))
+  {
+    fprintf(stderr, "it8528_profile_write_presence: write() failed!\n");
+    close(fd);
+    unlink(path);
+    return -1;
+  }
+  close(fd);
+
+  // Move the temporary file in place
+  if (rename(path, IT8528_PRESENCE_PATH) != 0)
+  {
+    fprintf(stderr, "it8528_profile_write_presence: rename() failed!\n");
+    unlink(path);
+    return -1;
+  }
+
+  return 0;
+}
+
+// Function called to set a profile to the built in one where every sensor and fan is present
+static void it8528_profile_set_defaults(struct it8528_profile* profile)
+{
+  memset(profile, 0, sizeof(*profile));
+  profile->magic = IT8528_PROFILE_MAGIC;
+  profile->version = IT8528_PROFILE_VERSION;
+  profile->size = sizeof(*profile);
+  profile->fan_name_count = sizeof(it8528_profile_default_fan_names);
+  memcpy(profile->fan_names, it8528_profile_default_fan_names,
+    sizeof(it8528_profile_default_fan_names));
+  profile->sensor_name_count = sizeof(it8528_profile_default_sensor_names);
+  memcpy(profile->sensor_names, it8528_profile_default_sensor_names,
+    sizeof(it8528_profile_default_sensor_names));
+  memset(profile->sensor_present, 1, sizeof(profile->sensor_present));
+  memset(profile->fan_present, 1, sizeof(profile->fan_present));
+}
+
+// Function called to parse a model.conf file, the MODEL value of the System Enclosure section,
+//   the REDUNDANT_POWER_INFO value of the System IO section, the FAN_N values of the System FAN
+//   section, and the TEMP_N values of the System Temperature section are used, a fan or sensor
+//   value is a chip ID optionally prefixed with EC: and values prefixed with another unit are
+//   skipped since they aren't read from the chip
+static int8_t it8528_profile_parse(const char* path, struct it8528_profile* profile)
+{
+  // Declare needed variables
+  u_int8_t fan_ids[IT8528_PROFILE_MAX_NAMES];
+  u_int8_t sensor_ids[IT8528_PROFILE_MAX_NAMES];
+  u_int8_t fan_count = 0;
+  u_int8_t sensor_count = 0;
+  char section[64] = "";
+  char line[256];
+  FILE* file;
+
+  // Open the file
+  file = fopen(path, "r");
+  if (file == NULL)
+  {
+    fprintf(stderr, "it8528_profile_parse: fopen() failed!\n");
+    return -1;
+  }
+
+  // Start from the built in profile with no names
+  it8528_profile_set_defaults(profile);
+  profile->fan_name_count = 0;
+  profile->sensor_name_count = 0;
+  memset(profile->fan_names, IT8528_PROFILE_NO_ID, sizeof(profile->fan_names));
+  memset(profile->sensor_names, IT8528_PROFILE_NO_ID, sizeof(profile->sensor_names));
+
+  // Loop through the lines
+  while (fgets(line, sizeof(line), file) != NULL)
+  {
+    // Remove the comment and the surrounding whitespace
+    char* comment = strpbrk(line, "#;");
+    if (comment != NULL)
+    {
+      *comment = '\0';
+    }
+    char* text = it8528_profile_trim(line);
+
+    // Check if this line starts a section
+    if (text[0] == '[')
+    {
+      char* end = strchr(text, ']');
+      if (end != NULL)
+      {
+        *end = '\0';
+        snprintf(section, sizeof(section), "%s", it8528_profile_trim(text + 1));
+      }
+      continue;
+    }
+
+    // Split the key and the value
+    char* separator = strchr(text, '=');
+    if (separator == NULL)
+    {
+      continue;
+    }
+    *separator = '\0';
+    char* key = it8528_profile_trim(text);
+    char* value = it8528_profile_trim(separator + 1);
+
+    // Use the values we know about
+    if (strcasecmp(section, "System Enclosure") == 0 && strcmp(key, "MODEL") == 0)
+    {
+      snprintf(profile->model, sizeof(profile->model), "%s", value);
+    }
+    else if (strcasecmp(section, "System IO") == 0 && strcmp(key, "REDUNDANT_POWER_INFO") == 0)
+    {
+      profile->redundant_power = strcasecmp(value, "yes") == 0;
+    }
+    else if (strcasecmp(section, "System FAN") == 0)
+    {
+      u_int8_t id;
+      if (it8528_profile_parse_name(key, "FAN_", value, profile->fan_names,
+        &profile->fan_name_count, &id) == 0 && fan_count < IT8528_PROFILE_MAX_NAMES)
+      {
+        fan_ids[fan_count++] = id;
+      }
+    }
+    else if (strcasecmp(section, "System Temperature") == 0)
+    {
+      u_int8_t id;
+      if (it8528_profile_parse_name(key, "TEMP_", value, profile->sensor_names,
+        &profile->sensor_name_count, &id) == 0 && sensor_count < IT8528_PROFILE_MAX_NAMES)
+      {
+        sensor_ids[sensor_count++] = id;
+      }
+    }
+  }
+
+  fclose(file);
+
+  // Make sure every fan exists on the chip, fans 10 and 11 only have a speed and only exist with
+  //   redundant power supplies, see it8528_get_fan_speed
+  for (u_int8_t i = 0; i < profile->fan_name_count; i++)
+  {
+    u_int8_t id = profile->fan_names[i];
+    if (id != IT8528_PROFILE_NO_ID && it8528_profile_find_id(it8528_fan_ids, IT8528_FAN_COUNT,
+      id) < 0 && !((id == 10 || id == 11) && profile->redundant_power))
+    {
+      fprintf(stderr, "%s: ignoring FAN_%u, fan ID %u doesn't exist on this chip!\n", path, i + 1,
+        id);
+      profile->fan_names[i] = IT8528_PROFILE_NO_ID;
+    }
+  }
+
+  // Make sure every sensor exists on the chip
+  for (u_int8_t i = 0; i < profile->sensor_name_count; i++)
+  {
+    u_int8_t id = profile->sensor_names[i];
+    if (id != IT8528_PROFILE_NO_ID &&
+      it8528_profile_find_id(it8528_sensor_ids, IT8528_SENSOR_COUNT, id) < 0)
+    {
+      fprintf(stderr, "%s: ignoring TEMP_%u, sensor ID %u doesn't exist on this chip!\n", path,
+        i + 1, id);
+      profile->sensor_names[i] = IT8528_PROFILE_NO_ID;
+    }
+  }
+
+  // Only sample the listed fans, or keep the built in names and sample every fan if none are
+  if (fan_count > 0)
+  {
+    memset(profile->fan_present, 0, sizeof(profile->fan_present));
+    for (u_int8_t i = 0; i < fan_count; i++)
+    {
+      int8_t index = it8528_profile_find_id(it8528_fan_ids, IT8528_FAN_COUNT, fan_ids[i]);
+      if (index >= 0)
+      {
+        profile->fan_present[index] = 1;
+      }
+    }
+  }
+  else
+  {
+    profile->fan_name_count = sizeof(it8528_profile_default_fan_names);
+    memcpy(profile->fan_names, it8528_profile_default_fan_names,
+      sizeof(it8528_profile_default_fan_names));
+  }
+
+  // Only sample the listed sensors, or keep the built in names and sample every sensor if none are
+  if (sensor_count > 0)
+  {
+    memset(profile->sensor_present, 0, sizeof(profile->sensor_present));
+    for (u_int8_t i = 0; i < sensor_count; i++)
+    {
+      int8_t index = it8528_profile_find_id(it8528_sensor_ids, IT8528_SENSOR_COUNT,
+        sensor_ids[i]);
+      if (index >= 0)
+      {
+        profile->sensor_present[index] = 1;
+      }
+    }
+  }
+  else
+  {
+    profile->sensor_name_count = sizeof(it8528_profile_default_sensor_names);
+    memcpy(profile->sensor_names, it8528_profile_default_sensor_names,
+      sizeof(it8528_profile_default_sensor_names));
+  }
+
+  return 0;
+}
+
+// Function called to parse a PREFIX_N = [EC:]ID value into the Nth name
+static int8_t it8528_profile_parse_name(const char* key, const char* prefix, const char* value,
+  u_int8_t* names, u_int8_t* count, u_int8_t* id)
+{
+  // Declare needed variables
+  size_t length = strlen(prefix);
+  unsigned long number;
+  unsigned long parsed;
+  char* end;
+
+  // Get the N of the key
+  if (strncmp(key, prefix, length) != 0)
+  {
+    return -1;
+  }
+  number = strtoul(key + length, &end, 10);
+  if (end == key + length || *end != '\0' || number < 1 || number > IT8528_PROFILE_MAX_NAMES)
+  {
+    return -1;
+  }
+
+  // Skip the EC unit and any value read from another unit
+  if (strncasecmp(value, "EC:", 3) == 0)
+  {
+    value += 3;
+  }
+  else if (!isdigit((unsigned char)value[0]))
+  {
+    return -1;
+  }
+
+  // Get the chip ID
+  parsed = strtoul(value, &end, 10);
+  if (end == value || *end != '\0' || parsed >= IT8528_PROFILE_NO_ID)
+  {
+    return -1;
+  }
+
+  // Set the name
+  names[number - 1] = parsed;
+  if (number > *count)
+  {
+    *count = number;
+  }
+  *id = parsed;
+
+  return 0;
+}
+
+// Function called to find the index of an ID in an array of IDs
+static int8_t it8528_profile_find_id(const u_int8_t* ids, u_int8_t count, u_int8_t id)
+{
+  for (u_int8_t i = 0; i < count; i++)
+  {
+    if (ids[i] == id)
+    {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+// Function called to compile the read plan of the present sensors and fans of a profile
+static void it8528_profile_compile(struct it8528_profile* profile)
+{
+  it8528_plan_snapshot(&profile->plan, profile->sensor_present, profile->fan_present);
+}
+
+// Function called to read the cached profile if it was compiled from the given file by this
+//   version of panq
+static int8_t it8528_profile_read_cache(const struct stat* st, struct it8528_profile* profile)
+{
+  // Declare needed variables
+  int fd = open(IT8528_PROFILE_CACHE_PATH, O_RDONLY | O_CLOEXEC);
+  ssize_t length;
+
+  // Read the cached profile
+  if (fd < 0)
+  {
+    return -1;
+  }
+  length = read(fd, profile, sizeof(*profile));
+  close(fd);
+
+  // Make sure it matches
+  if (length != sizeof(*profile) || profile->magic != IT8528_PROFILE_MAGIC ||
+    profile->version != IT8528_PROFILE_VERSION || profile->size != sizeof(*profile) ||
+    profile->source_device != (u_int64_t)st->st_dev ||
+    profile->source_inode != (u_int64_t)st->st_ino || profile->source_size != st->st_size ||
+    profile->source_mtime != st->st_mtime)
+  {
+    return -1;
+  }
+
+  return 0;
+}
+
+// Function called to cache a compiled profile, replacing the cache file atomically so that
+//   readers never see a partial profile, failures are ignored since the cache is only a shortcut
+static void it8528_profile_write_cache(const struct it8528_profile* profile)
+{
+  // Declare needed variables
+  char path[sizeof(IT8528_PROFILE_CACHE_PATH) + 16];
+  int fd;
+
+  // Write the profile to a temporary file
+  snprintf(path, sizeof(path), "%s.%d", IT8528_PROFILE_CACHE_PATH, (int)getpid());
+  fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0)
+  {
+    return;
+  }
+  if (write(fd, profile, sizeof(*profile)) != sizeof(*profile))
+  {
+    close(fd);
+    unlink(path);
+    return;
+  }
+  close(fd);
+
+  // Move the temporary file in place
+  if (rename(path, IT8528_PROFILE_CACHE_PATH) != 0)
+  {
+    unlink(path);
+  }
+}
+
+// Function called to leave the sensors and fans missing from the presence map out of a profile
+//   and compile its read plan again, nothing changes if there is no valid presence map
+static void it8528_profile_apply_presence(struct it8528_profile* profile)
+{
+  // Declare needed variables
+  struct it8528_presence presence;
+  int fd = open(IT8528_PRESENCE_PATH, O_RDONLY | O_CLOEXEC);
+  ssize_t length;
+
+  // Read the presence map
+  it8528_profile_discovered = 0;
+  if (fd < 0)
+  {
+    return;
+  }
+  length = read(fd, &presence, sizeof(presence));
+  close(fd);
+
+  // Make sure it was written by this version of panq
+  if (length != sizeof(presence) || presence.magic != IT8528_PRESENCE_MAGIC ||
+    presence.version != IT8528_PRESENCE_VERSION || presence.size != sizeof(presence))
+  {
+    return;
+  }
+
+  // Only keep the sensors and fans that are both in the profile and present
+  for (u_int8_t i = 0; i < IT8528_SENSOR_COUNT; i++)
+  {
+    profile->sensor_present[i] &= presence.sensor_present[i] != 0;
+  }
+  for (u_int8_t i = 0; i < IT8528_FAN_COUNT; i++)
+  {
+    profile->fan_present[i] &= presence.fan_present[i] != 0;
+  }
+  it8528_profile_compile(profile);
+  it8528_profile_discovered = 1;
+}
+
+// Function called to remove the whitespace around a string
+static char* it8528_profile_trim(char* text)
+{
+  // Declare needed variables
+  char* end;
+
+  while (isspace((unsigned char)*text))
+  {
+    text++;
+  }
+  end = text + strlen(text);
+  while (end > text && isspace((unsigned char)end[-1]))
+  {
+    *--end = '\0';
+  }
+
+  return text;
+}
@@ -0,0 +1,451 @@
+/*
+ * Copyright (C) 2021 Stonyx
+ * http://www.stonyx.com
+ *
+ * Copyright (C) 2020 Guillaume Valadon
+ * guillaume@valadon.net
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+#include "it8528_utils.h"
+#include "it8528_trace.h"
+
+// Define the structure holding the counters of a thread, a thread only ever writes its own
+//   counters so recording needs neither a lock nor an atomic operation, and the counters of a
+//   thread that exited are kept and handed to the next new thread so that no count is lost
+struct it8528_trace_thread
+{
+  struct it8528_trace_thread* next;
+  u_int8_t in_use;
+  struct it8528_trace_counters ops[IT8528_TRACE_OPS];
+  struct it8528_trace_register registers[IT8528_TRACE_REGISTERS];
+};
+
+// Define the operation names
+static const char* it8528_trace_op_names[] = { "read", "write", "lock", "handshake_input",
+  "handshake_output", "handshake_buffer" };
+
+// Declare the counters of every thread and of the calling thread
+static struct it8528_trace_thread* it8528_trace_threads;
+static pthread_mutex_t it8528_trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t it8528_trace_once = PTHREAD_ONCE_INIT;
+static pthread_key_t it8528_trace_key;
+static __thread struct it8528_trace_thread* it8528_trace_current;
+
+// Declare the flag turning the counters on, only the overhead benchmark turns them off
+static u_int8_t it8528_trace_enabled = 1;
+
+// Declare functions
+static struct it8528_trace_thread* it8528_trace_get_thread(void);
+static void it8528_trace_create_key(void);
+static void it8528_trace_release_thread(void* argument);
+static u_int8_t it8528_trace_get_bucket(u_int64_t nanoseconds);
+static u_int64_t it8528_trace_get_percentile(const u_int64_t* buckets, u_int64_t count,
+  double fraction);
+static u_int64_t it8528_trace_get_time(void);
+static int it8528_trace_compare_registers(const void* a, const void* b);
+
+// Function called to turn the counters on or off
+void it8528_trace_set_enabled(u_int8_t enabled)
+{
+  it8528_trace_enabled = enabled;
+}
+
+// Function called at the start of a transaction, returns the time to pass to it8528_trace_end or
+//   0 when the counters are off
+u_int64_t it8528_trace_begin(void)
+{
+  return it8528_trace_enabled ? it8528_trace_get_time() : 0;
+}
+
+// Function called at the end of a transaction on a register to count it and its latency against
+//   the operation and the register
+void it8528_trace_end(u_int8_t op, u_int16_t command, u_int64_t start, int8_t ret)
+{
+  // Declare needed variables
+  struct it8528_trace_thread* thread;
+  u_int64_t nanoseconds;
+
+  // Check if the counters are off
+  if (start == 0)
+  {
+    return;
+  }
+
+  // Count the transaction against the operation
+  nanoseconds = it8528_trace_get_time() - start;
+  it8528_trace_record(op, nanoseconds, ret);
+  thread = it8528_trace_current;
+  if (thread == NULL)
+  {
+    return;
+  }
+
+  // Find the slot of the register, giving up on registers beyond the size of the table
+  u_int16_t index = (u_int16_t)(command * 0x9E37) % IT8528_TRACE_REGISTERS;
+  for (u_int16_t i = 0; ; i++)
+  {
+    if (i == IT8528_TRACE_REGISTERS)
+    {
+      return;
+    }
+    if (!thread->registers[index].used || thread->registers[index].command == command)
+    {
+      break;
+    }
+    index = (index + 1) % IT8528_TRACE_REGISTERS;
+  }
+
+  // Count the transaction against the register
+  struct it8528_trace_register* reg = &thread->registers[index];
+  reg->used = 1;
+  reg->command = command;
+  if (op == IT8528_TRACE_OP_WRITE)
+  {
+    reg->writes++;
+  }
+  else
+  {
+    reg->reads++;
+  }
+  if (ret != 0)
+  {
+    reg->errors++;
+  }
+  reg->nanoseconds += nanoseconds;
+  if (nanoseconds > reg->max_nanoseconds)
+  {
+    reg->max_nanoseconds = nanoseconds;
+  }
+  reg->buckets[it8528_trace_get_bucket(nanoseconds)]++;
+}
+
+// Function called to count an operation that took nanoseconds
+void it8528_trace_record(u_int8_t op, u_int64_t nanoseconds, int8_t ret)
+{
+  // Declare needed variables
+  struct it8528_trace_thread* thread;
+
+  // Get the counters of the thread
+  if (!it8528_trace_enabled || (thread = it8528_trace_get_thread()) == NULL)
+  {
+    return;
+  }
+
+  // Count the operation
+  struct it8528_trace_counters* counters = &thread->ops[op];
+  counters->count++;
+  if (ret != 0)
+  {
+    counters->errors++;
+  }
+  counters->nanoseconds += nanoseconds;
+  if (nanoseconds > counters->max_nanoseconds)
+  {
+    counters->max_nanoseconds = nanoseconds;
+  }
+  counters->buckets[it8528_trace_get_bucket(nanoseconds)]++;
+}
+
+// Function called to count a retry of an operation, such as a handshake going back to sleep
+void it8528_trace_retry(u_int8_t op)
+{
+  // Declare needed variables
+  struct it8528_trace_thread* thread;
+
+  if (it8528_trace_enabled && (thread = it8528_trace_get_thread()) != NULL)
+  {
+    thread->ops[op].retries++;
+  }
+}
+
+// Function called to get the counters of an operation summed over every thread
+void it8528_trace_get_counters(u_int8_t op, struct it8528_trace_counters* counters)
+{
+  memset(counters, 0, sizeof(*counters));
+
+  // Sum the counters of every thread, the other threads keep counting while we read
+  pthread_mutex_lock(&it8528_trace_mutex);
+  for (struct it8528_trace_thread* thread = it8528_trace_threads; thread != NULL;
+    thread = thread->next)
+  {
+    const struct it8528_trace_counters* source = &thread->ops[op];
+    counters->count += source->count;
+    counters->errors += source->errors;
+    counters->retries += source->retries;
+    counters->nanoseconds += source->nanoseconds;
+    if (source->max_nanoseconds > counters->max_nanoseconds)
+    {
+      counters->max_nanoseconds = source->max_nanoseconds;
+    }
+    for (u_int8_t i = 0; i < IT8528_TRACE_BUCKETS; i++)
+    {
+      counters->buckets[i] += source->buckets[i];
+    }
+  }
+  pthread_mutex_unlock(&it8528_trace_mutex);
+}
+
+// Function called to get the counters of every register summed over every thread and sorted by
+//   command, registers must hold IT8528_TRACE_REGISTERS entries, returns the number of registers
+u_int16_t it8528_trace_get_registers(struct it8528_trace_register* registers)
+{
+  // Declare needed variables
+  u_int16_t count = 0;
+
+  // Merge the registers of every thread
+  pthread_mutex_lock(&it8528_trace_mutex);
+  for (struct it8528_trace_thread* thread = it8528_trace_threads; thread != NULL;
+    thread = thread->next)
+  {
+    for (u_int16_t i = 0; i < IT8528_TRACE_REGISTERS; i++)
+    {
+      // Declare needed variables
+      const struct it8528_trace_register* source = &thread->registers[i];
+      u_int16_t j;
+
+      // Find the register or add it
+      if (!source->used)
+      {
+        continue;
+      }
+      for (j = 0; j < count && registers[j].command != source->command; j++)
+      {
+      }
+      if (j == count)
+      {
+        if (count == IT8528_TRACE_REGISTERS)
+        {
+          continue;
+        }
+        memset(&registers[count], 0, sizeof(registers[count]));
+        registers[count].used = 1;
+        registers[count].command = source->command;
+        count++;
+      }
+
+      // Add the counters
+      registers[j].reads += source->reads;
+      registers[j].writes += source->writes;
+      registers[j].errors += source->errors;
+      registers[j].nanoseconds += source->nanoseconds;
+      if (source->max_nanoseconds > registers[j].max_nanoseconds)
+      {
+        registers[j].max_nanoseconds = source->max_nanoseconds;
+      }
+      for (u_int8_t k = 0; k < IT8528_TRACE_BUCKETS; k++)
+      {
+        registers[j].buckets[k] += source->buckets[k];
+      }
+    }
+  }
+  pthread_mutex_unlock(&it8528_trace_mutex);
+
+  // Sort the registers
+  qsort(registers, count, sizeof(registers[0]), it8528_trace_compare_registers);
+
+  return count;
+}
+
+// Function called to get the name of an operation
+const char* it8528_trace_get_op_name(u_int8_t op)
+{
+  return it8528_trace_op_names[op];
+}
+
+// Function called to get the largest latency in nanoseconds counted by a bucket, the last bucket
+//   has no limit and returns UINT64_MAX
+u_int64_t it8528_trace_get_bucket_limit(u_int8_t bucket)
+{
+  if (bucket == IT8528_TRACE_BUCKETS - 1)
+  {
+    return UINT64_MAX;
+  }
+
+  return bucket == 0 ? 0 : (1ULL << bucket) - 1;
+}
+
+// Function called to print the counters and latency percentiles of every operation and register
+//   along with the non empty buckets of the histogram of every operation
+void it8528_trace_print(FILE* stream)
+{
+  // Declare needed variables
+  struct it8528_trace_register* registers;
+  u_int16_t count;
+
+  fprintf(stream, "trace_probes %s\n", IT8528_TRACE_SDT ? "sdt" : "none");
+
+  // Print the operations
+  for (u_int8_t i = 0; i < IT8528_TRACE_OPS; i++)
+  {
+    // Declare needed variables
+    struct it8528_trace_counters counters;
+    const char* name = it8528_trace_op_names[i];
+
+    it8528_trace_get_counters(i, &counters);
+    fprintf(stream, "op_%s_count %llu\n", name, (unsigned long long)counters.count);
+    fprintf(stream, "op_%s_errors %llu\n", name, (unsigned long long)counters.errors);
+    fprintf(stream, "op_%s_retries %llu\n", name, (unsigned long long)counters.retries);
+    fprintf(stream, "op_%s_ns %llu\n", name, (unsigned long long)counters.nanoseconds);
+    fprintf(stream, "op_%s_max_ns %llu\n", name, (unsigned long long)counters.max_nanoseconds);
+    fprintf(stream, "op_%s_p50_ns %llu\n", name, (unsigned long long)
+      it8528_trace_get_percentile(counters.buckets, counters.count, 0.5));
+    fprintf(stream, "op_%s_p99_ns %llu\n", name, (unsigned long long)
+      it8528_trace_get_percentile(counters.buckets, counters.count, 0.99));
+
+    // Print the buckets as their upper limit and count
+    fprintf(stream, "op_%s_histogram", name);
+    for (u_int8_t j = 0; j < IT8528_TRACE_BUCKETS; j++)
+    {
+      if (counters.buckets[j] > 0 && j < IT8528_TRACE_BUCKETS - 1)
+      {
+        fprintf(stream, " %llu:%llu", (unsigned long long)it8528_trace_get_bucket_limit(j),
+          (unsigned long long)counters.buckets[j]);
+      }
+      else if (counters.buckets[j] > 0)
+      {
+        fprintf(stream, " inf:%llu", (unsigned long long)counters.buckets[j]);
+      }
+    }
+    fprintf(stream, "\n");
+  }
+
+  // Print the registers
+  registers = malloc(IT8528_TRACE_REGISTERS * sizeof(*registers));
+  if (registers == NULL)
+  {
+    return;
+  }
+  count = it8528_trace_get_registers(registers);
+  for (u_int16_t i = 0; i < count; i++)
+  {
+    u_int64_t total = registers[i].reads + registers[i].writes;
+    fprintf(stream, "register 0x%04X reads %llu writes %llu errors %llu mean_ns %llu p50_ns %llu "
+      "p99_ns %llu max_ns %llu\n", registers[i].command, (unsigned long long)registers[i].reads,
+      (unsigned long long)registers[i].writes, (unsigned long long)registers[i].errors,
+      (unsigned long long)(total > 0 ? registers[i].nanoseconds / total : 0),
+      (unsigned long long)it8528_trace_get_percentile(registers[i].buckets, total, 0.5),
+      (unsigned long long)it8528_trace_get_percentile(registers[i].buckets, total, 0.99),
+      (unsigned long long)registers[i].max_nanoseconds);
+  }
+  free(registers);
+}
+
+// Function called to get the counters of the calling thread, creating them the first time
+static struct it8528_trace_thread* it8528_trace_get_thread(void)
+{
+  // Declare needed variables
+  struct it8528_trace_thread* thread = it8528_trace_current;
+
+  // Check if the thread already has its counters
+  if (thread != NULL)
+  {
+    return thread;
+  }
+
+  // Reuse the counters of a thread that exited or allocate new ones
+  pthread_once(&it8528_trace_once, it8528_trace_create_key);
+  pthread_mutex_lock(&it8528_trace_mutex);
+  for (thread = it8528_trace_threads; thread != NULL && thread->in_use; thread = thread->next)
+  {
+  }
+  if (thread == NULL)
+  {
+    thread = calloc(1, sizeof(*thread));
+    if (thread == NULL)
+    {
+      pthread_mutex_unlock(&it8528_trace_mutex);
+      return NULL;
+    }
+    thread->next = it8528_trace_threads;
+    it8528_trace_threads = thread;
+  }
+  thread->in_use = 1;
+  pthread_mutex_unlock(&it8528_trace_mutex);
+
+  // Remember the counters and hand them back when the thread exits
+  it8528_trace_current = thread;
+  pthread_setspecific(it8528_trace_key, thread);
+
+  return thread;
+}
+
+// Function called once to create the key releasing the counters of the threads that exit
+static void it8528_trace_create_key(void)
+{
+  pthread_key_create(&it8528_trace_key, it8528_trace_release_thread);
+}
+
+// Function called when a thread exits to let the next new thread take its counters over
+static void it8528_trace_release_thread(void* argument)
+{
+  // Declare needed variables
+  struct it8528_trace_thread* thread = argument;
+
+  pthread_mutex_lock(&it8528_trace_mutex);
+  thread->in_use = 0;
+  pthread_mutex_unlock(&it8528_trace_mutex);
+}
+
+// Function called to get the bucket of a latency in nanoseconds
+static u_int8_t it8528_trace_get_bucket(u_int64_t nanoseconds)
+{
+  // Declare needed variables
+  u_int8_t bucket = nanoseconds == 0 ? 0 : 64 - __builtin_clzll(nanoseconds);
+
+  return bucket < IT8528_TRACE_BUCKETS ? bucket : IT8528_TRACE_BUCKETS - 1;
+}
+
+// Function called to get the upper limit of the bucket holding a percentile of a histogram
+static u_int64_t it8528_trace_get_percentile(const u_int64_t* buckets, u_int64_t count,
+  double fraction)
+{
+  // Declare needed variables
+  u_int64_t rank = (u_int64_t)(count * fraction);
+  u_int64_t seen = 0;
+
+  // Check if the histogram is empty
+  if (count == 0)
+  {
+    return 0;
+  }
+
+  // Find the bucket holding the rank
+  for (u_int8_t i = 0; i < IT8528_TRACE_BUCKETS; i++)
+  {
+    seen += buckets[i];
+    if (seen > rank)
+    {
+      return it8528_trace_get_bucket_limit(i);
+    }
+  }
+
+  return it8528_trace_get_bucket_limit(IT8528_TRACE_BUCKETS - 1);
+}
+
+// Function called to get the monotonic time in nanoseconds
+static u_int64_t it8528_trace_get_time(void)
+{
+  // Declare needed variables
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (u_int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Function called to compare two registers by command when sorting
+static int it8528_trace_compare_registers(const void* a, const void* b)
+{
+  // Declare needed variables
+  u_int16_t command_a = ((const struct it8528_trace_register*)a)->command;
+  u_int16_t command_b = ((const struct it8528_trace_register*)b)->command;
+
+  return (command_a > command_b) - (command_a < command_b);
+}
@@ -0,0 +1,263 @@
+/*
+ * Copyright (C) 2021 Stonyx
+ * http://www.stonyx.com
+ *
+ * Copyright (C) 2020 Guillaume Valadon
+ * guillaume@valadon.net
+ */
+
+#include <cap-ng.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/io.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include "it8528_utils.h"
+#include "it8528_transport.h"
+
+// Declare functions
+static int8_t it8528_ioperm_open(void);
+static void it8528_ioperm_close(void);
+static u_int8_t it8528_ioperm_read_port(u_int16_t port);
+static void it8528_ioperm_write_port(u_int8_t value, u_int16_t port);
+static int8_t it8528_devport_open(void);
+static void it8528_devport_close(void);
+static u_int8_t it8528_devport_read_port(u_int16_t port);
+static void it8528_devport_write_port(u_int8_t value, u_int16_t port);
+static u_int8_t it8528_closed_read_port(u_int16_t port);
+static void it8528_closed_write_port(u_int8_t value, u_int16_t port);
+static void it8528_transport_error(const char* message);
+
+// Define the backend using direct port I/O after getting permission with ioperm
+const struct it8528_transport it8528_ioperm_transport = {
+  .name = "ioperm",
+  .open = it8528_ioperm_open,
+  .close = it8528_ioperm_close,
+  .read_port = it8528_ioperm_read_port,
+  .write_port = it8528_ioperm_write_port
+};
+
+// Define the backend using pread and pwrite on /dev/port which works where ioperm is blocked
+const struct it8528_transport it8528_devport_transport = {
+  .name = "devport",
+  .open = it8528_devport_open,
+  .close = it8528_devport_close,
+  .read_port = it8528_devport_read_port,
+  .write_port = it8528_devport_write_port
+};
+
+// Define the backend used before a transport is opened which behaves like a floating bus so that
+//   every handshake fails
+static const struct it8528_transport it8528_closed_transport = {
+  .name = "closed",
+  .read_port = it8528_closed_read_port,
+  .write_port = it8528_closed_write_port
+};
+
+// Define the list of backends, the first two are tried in order when none is selected
+const struct it8528_transport* const it8528_transports[] = {
+  &it8528_ioperm_transport,
+  &it8528_devport_transport,
+  &it8528_emulated_transport,
+  NULL
+};
+
+// Declare the open transport
+const struct it8528_transport* it8528_transport = &it8528_closed_transport;
+
+// Declare the /dev/port file descriptor
+static int it8528_devport_fd = -1;
+
+// Declare the last error of a transport that couldn't be opened, it is only printed right away
+//   when the transport was selected so that trying the transports in turn stays quiet until
+//   they all failed
+static const char* it8528_transport_last_error = NULL;
+static u_int8_t it8528_transport_quiet = 0;
+
+// Function called to open a transport by name, a NULL name or "auto" tries direct port I/O first
+//   and falls back to /dev/port
+int8_t it8528_open_transport(const char* name)
+{
+  // Close the open transport
+  it8528_close_transport();
+
+  // Check if no transport was selected
+  if (name == NULL || strcmp(name, "auto") == 0)
+  {
+    // Declare needed variables
+    const char* ioperm_error;
+
+    // Try both transports quietly
+    it8528_transport_quiet = 1;
+    if (it8528_ioperm_transport.open() == 0)
+    {
+      it8528_transport_quiet = 0;
+      it8528_transport = &it8528_ioperm_transport;
+      return 0;
+    }
+    ioperm_error = it8528_transport_last_error;
+    if (it8528_devport_transport.open() == 0)
+    {
+      it8528_transport_quiet = 0;
+      it8528_transport = &it8528_devport_transport;
+      return 0;
+    }
+    it8528_transport_quiet = 0;
+
+    // Tell why neither could be opened
+    fprintf(stderr, "%s\n%s\n", ioperm_error, it8528_transport_last_error);
+    return -1;
+  }
+
+  // Look for the selected transport
+  for (u_int8_t i = 0; it8528_transports[i] != NULL; i++)
+  {
+    if (strcmp(name, it8528_transports[i]->name) == 0)
+    {
+      if (it8528_transports[i]->open() != 0)
+      {
+        return -1;
+      }
+
+      it8528_transport = it8528_transports[i];
+      return 0;
+    }
+  }
+
+  fprintf(stderr, "it8528_open_transport: unknown transport %s!\n", name);
+
+  return -1;
+}
+
+// Function called to close the open transport
+void it8528_close_transport(void)
+{
+  if (it8528_transport->close != NULL)
+  {
+    it8528_transport->close();
+  }
+  it8528_transport = &it8528_closed_transport;
+}
+
+// Function called to get permission to access the various IT8528 chip ports
+static int8_t it8528_ioperm_open(void)
+{
+  // Check if we don't have the CAP_SYS_RAW_IO capability and are not running as root
+  if (capng_have_capability(CAPNG_EFFECTIVE, CAP_SYS_RAWIO) == 0 &&
+     (getuid() != 0 || geteuid() != 0))
+  {
+    it8528_transport_error("PanQ must have the CAP_SYS_RAWIO capability, or be launched as root!");
+    return -1;
+  }
+
+  // Get permission to access both ID ports, which are next to each other, and each of the
+  //   communication ports, which aren't so that the ports between them are left alone
+  if (ioperm(IT8528_ID_PORT_1, IT8528_ID_PORT_2 - IT8528_ID_PORT_1 + 1, 1) != 0)
+  {
+    it8528_transport_error("it8528_ioperm_open: ioperm(IT8528_ID_PORT_1) failed!");
+    return -1;
+  }
+  if (ioperm(IT8528_COMM_PORT_1, 1, 1) != 0)
+  {
+    it8528_transport_error("it8528_ioperm_open: ioperm(IT8528_COMM_PORT_1) failed!");
+    ioperm(IT8528_ID_PORT_1, IT8528_ID_PORT_2 - IT8528_ID_PORT_1 + 1, 0);
+    return -1;
+  }
+  if (ioperm(IT8528_COMM_PORT_2, 1, 1) != 0)
+  {
+    it8528_transport_error("it8528_ioperm_open: ioperm(IT8528_COMM_PORT_2) failed!");
+    it8528_ioperm_close();
+    return -1;
+  }
+
+  return 0;
+}
+
+// Function called to give up permission to access the IT8528 chip ports, which is also used to
+//   revoke the ports granted before a failed ioperm call
+static void it8528_ioperm_close(void)
+{
+  ioperm(IT8528_ID_PORT_1, IT8528_ID_PORT_2 - IT8528_ID_PORT_1 + 1, 0);
+  ioperm(IT8528_COMM_PORT_1, 1, 0);
+  ioperm(IT8528_COMM_PORT_2, 1, 0);
+}
+
+// Function called to read a byte from a port with direct port I/O
+static u_int8_t it8528_ioperm_read_port(u_int16_t port)
+{
+  return inb(port);
+}
+
+// Function called to write a byte to a port with direct port I/O
+static void it8528_ioperm_write_port(u_int8_t value, u_int16_t port)
+{
+  outb(value, port);
+}
+
+// Function called to open /dev/port
+static int8_t it8528_devport_open(void)
+{
+  it8528_devport_fd = open("/dev/port", O_RDWR | O_CLOEXEC);
+  if (it8528_devport_fd < 0)
+  {
+    it8528_transport_error("it8528_devport_open: open(/dev/port) failed!");
+    return -1;
+  }
+
+  return 0;
+}
+
+// Function called to close /dev/port
+static void it8528_devport_close(void)
+{
+  close(it8528_devport_fd);
+  it8528_devport_fd = -1;
+}
+
+// Function called to read a byte from a port through /dev/port
+static u_int8_t it8528_devport_read_port(u_int16_t port)
+{
+  // Declare needed variables
+  u_int8_t value = 0xFF;
+
+  // Read the byte, a failed read returns what a floating bus would
+  if (pread(it8528_devport_fd, &value, 1, port) != 1)
+  {
+    return 0xFF;
+  }
+
+  return value;
+}
+
+// Function called to write a byte to a port through /dev/port
+static void it8528_devport_write_port(u_int8_t value, u_int16_t port)
+{
+  if (pwrite(it8528_devport_fd, &value, 1, port) != 1)
+  {
+    fprintf(stderr, "it8528_devport_write_port: pwrite() failed!\n");
+  }
+}
+
+// Function called to read a byte when no transport is open
+static u_int8_t it8528_closed_read_port(u_int16_t port)
+{
+  return 0xFF;
+}
+
+// Function called to write a byte when no transport is open
+static void it8528_closed_write_port(u_int8_t value, u_int16_t port)
+{
+}
+
+// Function called to report why a transport couldn't be opened, the message is kept for later
+//   instead while the transports are tried in turn
+static void it8528_transport_error(const char* message)
+{
+  it8528_transport_last_error = message;
+  if (!it8528_transport_quiet)
+  {
+    fprintf(stderr, "%s\n", message);
+  }
+}
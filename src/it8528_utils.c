@@ -6,31 +6,134 @@
  * guillaume@valadon.net
  */
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
-#include <sys/io.h>
+#include <string.h>
 #include <time.h>
 #include <unistd.h>
 #include "it8528_utils.h"
+#include "it8528_cache.h"
+#include "it8528_lock.h"
+#include "it8528_trace.h"
+#include "it8528_transport.h"
 
 // Define constants
-#define IT8528_WAIT_FOR_READY_RETRIES 400
-#define IT8528_CLEAR_BUFFER_RETRIES 5000
+// The timeouts match the previous 400 and 5000 retries of 50 microseconds each, a handshake is
+//   also cut short by the deadline of its transaction
+#define IT8528_WAIT_FOR_READY_TIMEOUT 20000000
+#define IT8528_CLEAR_BUFFER_TIMEOUT 250000000
+#define IT8528_BREAKER_THRESHOLD 3
+#define IT8528_BREAKER_COOLDOWN 1000000000
+#define IT8528_BREAKER_MAX_COOLDOWN 30000000000
+#define IT8528_DRAIN_MAX_BYTES 16
+#define IT8528_DEFAULT_SPIN_POLLS 64
+#define IT8528_MIN_SPIN_POLLS 16
+#define IT8528_MAX_SPIN_POLLS 4096
+#define IT8528_CALIBRATION_READS 16
+#define IT8528_HANDSHAKES_PER_READ 8
+
+// Define the structure holding the parameters of a wait mode
+struct it8528_wait_config
+{
+  u_int32_t spin_scale;
+  u_int64_t initial_backoff;
+  u_int64_t max_backoff;
+};
+
+// Define the parameters of the wait modes, the lowest CPU mode never busy polls and sleeps for
+//   the same 50 microseconds as before
+static const struct it8528_wait_config it8528_wait_configs[] = {
+  [IT8528_WAIT_MODE_LATENCY] = { 4, 1000, 8000 },
+  [IT8528_WAIT_MODE_BALANCED] = { 1, 2000, 50000 },
+  [IT8528_WAIT_MODE_CPU] = { 0, 50000, 50000 }
+};
+
+// Define the wait mode and handshake names
+static const char* it8528_wait_mode_names[] = { "latency", "balanced", "cpu" };
+static const char* it8528_handshake_names[] = { "input", "output", "buffer" };
+static const char* it8528_breaker_state_names[] = { "closed", "open", "half_open" };
+
+// Define the error messages, indexed by the negated error codes
+static const char* it8528_error_messages[] = {
+  [0] = "success",
+  [-IT8528_ERROR] = "failure",
+  [-IT8528_ERROR_LOCK] = "lock not acquired",
+  [-IT8528_ERROR_INPUT_TIMEOUT] = "chip not taking input",
+  [-IT8528_ERROR_OUTPUT_TIMEOUT] = "output buffer not emptied",
+  [-IT8528_ERROR_BUFFER_TIMEOUT] = "no output from chip",
+  [-IT8528_ERROR_DEADLINE] = "transaction deadline passed",
+  [-IT8528_ERROR_BREAKER_OPEN] = "circuit breaker open",
+  [-IT8528_ERROR_RESYNC] = "chip out of sync"
+};
+
+// Declare the wait state
+static u_int8_t it8528_wait_mode = IT8528_WAIT_MODE_BALANCED;
+static u_int32_t it8528_spin_polls = IT8528_DEFAULT_SPIN_POLLS;
+
+// Declare the handshake statistics
+static struct it8528_handshake_stats it8528_handshake_stats[IT8528_HANDSHAKE_KINDS];
+static struct it8528_handshake it8528_last_handshake;
+static u_int32_t it8528_read_handshake_polls[IT8528_HANDSHAKES_PER_READ];
+static u_int64_t it8528_read_handshake_nanoseconds[IT8528_HANDSHAKES_PER_READ];
+static u_int8_t it8528_read_handshakes;
+
+// Declare the transaction deadline, the monotonic time in nanoseconds the transaction in progress
+//   must be done by or 0 outside of a transaction, its timeout, and the deadline the next
+//   transaction inherits from the lock request made for it so that the wait counts against it
+static u_int64_t it8528_transaction_timeout = IT8528_DEFAULT_TRANSACTION_TIMEOUT * 1000000ULL;
+static u_int64_t it8528_transaction_deadline;
+static u_int64_t it8528_next_deadline;
+
+// Declare the circuit breaker state, the consecutive failed transactions, when an open breaker
+//   lets the next transaction try, and how long it stays open next time
+static u_int8_t it8528_breaker_state = IT8528_BREAKER_CLOSED;
+static u_int32_t it8528_breaker_failures;
+static u_int64_t it8528_breaker_retry_time;
+static u_int64_t it8528_breaker_cooldown = IT8528_BREAKER_COOLDOWN;
+static struct it8528_fault_stats it8528_fault_stats;
+
+// Declare functions
+static int8_t it8528_read_byte(u_int8_t command0, u_int8_t command1, u_int8_t* value);
+static int8_t it8528_read_byte_traced(u_int8_t command0, u_int8_t command1, u_int8_t* value);
+static int8_t it8528_write_byte_traced(u_int8_t command0, u_int8_t command1, u_int8_t value);
+static int8_t it8528_write_byte(u_int8_t command0, u_int8_t command1, u_int8_t value);
+static int8_t it8528_yield_lock(void);
+static int8_t it8528_begin_transaction(void);
+static void it8528_end_transaction(int8_t ret);
+static int8_t it8528_recover(void);
+static void it8528_drain_output(void);
+static u_int64_t it8528_get_time(void);
+static int8_t it8528_poll_status(u_int8_t kind, u_int8_t mask, u_int8_t expected,
+  u_int64_t timeout);
+static void it8528_record_handshake(u_int8_t kind, u_int32_t polls, u_int64_t nanoseconds,
+  int8_t ret);
+static int it8528_compare_u32(const void* a, const void* b);
+static int it8528_compare_u64(const void* a, const void* b);
 
 // Function called to check if an IT8528 chip is present
 int8_t it8528_check_if_present(void)
 {
+  // Hold the lock shared with the other processes while using the ID ports
+  if (it8528_acquire_lock(it8528_lock_get_read_class()) != 0)
+  {
+    fprintf(stderr, "it8528_check_if_present: it8528_acquire_lock() failed!\n");
+    return -1;
+  }
+
   // Write 0x20 to the first ID port
-  outb(0x20, IT8528_ID_PORT_1);
+  it8528_outb(0x20, IT8528_ID_PORT_1);
 
   // Read a byte from the second ID port
-  u_int8_t byte_1 = inb(IT8528_ID_PORT_2);
+  u_int8_t byte_1 = it8528_inb(IT8528_ID_PORT_2);
 
   // Write 0x21 to the first ID port
-  outb(0x21, IT8528_ID_PORT_1);
+  it8528_outb(0x21, IT8528_ID_PORT_1);
 
   // Read a byte from the second ID port
-  u_int8_t byte_2 = inb(IT8528_ID_PORT_2);
+  u_int8_t byte_2 = it8528_inb(IT8528_ID_PORT_2);
+
+  it8528_lock_release();
 
   // Check if the ID matches
   if (byte_1 == 0x85 && byte_2 == 0x28)
@@ -46,74 +149,110 @@ int8_t it8528_check_if_present(void)
 // Function called to read a byte from the IT8528 chip
 int8_t it8528_get_byte(u_int8_t command0, u_int8_t command1, u_int8_t* value)
 {
-  // Read from the second communication port and check if the read byte has the first bit set to 1
-  if ((inb(IT8528_COMM_PORT_2) & 0x01) == 0x01)
-  {
-    // Clear the chip buffer
-    it8528_clear_buffer();
+  // Declare needed variables
+  int8_t ret;
 
-    // Read from the first communication port
-    inb(IT8528_COMM_PORT_1);
+  // Hold the lock shared with the other processes for the whole transaction
+  ret = it8528_acquire_lock(it8528_lock_get_read_class());
+  if (ret != 0)
+  {
+    fprintf(stderr, "it8528_get_byte: it8528_acquire_lock() failed!\n");
+    return ret;
   }
+  ret = it8528_read_byte_traced(command0, command1, value);
+  it8528_lock_release();
 
-  // Send the commands
-  if (it8528_send_commands(command0, command1) != 0)
+  return ret;
+}
+
+// Function called to read a block of consecutive registers from the IT8528 chip
+// The chip has no block transfer so every register is still its own transaction, but callers
+//   get one call per block instead of one per register
+// The lock is held across the block but every register is a unit the block can be preempted
+//   after, so a request of a higher class waits for one transaction instead of the whole block
+int8_t it8528_read_block(u_int16_t start, u_int16_t length, u_int8_t* buffer)
+{
+  // Declare needed variables
+  int8_t ret = 0;
+
+  // Hold the lock shared with the other processes for the block
+  ret = it8528_acquire_lock(it8528_lock_get_read_class());
+  if (ret != 0)
   {
-    fprintf(stderr, "it8528_get_byte: it8528_send_commands() failed!\n");
-    return -1;
+    fprintf(stderr, "it8528_read_block: it8528_acquire_lock() failed!\n");
+    return ret;
   }
 
-  // Clear the chip buffer
-  it8528_clear_buffer();
+  // Read every register of the block
+  for (u_int16_t i = 0; i < length; i++)
+  {
+    // Declare needed variables
+    u_int16_t command = start + i;
 
-  // Read the byte from first communication port
-  *value = inb(IT8528_COMM_PORT_1);
+    // Give way to the requests of a higher class waiting for the lock
+    if (i > 0)
+    {
+      ret = it8528_yield_lock();
+      if (ret != 0)
+      {
+        fprintf(stderr, "it8528_read_block: it8528_yield_lock() failed!\n");
+        break;
+      }
+    }
 
-  return 0;
+    // Get the byte
+    ret = it8528_read_byte_traced(command & 0xFF, (command >> 8) & 0xFF, &buffer[i]);
+    if (ret != 0)
+    {
+      fprintf(stderr, "it8528_read_block: it8528_read_byte() failed, %s!\n",
+        it8528_strerror(ret));
+      break;
+    }
+  }
+
+  it8528_lock_release();
+
+  return ret;
 }
 
 // Function called to send a byte to the IT8528 chip
 int8_t it8528_set_byte(u_int8_t command0, u_int8_t command1, u_int8_t value)
 {
-  // Wait until the chip is ready
-  if (it8528_wait_for_ready(IT8528_WAIT_FOR_READY_INPUT) != 0)
-  {
-    fprintf(stderr, "it8528_send_byte(): it8528_wait_for_ready() failed!\n");
-    return -1;
-  }
+  // Declare needed variables
+  int8_t ret;
 
-  // Write 0x88 to the second communication port
-  outb(0x88, IT8528_COMM_PORT_2);
+  // Invalidate the cached byte since it is about to change
+  it8528_cache_invalidate(command0 | (command1 << 8));
 
-  // Wait until the chip is ready
-  if (it8528_wait_for_ready(IT8528_WAIT_FOR_READY_INPUT) != 0)
+  // Hold the lock shared with the other processes for the whole transaction
+  ret = it8528_acquire_lock(IT8528_LOCK_CLASS_CONTROL);
+  if (ret != 0)
   {
-    fprintf(stderr, "it8528_send_byte(): it8528_wait_for_ready() failed!\n");
-    return -1;
+    fprintf(stderr, "it8528_set_byte: it8528_acquire_lock() failed!\n");
+    return ret;
   }
+  ret = it8528_write_byte_traced(command0, command1, value);
+  it8528_lock_release();
 
-  // Write the first command bitwise ored with 0x80 to the first communication port
-  outb(command0 | 0x80, IT8528_COMM_PORT_1);
-
-  // Wait until the chip is ready
-  if (it8528_wait_for_ready(IT8528_WAIT_FOR_READY_INPUT) != 0)
-  {
-    fprintf(stderr, "it8528_send_byte(): it8528_wait_for_ready() failed!\n");
-    return -1;
-  }
+  return ret;
+}
 
-  // Write the second command to the first communication port
-  outb(command1, IT8528_COMM_PORT_1);
+// Function called to take the lock in a priority class for a transaction or a batch of
+//   transactions, the wait counts against the deadline of the next transaction so that a
+//   transaction takes no longer than its timeout including the wait, and a lock that can't be
+//   taken in time fails like a transaction that timed out on the chip
+int8_t it8528_acquire_lock(u_int8_t class)
+{
+  // Declare needed variables
+  u_int64_t deadline = it8528_get_time() + it8528_transaction_timeout;
 
-  // Wait until the chip is ready
-  if (it8528_wait_for_ready(IT8528_WAIT_FOR_READY_INPUT) != 0)
+  // Take the lock before the deadline
+  if (it8528_lock_acquire_before(class, deadline) != 0)
   {
-    fprintf(stderr, "it8528_send_byte(): it8528_wait_for_ready() failed!\n");
-    return -1;
+    it8528_end_transaction(IT8528_ERROR_LOCK);
+    return IT8528_ERROR_LOCK;
   }
-
-  // Write the byte to the first communication port
-  outb(value, IT8528_COMM_PORT_1);
+  it8528_next_deadline = deadline;
 
   return 0;
 }
@@ -122,27 +261,18 @@ int8_t it8528_set_byte(u_int8_t command0, u_int8_t command1, u_int8_t value)
 // TODO: rename "value" to something better to match variable name "byte" in above functions
 int8_t it8528_get_double(u_int8_t command0, u_int8_t command1, double* value)
 {
-  // Read from second communication port and check if the read byte has the first bit set to 1
-  if ((inb(IT8528_COMM_PORT_2) & 0x01) == 0x01)
-  {
-    // Clear the chip buffer
-    it8528_clear_buffer();
-
-    // Read from the first communication port
-    inb(IT8528_COMM_PORT_1);
-  }
+  // Declare needed variables
+  u_int8_t byte;
 
-  // Send the commands
-  if (it8528_send_commands(command0, command1) != 0)
+  // Read the byte in a locked transaction
+  int8_t ret = it8528_get_byte(command0, command1, &byte);
+  if (ret != 0)
   {
-    return -1;
+    return ret;
   }
 
-  // Clear the chip buffer
-  it8528_clear_buffer();
-
-  // Read the double from the first communication port
-  *value = inb(IT8528_COMM_PORT_1);
+  // Convert the byte to a double
+  *value = byte;
 
   return 0;
 }
@@ -150,51 +280,59 @@ int8_t it8528_get_double(u_int8_t command0, u_int8_t command1, double* value)
 // Function called to send commands to the IT8528 chip
 int8_t it8528_send_commands(u_int8_t command0, u_int8_t command1)
 {
+  // Declare needed variables
+  int8_t ret;
+
   // Wait until the chip is ready
-  if (it8528_wait_for_ready(IT8528_WAIT_FOR_READY_OUTPUT) != 0)
+  ret = it8528_wait_for_ready(IT8528_WAIT_FOR_READY_OUTPUT);
+  if (ret != 0)
   {
     fprintf(stderr, "it8528_send_commands(): it8528_wait_for_ready() failed!\n");
-    return -1;
+    return ret;
   }
 
   // Read from the first communication port
-  inb(IT8528_COMM_PORT_1);
+  it8528_inb(IT8528_COMM_PORT_1);
 
   // Wait until the chip is ready
-  if (it8528_wait_for_ready(IT8528_WAIT_FOR_READY_INPUT) != 0)
+  ret = it8528_wait_for_ready(IT8528_WAIT_FOR_READY_INPUT);
+  if (ret != 0)
   {
     fprintf(stderr, "it8528_send_commands(): it8528_wait_for_ready() failed!\n");
-    return -1;
+    return ret;
   }
 
   // Write 0x88 to the second communication port
-  outb(0x88, IT8528_COMM_PORT_2);
+  it8528_outb(0x88, IT8528_COMM_PORT_2);
 
   // Wait until the chip is ready
-  if (it8528_wait_for_ready(IT8528_WAIT_FOR_READY_INPUT) != 0)
+  ret = it8528_wait_for_ready(IT8528_WAIT_FOR_READY_INPUT);
+  if (ret != 0)
   {
     fprintf(stderr, "it8528_send_commands(): it8528_wait_for_ready() failed!\n");
-    return -1;
+    return ret;
   }
 
   // Write the first command to the first communication port
-  outb(command0, IT8528_COMM_PORT_1);
+  it8528_outb(command0, IT8528_COMM_PORT_1);
 
   // Wait until the chip is ready
-  if (it8528_wait_for_ready(IT8528_WAIT_FOR_READY_INPUT) != 0)
+  ret = it8528_wait_for_ready(IT8528_WAIT_FOR_READY_INPUT);
+  if (ret != 0)
   {
     fprintf(stderr, "it8528_send_commands(): it8528_wait_for_ready() failed!\n");
-    return -1;
+    return ret;
   }
 
   // Write the second command to the first communication port
-  outb(command1, IT8528_COMM_PORT_1);
+  it8528_outb(command1, IT8528_COMM_PORT_1);
 
   // Wait until the chip is ready
-  if (it8528_wait_for_ready(IT8528_WAIT_FOR_READY_INPUT) != 0)
+  ret = it8528_wait_for_ready(IT8528_WAIT_FOR_READY_INPUT);
+  if (ret != 0)
   {
     fprintf(stderr, "it8528_send_commands(): it8528_wait_for_ready() failed!\n");
-    return -1;
+    return ret;
   }
 
   return 0;
@@ -203,59 +341,639 @@ int8_t it8528_send_commands(u_int8_t command0, u_int8_t command1)
 // Function called to check if the IT8528 chip port is ready to be used
 int8_t it8528_wait_for_ready(u_int8_t direction)
 {
-  // Declare needed variables
-  int retries = IT8528_WAIT_FOR_READY_RETRIES;
-  int byte;
-  struct timespec ts = {
-    .tv_sec = 0,
-    .tv_nsec = 50000
-  };
+  // Wait for the bit that corresponds to the passed in direction to be set to 0
+  return it8528_poll_status(direction == IT8528_WAIT_FOR_READY_INPUT ? IT8528_HANDSHAKE_INPUT :
+    IT8528_HANDSHAKE_OUTPUT, direction, 0x00, IT8528_WAIT_FOR_READY_TIMEOUT);
+}
 
-  // Loop until we get the byte we are waiting for or we run out of retries
-  do {
-    // Read a byte from the second communication port
-    byte = inb(IT8528_COMM_PORT_2);
+// Function called to clear the IT8528 chip buffers
+int8_t it8528_clear_buffer(void)
+{
+  // Wait for the first bit to be set to 1
+  return it8528_poll_status(IT8528_HANDSHAKE_BUFFER, 0x01, 0x01, IT8528_CLEAR_BUFFER_TIMEOUT);
+}
 
-    // Sleep for 50 microseconds
-    nanosleep(&ts, NULL);
+// Function called to set the strategy used when waiting for the IT8528 chip
+void it8528_set_wait_mode(u_int8_t mode)
+{
+  if (mode <= IT8528_WAIT_MODE_CPU)
+  {
+    it8528_wait_mode = mode;
+  }
+}
 
-    // Check if the read byte has the bit that corresponds to the passed in direction set to 0
-    if ((byte & direction) == 0x00)
+// Function called to convert a wait mode name to a wait mode
+int8_t it8528_parse_wait_mode(const char* name, u_int8_t* mode)
+{
+  // Look for the name in the list of wait mode names
+  for (u_int8_t i = 0; i <= IT8528_WAIT_MODE_CPU; i++)
+  {
+    if (strcmp(name, it8528_wait_mode_names[i]) == 0)
     {
+      *mode = i;
       return 0;
     }
   }
-  while (retries--);
 
   return -1;
 }
 
-// Function called to clear the IT8528 chip buffers
-int8_t it8528_clear_buffer(void)
+// Function called to get the name of a wait mode
+const char* it8528_get_wait_mode_name(u_int8_t mode)
+{
+  return mode <= IT8528_WAIT_MODE_CPU ? it8528_wait_mode_names[mode] : "unknown";
+}
+
+// Function called to calibrate the number of busy polls done before backing off against the
+//   observed ready latency of the IT8528 chip
+int8_t it8528_calibrate_wait(struct it8528_wait_calibration* calibration)
 {
   // Declare needed variables
-  int retries = IT8528_CLEAR_BUFFER_RETRIES;
-  int byte;
-  struct timespec ts = {
-    .tv_sec = 0,
-    .tv_nsec = 50000
+  u_int32_t polls[IT8528_CALIBRATION_READS * IT8528_HANDSHAKES_PER_READ];
+  u_int64_t nanoseconds[IT8528_CALIBRATION_READS * IT8528_HANDSHAKES_PER_READ];
+  u_int32_t count = 0;
+  u_int32_t saved_spin_polls = it8528_spin_polls;
+  u_int8_t saved_mode = it8528_wait_mode;
+  u_int8_t byte;
+
+  // Busy poll for the whole timeout so that the observed latency isn't hidden by sleeping
+  it8528_spin_polls = UINT32_MAX;
+  it8528_wait_mode = IT8528_WAIT_MODE_LATENCY;
+
+  // Read the first temperature register a few times and record every handshake
+  for (u_int32_t i = 0; i < IT8528_CALIBRATION_READS; i++)
+  {
+    // Read the byte
+    if (it8528_get_byte(0x00, 0x06, &byte) != 0)
+    {
+      it8528_spin_polls = saved_spin_polls;
+      it8528_wait_mode = saved_mode;
+      fprintf(stderr, "it8528_calibrate_wait: it8528_get_byte() failed!\n");
+      return -1;
+    }
+
+    // Record the handshakes of the read
+    for (u_int8_t j = 0; j < it8528_read_handshakes && count < sizeof(polls) / sizeof(polls[0]);
+      j++)
+    {
+      polls[count] = it8528_read_handshake_polls[j];
+      nanoseconds[count] = it8528_read_handshake_nanoseconds[j];
+      count++;
+    }
+  }
+
+  // Restore the wait mode
+  it8528_wait_mode = saved_mode;
+
+  // Sort the recorded handshakes
+  qsort(polls, count, sizeof(polls[0]), it8528_compare_u32);
+  qsort(nanoseconds, count, sizeof(nanoseconds[0]), it8528_compare_u64);
+
+  // Spin for twice the 90th percentile of observed polls before backing off
+  calibration->handshakes = count;
+  calibration->median_polls = count > 0 ? polls[count / 2] : 0;
+  calibration->max_polls = count > 0 ? polls[count - 1] : 0;
+  calibration->median_nanoseconds = count > 0 ? nanoseconds[count / 2] : 0;
+  calibration->max_nanoseconds = count > 0 ? nanoseconds[count - 1] : 0;
+  calibration->spin_polls = count > 0 ? 2 * polls[count * 9 / 10] : IT8528_DEFAULT_SPIN_POLLS;
+  if (calibration->spin_polls < IT8528_MIN_SPIN_POLLS)
+  {
+    calibration->spin_polls = IT8528_MIN_SPIN_POLLS;
+  }
+  if (calibration->spin_polls > IT8528_MAX_SPIN_POLLS)
+  {
+    calibration->spin_polls = IT8528_MAX_SPIN_POLLS;
+  }
+  it8528_spin_polls = calibration->spin_polls;
+
+  return 0;
+}
+
+// Function called to get the statistics of a handshake kind
+void it8528_get_handshake_stats(u_int8_t kind, struct it8528_handshake_stats* stats)
+{
+  if (kind < IT8528_HANDSHAKE_KINDS)
+  {
+    *stats = it8528_handshake_stats[kind];
+  }
+}
+
+// Function called to get the name of a handshake kind
+const char* it8528_get_handshake_name(u_int8_t kind)
+{
+  return kind < IT8528_HANDSHAKE_KINDS ? it8528_handshake_names[kind] : NULL;
+}
+
+// Function called to get the polls and wall time of the last handshake
+void it8528_get_last_handshake(struct it8528_handshake* handshake)
+{
+  *handshake = it8528_last_handshake;
+}
+
+// Function called to print the handshake statistics
+void it8528_print_wait_stats(FILE* stream)
+{
+  fprintf(stream, "wait_mode %s\n", it8528_wait_mode_names[it8528_wait_mode]);
+  fprintf(stream, "wait_spin_polls %u\n", it8528_spin_polls);
+  for (u_int8_t i = 0; i < IT8528_HANDSHAKE_KINDS; i++)
+  {
+    struct it8528_handshake_stats* stats = &it8528_handshake_stats[i];
+    fprintf(stream, "handshake_%s_count %llu\n", it8528_handshake_names[i],
+      (unsigned long long)stats->count);
+    fprintf(stream, "handshake_%s_polls %llu\n", it8528_handshake_names[i],
+      (unsigned long long)stats->polls);
+    fprintf(stream, "handshake_%s_nanoseconds %llu\n", it8528_handshake_names[i],
+      (unsigned long long)stats->nanoseconds);
+    fprintf(stream, "handshake_%s_max_nanoseconds %llu\n", it8528_handshake_names[i],
+      (unsigned long long)stats->max_nanoseconds);
+    fprintf(stream, "handshake_%s_timeouts %llu\n", it8528_handshake_names[i],
+      (unsigned long long)stats->timeouts);
+  }
+}
+
+// Function called to set the timeout in milliseconds of every transaction with the chip, which
+//   bounds how long a read or a write can wait for the chip once it holds the lock
+void it8528_set_transaction_timeout(u_int32_t timeout)
+{
+  if (timeout > 0 && timeout <= IT8528_MAX_TRANSACTION_TIMEOUT)
+  {
+    it8528_transaction_timeout = timeout * 1000000ULL;
+  }
+}
+
+// Function called to get the message of an error code
+const char* it8528_strerror(int8_t error)
+{
+  return error <= 0 && error >= IT8528_ERROR_RESYNC ? it8528_error_messages[-error] :
+    "unknown error";
+}
+
+// Function called to get the statistics of the failed transactions and of the circuit breaker
+void it8528_get_fault_stats(struct it8528_fault_stats* stats)
+{
+  *stats = it8528_fault_stats;
+  stats->breaker_state = it8528_breaker_state;
+}
+
+// Function called to get the name of a circuit breaker state
+const char* it8528_get_breaker_state_name(u_int8_t state)
+{
+  return state <= IT8528_BREAKER_HALF_OPEN ? it8528_breaker_state_names[state] : "unknown";
+}
+
+// Function called to print the statistics of the failed transactions and of the circuit breaker
+void it8528_print_fault_stats(FILE* stream)
+{
+  fprintf(stream, "transaction_timeout_ms %llu\n",
+    (unsigned long long)it8528_transaction_timeout / 1000000);
+  fprintf(stream, "transaction_failures %llu\n",
+    (unsigned long long)it8528_fault_stats.failures);
+  fprintf(stream, "transaction_deadline_misses %llu\n",
+    (unsigned long long)it8528_fault_stats.deadline_misses);
+  fprintf(stream, "breaker_state %s\n", it8528_breaker_state_names[it8528_breaker_state]);
+  fprintf(stream, "breaker_trips %llu\n", (unsigned long long)it8528_fault_stats.breaker_trips);
+  fprintf(stream, "breaker_fast_failures %llu\n",
+    (unsigned long long)it8528_fault_stats.fast_failures);
+  fprintf(stream, "breaker_recoveries %llu\n", (unsigned long long)it8528_fault_stats.recoveries);
+  fprintf(stream, "breaker_recovery_failures %llu\n",
+    (unsigned long long)it8528_fault_stats.recovery_failures);
+  fprintf(stream, "drained_bytes %llu\n", (unsigned long long)it8528_fault_stats.drained_bytes);
+}
+
+// Function called to read a byte from the IT8528 chip while holding the lock
+static int8_t it8528_read_byte(u_int8_t command0, u_int8_t command1, u_int8_t* value)
+{
+  // Declare needed variables
+  int8_t ret;
+
+  // Start recording the handshakes of this read
+  it8528_read_handshakes = 0;
+
+  // Drop any stale byte left in the output buffer
+  it8528_drain_output();
+
+  // Send the commands
+  ret = it8528_send_commands(command0, command1);
+  if (ret != 0)
+  {
+    fprintf(stderr, "it8528_read_byte: it8528_send_commands() failed!\n");
+    return ret;
+  }
+
+  // Wait for the byte, the output buffer would otherwise hold whatever was last in it
+  ret = it8528_clear_buffer();
+  if (ret != 0)
+  {
+    fprintf(stderr, "it8528_read_byte: it8528_clear_buffer() failed!\n");
+    return ret;
+  }
+
+  // Read the byte from first communication port
+  *value = it8528_inb(IT8528_COMM_PORT_1);
+
+  return 0;
+}
+
+// Function called to send a byte to the IT8528 chip while holding the lock
+static int8_t it8528_write_byte(u_int8_t command0, u_int8_t command1, u_int8_t value)
+{
+  // Declare needed variables
+  int8_t ret;
+
+  // Wait until the chip is ready
+  ret = it8528_wait_for_ready(IT8528_WAIT_FOR_READY_INPUT);
+  if (ret != 0)
+  {
+    fprintf(stderr, "it8528_send_byte(): it8528_wait_for_ready() failed!\n");
+    return ret;
+  }
+
+  // Write 0x88 to the second communication port
+  it8528_outb(0x88, IT8528_COMM_PORT_2);
+
+  // Wait until the chip is ready
+  ret = it8528_wait_for_ready(IT8528_WAIT_FOR_READY_INPUT);
+  if (ret != 0)
+  {
+    fprintf(stderr, "it8528_send_byte(): it8528_wait_for_ready() failed!\n");
+    return ret;
+  }
+
+  // Write the first command bitwise ored with 0x80 to the first communication port
+  it8528_outb(command0 | 0x80, IT8528_COMM_PORT_1);
+
+  // Wait until the chip is ready
+  ret = it8528_wait_for_ready(IT8528_WAIT_FOR_READY_INPUT);
+  if (ret != 0)
+  {
+    fprintf(stderr, "it8528_send_byte(): it8528_wait_for_ready() failed!\n");
+    return ret;
+  }
+
+  // Write the second command to the first communication port
+  it8528_outb(command1, IT8528_COMM_PORT_1);
+
+  // Wait until the chip is ready
+  ret = it8528_wait_for_ready(IT8528_WAIT_FOR_READY_INPUT);
+  if (ret != 0)
+  {
+    fprintf(stderr, "it8528_send_byte(): it8528_wait_for_ready() failed!\n");
+    return ret;
+  }
+
+  // Write the byte to the first communication port
+  it8528_outb(value, IT8528_COMM_PORT_1);
+
+  return 0;
+}
+
+// Function called to read a byte while holding the lock and count the transaction
+static int8_t it8528_read_byte_traced(u_int8_t command0, u_int8_t command1, u_int8_t* value)
+{
+  // Declare needed variables
+  u_int16_t command = command0 | (command1 << 8);
+  u_int64_t start = it8528_trace_begin();
+  int8_t ret;
+
+  IT8528_PROBE2(transaction__start, IT8528_TRACE_OP_READ, command);
+  ret = it8528_begin_transaction();
+  if (ret == 0)
+  {
+    ret = it8528_read_byte(command0, command1, value);
+    it8528_end_transaction(ret);
+  }
+  it8528_trace_end(IT8528_TRACE_OP_READ, command, start, ret);
+  IT8528_PROBE4(transaction__end, IT8528_TRACE_OP_READ, command, ret, start);
+
+  return ret;
+}
+
+// Function called to send a byte while holding the lock and count the transaction
+static int8_t it8528_write_byte_traced(u_int8_t command0, u_int8_t command1, u_int8_t value)
+{
+  // Declare needed variables
+  u_int16_t command = command0 | (command1 << 8);
+  u_int64_t start = it8528_trace_begin();
+  int8_t ret;
+
+  IT8528_PROBE2(transaction__start, IT8528_TRACE_OP_WRITE, command);
+  ret = it8528_begin_transaction();
+  if (ret == 0)
+  {
+    ret = it8528_write_byte(command0, command1, value);
+    it8528_end_transaction(ret);
+  }
+  it8528_trace_end(IT8528_TRACE_OP_WRITE, command, start, ret);
+  IT8528_PROBE4(transaction__end, IT8528_TRACE_OP_WRITE, command, ret, start);
+
+  return ret;
+}
+
+// Function called between two transactions of a block read to give way to the requests of a
+//   higher class waiting for the lock, taking it back counts against the deadline of the next
+//   transaction like it8528_acquire_lock
+static int8_t it8528_yield_lock(void)
+{
+  // Declare needed variables
+  u_int64_t deadline = it8528_get_time() + it8528_transaction_timeout;
+
+  // Give the lock away and take it back before the deadline
+  if (it8528_lock_yield(deadline) != 0)
+  {
+    it8528_end_transaction(IT8528_ERROR_LOCK);
+    return IT8528_ERROR_LOCK;
+  }
+  it8528_next_deadline = deadline;
+
+  return 0;
+}
+
+// Function called to start a transaction while holding the lock by setting its deadline, a
+//   transaction fails fast while the circuit breaker is open and the first one after the cool
+//   down recovers the chip before going ahead
+static int8_t it8528_begin_transaction(void)
+{
+  // Declare needed variables
+  u_int64_t now = it8528_get_time();
+  int8_t ret;
+
+  // Set the deadline, which started with the lock request if the transaction made one
+  it8528_transaction_deadline = it8528_next_deadline != 0 ? it8528_next_deadline :
+    now + it8528_transaction_timeout;
+  it8528_next_deadline = 0;
+
+  // Check if the breaker is open
+  if (it8528_breaker_state == IT8528_BREAKER_OPEN)
+  {
+    // Leave the chip alone until the cool down is over
+    if (now < it8528_breaker_retry_time)
+    {
+      it8528_fault_stats.fast_failures++;
+      it8528_transaction_deadline = 0;
+      return IT8528_ERROR_BREAKER_OPEN;
+    }
+    it8528_breaker_state = IT8528_BREAKER_HALF_OPEN;
+  }
+
+  // Recover the chip before letting a transaction through the half open breaker
+  if (it8528_breaker_state == IT8528_BREAKER_HALF_OPEN)
+  {
+    ret = it8528_recover();
+    if (ret != 0)
+    {
+      it8528_fault_stats.recovery_failures++;
+      it8528_end_transaction(ret);
+      return ret;
+    }
+  }
+
+  return 0;
+}
+
+// Function called to end a transaction, closing the circuit breaker when it succeeded and
+//   opening it after too many failures in a row or a failure right after a recovery, every time
+//   the breaker opens again without a success in between it stays open twice as long
+static void it8528_end_transaction(int8_t ret)
+{
+  // Clear the deadline
+  it8528_transaction_deadline = 0;
+
+  // Check if the transaction succeeded
+  if (ret == 0)
+  {
+    if (it8528_breaker_state == IT8528_BREAKER_HALF_OPEN)
+    {
+      it8528_fault_stats.recoveries++;
+    }
+    it8528_breaker_state = IT8528_BREAKER_CLOSED;
+    it8528_breaker_failures = 0;
+    it8528_breaker_cooldown = IT8528_BREAKER_COOLDOWN;
+    return;
+  }
+
+  // Count the failure and don't leave a stray byte behind for the next transaction, unless the
+  //   lock wasn't taken in time and the chip belongs to someone else
+  it8528_fault_stats.failures++;
+  if (ret == IT8528_ERROR_DEADLINE || ret == IT8528_ERROR_LOCK)
+  {
+    it8528_fault_stats.deadline_misses++;
+  }
+  it8528_breaker_failures++;
+  if (ret != IT8528_ERROR_LOCK)
+  {
+    it8528_drain_output();
+  }
+
+  // Check if the breaker should open, an open breaker only sees a failed lock request and stays
+  //   open until its cool down is over
+  if (it8528_breaker_state == IT8528_BREAKER_HALF_OPEN ||
+    (it8528_breaker_state == IT8528_BREAKER_CLOSED &&
+      it8528_breaker_failures >= IT8528_BREAKER_THRESHOLD))
+  {
+    if (it8528_breaker_state == IT8528_BREAKER_HALF_OPEN)
+    {
+      it8528_breaker_cooldown *= 2;
+      if (it8528_breaker_cooldown > IT8528_BREAKER_MAX_COOLDOWN)
+      {
+        it8528_breaker_cooldown = IT8528_BREAKER_MAX_COOLDOWN;
+      }
+    }
+    else
+    {
+      fprintf(stderr, "it8528_end_transaction: %u transactions failed in a row, leaving the chip "
+        "alone for a while!\n", it8528_breaker_failures);
+    }
+    it8528_breaker_state = IT8528_BREAKER_OPEN;
+    it8528_breaker_retry_time = it8528_get_time() + it8528_breaker_cooldown;
+    it8528_fault_stats.breaker_trips++;
+  }
+}
+
+// Function called to bring the chip back to a known state before using it again, the stale bytes
+//   are drained from the output buffer and the chip must take input again and have nothing more
+//   to say, the 0x88 that starts the next transaction then resets the command state of the chip
+static int8_t it8528_recover(void)
+{
+  // Declare needed variables
+  int8_t ret;
+
+  // Drain the output buffer
+  it8528_drain_output();
+
+  // Wait until the chip takes input
+  ret = it8528_wait_for_ready(IT8528_WAIT_FOR_READY_INPUT);
+  if (ret != 0)
+  {
+    fprintf(stderr, "it8528_recover: it8528_wait_for_ready() failed!\n");
+    return ret;
+  }
+
+  // Make sure the chip stopped filling the output buffer
+  if ((it8528_inb(IT8528_COMM_PORT_2) & 0x01) == 0x01)
+  {
+    fprintf(stderr, "it8528_recover: output buffer still full!\n");
+    return IT8528_ERROR_RESYNC;
+  }
+
+  return 0;
+}
+
+// Function called to read the bytes left in the output buffer until it is empty, giving up after
+//   a few bytes so that a chip stuck with its OBF bit set can't keep us here
+static void it8528_drain_output(void)
+{
+  for (u_int8_t i = 0; i < IT8528_DRAIN_MAX_BYTES &&
+    (it8528_inb(IT8528_COMM_PORT_2) & 0x01) == 0x01; i++)
+  {
+    it8528_inb(IT8528_COMM_PORT_1);
+    it8528_fault_stats.drained_bytes++;
+  }
+}
+
+// Function called to get the monotonic time in nanoseconds
+static u_int64_t it8528_get_time(void)
+{
+  // Declare needed variables
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (u_int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Function called to poll the second communication port until the bits in the passed in mask
+//   match the expected value, busy polling first and then backing off exponentially, until the
+//   timeout of the handshake or the deadline of the transaction, whichever comes first
+static int8_t it8528_poll_status(u_int8_t kind, u_int8_t mask, u_int8_t expected,
+  u_int64_t timeout)
+{
+  // Declare needed variables
+  static const int8_t timeout_errors[IT8528_HANDSHAKE_KINDS] = {
+    [IT8528_HANDSHAKE_INPUT] = IT8528_ERROR_INPUT_TIMEOUT,
+    [IT8528_HANDSHAKE_OUTPUT] = IT8528_ERROR_OUTPUT_TIMEOUT,
+    [IT8528_HANDSHAKE_BUFFER] = IT8528_ERROR_BUFFER_TIMEOUT
   };
+  const struct it8528_wait_config* config = &it8528_wait_configs[it8528_wait_mode];
+  u_int64_t start = it8528_get_time();
+  u_int64_t now = start;
+  u_int64_t end = start + timeout;
+  u_int64_t backoff = config->initial_backoff;
+  u_int32_t spin_polls = it8528_spin_polls == UINT32_MAX ? UINT32_MAX :
+    it8528_spin_polls * config->spin_scale;
+  u_int32_t polls = 0;
+  int8_t ret;
+
+  // Stop at the deadline of the transaction if it comes first
+  if (it8528_transaction_deadline != 0 && it8528_transaction_deadline < end)
+  {
+    end = it8528_transaction_deadline;
+  }
 
-  // Loop until we get the byte we are waiting for or we run out of retires
-  do {
+  // Loop until we get the byte we are waiting for or we run out of time
+  while (1)
+  {
     // Read a byte from the second communication port
-    byte = inb(IT8528_COMM_PORT_2);
+    u_int8_t byte = it8528_inb(IT8528_COMM_PORT_2);
+    polls++;
 
-    // Sleep for 50 microseconds
-    nanosleep(&ts, NULL);
+    // Check if the read byte has the bits we are waiting for
+    if ((byte & mask) == expected)
+    {
+      now = it8528_get_time();
+      ret = 0;
+      break;
+    }
 
-    // Check if the read byte has the first bit set to 1
-    if ((byte & 0x01) == 0x01)
+    // Check if we ran out of time
+    now = it8528_get_time();
+    if (now >= end)
     {
-      return 0;
+      ret = end == start + timeout ? timeout_errors[kind] : IT8528_ERROR_DEADLINE;
+      break;
+    }
+
+    // Check if we should keep busy polling
+    if (polls < spin_polls)
+    {
+      __builtin_ia32_pause();
+      continue;
+    }
+
+    // Sleep, never past the end, and double the time we'll sleep next time
+    IT8528_PROBE3(retry, kind, polls, backoff);
+    it8528_trace_retry(IT8528_TRACE_OP_HANDSHAKE + kind);
+    struct timespec ts = {
+      .tv_sec = 0,
+      .tv_nsec = backoff < end - now ? backoff : end - now
+    };
+    nanosleep(&ts, NULL);
+    backoff *= 2;
+    if (backoff > config->max_backoff)
+    {
+      backoff = config->max_backoff;
     }
   }
-  while (retries--);
 
-  return -1;
-}
\ No newline at end of file
+  // Record the handshake
+  it8528_record_handshake(kind, polls, now - start, ret);
+
+  return ret;
+}
+
+// Function called to record the polls and wall time of a handshake
+static void it8528_record_handshake(u_int8_t kind, u_int32_t polls, u_int64_t nanoseconds,
+  int8_t ret)
+{
+  // Declare needed variables
+  struct it8528_handshake_stats* stats = &it8528_handshake_stats[kind];
+
+  // Fire the probe and count the handshake against its operation
+  IT8528_PROBE4(handshake, kind, polls, nanoseconds, ret);
+  it8528_trace_record(IT8528_TRACE_OP_HANDSHAKE + kind, nanoseconds, ret);
+
+  // Update the statistics of the handshake kind
+  stats->count++;
+  stats->polls += polls;
+  stats->nanoseconds += nanoseconds;
+  if (nanoseconds > stats->max_nanoseconds)
+  {
+    stats->max_nanoseconds = nanoseconds;
+  }
+  if (ret != 0)
+  {
+    stats->timeouts++;
+  }
+
+  // Remember the last handshake
+  it8528_last_handshake.kind = kind;
+  it8528_last_handshake.polls = polls;
+  it8528_last_handshake.nanoseconds = nanoseconds;
+
+  // Remember the handshakes of the current read for the calibration
+  if (it8528_read_handshakes < IT8528_HANDSHAKES_PER_READ)
+  {
+    it8528_read_handshake_polls[it8528_read_handshakes] = polls;
+    it8528_read_handshake_nanoseconds[it8528_read_handshakes] = nanoseconds;
+    it8528_read_handshakes++;
+  }
+}
+
+// Function called to compare two unsigned 32 bit integers when sorting
+static int it8528_compare_u32(const void* a, const void* b)
+{
+  // Declare needed variables
+  u_int32_t value_a = *(const u_int32_t*)a;
+  u_int32_t value_b = *(const u_int32_t*)b;
+
+  return (value_a > value_b) - (value_a < value_b);
+}
+
+// Function called to compare two unsigned 64 bit integers when sorting
+static int it8528_compare_u64(const void* a, const void* b)
+{
+  // Declare needed variables
+  u_int64_t value_a = *(const u_int64_t*)a;
+  u_int64_t value_b = *(const u_int64_t*)b;
+
+  return (value_a > value_b) - (value_a < value_b);
+}
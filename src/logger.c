@@ -0,0 +1,996 @@
+/*
+ * Copyright (C) 2021 Stonyx
+ * http://www.stonyx.com
+ *
+ * Copyright (C) 2020 Guillaume Valadon
+ * guillaume@valadon.net
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+#include "it8528_cache.h"
+#include "it8528.h"
+#include "it8528_profile.h"
+#include "realtime.h"
+#include "logger.h"
+
+// Define constants
+#define LOGGER_MAX_VALUES (IT8528_SENSOR_COUNT + 3 * IT8528_FAN_COUNT + IT8528_POWER_SUPPLY_COUNT)
+#define LOGGER_BITMAP_SIZE ((LOGGER_MAX_VALUES + 7) / 8)
+
+// Define the record flags of the binary format
+#define LOGGER_RECORD_VALIDITY 0x01
+
+// Define the structure holding the columns of a log, the indexes are the indexes of the sensors
+//   and fans in the it8528_sensor_ids and it8528_fan_ids arrays, the values of a row are every
+//   temperature in hundredths of a degree followed by the speed, PWM, and status of every fan
+//   and by the status of every power supply
+struct logger_layout
+{
+  u_int8_t sensor_count;
+  u_int8_t sensor_ids[IT8528_SENSOR_COUNT];
+  u_int8_t sensor_indexes[IT8528_SENSOR_COUNT];
+  u_int8_t fan_count;
+  u_int8_t fan_ids[IT8528_FAN_COUNT];
+  u_int8_t fan_indexes[IT8528_FAN_COUNT];
+  u_int8_t power_supply_count;
+  u_int16_t value_count;
+};
+
+// Define the structure holding the buffered writer, the buffer holds up to flush size bytes plus
+//   one record so that a record is never split between two writes
+struct logger_writer
+{
+  int fd;
+  char* buffer;
+  size_t length;
+  size_t flush_size;
+  u_int64_t flush_interval;
+  u_int64_t last_flush;
+  struct logger_stats* stats;
+};
+
+// Define the structure holding the previous record of a binary log, every record only holds the
+//   values that changed since the previous one as deltas
+struct logger_delta
+{
+  int64_t monotonic;
+  int64_t wall;
+  int32_t values[LOGGER_MAX_VALUES];
+  u_int8_t valid[LOGGER_MAX_VALUES];
+};
+
+// Define the format names
+static const char* logger_format_names[] = { "csv", "jsonl", "binary" };
+
+// Declare the flag set by the signal handler when the logger should stop
+static volatile sig_atomic_t logger_stop = 0;
+
+// Declare functions
+static void logger_handle_signal(int signal);
+static int64_t logger_get_time(clockid_t clock);
+static void logger_get_layout(struct logger_layout* layout);
+static int8_t logger_set_layout(struct logger_layout* layout, const u_int8_t* sensor_ids,
+  u_int8_t sensor_count, const u_int8_t* fan_ids, u_int8_t fan_count,
+  u_int8_t power_supply_count);
+static void logger_flatten(const struct logger_layout* layout,
+  const struct it8528_snapshot* snapshot, int32_t* values, u_int8_t* valid);
+static void logger_unflatten(const struct logger_layout* layout, const int32_t* values,
+  const u_int8_t* valid, struct it8528_snapshot* snapshot);
+static int8_t logger_writer_open(struct logger_writer* writer, const struct logger_config* config,
+  struct logger_stats* stats);
+static int8_t logger_writer_close(struct logger_writer* writer);
+static int8_t logger_writer_flush(struct logger_writer* writer);
+static int8_t logger_writer_check(struct logger_writer* writer);
+static void logger_printf(struct logger_writer* writer, const char* format, ...);
+static void logger_put(struct logger_writer* writer, const void* data, size_t length);
+static void logger_put_varint(struct logger_writer* writer, int64_t value);
+static int8_t logger_get_varint(FILE* file, int64_t* value);
+static void logger_write_header(struct logger_writer* writer, u_int8_t format,
+  const struct logger_layout* layout, u_int64_t interval, int64_t monotonic, int64_t wall);
+static void logger_write_text(struct logger_writer* writer, u_int8_t format,
+  const struct logger_layout* layout, int64_t monotonic, const struct it8528_snapshot* snapshot);
+static void logger_write_binary(struct logger_writer* writer, const struct logger_layout* layout,
+  struct logger_delta* delta, u_int64_t interval, int64_t monotonic,
+  const struct it8528_snapshot* snapshot);
+
+// Function called to sample every sensor and fan of the model profile on a fixed interval and
+//   write every sample to the output until the count is reached or a SIGINT or a SIGTERM signal
+//   is received
+// Deadlines are absolute so that the time taken by a sample doesn't push the following ones
+//   back, a deadline whose whole interval went by before the previous sample finished is skipped
+//   and counted as missed instead of being sampled in a burst
+int8_t logger_run(const struct logger_config* config, struct logger_stats* stats)
+{
+  // Declare needed variables
+  struct logger_layout layout;
+  struct logger_writer writer;
+  static struct logger_delta delta;
+  struct it8528_snapshot snapshot;
+  int8_t ret = 0;
+
+  // Start from empty statistics
+  memset(stats, 0, sizeof(*stats));
+
+  // Open the output
+  if (logger_writer_open(&writer, config, stats) != 0)
+  {
+    fprintf(stderr, "logger_run: logger_writer_open() failed!\n");
+    return -1;
+  }
+
+  // Install the signal handlers, a closed pipe ends the run through a failed write
+  signal(SIGINT, logger_handle_signal);
+  signal(SIGTERM, logger_handle_signal);
+  signal(SIGPIPE, SIG_IGN);
+
+  // Make sure every sample reads registers no older than half the interval
+  it8528_cache_limit_age(config->interval / 2000000);
+
+  // Write the header
+  logger_get_layout(&layout);
+  int64_t deadline = logger_get_time(CLOCK_MONOTONIC);
+  memset(&delta, 0, sizeof(delta));
+  delta.monotonic = deadline;
+  delta.wall = logger_get_time(CLOCK_REALTIME);
+  logger_write_header(&writer, config->format, &layout, config->interval, delta.monotonic,
+    delta.wall);
+
+  // Loop until we are told to stop or we took enough samples
+  while (!logger_stop && (config->count == 0 || stats->samples < config->count))
+  {
+    // Wait for the deadline
+    struct timespec ts = {
+      .tv_sec = deadline / 1000000000,
+      .tv_nsec = deadline % 1000000000
+    };
+    if (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0)
+    {
+      continue;
+    }
+
+    // Take the sample and record how late we woke up
+    int64_t monotonic = logger_get_time(CLOCK_MONOTONIC);
+    u_int64_t jitter = monotonic > deadline ? monotonic - deadline : 0;
+    realtime_record_wakeup(deadline, monotonic);
+    if (it8528_get_snapshot(&snapshot) != 0)
+    {
+      stats->sample_errors++;
+    }
+    stats->samples++;
+    stats->jitter_nanoseconds += jitter;
+    stats->jitter_squares += (double)jitter * jitter;
+    if (jitter > stats->max_jitter_nanoseconds)
+    {
+      stats->max_jitter_nanoseconds = jitter;
+    }
+
+    // Write the sample
+    if (config->format == LOGGER_FORMAT_BINARY)
+    {
+      logger_write_binary(&writer, &layout, &delta, config->interval, monotonic, &snapshot);
+    }
+    else
+    {
+      logger_write_text(&writer, config->format, &layout, monotonic, &snapshot);
+    }
+    if (logger_writer_check(&writer) != 0)
+    {
+      fprintf(stderr, "logger_run: logger_writer_check() failed!\n");
+      ret = -1;
+      break;
+    }
+
+    // Move on to the next deadline, skipping the ones we missed
+    deadline += config->interval;
+    int64_t now = logger_get_time(CLOCK_MONOTONIC);
+    while (deadline + (int64_t)config->interval <= now)
+    {
+      deadline += config->interval;
+      stats->missed_deadlines++;
+    }
+  }
+
+  // Remove the age limit
+  it8528_cache_limit_age(IT8528_CACHE_DEFAULT_MAX_AGE);
+
+  // Write what is left and close the output
+  if (logger_writer_close(&writer) != 0)
+  {
+    fprintf(stderr, "logger_run: logger_writer_close() failed!\n");
+    ret = -1;
+  }
+
+  return ret;
+}
+
+// Function called to convert a binary log back to text in the configured format
+int8_t logger_decode(const char* input_path, const struct logger_config* config,
+  struct logger_stats* stats)
+{
+  // Declare needed variables
+  struct logger_binary_header header;
+  struct logger_layout layout;
+  struct logger_writer writer;
+  struct it8528_snapshot snapshot;
+  static int32_t values[LOGGER_MAX_VALUES];
+  static u_int8_t valid[LOGGER_MAX_VALUES];
+  u_int8_t sensor_ids[IT8528_SENSOR_COUNT];
+  u_int8_t fan_ids[IT8528_FAN_COUNT];
+  u_int8_t bitmap[LOGGER_BITMAP_SIZE];
+  int8_t ret = 0;
+  FILE* file;
+
+  // Make sure the format is a text one
+  if (config->format == LOGGER_FORMAT_BINARY)
+  {
+    fprintf(stderr, "logger_decode: binary logs can only be decoded to text!\n");
+    return -1;
+  }
+
+  // Open the log
+  file = fopen(input_path, "rb");
+  if (file == NULL)
+  {
+    fprintf(stderr, "logger_decode: fopen() failed!\n");
+    return -1;
+  }
+
+  // Read the header and the IDs of the columns
+  if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != LOGGER_BINARY_MAGIC ||
+      header.version != LOGGER_BINARY_VERSION || header.sensor_count > IT8528_SENSOR_COUNT ||
+      header.fan_count > IT8528_FAN_COUNT ||
+      header.power_supply_count > IT8528_POWER_SUPPLY_COUNT ||
+      fread(sensor_ids, 1, header.sensor_count, file) != header.sensor_count ||
+      fread(fan_ids, 1, header.fan_count, file) != header.fan_count ||
+      logger_set_layout(&layout, sensor_ids, header.sensor_count, fan_ids, header.fan_count,
+      header.power_supply_count) != 0)
+  {
+    fprintf(stderr, "logger_decode: invalid binary log!\n");
+    fclose(file);
+    return -1;
+  }
+
+  // Open the output
+  memset(stats, 0, sizeof(*stats));
+  if (logger_writer_open(&writer, config, stats) != 0)
+  {
+    fprintf(stderr, "logger_decode: logger_writer_open() failed!\n");
+    fclose(file);
+    return -1;
+  }
+  logger_write_header(&writer, config->format, &layout, header.interval,
+    header.start_monotonic, header.start_wall);
+
+  // Loop through the records, a truncated last record left by a crash is ignored
+  int64_t monotonic = header.start_monotonic;
+  int64_t wall = header.start_wall;
+  size_t bitmap_size = (layout.value_count + 7) / 8;
+  memset(values, 0, sizeof(values));
+  memset(valid, 0, sizeof(valid));
+  int flags;
+  while ((flags = getc(file)) != EOF)
+  {
+    // Declare needed variables
+    int64_t monotonic_delta;
+    int64_t wall_delta;
+
+    // Read the timestamps
+    if (logger_get_varint(file, &monotonic_delta) != 0 ||
+        logger_get_varint(file, &wall_delta) != 0)
+    {
+      break;
+    }
+    monotonic_delta += header.interval;
+    monotonic += monotonic_delta;
+    wall += monotonic_delta + wall_delta;
+
+    // Read the validity of the values if it changed
+    if (flags & LOGGER_RECORD_VALIDITY)
+    {
+      if (fread(bitmap, 1, bitmap_size, file) != bitmap_size)
+      {
+        break;
+      }
+      for (u_int16_t i = 0; i < layout.value_count; i++)
+      {
+        valid[i] = (bitmap[i / 8] >> (i % 8)) & 1;
+      }
+    }
+
+    // Read the values that changed
+    if (fread(bitmap, 1, bitmap_size, file) != bitmap_size)
+    {
+      break;
+    }
+    u_int16_t i;
+    for (i = 0; i < layout.value_count; i++)
+    {
+      int64_t value_delta;
+      if (((bitmap[i / 8] >> (i % 8)) & 1) == 0)
+      {
+        continue;
+      }
+      if (logger_get_varint(file, &value_delta) != 0)
+      {
+        break;
+      }
+      values[i] += value_delta;
+    }
+    if (i < layout.value_count)
+    {
+      break;
+    }
+
+    // Write the sample
+    logger_unflatten(&layout, values, valid, &snapshot);
+    snapshot.time.tv_sec = wall / 1000000000;
+    snapshot.time.tv_nsec = wall % 1000000000;
+    logger_write_text(&writer, config->format, &layout, monotonic, &snapshot);
+    stats->samples++;
+    if (logger_writer_check(&writer) != 0)
+    {
+      fprintf(stderr, "logger_decode: logger_writer_check() failed!\n");
+      ret = -1;
+      break;
+    }
+  }
+
+  fclose(file);
+
+  // Write what is left and close the output
+  if (logger_writer_close(&writer) != 0)
+  {
+    fprintf(stderr, "logger_decode: logger_writer_close() failed!\n");
+    ret = -1;
+  }
+
+  return ret;
+}
+
+// Function called to convert an interval like 250ms, 2s, 500us, or 100000ns to nanoseconds, a
+//   number without a unit is in milliseconds and the interval is at most a day
+int8_t logger_parse_interval(const char* text, u_int64_t* interval)
+{
+  // Declare needed variables
+  char* end;
+  u_int64_t multiplier;
+  unsigned long long value;
+
+  // Make sure there is a positive number that strtoull didn't have to cut short
+  errno = 0;
+  value = strtoull(text, &end, 10);
+  if (end == text || value == 0 || errno == ERANGE || strchr(text, '-') != NULL)
+  {
+    return -1;
+  }
+
+  // Get the number of nanoseconds in the unit
+  if (strcmp(end, "ns") == 0)
+  {
+    multiplier = 1;
+  }
+  else if (strcmp(end, "us") == 0)
+  {
+    multiplier = 1000;
+  }
+  else if (strcmp(end, "ms") == 0 || *end == '\0')
+  {
+    multiplier = 1000000;
+  }
+  else if (strcmp(end, "s") == 0)
+  {
+    multiplier = 1000000000;
+  }
+  else
+  {
+    return -1;
+  }
+
+  // Convert the number to nanoseconds unless it would overflow or go past LOGGER_MAX_INTERVAL,
+  //   which keeps the deadlines and the cache age limit derived from it in range
+  if (value > UINT64_MAX / multiplier || value * multiplier > LOGGER_MAX_INTERVAL)
+  {
+    return -1;
+  }
+  *interval = value * multiplier;
+
+  return 0;
+}
+
+// Function called to convert a format name to a format
+int8_t logger_parse_format(const char* name, u_int8_t* format)
+{
+  for (u_int8_t i = 0; i < sizeof(logger_format_names) / sizeof(logger_format_names[0]); i++)
+  {
+    if (strcmp(name, logger_format_names[i]) == 0)
+    {
+      *format = i;
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+// Function called to print the statistics of a logging run
+void logger_print_stats(const struct logger_stats* stats, FILE* stream)
+{
+  // Declare needed variables
+  double mean = 0;
+  double deviation = 0;
+
+  // Calculate the mean and the standard deviation of the jitter
+  if (stats->samples > 0)
+  {
+    mean = (double)stats->jitter_nanoseconds / stats->samples;
+    deviation = sqrt(fmax(stats->jitter_squares / stats->samples - mean * mean, 0));
+  }
+
+  fprintf(stream, "samples %llu\n", (unsigned long long)stats->samples);
+  fprintf(stream, "missed_deadlines %llu\n", (unsigned long long)stats->missed_deadlines);
+  fprintf(stream, "sample_errors %llu\n", (unsigned long long)stats->sample_errors);
+  fprintf(stream, "jitter_mean_ns %.0f\n", mean);
+  fprintf(stream, "jitter_stddev_ns %.0f\n", deviation);
+  fprintf(stream, "jitter_max_ns %llu\n", (unsigned long long)stats->max_jitter_nanoseconds);
+  fprintf(stream, "flushes %llu\n", (unsigned long long)stats->flushes);
+  fprintf(stream, "bytes_written %llu\n", (unsigned long long)stats->bytes);
+}
+
+// Function called when the logger receives a SIGINT or a SIGTERM signal
+static void logger_handle_signal(int signal)
+{
+  logger_stop = 1;
+}
+
+// Function called to get the time of a clock in nanoseconds
+static int64_t logger_get_time(clockid_t clock)
+{
+  // Declare needed variables
+  struct timespec ts;
+
+  clock_gettime(clock, &ts);
+
+  return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Function called to get the columns of the sensors, fans, and power supplies of the model
+//   profile
+static void logger_get_layout(struct logger_layout* layout)
+{
+  // Declare needed variables
+  const struct it8528_profile* profile = it8528_profile_get();
+  u_int8_t sensor_ids[IT8528_SENSOR_COUNT];
+  u_int8_t sensor_count = 0;
+  u_int8_t fan_ids[IT8528_FAN_COUNT];
+  u_int8_t fan_count = 0;
+
+  // Collect the IDs of the present sensors and fans
+  for (u_int8_t i = 0; i < IT8528_SENSOR_COUNT; i++)
+  {
+    if (profile->sensor_present[i])
+    {
+      sensor_ids[sensor_count++] = it8528_sensor_ids[i];
+    }
+  }
+  for (u_int8_t i = 0; i < IT8528_FAN_COUNT; i++)
+  {
+    if (profile->fan_present[i])
+    {
+      fan_ids[fan_count++] = it8528_fan_ids[i];
+    }
+  }
+
+  logger_set_layout(layout, sensor_ids, sensor_count, fan_ids, fan_count,
+    profile->plan.power_supply_index >= 0 ? IT8528_POWER_SUPPLY_COUNT : 0);
+}
+
+// Function called to set the columns of a log from the sensor and fan IDs
+static int8_t logger_set_layout(struct logger_layout* layout, const u_int8_t* sensor_ids,
+  u_int8_t sensor_count, const u_int8_t* fan_ids, u_int8_t fan_count,
+  u_int8_t power_supply_count)
+{
+  // Find the index of every sensor
+  memset(layout, 0, sizeof(*layout));
+  for (u_int8_t i = 0; i < sensor_count; i++)
+  {
+    u_int8_t j;
+    for (j = 0; j < IT8528_SENSOR_COUNT && it8528_sensor_ids[j] != sensor_ids[i]; j++);
+    if (j == IT8528_SENSOR_COUNT)
+    {
+      return -1;
+    }
+    layout->sensor_ids[i] = sensor_ids[i];
+    layout->sensor_indexes[i] = j;
+  }
+
+  // Find the index of every fan
+  for (u_int8_t i = 0; i < fan_count; i++)
+  {
+    u_int8_t j;
+    for (j = 0; j < IT8528_FAN_COUNT && it8528_fan_ids[j] != fan_ids[i]; j++);
+    if (j == IT8528_FAN_COUNT)
+    {
+      return -1;
+    }
+    layout->fan_ids[i] = fan_ids[i];
+    layout->fan_indexes[i] = j;
+  }
+
+  layout->sensor_count = sensor_count;
+  layout->fan_count = fan_count;
+  layout->power_supply_count = power_supply_count;
+  layout->value_count = sensor_count + 3 * fan_count + power_supply_count;
+
+  return 0;
+}
+
+// Function called to convert a snapshot to the values of a row
+static void logger_flatten(const struct logger_layout* layout,
+  const struct it8528_snapshot* snapshot, int32_t* values, u_int8_t* valid)
+{
+  // Declare needed variables
+  u_int16_t count = 0;
+
+  // Convert the temperatures to hundredths of a degree
+  for (u_int8_t i = 0; i < layout->sensor_count; i++)
+  {
+    u_int8_t index = layout->sensor_indexes[i];
+    valid[count] = snapshot->temperature_valid[index];
+    values[count] = valid[count] ? lround(snapshot->temperatures[index] * 100) : 0;
+    count++;
+  }
+
+  // Copy the fan speeds, PWMs, and statuses
+  for (u_int8_t i = 0; i < layout->fan_count; i++)
+  {
+    u_int8_t index = layout->fan_indexes[i];
+    u_int8_t fan_valid = snapshot->fan_valid[index];
+    valid[count] = fan_valid;
+    values[count++] = fan_valid ? snapshot->fan_speeds[index] : 0;
+    valid[count] = fan_valid;
+    values[count++] = fan_valid ? snapshot->fan_pwms[index] : 0;
+    valid[count] = fan_valid;
+    values[count++] = fan_valid ? snapshot->fan_statuses[index] : 0;
+  }
+
+  // Copy the power supply statuses
+  for (u_int8_t i = 0; i < layout->power_supply_count; i++)
+  {
+    valid[count] = snapshot->power_supply_valid[i];
+    values[count] = valid[count] ? snapshot->power_supply_statuses[i] : 0;
+    count++;
+  }
+}
+
+// Function called to convert the values of a row back to a snapshot
+static void logger_unflatten(const struct logger_layout* layout, const int32_t* values,
+  const u_int8_t* valid, struct it8528_snapshot* snapshot)
+{
+  // Declare needed variables
+  u_int16_t count = 0;
+
+  // Convert the temperatures back to degrees
+  memset(snapshot, 0, sizeof(*snapshot));
+  for (u_int8_t i = 0; i < layout->sensor_count; i++)
+  {
+    u_int8_t index = layout->sensor_indexes[i];
+    snapshot->temperature_valid[index] = valid[count];
+    snapshot->temperatures[index] = values[count++] / 100.0;
+  }
+
+  // Copy the fan speeds, PWMs, and statuses
+  for (u_int8_t i = 0; i < layout->fan_count; i++)
+  {
+    u_int8_t index = layout->fan_indexes[i];
+    snapshot->fan_valid[index] = valid[count];
+    snapshot->fan_speeds[index] = values[count++];
+    snapshot->fan_pwms[index] = values[count++];
+    snapshot->fan_statuses[index] = values[count++];
+  }
+
+  // Copy the power supply statuses
+  for (u_int8_t i = 0; i < layout->power_supply_count; i++)
+  {
+    snapshot->power_supply_valid[i] = valid[count];
+    snapshot->power_supply_statuses[i] = values[count++];
+  }
+}
+
+// Function called to open the output of a logging run, standard output if there is no path or
+//   the path is -
+static int8_t logger_writer_open(struct logger_writer* writer, const struct logger_config* config,
+  struct logger_stats* stats)
+{
+  // Open the output
+  memset(writer, 0, sizeof(*writer));
+  if (config->output_path == NULL || strcmp(config->output_path, "-") == 0)
+  {
+    writer->fd = STDOUT_FILENO;
+  }
+  else
+  {
+    writer->fd = open(config->output_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (writer->fd < 0)
+    {
+      fprintf(stderr, "logger_writer_open: open() failed!\n");
+      return -1;
+    }
+  }
+
+  // Allocate the buffer
+  writer->buffer = malloc(config->flush_size + LOGGER_MAX_RECORD);
+  if (writer->buffer == NULL)
+  {
+    fprintf(stderr, "logger_writer_open: malloc() failed!\n");
+    if (writer->fd != STDOUT_FILENO)
+    {
+      close(writer->fd);
+    }
+    return -1;
+  }
+
+  writer->flush_size = config->flush_size;
+  writer->flush_interval = (u_int64_t)config->flush_interval * 1000000;
+  writer->last_flush = logger_get_time(CLOCK_MONOTONIC);
+  writer->stats = stats;
+
+  return 0;
+}
+
+// Function called to write what is left in the buffer and close the output
+static int8_t logger_writer_close(struct logger_writer* writer)
+{
+  // Declare needed variables
+  int8_t ret = logger_writer_flush(writer);
+
+  // Close the output
+  if (writer->fd != STDOUT_FILENO && close(writer->fd) != 0)
+  {
+    ret = -1;
+  }
+  free(writer->buffer);
+  writer->buffer = NULL;
+
+  return ret;
+}
+
+// Function called to write the buffer to the output
+static int8_t logger_writer_flush(struct logger_writer* writer)
+{
+  // Declare needed variables
+  size_t written = 0;
+
+  // Write the whole buffer, retrying partial writes
+  while (written < writer->length)
+  {
+    ssize_t length = write(writer->fd, writer->buffer + written, writer->length - written);
+    if (length < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      writer->length = 0;
+      return -1;
+    }
+    written += length;
+  }
+
+  // Update the statistics
+  if (written > 0)
+  {
+    writer->stats->flushes++;
+    writer->stats->bytes += written;
+  }
+  writer->length = 0;
+  writer->last_flush = logger_get_time(CLOCK_MONOTONIC);
+
+  return 0;
+}
+
+// Function called after every record to flush the buffer once it holds flush size bytes or its
+//   oldest record is older than the flush interval
+static int8_t logger_writer_check(struct logger_writer* writer)
+{
+  if (writer->length >= writer->flush_size ||
+      logger_get_time(CLOCK_MONOTONIC) - writer->last_flush >= writer->flush_interval)
+  {
+    return logger_writer_flush(writer);
+  }
+
+  return 0;
+}
+
+// Function called to print text to the buffer, a record never exceeds LOGGER_MAX_RECORD bytes
+static void logger_printf(struct logger_writer* writer, const char* format, ...)
+{
+  // Declare needed variables
+  va_list arguments;
+  size_t room = writer->flush_size + LOGGER_MAX_RECORD - writer->length;
+
+  // Print the text, truncating it if there is no room left
+  va_start(arguments, format);
+  int length = vsnprintf(writer->buffer + writer->length, room, format, arguments);
+  va_end(arguments);
+  if (length > 0)
+  {
+    writer->length += (size_t)length < room ? (size_t)length : room - 1;
+  }
+}
+
+// Function called to put bytes in the buffer
+static void logger_put(struct logger_writer* writer, const void* data, size_t length)
+{
+  // Declare needed variables
+  size_t room = writer->flush_size + LOGGER_MAX_RECORD - writer->length;
+
+  // Copy the bytes, truncating them if there is no room left
+  if (length > room)
+  {
+    length = room;
+  }
+  memcpy(writer->buffer + writer->length, data, length);
+  writer->length += length;
+}
+
+// Function called to put a signed value in the buffer as a zigzag encoded varint so that small
+//   deltas of either sign take a single byte
+static void logger_put_varint(struct logger_writer* writer, int64_t value)
+{
+  // Declare needed variables
+  u_int64_t zigzag = ((u_int64_t)value << 1) ^ (u_int64_t)(value >> 63);
+  u_int8_t bytes[10];
+  u_int8_t count = 0;
+
+  // Encode 7 bits per byte with the high bit set on every byte but the last
+  while (zigzag >= 0x80)
+  {
+    bytes[count++] = (zigzag & 0x7F) | 0x80;
+    zigzag >>= 7;
+  }
+  bytes[count++] = zigzag;
+
+  logger_put(writer, bytes, count);
+}
+
+// Function called to read a zigzag encoded varint from a file
+static int8_t logger_get_varint(FILE* file, int64_t* value)
+{
+  // Declare needed variables
+  u_int64_t zigzag = 0;
+  int byte;
+
+  // Decode 7 bits per byte until a byte without the high bit
+  for (u_int8_t shift = 0; shift < 64; shift += 7)
+  {
+    byte = getc(file);
+    if (byte == EOF)
+    {
+      return -1;
+    }
+    zigzag |= (u_int64_t)(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0)
+    {
+      *value = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+// Function called to write the header of a log, the column names for CSV, nothing for JSONL,
+//   and the header structure followed by the column IDs for the binary format
+static void logger_write_header(struct logger_writer* writer, u_int8_t format,
+  const struct logger_layout* layout, u_int64_t interval, int64_t monotonic, int64_t wall)
+{
+  // Check which format is used
+  if (format == LOGGER_FORMAT_CSV)
+  {
+    logger_printf(writer, "monotonic_ns,wall_ns");
+    for (u_int8_t i = 0; i < layout->sensor_count; i++)
+    {
+      logger_printf(writer, ",temperature_%u", layout->sensor_ids[i]);
+    }
+    for (u_int8_t i = 0; i < layout->fan_count; i++)
+    {
+      logger_printf(writer, ",fan_%u_rpm,fan_%u_pwm,fan_%u_status", layout->fan_ids[i],
+        layout->fan_ids[i], layout->fan_ids[i]);
+    }
+    for (u_int8_t i = 0; i < layout->power_supply_count; i++)
+    {
+      logger_printf(writer, ",power_supply_%u", i + 1);
+    }
+    logger_printf(writer, "\n");
+  }
+  else if (format == LOGGER_FORMAT_BINARY)
+  {
+    struct logger_binary_header header = {
+      .magic = LOGGER_BINARY_MAGIC,
+      .version = LOGGER_BINARY_VERSION,
+      .sensor_count = layout->sensor_count,
+      .fan_count = layout->fan_count,
+      .power_supply_count = layout->power_supply_count,
+      .interval = interval,
+      .start_monotonic = monotonic,
+      .start_wall = wall
+    };
+    logger_put(writer, &header, sizeof(header));
+    logger_put(writer, layout->sensor_ids, layout->sensor_count);
+    logger_put(writer, layout->fan_ids, layout->fan_count);
+  }
+}
+
+// Function called to write a sample as a CSV row or a JSON line, values that couldn't be read
+//   are left empty or null
+static void logger_write_text(struct logger_writer* writer, u_int8_t format,
+  const struct logger_layout* layout, int64_t monotonic, const struct it8528_snapshot* snapshot)
+{
+  // Declare needed variables
+  int64_t wall = (int64_t)snapshot->time.tv_sec * 1000000000 + snapshot->time.tv_nsec;
+
+  // Check which format is used
+  if (format == LOGGER_FORMAT_CSV)
+  {
+    logger_printf(writer, "%lld,%lld", (long long)monotonic, (long long)wall);
+    for (u_int8_t i = 0; i < layout->sensor_count; i++)
+    {
+      u_int8_t index = layout->sensor_indexes[i];
+      if (snapshot->temperature_valid[index])
+      {
+        logger_printf(writer, ",%.2f", snapshot->temperatures[index]);
+      }
+      else
+      {
+        logger_printf(writer, ",");
+      }
+    }
+    for (u_int8_t i = 0; i < layout->fan_count; i++)
+    {
+      u_int8_t index = layout->fan_indexes[i];
+      if (snapshot->fan_valid[index])
+      {
+        logger_printf(writer, ",%u,%u,%u", snapshot->fan_speeds[index],
+          snapshot->fan_pwms[index], snapshot->fan_statuses[index]);
+      }
+      else
+      {
+        logger_printf(writer, ",,,");
+      }
+    }
+    for (u_int8_t i = 0; i < layout->power_supply_count; i++)
+    {
+      if (snapshot->power_supply_valid[i])
+      {
+        logger_printf(writer, ",%u", snapshot->power_supply_statuses[i]);
+      }
+      else
+      {
+        logger_printf(writer, ",");
+      }
+    }
+    logger_printf(writer, "\n");
+  }
+  else
+  {
+    logger_printf(writer, "{\"monotonic_ns\":%lld,\"wall_ns\":%lld,\"temperatures\":{",
+      (long long)monotonic, (long long)wall);
+    for (u_int8_t i = 0; i < layout->sensor_count; i++)
+    {
+      u_int8_t index = layout->sensor_indexes[i];
+      logger_printf(writer, "%s\"%u\":", i > 0 ? "," : "", layout->sensor_ids[i]);
+      if (snapshot->temperature_valid[index])
+      {
+        logger_printf(writer, "%.2f", snapshot->temperatures[index]);
+      }
+      else
+      {
+        logger_printf(writer, "null");
+      }
+    }
+    logger_printf(writer, "},\"fans\":{");
+    for (u_int8_t i = 0; i < layout->fan_count; i++)
+    {
+      u_int8_t index = layout->fan_indexes[i];
+      logger_printf(writer, "%s\"%u\":", i > 0 ? "," : "", layout->fan_ids[i]);
+      if (snapshot->fan_valid[index])
+      {
+        logger_printf(writer, "{\"rpm\":%u,\"pwm\":%u,\"status\":%u}",
+          snapshot->fan_speeds[index], snapshot->fan_pwms[index], snapshot->fan_statuses[index]);
+      }
+      else
+      {
+        logger_printf(writer, "null");
+      }
+    }
+    logger_printf(writer, "},\"power_supplies\":{");
+    for (u_int8_t i = 0; i < layout->power_supply_count; i++)
+    {
+      logger_printf(writer, "%s\"%u\":", i > 0 ? "," : "", i + 1);
+      if (snapshot->power_supply_valid[i])
+      {
+        logger_printf(writer, "%u", snapshot->power_supply_statuses[i]);
+      }
+      else
+      {
+        logger_printf(writer, "null");
+      }
+    }
+    logger_printf(writer, "}}\n");
+  }
+}
+
+// Function called to write a sample as a binary record which is made of
+//   - a flags byte, with LOGGER_RECORD_VALIDITY set when the validity bitmap is present
+//   - the monotonic time since the previous record minus the interval as a varint
+//   - the wall time since the previous record minus the monotonic one as a varint
+//   - a bitmap of the valid values if their validity changed since the previous record
+//   - a bitmap of the valid values that changed since the previous record
+//   - the delta of every changed value as a varint
+// Readings rarely change from one sample to the next so a record is mostly its two bitmaps
+static void logger_write_binary(struct logger_writer* writer, const struct logger_layout* layout,
+  struct logger_delta* delta, u_int64_t interval, int64_t monotonic,
+  const struct it8528_snapshot* snapshot)
+{
+  // Declare needed variables
+  int32_t values[LOGGER_MAX_VALUES];
+  u_int8_t valid[LOGGER_MAX_VALUES];
+  u_int8_t validity[LOGGER_BITMAP_SIZE];
+  u_int8_t changes[LOGGER_BITMAP_SIZE];
+  size_t bitmap_size = (layout->value_count + 7) / 8;
+  int64_t wall = (int64_t)snapshot->time.tv_sec * 1000000000 + snapshot->time.tv_nsec;
+  u_int8_t flags = 0;
+
+  // Build the bitmaps
+  logger_flatten(layout, snapshot, values, valid);
+  memset(validity, 0, sizeof(validity));
+  memset(changes, 0, sizeof(changes));
+  for (u_int16_t i = 0; i < layout->value_count; i++)
+  {
+    validity[i / 8] |= valid[i] << (i % 8);
+    if (valid[i] != delta->valid[i])
+    {
+      flags |= LOGGER_RECORD_VALIDITY;
+    }
+    if (valid[i] && values[i] != delta->values[i])
+    {
+      changes[i / 8] |= 1 << (i % 8);
+    }
+  }
+
+  // Write the flags and the timestamps
+  logger_put(writer, &flags, 1);
+  logger_put_varint(writer, monotonic - delta->monotonic - (int64_t)interval);
+  logger_put_varint(writer, (wall - delta->wall) - (monotonic - delta->monotonic));
+
+  // Write the bitmaps
+  if (flags & LOGGER_RECORD_VALIDITY)
+  {
+    logger_put(writer, validity, bitmap_size);
+  }
+  logger_put(writer, changes, bitmap_size);
+
+  // Write the deltas of the changed values
+  for (u_int16_t i = 0; i < layout->value_count; i++)
+  {
+    if (valid[i] && values[i] != delta->values[i])
+    {
+      logger_put_varint(writer, (int64_t)values[i] - delta->values[i]);
+      delta->values[i] = values[i];
+    }
+    delta->valid[i] = valid[i];
+  }
+  delta->monotonic = monotonic;
+  delta->wall = wall;
+}
@@ -9,9 +9,8 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include <cap-ng.h>
-#include <sys/io.h>
-#include "it8528_utils.h"
+#include <sys/types.h>
+#include "daemon.h"
 #include "commands.h"
 
 // Declare functions
@@ -28,131 +27,107 @@ int main(int argc, char** argv)
     exit(EXIT_FAILURE);
   }
 
-  // Check if we don't have the CAP_SYS_RAW_IO capability and are not running as root
-  if (capng_have_capability(CAPNG_EFFECTIVE, CAP_SYS_RAWIO) == 0 &&
-     (getuid() != 0 || geteuid() != 0))
+  // Check if the arguments are a list of commands that can run one after the other, such as
+  //   temp1 temp2 fan1 fan3=60, which includes a single tempN or fanN command
+  if (is_command_list(argc - 1, argv + 1))
   {
-    fprintf(stderr, "PanQ must have the CAP_SYS_RAWIO capability, or be launched as root!\n");
-    exit(EXIT_FAILURE);
+    exit(run_commands(argc - 1, argv + 1, 0) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
   }
 
-  // Get permission to access the various IT8528 chip ports
-  if (ioperm(IT8528_ID_PORT_1, 1, 1) != 0)
+  // Call the correct command
+  if (strcmp("analyze", argv[1]) == 0)
   {
-    fprintf(stderr, "main: ioperm(IT8528_ID_PORT_1) failed!\n");
-    exit(EXIT_FAILURE);
+    analyze_command(argc - 1, argv + 1);
   }
-  if (ioperm(IT8528_ID_PORT_2, 1, 1) != 0)
+  else if (strcmp("batch", argv[1]) == 0)
   {
-    fprintf(stderr, "main: ioperm(IT8528_ID_PORT_2) failed!\n");
-    exit(EXIT_FAILURE);
+    batch_command();
   }
-  if (ioperm(IT8528_COMM_PORT_1, 1, 1) != 0)
+  else if (strcmp("bench", argv[1]) == 0)
   {
-    fprintf(stderr, "main: ioperm(IT8528_COMM_PORT_1) failed!\n");
-    exit(EXIT_FAILURE);
+    bench_command(argc - 1, argv + 1);
   }
-  if (ioperm(IT8528_COMM_PORT_2, 1, 1) != 0)
+  else if (strcmp("bench-fault", argv[1]) == 0)
   {
-    fprintf(stderr, "main: ioperm(IT8528_COMM_PORT_2) failed!\n");
-    exit(EXIT_FAILURE);
+    bench_fault_command();
   }
-
-  // Check if the IT8528 chip is not present
-  if (it8528_check_if_present() != 0)
+  else if (strcmp("bench-lock", argv[1]) == 0)
   {
-    fprintf(stderr, "IT8528 chip not found");
-    exit(EXIT_FAILURE);
+    bench_lock_command();
   }
-
-  // Call the correct command
-  if (strcmp("check", argv[1]) == 0)
+  else if (strcmp("bench-shm", argv[1]) == 0)
+  {
+    bench_shm_command(argc == 2 ? NULL : argv[2]);
+  }
+  else if (strcmp("bench-trace", argv[1]) == 0)
+  {
+    bench_trace_command(argc == 2 ? NULL : argv[2]);
+  }
+  else if (strcmp("bench-transport", argv[1]) == 0)
+  {
+    bench_transport_command();
+  }
+  else if (strcmp("calibrate", argv[1]) == 0)
+  {
+    calibrate_command();
+  }
+  else if (strcmp("check", argv[1]) == 0)
   {
     check_command();
   }
-  else if (strcmp("fan1", argv[1]) == 0)
+  else if (strcmp("daemon", argv[1]) == 0)
   {
-    // Check if there is no speed argument
     if (argc == 2)
     {
-      // Call the fan command function with the correct fan ID based on the fan related switch
-      //   statements in the it8528.c file
-      fan_command(5, NULL);
+      daemon_command(NULL);
     }
     else
     {
-      // Convert argument 2 to an integer
-      u_int8_t speed = strtoul(argv[2], NULL, 10);
-
-      // Call the fan command function with the correct fan ID based on the fan related switch
-      //   statements in the it8528.c file
-      fan_command(5, &speed);
+      daemon_command(argv[2]);
     }
   }
-  else if (strcmp("fan2", argv[1]) == 0)
+  else if (strcmp("discover", argv[1]) == 0)
   {
-    // Check if there is no speed argument
-    if (argc == 2)
-    {
-      // Call the fan command function with the correct fan ID based on the fan related switch
-      //   statements in the it8528.c file
-      fan_command(7, NULL);
-    }
-    else
-    {
-      // Convert argument 2 to an integer
-      u_int8_t speed = strtoul(argv[2], NULL, 10);
-
-      // Call the fan command function with the correct fan ID based on the fan related switch
-      //   statements in the it8528.c file
-      fan_command(7, &speed);
-    }
+    discover_command(argc - 1, argv + 1);
   }
-  else if (strcmp("fan3", argv[1]) == 0)
+  else if (strcmp("exporter", argv[1]) == 0)
   {
-    // Check if there is no speed argument
-    if (argc == 2)
-    {
-      // Call the fan command function with the correct fan ID based on the fan related switch
-      //   statements in the it8528.c file
-      fan_command(25, NULL);
-    }
-    else
-    {
-      // Convert argument 2 to an integer
-      u_int8_t speed = strtoul(argv[2], NULL, 10);
-
-      // Call the fan command function with the correct fan ID based on the fan related switch
-      //   statements in the it8528.c file
-      fan_command(25, &speed);
-    }
+    exporter_command(argc - 1, argv + 1);
   }
-  else if (strcmp("fan4", argv[1]) == 0)
+  else if (strcmp("fan-control", argv[1]) == 0)
   {
-    // Check if there is no speed argument
-    if (argc == 2)
-    {
-      // Call the fan command function with the correct fan ID based on the fan related switch
-      //   statements in the it8528.c file
-      fan_command(35, NULL);
-    }
-    else
+    fan_control_command(argc - 1, argv + 1);
+  }
+  else if (strcmp("fans", argv[1]) == 0)
+  {
+    if (fans_command(argc - 1, argv + 1) != 0)
     {
-      // Convert argument 2 to an integer
-      u_int8_t speed = strtoul(argv[2], NULL, 10);
-
-      // Call the fan command function with the correct fan ID based on the fan related switch
-      //   statements in the it8528.c file
-      fan_command(35, &speed);
+      exit(EXIT_FAILURE);
     }
   }
   else if (strcmp("help", argv[1]) == 0)
   {
     usage();
   }
+  else if (strcmp("history", argv[1]) == 0)
+  {
+    history_command(argc - 1, argv + 1);
+  }
   else if (strcmp("log", argv[1]) == 0)
   {
-    log_command();
+    log_command(argc - 1, argv + 1);
+  }
+  else if (strcmp("profile", argv[1]) == 0)
+  {
+    profile_command();
+  }
+  else if (strcmp("shm-read", argv[1]) == 0)
+  {
+    shm_read_command();
+  }
+  else if (strcmp("stats", argv[1]) == 0)
+  {
+    stats_command(argc - 1, argv + 1);
   }
   else if (strcmp("test", argv[1]) == 0)
   {
@@ -165,36 +140,6 @@ int main(int argc, char** argv)
       test_command(argv[2]);
     }
   }
-  else if (strcmp("temp1", argv[1]) == 0)
-  {
-    // Call the temperature command function with the correct sensor ID based on the switch
-    //   statement in the it8528_get_temperature function in the it8528.c file
-    temperature_command(1);
-  }
-  else if (strcmp("temp2", argv[1]) == 0)
-  {
-    // Call the temperature command function with the correct sensor ID based on the switch
-    //   statement in the it8528_get_temperature function in the it8528.c file
-    temperature_command(7);
-  }
-  else if (strcmp("temp3", argv[1]) == 0)
-  {
-    // Call the temperature command function with the correct sensor ID based on the switch
-    //   statement in the it8528_get_temperature function in the it8528.c file
-    temperature_command(10);
-  }
-  else if (strcmp("temp4", argv[1]) == 0)
-  {
-    // Call the temperature command function with the correct sensor ID based on the switch
-    //   statement in the it8528_get_temperature function in the it8528.c file
-    temperature_command(11);
-  }
-  else if (strcmp("temp5", argv[1]) == 0)
-  {
-    // Call the temperature command function with the correct sensor ID based on the switch
-    //   statement in the it8528_get_temperature function in the it8528.c file
-    temperature_command(38);
-  }
   else
   {
     usage();
@@ -209,20 +154,32 @@ void usage(void)
   // Print the usage information
   printf("Control the I8528 Super I/O controller chip on QNAP NAS units\n\n");
   printf("Usage: panq { COMMAND | help }\n");
+  printf("       panq { tempN | fanN[=speed_percentage] | fans N=speed... | log }...\n");
   printf("\n");
   printf("Available commands:\n");
+  printf("  analyze [options] logs  - summarize logs written by the log command per window\n");
+  printf("  batch                   - run the commands read from standard input, one reply each\n");
+  printf("  bench [options]         - benchmark the protocol against an emulated chip\n");
+  printf("  bench-fault             - benchmark the reads from a wedged emulated chip\n");
+  printf("  bench-lock              - check that a killed lock waiter holds nobody back\n");
+  printf("  bench-shm [readers]     - benchmark shared memory reads with up to readers threads\n");
+  printf("  bench-trace [count]     - benchmark the overhead of the transaction counters\n");
+  printf("  bench-transport         - benchmark every port I/O transport\n");
+  printf("  calibrate               - calibrate and show the handshake wait\n");
   printf("  check                   - detect the Super I/O controller\n");
-  printf("  fan1 [speed_percentage] - get or set the fan #1 speed\n");
-  printf("  fan2 [speed_percentage] - get or set the fan #2 speed\n");
-  printf("  fan3 [speed_percentage] - get or set the fan #3 speed\n");
-  printf("  fan4 [speed_percentage] - get or set the fan #4 speed\n");
+  printf("  daemon [socket_path]    - sample all sensors and serve them over a Unix socket\n");
+  printf("  discover [options]      - find the sensors and fans that are wired up\n");
+  printf("  exporter [options]      - serve the metrics of all sensors to Prometheus over HTTP\n");
+  printf("  fan-control [options]   - drive fan groups from temperatures as set in a config\n");
+  printf("  fanN [speed_percentage] - get or set the speed of fan #N of the profile\n");
+  printf("  fans N=speed...         - set the speed of several fans at once\n");
   printf("  help                    - this help message\n");
-  printf("  log                     - display fan speed & temperature\n");
+  printf("  history [options] path  - query the history file recorded by the daemon\n");
+  printf("  log [options]           - display or stream every fan, temperature & power supply\n");
+  printf("  profile                 - show the model profile in use\n");
+  printf("  shm-read                - show the readings the daemon published to shared memory\n");
+  printf("  stats [--window 24h]    - show the statistics or the rollups of the running daemon\n");
   printf("  test [libuLinux_hal.so] - test functions against libuLinux_hal.so\n");
-  printf("  temp1                   - retrieve the temperature of sensor #1\n");
-  printf("  temp2                   - retrieve the temperature of sensor #2\n");
-  printf("  temp3                   - retrieve the temperature of sensor #3\n");
-  printf("  temp4                   - retrieve the temperature of sensor #4\n");
-  printf("  temp5                   - retrieve the temperature of sensor #5\n");
+  printf("  tempN                   - retrieve the temperature of sensor #N of the profile\n");
   printf("\n");
-}
\ No newline at end of file
+}
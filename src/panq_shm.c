@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2021 Stonyx
+ * http://www.stonyx.com
+ *
+ * Copyright (C) 2020 Guillaume Valadon
+ * guillaume@valadon.net
+ */
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include "panq_shm.h"
+
+// Function called to open an existing region for reading
+int8_t panq_shm_open(const char* name, struct panq_shm* shm)
+{
+  // Declare needed variables
+  struct stat st;
+  int fd;
+
+  // Open the region
+  fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+  if (fd < 0)
+  {
+    return -1;
+  }
+
+  // Make sure the region is big enough before mapping it
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(struct panq_shm_region))
+  {
+    close(fd);
+    return -1;
+  }
+
+  // Map the region, the mapping stays valid after closing the file descriptor
+  shm->region = mmap(NULL, sizeof(struct panq_shm_region), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (shm->region == MAP_FAILED)
+  {
+    return -1;
+  }
+
+  // Make sure the region has the layout we know about
+  if (shm->region->magic != PANQ_SHM_MAGIC || shm->region->version != PANQ_SHM_VERSION ||
+      shm->region->size != sizeof(struct panq_shm_region))
+  {
+    panq_shm_close(shm);
+    return -1;
+  }
+
+  return 0;
+}
+
+// Function called to read a consistent copy of the data without taking any lock, retrying while
+//   the writer is updating it
+int8_t panq_shm_read(const struct panq_shm* shm, struct panq_shm_data* data)
+{
+  for (int retries = PANQ_SHM_READ_RETRIES; retries > 0; retries--)
+  {
+    // Read the sequence before the data
+    u_int32_t sequence = __atomic_load_n(&shm->region->sequence, __ATOMIC_ACQUIRE);
+
+    // Check if the writer is updating the data
+    if (sequence & 1)
+    {
+      __builtin_ia32_pause();
+      continue;
+    }
+
+    // Copy the data and make sure the copy is done before reading the sequence again
+    memcpy(data, (const void*)&shm->region->data, sizeof(*data));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    // Check if the sequence didn't change while copying
+    if (__atomic_load_n(&shm->region->sequence, __ATOMIC_RELAXED) == sequence)
+    {
+      return 0;
+    }
+  }
+
+  return -1;
+}
+
+// Function called to close a region
+void panq_shm_close(struct panq_shm* shm)
+{
+  if (shm->region != NULL && shm->region != MAP_FAILED)
+  {
+    munmap(shm->region, sizeof(struct panq_shm_region));
+  }
+  shm->region = NULL;
+}
+
+// Function called to create a region that can be read by everyone and written by the caller
+int8_t panq_shm_create(const char* name, struct panq_shm* shm)
+{
+  // Declare needed variables
+  int fd;
+
+  // Create the region, replacing any region left behind by a previous writer
+  shm_unlink(name);
+  fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  if (fd < 0)
+  {
+    return -1;
+  }
+
+  // Make sure the umask didn't remove the read permissions and size the region
+  if (fchmod(fd, 0644) != 0 || ftruncate(fd, sizeof(struct panq_shm_region)) != 0)
+  {
+    close(fd);
+    shm_unlink(name);
+    return -1;
+  }
+
+  // Map the region
+  shm->region = mmap(NULL, sizeof(struct panq_shm_region), PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+    0);
+  close(fd);
+  if (shm->region == MAP_FAILED)
+  {
+    shm_unlink(name);
+    return -1;
+  }
+
+  // Fill in the header last so that readers never see a valid header with a partial layout
+  shm->region->version = PANQ_SHM_VERSION;
+  shm->region->size = sizeof(struct panq_shm_region);
+  __atomic_store_n(&shm->region->magic, PANQ_SHM_MAGIC, __ATOMIC_RELEASE);
+
+  return 0;
+}
+
+// Function called to publish new data, there must only be one writer
+void panq_shm_publish(struct panq_shm* shm, const struct panq_shm_data* data)
+{
+  // Declare needed variables
+  u_int32_t sequence = __atomic_load_n(&shm->region->sequence, __ATOMIC_RELAXED);
+
+  // Make the sequence odd and make sure readers see that before any of the new data
+  __atomic_store_n(&shm->region->sequence, sequence + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  // Copy the data
+  memcpy(&shm->region->data, data, sizeof(*data));
+
+  // Make the sequence even again once all the new data is visible
+  __atomic_store_n(&shm->region->sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+// Function called to close and remove a region that was created by the caller
+void panq_shm_destroy(const char* name, struct panq_shm* shm)
+{
+  panq_shm_close(shm);
+  shm_unlink(name);
+}
@@ -0,0 +1,292 @@
+/*
+ * Copyright (C) 2021 Stonyx
+ * http://www.stonyx.com
+ *
+ * Copyright (C) 2020 Guillaume Valadon
+ * guillaume@valadon.net
+ */
+
+#define _GNU_SOURCE
+
+#include <math.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/types.h>
+#include "realtime.h"
+
+// Declare the mode that was asked for and the parts of it that took effect
+static struct realtime_config realtime_config = {
+  .cpu = -1,
+  .bound = REALTIME_DEFAULT_BOUND
+};
+static u_int8_t realtime_memory_locked = 0;
+static u_int8_t realtime_scheduled = 0;
+static u_int8_t realtime_pinned = 0;
+
+// Declare the wakeup latencies seen since the start
+static struct realtime_stats realtime_stats;
+
+// Declare functions
+static void realtime_prefault_stack(void);
+
+// Function called to parse a real-time mode from a comma separated list like fifo=20,cpu=1,
+//   bound=500 where fifo selects the FIFO real-time scheduling class at an optional priority, cpu
+//   pins the process to a CPU, and bound is the wakeup latency in microseconds the mode is
+//   expected to keep, on turns the mode on without any of them and off turns it off
+int8_t realtime_parse(const char* string, struct realtime_config* config)
+{
+  // Declare needed variables
+  char copy[64];
+  char* saveptr;
+  char* end;
+
+  // Start with the mode turned off
+  memset(config, 0, sizeof(*config));
+  config->cpu = -1;
+  config->bound = REALTIME_DEFAULT_BOUND;
+
+  // Copy the string since strtok_r() modifies it
+  if (strlen(string) >= sizeof(copy))
+  {
+    return -1;
+  }
+  strcpy(copy, string);
+
+  // Loop through the items
+  for (char* item = strtok_r(copy, ",", &saveptr); item != NULL;
+    item = strtok_r(NULL, ",", &saveptr))
+  {
+    // Split the item into its name and its value
+    char* value = strchr(item, '=');
+    unsigned long number = 0;
+    if (value != NULL)
+    {
+      *value++ = '\0';
+      number = strtoul(value, &end, 10);
+      if (*value == '\0' || *end != '\0')
+      {
+        return -1;
+      }
+    }
+
+    // Check which item it is
+    if (strcmp(item, "off") == 0 && value == NULL)
+    {
+      config->enabled = 0;
+      config->priority = 0;
+      config->cpu = -1;
+      continue;
+    }
+    config->enabled = 1;
+    if (strcmp(item, "on") == 0 && value == NULL)
+    {
+      continue;
+    }
+    if (strcmp(item, "fifo") == 0)
+    {
+      if (value == NULL)
+      {
+        number = REALTIME_DEFAULT_PRIORITY;
+      }
+      if (number < sched_get_priority_min(SCHED_FIFO) ||
+        number > sched_get_priority_max(SCHED_FIFO))
+      {
+        return -1;
+      }
+      config->priority = number;
+    }
+    else if (strcmp(item, "cpu") == 0 && value != NULL && number < CPU_SETSIZE)
+    {
+      config->cpu = number;
+    }
+    else if (strcmp(item, "bound") == 0 && value != NULL && number > 0 &&
+      number <= REALTIME_MAX_BOUND)
+    {
+      config->bound = number;
+    }
+    else
+    {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+// Function called to enter the real-time mode before a resident loop starts, memory is locked so
+//   that a sample never waits on a page fault, the stack is faulted in up front, the timer slack
+//   is cut to the minimum so that absolute sleeps end on time, and the scheduling class and CPU
+//   are changed if asked for, a part that can't be set up is reported and left out
+void realtime_enter(const struct realtime_config* config)
+{
+  // Declare needed variables
+  struct sched_param param;
+  cpu_set_t cpus;
+
+  // Remember the mode so that it can be reported with the latencies
+  realtime_config = *config;
+  if (!config->enabled)
+  {
+    return;
+  }
+
+  // Lock every page we have and will have in memory
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+  {
+    fprintf(stderr, "realtime_enter: mlockall() failed!\n");
+  }
+  else
+  {
+    realtime_memory_locked = 1;
+  }
+
+  // Fault the stack in and cut the timer slack
+  realtime_prefault_stack();
+  if (prctl(PR_SET_TIMERSLACK, 1UL, 0UL, 0UL, 0UL) != 0)
+  {
+    fprintf(stderr, "realtime_enter: prctl() failed!\n");
+  }
+
+  // Switch to the real-time scheduling class
+  if (config->priority != 0)
+  {
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = config->priority;
+    if (sched_setscheduler(0, SCHED_FIFO | SCHED_RESET_ON_FORK, &param) != 0)
+    {
+      fprintf(stderr, "realtime_enter: sched_setscheduler() failed!\n");
+    }
+    else
+    {
+      realtime_scheduled = 1;
+    }
+  }
+
+  // Pin the process to a CPU
+  if (config->cpu >= 0)
+  {
+    CPU_ZERO(&cpus);
+    CPU_SET(config->cpu, &cpus);
+    if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0)
+    {
+      fprintf(stderr, "realtime_enter: sched_setaffinity() failed!\n");
+    }
+    else
+    {
+      realtime_pinned = 1;
+    }
+  }
+}
+
+// Function called to check if the real-time mode was asked for
+u_int8_t realtime_is_enabled(void)
+{
+  return realtime_config.enabled;
+}
+
+// Function called to record how late a resident loop woke up for a deadline, both times are
+//   monotonic nanoseconds
+void realtime_record_wakeup(int64_t deadline, int64_t now)
+{
+  // Declare needed variables
+  u_int64_t latency = now > deadline ? now - deadline : 0;
+  u_int8_t bucket = 0;
+
+  // Add the latency to the totals
+  realtime_stats.wakeups++;
+  realtime_stats.latency_nanoseconds += latency;
+  realtime_stats.latency_squares += (double)latency * latency;
+  if (latency > realtime_stats.max_latency_nanoseconds)
+  {
+    realtime_stats.max_latency_nanoseconds = latency;
+  }
+  if (latency > (u_int64_t)realtime_config.bound * 1000)
+  {
+    realtime_stats.late_wakeups++;
+  }
+
+  // Add it to the bucket of its power of two
+  while (bucket < REALTIME_BUCKET_COUNT - 1 && latency >= (1ULL << bucket))
+  {
+    bucket++;
+  }
+  realtime_stats.buckets[bucket]++;
+}
+
+// Function called to get the wakeup latencies seen since the start
+void realtime_get_stats(struct realtime_stats* stats)
+{
+  *stats = realtime_stats;
+}
+
+// Function called to print the real-time mode and the wakeup latencies seen since the start, the
+//   percentile is interpolated within the power of two bucket it falls in and kept below the
+//   worst latency, and the latencies are within the bound if the worst one is
+void realtime_print_stats(FILE* stream)
+{
+  // Declare needed variables
+  double mean = 0;
+  double deviation = 0;
+  u_int64_t p99 = 0;
+  u_int64_t seen = 0;
+
+  // Calculate the mean, the standard deviation, and the 99th percentile of the latency
+  if (realtime_stats.wakeups > 0)
+  {
+    mean = (double)realtime_stats.latency_nanoseconds / realtime_stats.wakeups;
+    deviation = sqrt(fmax(realtime_stats.latency_squares / realtime_stats.wakeups - mean * mean,
+      0));
+    for (u_int8_t i = 0; i < REALTIME_BUCKET_COUNT; i++)
+    {
+      // Check if the percentile falls in this bucket, which holds the latencies from half its
+      //   upper limit up to it
+      if ((seen + realtime_stats.buckets[i]) * 100 >= realtime_stats.wakeups * 99)
+      {
+        u_int64_t lower = i > 0 ? 1ULL << (i - 1) : 0;
+        p99 = lower + (u_int64_t)(((1ULL << i) - lower) *
+          (realtime_stats.wakeups * 0.99 - seen) / realtime_stats.buckets[i]);
+        break;
+      }
+      seen += realtime_stats.buckets[i];
+    }
+    if (p99 > realtime_stats.max_latency_nanoseconds)
+    {
+      p99 = realtime_stats.max_latency_nanoseconds;
+    }
+  }
+
+  fprintf(stream, "realtime_mode %s\n", realtime_config.enabled ? "on" : "off");
+  fprintf(stream, "realtime_memory_locked %u\n", realtime_memory_locked);
+  fprintf(stream, "realtime_policy %s\n", realtime_scheduled ? "fifo" : "other");
+  fprintf(stream, "realtime_priority %u\n", realtime_scheduled ? realtime_config.priority : 0);
+  fprintf(stream, "realtime_cpu %d\n", realtime_pinned ? realtime_config.cpu : -1);
+  fprintf(stream, "wakeup_bound_us %u\n", realtime_config.bound);
+  fprintf(stream, "wakeups %llu\n", (unsigned long long)realtime_stats.wakeups);
+  fprintf(stream, "wakeups_late %llu\n", (unsigned long long)realtime_stats.late_wakeups);
+  fprintf(stream, "wakeup_latency_mean_ns %.0f\n", mean);
+  fprintf(stream, "wakeup_latency_stddev_ns %.0f\n", deviation);
+  fprintf(stream, "wakeup_latency_p99_ns %llu\n", (unsigned long long)p99);
+  fprintf(stream, "wakeup_latency_max_ns %llu\n",
+    (unsigned long long)realtime_stats.max_latency_nanoseconds);
+  fprintf(stream, "wakeup_within_bound %s\n",
+    realtime_stats.max_latency_nanoseconds <= (u_int64_t)realtime_config.bound * 1000 ? "yes" :
+    "no");
+}
+
+// Function called to touch the stack a resident loop will use so that its pages are faulted in,
+//   and locked if memory is locked, before the first sample
+static void __attribute__((noinline)) realtime_prefault_stack(void)
+{
+  // Declare needed variables
+  volatile u_int8_t stack[REALTIME_STACK_SIZE];
+
+  // Touch every page
+  for (size_t i = 0; i < sizeof(stack); i += 4096)
+  {
+    stack[i] = 0;
+  }
+}
@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2021 Stonyx
+ * http://www.stonyx.com
+ *
+ * Copyright (C) 2020 Guillaume Valadon
+ * guillaume@valadon.net
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+#include "it8528.h"
+#include "rollup.h"
+
+// Define the structure holding a ring, bucket i holds the samples taken from starts[i] for
+//   resolution milliseconds and a bucket is cleared when a sample of a newer period lands in it
+struct rollup_ring
+{
+  u_int32_t resolution;
+  u_int32_t size;
+  int64_t* starts;
+  struct rollup_bucket (*buckets)[ROLLUP_SERIES];
+};
+
+// Declare the buckets of every ring, they are allocated once so that the memory used doesn't
+//   depend on the uptime
+static int64_t rollup_second_starts[ROLLUP_SECOND_BUCKETS];
+static int64_t rollup_minute_starts[ROLLUP_MINUTE_BUCKETS];
+static int64_t rollup_hour_starts[ROLLUP_HOUR_BUCKETS];
+static struct rollup_bucket rollup_second_buckets[ROLLUP_SECOND_BUCKETS][ROLLUP_SERIES];
+static struct rollup_bucket rollup_minute_buckets[ROLLUP_MINUTE_BUCKETS][ROLLUP_SERIES];
+static struct rollup_bucket rollup_hour_buckets[ROLLUP_HOUR_BUCKETS][ROLLUP_SERIES];
+
+// Define the rings
+static const struct rollup_ring rollup_rings[ROLLUP_RINGS] = {
+  [ROLLUP_RING_SECONDS] = { 1000, ROLLUP_SECOND_BUCKETS, rollup_second_starts,
+    rollup_second_buckets },
+  [ROLLUP_RING_MINUTES] = { 60000, ROLLUP_MINUTE_BUCKETS, rollup_minute_starts,
+    rollup_minute_buckets },
+  [ROLLUP_RING_HOURS] = { 3600000, ROLLUP_HOUR_BUCKETS, rollup_hour_starts,
+    rollup_hour_buckets }
+};
+
+// Function called to empty every ring
+void rollup_reset(void)
+{
+  for (u_int8_t i = 0; i < ROLLUP_RINGS; i++)
+  {
+    const struct rollup_ring* ring = &rollup_rings[i];
+    for (u_int32_t j = 0; j < ring->size; j++)
+    {
+      ring->starts[j] = INT64_MIN;
+    }
+    memset(ring->buckets, 0, ring->size * sizeof(ring->buckets[0]));
+  }
+}
+
+// Function called to add the valid temperatures and fan speeds of a snapshot taken at a
+//   monotonic time in milliseconds to the current bucket of every ring
+void rollup_add(const struct it8528_snapshot* snapshot, int64_t time)
+{
+  // Declare needed variables
+  int32_t values[ROLLUP_SERIES];
+  u_int8_t valid[ROLLUP_SERIES];
+
+  // Convert the temperatures to hundredths of a degree
+  for (u_int8_t i = 0; i < IT8528_SENSOR_COUNT; i++)
+  {
+    valid[i] = snapshot->temperature_valid[i];
+    values[i] = (int32_t)(snapshot->temperatures[i] * 100 +
+      (snapshot->temperatures[i] < 0 ? -0.5 : 0.5));
+  }
+  for (u_int8_t i = 0; i < IT8528_FAN_COUNT; i++)
+  {
+    valid[IT8528_SENSOR_COUNT + i] = snapshot->fan_valid[i];
+    values[IT8528_SENSOR_COUNT + i] = snapshot->fan_speeds[i];
+  }
+
+  // Loop through the rings
+  for (u_int8_t i = 0; i < ROLLUP_RINGS; i++)
+  {
+    // Find the bucket of the period the time falls in and clear it if it holds an older period
+    const struct rollup_ring* ring = &rollup_rings[i];
+    int64_t start = time - time % ring->resolution;
+    u_int32_t index = (start / ring->resolution) % ring->size;
+    if (ring->starts[index] != start)
+    {
+      memset(ring->buckets[index], 0, sizeof(ring->buckets[index]));
+      ring->starts[index] = start;
+    }
+
+    // Add the values to the bucket
+    for (u_int8_t j = 0; j < ROLLUP_SERIES; j++)
+    {
+      struct rollup_bucket* bucket = &ring->buckets[index][j];
+      if (!valid[j])
+      {
+        continue;
+      }
+      if (bucket->count == 0 || values[j] < bucket->min)
+      {
+        bucket->min = values[j];
+      }
+      if (bucket->count == 0 || values[j] > bucket->max)
+      {
+        bucket->max = values[j];
+      }
+      bucket->sum += values[j];
+      bucket->count++;
+    }
+  }
+}
+
+// Function called to merge the buckets of the last window milliseconds before now into one
+//   result per series, the finest ring spanning the window is used and the window is cut to the
+//   span of the coarsest ring, returns the resolution of the ring used
+u_int32_t rollup_query(int64_t window, int64_t now, struct rollup_bucket* results)
+{
+  // Declare needed variables
+  const struct rollup_ring* ring = &rollup_rings[ROLLUP_RINGS - 1];
+
+  // Find the finest ring spanning the window
+  for (u_int8_t i = 0; i < ROLLUP_RINGS; i++)
+  {
+    if ((int64_t)rollup_rings[i].resolution * rollup_rings[i].size >= window)
+    {
+      ring = &rollup_rings[i];
+      break;
+    }
+  }
+
+  // Merge every bucket overlapping the window
+  memset(results, 0, ROLLUP_SERIES * sizeof(results[0]));
+  for (u_int32_t i = 0; i < ring->size; i++)
+  {
+    if (ring->starts[i] == INT64_MIN || ring->starts[i] + ring->resolution <= now - window ||
+        ring->starts[i] > now)
+    {
+      continue;
+    }
+    for (u_int8_t j = 0; j < ROLLUP_SERIES; j++)
+    {
+      const struct rollup_bucket* bucket = &ring->buckets[i][j];
+      if (bucket->count == 0)
+      {
+        continue;
+      }
+      if (results[j].count == 0 || bucket->min < results[j].min)
+      {
+        results[j].min = bucket->min;
+      }
+      if (results[j].count == 0 || bucket->max > results[j].max)
+      {
+        results[j].max = bucket->max;
+      }
+      results[j].sum += bucket->sum;
+      results[j].count += bucket->count;
+    }
+  }
+
+  return ring->resolution;
+}
+
+// Function called to print the minimum, maximum, and average of every temperature and fan speed
+//   over the last window milliseconds before now
+void rollup_print(int64_t window, int64_t now, FILE* stream)
+{
+  // Declare needed variables
+  struct rollup_bucket results[ROLLUP_SERIES];
+
+  // Merge the buckets
+  u_int32_t resolution = rollup_query(window, now, results);
+  int64_t span = (int64_t)rollup_rings[ROLLUP_RINGS - 1].resolution *
+    rollup_rings[ROLLUP_RINGS - 1].size;
+
+  // Print the window and the results of the series that have samples
+  fprintf(stream, "window_seconds %lld\n", (long long)(window < span ? window : span) / 1000);
+  fprintf(stream, "resolution_seconds %u\n", resolution / 1000);
+  for (u_int8_t i = 0; i < IT8528_SENSOR_COUNT; i++)
+  {
+    if (results[i].count > 0)
+    {
+      fprintf(stream, "temperature %-8u min %8.2f  max %8.2f  avg %8.2f  samples %u\n",
+        it8528_sensor_ids[i], results[i].min / 100.0, results[i].max / 100.0,
+        (double)results[i].sum / results[i].count / 100, results[i].count);
+    }
+  }
+  for (u_int8_t i = 0; i < IT8528_FAN_COUNT; i++)
+  {
+    struct rollup_bucket* result = &results[IT8528_SENSOR_COUNT + i];
+    if (result->count > 0)
+    {
+      fprintf(stream, "fan_speed %-10u min %8d  max %8d  avg %8.1f  samples %u\n",
+        it8528_fan_ids[i], result->min, result->max, (double)result->sum / result->count,
+        result->count);
+    }
+  }
+}
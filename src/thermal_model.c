@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) 2021 Stonyx
+ * http://www.stonyx.com
+ *
+ * Copyright (C) 2020 Guillaume Valadon
+ * guillaume@valadon.net
+ */
+
+#include <math.h>
+#include <string.h>
+#include <sys/types.h>
+#include "thermal_model.h"
+
+// Declare functions
+static void thermal_model_update(struct thermal_model* model, const double* features,
+  double rate);
+static u_int8_t thermal_model_makes_sense(const double* parameters, double temperature);
+static void thermal_model_get_features(double temperature, double speed, double load,
+  double* features);
+
+// Function called to start a model that knows nothing yet, the forgetting factor between 0 and 1
+//   sets how fast old spans are forgotten, 0.99 gives them a lifetime of around 100 spans
+void thermal_model_init(struct thermal_model* model, double forgetting)
+{
+  memset(model, 0, sizeof(*model));
+  model->forgetting = forgetting;
+  for (u_int8_t i = 0; i < THERMAL_MODEL_PARAMETERS; i++)
+  {
+    model->covariance[i][i] = THERMAL_MODEL_INITIAL_COVARIANCE;
+  }
+}
+
+// Function called to feed the model a temperature read dt seconds after the previous one while
+//   the speed and the load were the given ones, the features are averaged over the span using the
+//   mean of the two temperatures, and once the span is long enough the model is fitted to the
+//   change of the temperature over it, which the averaged features explain exactly
+void thermal_model_observe(struct thermal_model* model, double temperature, double speed,
+  double load, double dt)
+{
+  // Declare needed variables
+  double features[THERMAL_MODEL_PARAMETERS];
+
+  // Check if this is the first reading
+  if (!model->started || dt <= 0)
+  {
+    model->started = 1;
+    model->temperature = temperature;
+    model->span_temperature = temperature;
+    model->span_length = 0;
+    memset(model->span_features, 0, sizeof(model->span_features));
+    return;
+  }
+
+  // Add the reading to the span
+  thermal_model_get_features((model->temperature + temperature) / 2, speed, load, features);
+  for (u_int8_t i = 0; i < THERMAL_MODEL_PARAMETERS; i++)
+  {
+    model->span_features[i] += features[i] * dt;
+  }
+  model->span_length += dt;
+  model->temperature = temperature;
+
+  // Fit the model to the span once it is long enough and start the next one
+  if (model->span_length >= THERMAL_MODEL_SPAN)
+  {
+    for (u_int8_t i = 0; i < THERMAL_MODEL_PARAMETERS; i++)
+    {
+      features[i] = model->span_features[i] / model->span_length;
+    }
+    thermal_model_update(model, features,
+      (temperature - model->span_temperature) / model->span_length);
+    model->span_temperature = temperature;
+    model->span_length = 0;
+    memset(model->span_features, 0, sizeof(model->span_features));
+  }
+}
+
+// Function called to drop the span being gathered, the next reading starts a new one, this is
+//   used when readings were missed
+void thermal_model_restart(struct thermal_model* model)
+{
+  model->started = 0;
+}
+
+// Function called to fit the model to the mean features and the mean rate of a span by recursive
+//   least squares
+static void thermal_model_update(struct thermal_model* model, const double* features,
+  double rate)
+{
+  // Declare needed variables
+  double gain[THERMAL_MODEL_PARAMETERS];
+  double product[THERMAL_MODEL_PARAMETERS];
+  double forgetting = model->forgetting;
+  double denominator;
+  double error = rate;
+  double trace = 0;
+
+  // Work out the error of the prediction made without this span
+  for (u_int8_t i = 0; i < THERMAL_MODEL_PARAMETERS; i++)
+  {
+    error -= model->parameters[i] * features[i];
+  }
+  if (model->spans >= THERMAL_MODEL_WARMUP)
+  {
+    model->error_sum += error * error;
+    model->error_count++;
+  }
+
+  // Work out the gain from the covariance
+  denominator = forgetting;
+  for (u_int8_t i = 0; i < THERMAL_MODEL_PARAMETERS; i++)
+  {
+    product[i] = 0;
+    for (u_int8_t j = 0; j < THERMAL_MODEL_PARAMETERS; j++)
+    {
+      product[i] += model->covariance[i][j] * features[j];
+    }
+    denominator += features[i] * product[i];
+  }
+  for (u_int8_t i = 0; i < THERMAL_MODEL_PARAMETERS; i++)
+  {
+    gain[i] = product[i] / denominator;
+    trace += model->covariance[i][i];
+  }
+
+  // Don't forget anything while the covariance is already large, a steady temperature brings no
+  //   new information and forgetting would only make the covariance grow without end
+  if (trace > THERMAL_MODEL_MAX_TRACE)
+  {
+    forgetting = 1;
+  }
+
+  // Update the parameters and the covariance, which stays symmetric
+  for (u_int8_t i = 0; i < THERMAL_MODEL_PARAMETERS; i++)
+  {
+    model->parameters[i] += gain[i] * error;
+  }
+  for (u_int8_t i = 0; i < THERMAL_MODEL_PARAMETERS; i++)
+  {
+    for (u_int8_t j = i; j < THERMAL_MODEL_PARAMETERS; j++)
+    {
+      model->covariance[i][j] = (model->covariance[i][j] - gain[i] * product[j]) / forgetting;
+      model->covariance[j][i] = model->covariance[i][j];
+    }
+  }
+
+  model->spans++;
+
+  // Trust the parameters once enough spans were seen if they make sense, while the fans follow the
+  //   temperature closely the spans can't tell the effects of the temperature and of the speed
+  //   apart and the fitted parameters may wander off for a while, the ones trusted last are used
+  //   for the predictions in the meantime
+  if (model->spans >= THERMAL_MODEL_WARMUP &&
+    thermal_model_makes_sense(model->parameters, features[2]))
+  {
+    memcpy(model->trusted_parameters, model->parameters, sizeof(model->trusted_parameters));
+    model->trusted = 1;
+  }
+}
+
+// Function called to get the rate of change of the temperature in degrees per second the model
+//   expects at a temperature, speed, and load with the parameters trusted last
+double thermal_model_get_rate(const struct thermal_model* model, double temperature, double speed,
+  double load)
+{
+  // Declare needed variables
+  double features[THERMAL_MODEL_PARAMETERS];
+  double rate = 0;
+
+  thermal_model_get_features(temperature, speed, load, features);
+  for (u_int8_t i = 0; i < THERMAL_MODEL_PARAMETERS; i++)
+  {
+    rate += model->trusted_parameters[i] * features[i];
+  }
+
+  return rate;
+}
+
+// Function called to predict the temperature horizon seconds ahead if the speed and the load stay
+//   the same, the model is integrated in THERMAL_MODEL_PREDICTION_STEPS steps
+double thermal_model_predict(const struct thermal_model* model, double temperature, double speed,
+  double load, double horizon)
+{
+  // Declare needed variables
+  double step = horizon / THERMAL_MODEL_PREDICTION_STEPS;
+
+  for (u_int8_t i = 0; i < THERMAL_MODEL_PREDICTION_STEPS; i++)
+  {
+    temperature += step * thermal_model_get_rate(model, temperature, speed, load);
+  }
+
+  return temperature;
+}
+
+// Function called to check if the model has parameters it trusts that still make sense at a
+//   temperature, otherwise its predictions can't be used to pick a speed
+u_int8_t thermal_model_is_usable(const struct thermal_model* model, double temperature)
+{
+  return model->trusted && thermal_model_makes_sense(model->trusted_parameters, temperature);
+}
+
+// Function called to get the root mean square error in degrees per second of the rates the
+//   fitted parameters predicted for the spans after the warmup
+double thermal_model_get_error(const struct thermal_model* model)
+{
+  return model->error_count > 0 ? sqrt(model->error_sum / model->error_count) : 0;
+}
+
+// Function called to check if parameters make physical sense around a temperature, a faster fan
+//   must cool the sensor and the temperature must settle at any speed, which holds between 0 and 1
+//   if it holds at both ends
+static u_int8_t thermal_model_makes_sense(const double* parameters, double temperature)
+{
+  if (parameters[3] + parameters[4] * temperature >= 0 || parameters[2] >= 0 ||
+    parameters[2] + parameters[4] >= 0)
+  {
+    return 0;
+  }
+
+  return 1;
+}
+
+// Function called to build the features the rate is a linear combination of
+static void thermal_model_get_features(double temperature, double speed, double load,
+  double* features)
+{
+  features[0] = 1;
+  features[1] = load;
+  features[2] = temperature;
+  features[3] = speed;
+  features[4] = speed * temperature;
+}